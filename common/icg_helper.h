@@ -219,6 +219,48 @@ inline GLuint CompileShaders(const char* vshader,
 }
 
 
+// reads a shader file, a line #include "file.glsl" is replaced by the content of that file
+// so that shaders can share functions. All the shaders are copied in the same directory,
+// the included path is relative to it.
+inline bool ReadShaderFile(const char * file_path, string& code, int depth = 0) {
+    const int MAX_INCLUDE_DEPTH = 8;
+    const string INCLUDE = "#include \"";
+
+    ifstream shader_stream(file_path, ios::in);
+    if(!shader_stream.is_open()) {
+        printf("Could not open file: %s\n", file_path);
+        return false;
+    }
+
+    code.clear();
+    string line;
+    int line_number = 0;
+    while(getline(shader_stream, line)) {
+        line_number++;
+        size_t start = line.find_first_not_of(" \t");
+        if(start == string::npos || line.compare(start, INCLUDE.size(), INCLUDE) != 0) {
+            code += line + "\n";
+            continue;
+        }
+
+        size_t name_start = start + INCLUDE.size();
+        size_t name_end = line.find('"', name_start);
+        if(name_end == string::npos || depth >= MAX_INCLUDE_DEPTH) {
+            printf("Invalid include at %s:%d\n", file_path, line_number);
+            return false;
+        }
+        string included_code;
+        if(!ReadShaderFile(line.substr(name_start, name_end - name_start).c_str(),
+                           included_code, depth + 1)) {
+            return false;
+        }
+        // keep the line numbers of the compile errors those of this file
+        code += included_code + "#line " + to_string(line_number + 1) + "\n";
+    }
+    shader_stream.close();
+    return true;
+}
+
 // compiles the vertex, geometry and fragment shaders using file path
 // TODO: add support for tessellation shaders
 inline GLuint LoadShaders(const char * vertex_file_path,
@@ -229,67 +271,12 @@ inline GLuint LoadShaders(const char * vertex_file_path,
     const int SHADER_LOAD_FAILED = 0;
 
     string vertex_shader_code, fragment_shader_code, tesselation_control_shader_code, tesselation_evaluation_shader_code, geometry_shader_code;
-    {
-        // read the Vertex Shader code from the file
-        ifstream vertex_shader_stream(vertex_file_path, ios::in);
-        if(vertex_shader_stream.is_open()) {
-            vertex_shader_code = string(istreambuf_iterator<char>(vertex_shader_stream),
-                                        istreambuf_iterator<char>());
-            vertex_shader_stream.close();
-        } else {
-            printf("Could not open file: %s\n", vertex_file_path);
-            return SHADER_LOAD_FAILED;
-        }
-
-        // read the Fragment Shader code from the file
-        ifstream fragment_shader_stream(fragment_file_path, ios::in);
-        if(fragment_shader_stream.is_open()) {
-            fragment_shader_code = string(istreambuf_iterator<char>(fragment_shader_stream),
-                                          istreambuf_iterator<char>());
-            fragment_shader_stream.close();
-        } else {
-            printf("Could not open file: %s\n", fragment_file_path);
-            return SHADER_LOAD_FAILED;
-        }
-
-        // read the Tesselation Control Shader code from the file
-        if(tesselation_control_file_path != NULL) {
-            ifstream tesselation_control_shader_stream(tesselation_control_file_path, ios::in);
-            if(tesselation_control_shader_stream.is_open()) {
-                tesselation_control_shader_code = string(istreambuf_iterator<char>(tesselation_control_shader_stream),
-                                              istreambuf_iterator<char>());
-                tesselation_control_shader_stream.close();
-            } else {
-                printf("Could not open file: %s\n", tesselation_control_file_path);
-                return SHADER_LOAD_FAILED;
-            }
-        }
-
-        // read the Tesselation Evaluation Shader code from the file
-        if(tesselation_evaluation_file_path != NULL) {
-            ifstream tesselation_evaluation_shader_stream(tesselation_evaluation_file_path, ios::in);
-            if(tesselation_evaluation_shader_stream.is_open()) {
-                tesselation_evaluation_shader_code = string(istreambuf_iterator<char>(tesselation_evaluation_shader_stream),
-                                              istreambuf_iterator<char>());
-                tesselation_evaluation_shader_stream.close();
-            } else {
-                printf("Could not open file: %s\n", tesselation_evaluation_file_path);
-                return SHADER_LOAD_FAILED;
-            }
-        }
-
-        // read the Geometry Shader code from the file
-        if(geometry_file_path != NULL) {
-            ifstream geometry_shader_stream(geometry_file_path, ios::in);
-            if(geometry_shader_stream.is_open()) {
-                geometry_shader_code = string(istreambuf_iterator<char>(geometry_shader_stream),
-                                              istreambuf_iterator<char>());
-                geometry_shader_stream.close();
-            } else {
-                printf("Could not open file: %s\n", geometry_file_path);
-                return SHADER_LOAD_FAILED;
-            }
-        }
+    if(!ReadShaderFile(vertex_file_path, vertex_shader_code) ||
+       !ReadShaderFile(fragment_file_path, fragment_shader_code) ||
+       (tesselation_control_file_path != NULL && !ReadShaderFile(tesselation_control_file_path, tesselation_control_shader_code)) ||
+       (tesselation_evaluation_file_path != NULL && !ReadShaderFile(tesselation_evaluation_file_path, tesselation_evaluation_shader_code)) ||
+       (geometry_file_path != NULL && !ReadShaderFile(geometry_file_path, geometry_shader_code))) {
+        return SHADER_LOAD_FAILED;
     }
 
     // compile them
@@ -312,4 +299,67 @@ inline GLuint LoadShaders(const char * vertex_file_path,
                vertex_file_path, fragment_file_path, geometry_file_path);
     return status;
 }
+
+// compiles the compute shader stored in the given file, the caller checks
+// GLEW_ARB_compute_shader first since the context is only 4.1
+inline GLuint LoadComputeShader(const char * compute_file_path) {
+    const int SHADER_LOAD_FAILED = 0;
+    GLint success = GL_FALSE;
+    int info_log_length;
+
+    string compute_shader_code;
+    if(!ReadShaderFile(compute_file_path, compute_shader_code)) {
+        return SHADER_LOAD_FAILED;
+    }
+
+    // create the Compute Shader
+    GLuint compute_shader_id = glCreateShader(GL_COMPUTE_SHADER);
+
+    // compile Compute Shader
+    fprintf(stdout, "Compiling Compute shader: ");
+    char const * compute_source_pointer = compute_shader_code.c_str();
+    glShaderSource(compute_shader_id, 1, &compute_source_pointer , NULL);
+    glCompileShader(compute_shader_id);
+
+    // check Compute Shader
+    glGetShaderiv(compute_shader_id, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(compute_shader_id, GL_INFO_LOG_LENGTH, &info_log_length);
+    if(!success) {
+        vector<char> compute_shader_error_message(info_log_length);
+        glGetShaderInfoLog(compute_shader_id, info_log_length, NULL,
+                           &compute_shader_error_message[0]);
+        fprintf(stdout, "Failed:\n%s\n", &compute_shader_error_message[0]);
+        glDeleteShader(compute_shader_id);
+        return SHADER_LOAD_FAILED;
+    }
+    else
+        fprintf(stdout, "Success\n");
+
+    // Link the program
+    fprintf(stdout, "Linking shader program: ");
+    GLuint program_id = glCreateProgram();
+    glAttachShader(program_id, compute_shader_id);
+    glLinkProgram(program_id);
+
+    // Check the program
+    glGetProgramiv(program_id, GL_LINK_STATUS, &success);
+    glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &info_log_length);
+    vector<char> program_error_message(max(info_log_length, int(1)));
+    glGetProgramInfoLog(program_id, info_log_length, NULL, &program_error_message[0]);
+    glDeleteShader(compute_shader_id);
+    if(!success) {
+        fprintf(stdout, "Failed:\n%s\n", &program_error_message[0]);
+        printf("Failed linking:\n  cshader: %s\n", compute_file_path);
+        glDeleteProgram(program_id);
+        return SHADER_LOAD_FAILED;
+    }
+    else {
+        fprintf(stdout, "Success\n");
+    }
+
+    // make sure you see the text in terminal
+    fflush(stdout);
+
+    return program_id;
+}
 }
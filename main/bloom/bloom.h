@@ -0,0 +1,251 @@
+#pragma once
+#include <algorithm>
+#include "icg_helper.h"
+#include "../framebuffer.h"
+#include "../screenquad/fullscreenquad.h"
+
+/**
+ * @brief The Bloom class extracts the bloom from the HDR scene after the geometry passes:
+ * a bright pass into the first level of a mip chain at half the resolution, a progressive 13-tap downsample
+ * to the coarsest level, then a tent-filtered upsample that adds every level back into the first one.
+ * Each pass reads a texture a quarter of the size of the previous one, so the radius grows with the chain
+ * for about the cost of one pass over the half resolution level.
+ * The passes run as compute shaders when the driver exposes them, as full-screen quads otherwise.
+ */
+class Bloom {
+
+    public:
+        /** levels of the chain, the coarsest one is 1/64 of the scene resolution */
+        static constexpr int MAX_LEVELS = 6;
+
+    private:
+        FullScreenQuad quad;
+        GLuint downsampleProgram_id_, upsampleProgram_id_;
+        GLuint downsampleTexelSize_id, brightPass_id, upsampleTexelSize_id;
+
+        // compute versions, 0 when the driver does not support them
+        GLuint downsampleCompute_id_ = 0, upsampleCompute_id_ = 0;
+        GLuint computeDownsampleTexelSize_id, computeDownsampleLevel_id, computeBrightPass_id, computeDownsampleSize_id;
+        GLuint computeUpsampleTexelSize_id, computeUpsampleLevel_id, computeWeight_id, computeUpsampleSize_id;
+        bool useCompute = false;
+
+        ColorMipFBO chain;
+        GLuint chainTexture_id_;
+        int sceneWidth, sceneHeight;
+
+        static constexpr int LOCAL_SIZE = 8;
+        static constexpr GLint CHAIN_FORMAT = GL_R11F_G11F_B10F;
+
+        int levels() const {
+            return chain.getLevels() < MAX_LEVELS ? chain.getLevels() : MAX_LEVELS;
+        }
+
+        void setTexelSize(GLuint texelSize_id, int level) {
+            glUniform2f(texelSize_id, 1.0f / chain.getLevelWidth(level), 1.0f / chain.getLevelHeight(level));
+        }
+
+        // imageSize needs GLSL 4.30, the size of the stored level is passed instead
+        void dispatch(GLuint destinationSize_id, int level) {
+            glUniform2i(destinationSize_id, chain.getLevelWidth(level), chain.getLevelHeight(level));
+            glDispatchCompute((chain.getLevelWidth(level) + LOCAL_SIZE - 1) / LOCAL_SIZE,
+                              (chain.getLevelHeight(level) + LOCAL_SIZE - 1) / LOCAL_SIZE, 1);
+            // the next pass samples or reloads what this one stored
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+
+        void drawQuads(GLuint hdrTexture) {
+            int n = levels();
+            glDisable(GL_BLEND);
+            glActiveTexture(GL_TEXTURE0);
+
+            // bright pass, from the scene into the first level
+            glUseProgram(downsampleProgram_id_);
+            quad.Bind(downsampleProgram_id_);
+            chain.BindLevel(0);
+            glUniform1i(brightPass_id, true);
+            glUniform2f(downsampleTexelSize_id, 1.0f / sceneWidth, 1.0f / sceneHeight);
+            glBindTexture(GL_TEXTURE_2D, hdrTexture);
+            quad.Draw();
+
+            // each level from the previous one only
+            glUniform1i(brightPass_id, false);
+            glBindTexture(GL_TEXTURE_2D, chainTexture_id_);
+            for (int level = 1; level < n; ++level) {
+                chain.RestrictToLevel(level - 1);
+                chain.BindLevel(level);
+                setTexelSize(downsampleTexelSize_id, level - 1);
+                quad.Draw();
+            }
+
+            // back up, each level is added to the one below
+            glUseProgram(upsampleProgram_id_);
+            quad.Bind(upsampleProgram_id_);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            for (int level = n - 2; level >= 0; --level) {
+                // the first level holds the average of the levels rather than their sum
+                if (level == 0) {
+                    glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / n);
+                    glBlendFunc(GL_CONSTANT_ALPHA, GL_CONSTANT_ALPHA);
+                }
+                chain.RestrictToLevel(level + 1);
+                chain.BindLevel(level);
+                setTexelSize(upsampleTexelSize_id, level + 1);
+                quad.Draw();
+            }
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+            glBindTexture(GL_TEXTURE_2D, 0);
+            chain.RestoreLevels();
+            glBindVertexArray(0);
+            glUseProgram(0);
+            chain.Unbind();
+        }
+
+        void dispatchCompute(GLuint hdrTexture) {
+            int n = levels();
+            glActiveTexture(GL_TEXTURE0);
+
+            // the sampled and the stored levels differ, the whole chain stays visible to the sampler
+            glUseProgram(downsampleCompute_id_);
+            glBindImageTexture(0, chainTexture_id_, 0, GL_FALSE, 0, GL_WRITE_ONLY, CHAIN_FORMAT);
+            glUniform1i(computeBrightPass_id, true);
+            glUniform1f(computeDownsampleLevel_id, 0.0f);
+            glUniform2f(computeDownsampleTexelSize_id, 1.0f / sceneWidth, 1.0f / sceneHeight);
+            glBindTexture(GL_TEXTURE_2D, hdrTexture);
+            dispatch(computeDownsampleSize_id, 0);
+
+            glUniform1i(computeBrightPass_id, false);
+            glBindTexture(GL_TEXTURE_2D, chainTexture_id_);
+            for (int level = 1; level < n; ++level) {
+                glBindImageTexture(0, chainTexture_id_, level, GL_FALSE, 0, GL_WRITE_ONLY, CHAIN_FORMAT);
+                glUniform1f(computeDownsampleLevel_id, float(level - 1));
+                setTexelSize(computeDownsampleTexelSize_id, level - 1);
+                dispatch(computeDownsampleSize_id, level);
+            }
+
+            glUseProgram(upsampleCompute_id_);
+            for (int level = n - 2; level >= 0; --level) {
+                glBindImageTexture(0, chainTexture_id_, level, GL_FALSE, 0, GL_READ_WRITE, CHAIN_FORMAT);
+                glUniform1f(computeUpsampleLevel_id, float(level + 1));
+                glUniform1f(computeWeight_id, level == 0 ? 1.0f / n : 1.0f);
+                setTexelSize(computeUpsampleTexelSize_id, level + 1);
+                dispatch(computeUpsampleSize_id, level);
+            }
+
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glUseProgram(0);
+        }
+
+    public:
+        /** width, height: resolution of the HDR scene, the chain starts at half of it */
+        void Init(int width, int height) {
+            sceneWidth = width;
+            sceneHeight = height;
+            chainTexture_id_ = chain.Init(std::max(1, width / 2), std::max(1, height / 2),
+                                          CHAIN_FORMAT, GL_RGB, GL_FLOAT, true);
+
+            // compile the shaders
+            downsampleProgram_id_ = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                            "bloom_downsample_fshader.glsl");
+            upsampleProgram_id_ = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                          "bloom_upsample_fshader.glsl");
+            if(!downsampleProgram_id_ || !upsampleProgram_id_) {
+                exit(EXIT_FAILURE);
+            }
+
+            quad.registerProgram(downsampleProgram_id_);
+            quad.registerProgram(upsampleProgram_id_);
+
+            glUseProgram(downsampleProgram_id_);
+            glUniform1i(glGetUniformLocation(downsampleProgram_id_, "tex"), 0 /*GL_TEXTURE0*/);
+            downsampleTexelSize_id = glGetUniformLocation(downsampleProgram_id_, "texelSize");
+            brightPass_id = glGetUniformLocation(downsampleProgram_id_, "brightPass");
+
+            glUseProgram(upsampleProgram_id_);
+            glUniform1i(glGetUniformLocation(upsampleProgram_id_, "tex"), 0 /*GL_TEXTURE0*/);
+            upsampleTexelSize_id = glGetUniformLocation(upsampleProgram_id_, "texelSize");
+
+            // the context is 4.1, compute shaders are an extension there
+            if (GLEW_ARB_compute_shader && GLEW_ARB_shader_image_load_store) {
+                downsampleCompute_id_ = icg_helper::LoadComputeShader("bloom_downsample_cshader.glsl");
+                upsampleCompute_id_ = icg_helper::LoadComputeShader("bloom_upsample_cshader.glsl");
+            }
+            if (downsampleCompute_id_ && upsampleCompute_id_) {
+                glUseProgram(downsampleCompute_id_);
+                glUniform1i(glGetUniformLocation(downsampleCompute_id_, "tex"), 0 /*GL_TEXTURE0*/);
+                glUniform1i(glGetUniformLocation(downsampleCompute_id_, "destination"), 0 /*image unit*/);
+                computeDownsampleTexelSize_id = glGetUniformLocation(downsampleCompute_id_, "texelSize");
+                computeDownsampleLevel_id = glGetUniformLocation(downsampleCompute_id_, "sourceLevel");
+                computeBrightPass_id = glGetUniformLocation(downsampleCompute_id_, "brightPass");
+                computeDownsampleSize_id = glGetUniformLocation(downsampleCompute_id_, "destinationSize");
+
+                glUseProgram(upsampleCompute_id_);
+                glUniform1i(glGetUniformLocation(upsampleCompute_id_, "tex"), 0 /*GL_TEXTURE0*/);
+                glUniform1i(glGetUniformLocation(upsampleCompute_id_, "destination"), 0 /*image unit*/);
+                computeUpsampleTexelSize_id = glGetUniformLocation(upsampleCompute_id_, "texelSize");
+                computeUpsampleLevel_id = glGetUniformLocation(upsampleCompute_id_, "sourceLevel");
+                computeWeight_id = glGetUniformLocation(upsampleCompute_id_, "weight");
+                computeUpsampleSize_id = glGetUniformLocation(upsampleCompute_id_, "destinationSize");
+            } else {
+                glDeleteProgram(downsampleCompute_id_);
+                glDeleteProgram(upsampleCompute_id_);
+                downsampleCompute_id_ = upsampleCompute_id_ = 0;
+            }
+
+            // to avoid the current object being polluted
+            glUseProgram(0);
+        }
+
+        void Resize(int width, int height) {
+            sceneWidth = width;
+            sceneHeight = height;
+            chain.Resize(std::max(1, width / 2), std::max(1, height / 2));
+        }
+
+        /** the bloom of the given HDR scene, into the texture returned by getTexture. Leaves the default framebuffer bound */
+        void Compute(GLuint hdrTexture) {
+            if (useCompute) {
+                dispatchCompute(hdrTexture);
+            } else {
+                drawQuads(hdrTexture);
+            }
+        }
+
+        /** the first level of the chain, to be added to the scene before the tone mapping */
+        GLuint getTexture() const {
+            return chainTexture_id_;
+        }
+
+        bool isComputeSupported() const {
+            return downsampleCompute_id_ != 0;
+        }
+
+        /** switches between the compute and the full-screen quad passes, when both are available */
+        void toggleCompute() {
+            useCompute = !useCompute && isComputeSupported();
+        }
+
+        bool isUsingCompute() const {
+            return useCompute;
+        }
+
+        /** bytes of video memory held by the chain */
+        size_t memoryUsage() const {
+            size_t bytes = 0;
+            for (int level = 0; level < chain.getLevels(); ++level) {
+                bytes += size_t(chain.getLevelWidth(level)) * chain.getLevelHeight(level) * 4;
+            }
+            return bytes;
+        }
+
+        void Cleanup() {
+            glUseProgram(0);
+            quad.Cleanup();
+            glDeleteProgram(downsampleProgram_id_);
+            glDeleteProgram(upsampleProgram_id_);
+            glDeleteProgram(downsampleCompute_id_);
+            glDeleteProgram(upsampleCompute_id_);
+            chain.Cleanup();
+        }
+};
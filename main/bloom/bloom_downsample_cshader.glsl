@@ -0,0 +1,58 @@
+#version 410 core
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_image_load_store : require
+// compute version of bloom_downsample_fshader: one invocation per texel of the written level,
+// the level above is sampled with its mip level instead of being the only one the sampler sees
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D tex;
+uniform float sourceLevel;
+// size of a texel of the sampled level
+uniform vec2 texelSize;
+uniform bool brightPass;
+layout (r11f_g11f_b10f) uniform writeonly image2D destination;
+// size of the stored level, imageSize is GLSL 4.30
+uniform ivec2 destinationSize;
+
+const float BRIGHT_START = 1.5f;
+const float BRIGHT_END = 6.0f;
+
+vec2 uv;
+
+vec3 tap(in vec2 offset) {
+    return textureLod(tex, uv + offset * texelSize, sourceLevel).rgb;
+}
+
+vec3 karisAverage(in vec3 a, in vec3 b, in vec3 c, in vec3 d) {
+    vec4 w = 1.0f / (1.0f + vec4(dot(a, vec3(1.0f)), dot(b, vec3(1.0f)), dot(c, vec3(1.0f)), dot(d, vec3(1.0f))));
+    return (a * w.x + b * w.y + c * w.z + d * w.w) / (w.x + w.y + w.z + w.w);
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= destinationSize.x || texel.y >= destinationSize.y) {
+        return;
+    }
+    uv = (vec2(texel) + 0.5f) / vec2(destinationSize);
+
+    vec3 a = tap(vec2(-2.0f,  2.0f)), b = tap(vec2(0.0f,  2.0f)), c = tap(vec2(2.0f,  2.0f));
+    vec3 d = tap(vec2(-2.0f,  0.0f)), e = tap(vec2(0.0f,  0.0f)), f = tap(vec2(2.0f,  0.0f));
+    vec3 g = tap(vec2(-2.0f, -2.0f)), h = tap(vec2(0.0f, -2.0f)), i = tap(vec2(2.0f, -2.0f));
+    vec3 j = tap(vec2(-1.0f,  1.0f)), k = tap(vec2(1.0f,  1.0f));
+    vec3 l = tap(vec2(-1.0f, -1.0f)), m = tap(vec2(1.0f, -1.0f));
+
+    vec3 result;
+    if (brightPass) {
+        result = 0.5f * karisAverage(j, k, l, m)
+                + 0.125f * (karisAverage(a, b, d, e) + karisAverage(b, c, e, f)
+                            + karisAverage(d, e, g, h) + karisAverage(e, f, h, i));
+        result *= smoothstep(BRIGHT_START, BRIGHT_END, dot(result, vec3(1.0f)));
+    } else {
+        result = 0.125f * e
+                + 0.03125f * (a + c + g + i)
+                + 0.0625f * (b + d + f + h)
+                + 0.125f * (j + k + l + m);
+    }
+    imageStore(destination, texel, vec4(result, 1.0f));
+}
@@ -0,0 +1,48 @@
+#version 410 core
+// one step of the bloom downsample chain: a 13-tap filter of the level above, 4 overlapping 2x2 boxes
+// around a central one, which keeps the flickering of small highlights down.
+// The first step reads the full resolution HDR scene and keeps its bright part only
+in vec2 uv;
+
+uniform sampler2D tex;
+// size of a texel of tex
+uniform vec2 texelSize;
+uniform bool brightPass;
+
+out vec4 color;
+
+// same threshold the geometry passes used for their bright color, on the sum of the channels
+const float BRIGHT_START = 1.5f;
+const float BRIGHT_END = 6.0f;
+
+vec3 tap(in vec2 offset) {
+    return texture(tex, uv + offset * texelSize).rgb;
+}
+
+// boxes weighted by the inverse of their brightness so that a single very bright texel cannot flash
+vec3 karisAverage(in vec3 a, in vec3 b, in vec3 c, in vec3 d) {
+    vec4 w = 1.0f / (1.0f + vec4(dot(a, vec3(1.0f)), dot(b, vec3(1.0f)), dot(c, vec3(1.0f)), dot(d, vec3(1.0f))));
+    return (a * w.x + b * w.y + c * w.z + d * w.w) / (w.x + w.y + w.z + w.w);
+}
+
+void main() {
+    vec3 a = tap(vec2(-2.0f,  2.0f)), b = tap(vec2(0.0f,  2.0f)), c = tap(vec2(2.0f,  2.0f));
+    vec3 d = tap(vec2(-2.0f,  0.0f)), e = tap(vec2(0.0f,  0.0f)), f = tap(vec2(2.0f,  0.0f));
+    vec3 g = tap(vec2(-2.0f, -2.0f)), h = tap(vec2(0.0f, -2.0f)), i = tap(vec2(2.0f, -2.0f));
+    vec3 j = tap(vec2(-1.0f,  1.0f)), k = tap(vec2(1.0f,  1.0f));
+    vec3 l = tap(vec2(-1.0f, -1.0f)), m = tap(vec2(1.0f, -1.0f));
+
+    vec3 result;
+    if (brightPass) {
+        result = 0.5f * karisAverage(j, k, l, m)
+                + 0.125f * (karisAverage(a, b, d, e) + karisAverage(b, c, e, f)
+                            + karisAverage(d, e, g, h) + karisAverage(e, f, h, i));
+        result *= smoothstep(BRIGHT_START, BRIGHT_END, dot(result, vec3(1.0f)));
+    } else {
+        result = 0.125f * e
+                + 0.03125f * (a + c + g + i)
+                + 0.0625f * (b + d + f + h)
+                + 0.125f * (j + k + l + m);
+    }
+    color = vec4(result, 1.0f);
+}
@@ -0,0 +1,37 @@
+#version 410 core
+#extension GL_ARB_compute_shader : require
+#extension GL_ARB_shader_image_load_store : require
+// compute version of bloom_upsample_fshader: the level is read back and rewritten instead of blended
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+uniform sampler2D tex;
+uniform float sourceLevel;
+// size of a texel of the sampled level
+uniform vec2 texelSize;
+// scale of the sum, the blend constant of the fragment version
+uniform float weight;
+layout (r11f_g11f_b10f) uniform image2D destination;
+// size of the stored level, imageSize is GLSL 4.30
+uniform ivec2 destinationSize;
+
+vec3 tap(in vec2 uv, in vec2 offset) {
+    return textureLod(tex, uv + offset * texelSize, sourceLevel).rgb;
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= destinationSize.x || texel.y >= destinationSize.y) {
+        return;
+    }
+    vec2 uv = (vec2(texel) + 0.5f) / vec2(destinationSize);
+
+    vec3 result = 4.0f * tap(uv, vec2(0.0f));
+    result += 2.0f * (tap(uv, vec2(-1.0f,  0.0f)) + tap(uv, vec2(1.0f, 0.0f))
+                      + tap(uv, vec2( 0.0f, -1.0f)) + tap(uv, vec2(0.0f, 1.0f)));
+    result += tap(uv, vec2(-1.0f, -1.0f)) + tap(uv, vec2(1.0f, -1.0f))
+            + tap(uv, vec2(-1.0f,  1.0f)) + tap(uv, vec2(1.0f,  1.0f));
+
+    vec3 level = imageLoad(destination, texel).rgb;
+    imageStore(destination, texel, vec4((level + result / 16.0f) * weight, 1.0f));
+}
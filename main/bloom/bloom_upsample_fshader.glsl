@@ -0,0 +1,23 @@
+#version 410 core
+// one step of the bloom upsample chain: a 3x3 tent filter of the coarser level, added by blending
+// to the level below so that every level of the chain ends up in the first one
+in vec2 uv;
+
+uniform sampler2D tex;
+// size of a texel of tex
+uniform vec2 texelSize;
+
+out vec4 color;
+
+void main() {
+    vec3 result = 4.0f * texture(tex, uv).rgb;
+    result += 2.0f * (texture(tex, uv + vec2(-1.0f,  0.0f) * texelSize).rgb
+                      + texture(tex, uv + vec2( 1.0f,  0.0f) * texelSize).rgb
+                      + texture(tex, uv + vec2( 0.0f, -1.0f) * texelSize).rgb
+                      + texture(tex, uv + vec2( 0.0f,  1.0f) * texelSize).rgb);
+    result += texture(tex, uv + vec2(-1.0f, -1.0f) * texelSize).rgb
+            + texture(tex, uv + vec2( 1.0f, -1.0f) * texelSize).rgb
+            + texture(tex, uv + vec2(-1.0f,  1.0f) * texelSize).rgb
+            + texture(tex, uv + vec2( 1.0f,  1.0f) * texelSize).rgb;
+    color = vec4(result / 16.0f, 1.0f);
+}
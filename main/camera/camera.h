@@ -89,6 +89,32 @@ public:
         return lookAt(mirrorPos, mirrorPos + mirrorFront, this->WorldUp);
     }
 
+    // Moves the near plane of projection onto the horizontal plane at clipHeight, as seen from view, so that
+    // what lies below it is clipped before rasterization (Lengyel's oblique near-plane clipping).
+    // Only x, y and w of the clip coordinates are kept, the depth range is skewed
+    mat4 GetObliqueProjectionMatrix(const mat4 &projection, const mat4 &view, float clipHeight)
+    {
+        vec4 clipPlane = transpose(inverse(view)) * vec4(0.0f, 1.0f, 0.0f, -clipHeight);
+        // the eye must be below the plane, e.g. the mirrored eye of a camera above the water
+        if(clipPlane.w >= 0.0f){
+            return projection;
+        }
+
+        // corner of the view frustum opposite to the plane
+        vec4 q = vec4((sign(clipPlane.x) + projection[2][0]) / projection[0][0],
+                      (sign(clipPlane.y) + projection[2][1]) / projection[1][1],
+                      -1.0f,
+                      (1.0f + projection[2][2]) / projection[3][2]);
+        vec4 c = clipPlane * (2.0f / dot(clipPlane, q));
+
+        mat4 oblique = projection;
+        oblique[0][2] = c.x;
+        oblique[1][2] = c.y;
+        oblique[2][2] = c.z + 1.0f;
+        oblique[3][2] = c.w;
+        return oblique;
+    }
+
     const vec3& getPos() {
         return this->Position;
     }
@@ -0,0 +1,233 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "icg_helper.h"
+
+/**
+ * @brief The CloudNoise class generates the noise textures of the volumetric clouds once, on the CPU:
+ * a tileable 3D texture whose red channel shapes the clouds (value noise eroded by inverted Worley cells)
+ * and whose green channel holds the finer Worley octaves that erode their edges,
+ * and a 2D blue noise texture to jitter the start of the rays.
+ */
+class CloudNoise {
+
+    static uint32_t hash(int x, int y, int z, uint32_t seed) {
+        uint32_t h = seed;
+        h ^= uint32_t(x) * 0x8da6b343u;
+        h ^= uint32_t(y) * 0xd8163841u;
+        h ^= uint32_t(z) * 0xcb1ab31fu;
+        h ^= h >> 13;
+        h *= 0x5bd1e995u;
+        h ^= h >> 15;
+        return h;
+    }
+
+    static float random(int x, int y, int z, uint32_t seed) {
+        return (hash(x, y, z, seed) & 0xffffff) / float(0xffffff);
+    }
+
+    static int wrap(int i, int period) {
+        return ((i % period) + period) % period;
+    }
+
+    /** value noise with the given lattice period, p in lattice units */
+    static float valueNoise(float px, float py, float pz, int period, uint32_t seed) {
+        int x0 = int(std::floor(px)), y0 = int(std::floor(py)), z0 = int(std::floor(pz));
+        float fx = px - x0, fy = py - y0, fz = pz - z0;
+        // quintic fade
+        fx = fx * fx * fx * (fx * (fx * 6.0f - 15.0f) + 10.0f);
+        fy = fy * fy * fy * (fy * (fy * 6.0f - 15.0f) + 10.0f);
+        fz = fz * fz * fz * (fz * (fz * 6.0f - 15.0f) + 10.0f);
+
+        float corners[8];
+        for (int c = 0; c < 8; ++c) {
+            corners[c] = random(wrap(x0 + (c & 1), period), wrap(y0 + ((c >> 1) & 1), period),
+                                wrap(z0 + (c >> 2), period), seed);
+        }
+        float x00 = corners[0] + fx * (corners[1] - corners[0]);
+        float x10 = corners[2] + fx * (corners[3] - corners[2]);
+        float x01 = corners[4] + fx * (corners[5] - corners[4]);
+        float x11 = corners[6] + fx * (corners[7] - corners[6]);
+        float y0v = x00 + fy * (x10 - x00);
+        float y1v = x01 + fy * (x11 - x01);
+        return y0v + fz * (y1v - y0v);
+    }
+
+    /** distance to the closest feature point, one per cell, cells: cells along each axis. p in [0, 1[ */
+    static float worley(float px, float py, float pz, int cells, uint32_t seed) {
+        float x = px * cells, y = py * cells, z = pz * cells;
+        int cx = int(std::floor(x)), cy = int(std::floor(y)), cz = int(std::floor(z));
+        float closest = 1e9f;
+        for (int dz = -1; dz <= 1; ++dz) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int nx = cx + dx, ny = cy + dy, nz = cz + dz;
+                    int wx = wrap(nx, cells), wy = wrap(ny, cells), wz = wrap(nz, cells);
+                    float fx = nx + random(wx, wy, wz, seed) - x;
+                    float fy = ny + random(wx, wy, wz, seed + 1) - y;
+                    float fz = nz + random(wx, wy, wz, seed + 2) - z;
+                    closest = std::min(closest, fx * fx + fy * fy + fz * fz);
+                }
+            }
+        }
+        // the distance to the closest point rarely exceeds the size of a cell
+        return std::min(1.0f, std::sqrt(closest));
+    }
+
+public:
+    /** size^3 texels, RG8, repeats every size texels along each axis */
+    static GLuint createShapeTexture(int size) {
+        std::vector<unsigned char> texels(size_t(size) * size * size * 2);
+        for (int k = 0; k < size; ++k) {
+            for (int j = 0; j < size; ++j) {
+                for (int i = 0; i < size; ++i) {
+                    float px = float(i) / size, py = float(j) / size, pz = float(k) / size;
+
+                    // 3 octaves of value noise, billowed by the inverted Worley cells
+                    float value = 0.0f, amplitude = 0.5f;
+                    for (int octave = 0; octave < 3; ++octave) {
+                        int period = 4 << octave;
+                        value += amplitude * valueNoise(px * period, py * period, pz * period, period, 11 + octave);
+                        amplitude *= 0.5f;
+                    }
+                    value /= 0.875f;
+                    // remapped from [cells - 1, 1] to [0, 1]: the value noise rounds up inside the cells
+                    float cells = 1.0f - worley(px, py, pz, 4, 101);
+                    float shape = std::max(0.0f, std::min(1.0f, (value + 1.0f - cells) / (2.0f - cells)));
+
+                    // inverted Worley octaves, for the wispy edges
+                    float detail = 0.625f * (1.0f - worley(px, py, pz, 8, 201))
+                            + 0.25f * (1.0f - worley(px, py, pz, 16, 301))
+                            + 0.125f * (1.0f - worley(px, py, pz, 32, 401));
+
+                    size_t t = 2 * ((size_t(k) * size + j) * size + i);
+                    texels[t] = (unsigned char)(255.0f * shape + 0.5f);
+                    texels[t + 1] = (unsigned char)(255.0f * std::min(1.0f, detail) + 0.5f);
+                }
+            }
+        }
+
+        GLuint texture_id;
+        glGenTextures(1, &texture_id);
+        glBindTexture(GL_TEXTURE_3D, texture_id);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RG8, size, size, size, 0, GL_RG, GL_UNSIGNED_BYTE, &texels[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_3D);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        return texture_id;
+    }
+
+    /**
+     * size^2 texels, R8, by void and cluster: each texel is ranked by the order in which it fills the largest void
+     * of the texels ranked before it, so that any threshold of the texture is evenly spread without low frequencies
+     */
+    static GLuint createBlueNoiseTexture(int size) {
+        const int n = size * size;
+        const float sigma = 1.5f;
+
+        // energy of a point at every toroidal offset
+        std::vector<float> kernel(n);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                int dx = std::min(x, size - x), dy = std::min(y, size - y);
+                kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+            }
+        }
+
+        std::vector<float> energy(n, 0.0f);
+        std::vector<bool> filled(n, false);
+        auto splat = [&](int index, float sign) {
+            int px = index % size, py = index / size;
+            for (int y = 0; y < size; ++y) {
+                for (int x = 0; x < size; ++x) {
+                    energy[y * size + x] += sign * kernel[wrap(y - py, size) * size + wrap(x - px, size)];
+                }
+            }
+        };
+        auto largestVoid = [&]() {
+            int best = -1;
+            for (int i = 0; i < n; ++i) {
+                if (!filled[i] && (best < 0 || energy[i] < energy[best])) {
+                    best = i;
+                }
+            }
+            return best;
+        };
+        auto tightestCluster = [&]() {
+            int best = -1;
+            for (int i = 0; i < n; ++i) {
+                if (filled[i] && (best < 0 || energy[i] > energy[best])) {
+                    best = i;
+                }
+            }
+            return best;
+        };
+
+        // random initial points, spread by moving the tightest cluster into the largest void until it stays
+        int initialPoints = n / 10;
+        for (int p = 0; p < initialPoints; ++p) {
+            int index = hash(p, 0, 0, 7) % n;
+            while (filled[index]) {
+                index = (index + 1) % n;
+            }
+            filled[index] = true;
+            splat(index, 1.0f);
+        }
+        for (;;) {
+            int cluster = tightestCluster();
+            filled[cluster] = false;
+            splat(cluster, -1.0f);
+            int voidIndex = largestVoid();
+            filled[voidIndex] = true;
+            splat(voidIndex, 1.0f);
+            if (voidIndex == cluster) {
+                break;
+            }
+        }
+
+        // the initial points are ranked by removing the tightest clusters, the others by filling the largest voids
+        std::vector<int> rank(n, 0);
+        std::vector<bool> initial = filled;
+        std::vector<float> initialEnergy = energy;
+        for (int r = initialPoints - 1; r >= 0; --r) {
+            int cluster = tightestCluster();
+            filled[cluster] = false;
+            splat(cluster, -1.0f);
+            rank[cluster] = r;
+        }
+        filled = initial;
+        energy = initialEnergy;
+        for (int r = initialPoints; r < n; ++r) {
+            int voidIndex = largestVoid();
+            filled[voidIndex] = true;
+            splat(voidIndex, 1.0f);
+            rank[voidIndex] = r;
+        }
+
+        std::vector<unsigned char> texels(n);
+        for (int i = 0; i < n; ++i) {
+            texels[i] = (unsigned char)((rank[i] * 256) / n);
+        }
+
+        GLuint texture_id;
+        glGenTextures(1, &texture_id);
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size, size, 0, GL_RED, GL_UNSIGNED_BYTE, &texels[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture_id;
+    }
+};
@@ -0,0 +1,11 @@
+#version 410 core
+// the resolved clouds over the HDR scene, upsampled bilinearly: rgb is added, alpha multiplies what is behind
+in vec2 uv;
+
+uniform sampler2D clouds;
+
+layout (location = 0) out vec4 color;
+
+void main() {
+    color = texture(clouds, uv);
+}
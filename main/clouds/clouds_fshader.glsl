@@ -0,0 +1,140 @@
+#version 410 core
+// ray marches the cloud layer along the view ray of the pixel: rgb is the light scattered towards the eye,
+// alpha the transmittance of the clouds. The start of the ray is jittered by a blue noise that changes every
+// frame, the temporal resolve averages the jitter out
+in vec2 uv;
+
+// inverse of the projection times the rotation of the view: unprojects to positions relative to the camera
+uniform mat4 inverseVP;
+uniform vec3 cameraPos;
+// moves the scene coordinates to fixed world coordinates, plus the drift of the wind
+uniform vec3 noiseOffset;
+
+uniform sampler3D cloudNoise;
+uniform sampler2D blueNoise;
+uniform float jitterOffset;
+// steps along the part of the ray inside the layer
+uniform int marchSteps;
+// the rays stop at the scene depth, the cube map faces have none
+uniform sampler2D depthTex;
+uniform bool useDepth;
+
+uniform vec3 light_dir;
+uniform vec3 La, Ld;
+uniform vec3 topSkyColor;
+uniform vec3 bottomSkyColor;
+
+out vec4 color;
+
+// the layer, in scene units
+const float CLOUD_BOTTOM = 6.0f;
+const float CLOUD_TOP = 9.0f;
+const float MAX_DISTANCE = 60.0f;
+const float NOISE_SCALE = 1.0f / 24.0f;
+const float DETAIL_SCALE = 4.0f;
+const float COVERAGE = 0.45f;
+const float EXTINCTION = 4.0f;
+const float SUN_INTENSITY = 3.0f;
+
+// the coarse light march reaches as far as before with half the fetches
+const int LIGHT_STEPS = 2;
+const float LIGHT_STEP = 0.7f;
+
+float density(in vec3 p, in bool detailed) {
+    float h = (p.y - CLOUD_BOTTOM) / (CLOUD_TOP - CLOUD_BOTTOM);
+    if (h <= 0.0f || h >= 1.0f) {
+        return 0.0f;
+    }
+    // rounded bottoms, thinning tops
+    float heightShape = smoothstep(0.0f, 0.15f, h) * (1.0f - smoothstep(0.5f, 1.0f, h));
+
+    vec3 q = (p + noiseOffset) * NOISE_SCALE;
+    float shape = texture(cloudNoise, q).r * heightShape;
+    float base = clamp((shape - (1.0f - COVERAGE)) / COVERAGE, 0.0f, 1.0f);
+    if (!detailed || base <= 0.0f) {
+        return base;
+    }
+    // the detail erodes the thin parts only
+    float detail = texture(cloudNoise, q * DETAIL_SCALE).g;
+    return clamp(base - 0.35f * detail * (1.0f - base), 0.0f, 1.0f);
+}
+
+// Henyey-Greenstein
+float phase(in float cosAngle, in float g) {
+    float g2 = g * g;
+    return (1.0f - g2) / (4.0f * 3.14159265f * pow(1.0f + g2 - 2.0f * g * cosAngle, 1.5f));
+}
+
+void main() {
+    vec4 farPoint = inverseVP * vec4(uv * 2.0f - 1.0f, 1.0f, 1.0f);
+    vec3 dir = normalize(farPoint.xyz / farPoint.w);
+
+    float maxDistance = MAX_DISTANCE;
+    if (useDepth) {
+        float depth = texture(depthTex, uv).r;
+        if (depth < 1.0f) {
+            vec4 scenePoint = inverseVP * vec4(vec3(uv, depth) * 2.0f - 1.0f, 1.0f);
+            maxDistance = min(maxDistance, length(scenePoint.xyz / scenePoint.w));
+        }
+    }
+
+    // the part of the ray inside the layer
+    float tBottom = (CLOUD_BOTTOM - cameraPos.y) / dir.y;
+    float tTop = (CLOUD_TOP - cameraPos.y) / dir.y;
+    float tEnter = max(0.0f, min(tBottom, tTop));
+    float tExit = min(maxDistance, max(tBottom, tTop));
+    if (abs(dir.y) < 1e-4f) {
+        bool inside = cameraPos.y > CLOUD_BOTTOM && cameraPos.y < CLOUD_TOP;
+        tEnter = 0.0f;
+        tExit = inside ? maxDistance : 0.0f;
+    }
+    if (tExit <= tEnter) {
+        color = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return;
+    }
+
+    float stepSize = (tExit - tEnter) / float(marchSteps);
+    float jitter = fract(texture(blueNoise, gl_FragCoord.xy / vec2(textureSize(blueNoise, 0))).r + jitterOffset);
+    float t = tEnter + jitter * stepSize;
+
+    vec3 sunDir = normalize(light_dir);
+    float cosAngle = dot(dir, sunDir);
+    // forward scattering towards the sun, a little back scattering away from it
+    float sunPhase = mix(phase(cosAngle, 0.6f), phase(cosAngle, -0.3f), 0.3f);
+    vec3 sunLight = SUN_INTENSITY * Ld * max(sunDir.y, 0.0f);
+
+    vec3 scattered = vec3(0.0f);
+    float transmittance = 1.0f;
+    for (int i = 0; i < marchSteps; ++i) {
+        vec3 p = cameraPos + t * dir;
+        float d = density(p, true);
+        if (d > 0.0f) {
+            // optical depth towards the sun, coarse
+            float lightDepth = 0.0f;
+            for (int j = 1; j <= LIGHT_STEPS; ++j) {
+                lightDepth += density(p + sunDir * (LIGHT_STEP * float(j)), false);
+            }
+            float sunTransmittance = exp(-EXTINCTION * LIGHT_STEP * lightDepth);
+            // dark edges of the sides facing the sun
+            float powder = 1.0f - exp(-2.0f * EXTINCTION * LIGHT_STEP * d);
+
+            float h = clamp((p.y - CLOUD_BOTTOM) / (CLOUD_TOP - CLOUD_BOTTOM), 0.0f, 1.0f);
+            vec3 ambient = La + mix(bottomSkyColor, topSkyColor, h) * (0.3f + 0.7f * h);
+            vec3 luminance = sunLight * sunTransmittance * sunPhase * 4.0f * mix(1.0f, powder, 0.5f) + ambient;
+
+            // energy conserving integration over the step
+            float extinction = EXTINCTION * d;
+            float stepTransmittance = exp(-extinction * stepSize);
+            scattered += transmittance * luminance * (1.0f - stepTransmittance);
+            transmittance *= stepTransmittance;
+            if (transmittance < 0.01f) {
+                break;
+            }
+        }
+        t += stepSize;
+    }
+
+    // the layer fades into the haze instead of stopping at the end of the rays
+    float haze = smoothstep(0.6f * MAX_DISTANCE, MAX_DISTANCE, tEnter);
+    color = vec4(scattered * (1.0f - haze), mix(transmittance, 1.0f, haze));
+}
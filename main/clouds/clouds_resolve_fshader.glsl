@@ -0,0 +1,57 @@
+#version 410 core
+// accumulates the jittered cloud march over the frames: the history is reprojected through the cloud layer,
+// clamped to the neighbourhood of the current march so that moving clouds do not ghost
+in vec2 uv;
+
+uniform sampler2D current;
+uniform sampler2D history;
+uniform bool historyValid;
+
+// inverse of the projection times the rotation of the view
+uniform mat4 inverseVP;
+uniform float cameraHeight;
+// from positions relative to the camera to the clip space of the previous frame, with the scroll of the
+// scene and the drift of the wind in between
+uniform mat4 reprojection;
+
+out vec4 color;
+
+// as in clouds_fshader.glsl
+const float CLOUD_MIDDLE = 7.5f;
+const float DEFAULT_DISTANCE = 20.0f;
+const float HISTORY_WEIGHT = 0.9f;
+
+void main() {
+    vec4 now = texture(current, uv);
+    if (!historyValid) {
+        color = now;
+        return;
+    }
+
+    // the clouds are thin compared to their distance: reprojecting their middle plane is close enough
+    vec4 farPoint = inverseVP * vec4(uv * 2.0f - 1.0f, 1.0f, 1.0f);
+    vec3 dir = normalize(farPoint.xyz / farPoint.w);
+    float t = (CLOUD_MIDDLE - cameraHeight) / dir.y;
+    if (!(t > 0.0f) || t > 3.0f * DEFAULT_DISTANCE) {
+        t = DEFAULT_DISTANCE;
+    }
+    vec4 previous = reprojection * vec4(t * dir, 1.0f);
+    vec2 previousUv = previous.xy / previous.w * 0.5f + 0.5f;
+    if (previous.w <= 0.0f || any(lessThan(previousUv, vec2(0.0f))) || any(greaterThan(previousUv, vec2(1.0f)))) {
+        color = now;
+        return;
+    }
+
+    // textureOffset only takes constant offsets, the loop indices are not
+    vec2 texel = 1.0f / vec2(textureSize(current, 0));
+    vec4 low = now, high = now;
+    for (int y = -1; y <= 1; ++y) {
+        for (int x = -1; x <= 1; ++x) {
+            vec4 neighbour = texture(current, uv + vec2(x, y) * texel);
+            low = min(low, neighbour);
+            high = max(high, neighbour);
+        }
+    }
+    vec4 past = clamp(texture(history, previousUv), low, high);
+    color = mix(now, past, HISTORY_WEIGHT);
+}
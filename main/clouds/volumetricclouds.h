@@ -0,0 +1,265 @@
+#pragma once
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "cloudnoise.h"
+#include "../framebuffer.h"
+#include "../screenquad/fullscreenquad.h"
+#include "../light/light.h"
+#include "../skyDome/skyDome.h"
+
+/**
+ * @brief The VolumetricClouds class ray marches a layer of procedural clouds at a quarter of the pixels
+ * (half the resolution along each axis). Each frame marches with a different blue noise offset of the
+ * ray starts, the resolve pass reprojects and accumulates the previous frames so that a few steps per ray
+ * are enough. The result is composited over the HDR scene before the bloom and the tone mapping.
+ * The clouds are also a layer of the sky cube map, at its resolution, for the mirrored view.
+ */
+class VolumetricClouds: public SkyLayer {
+
+public:
+    /**
+     * steps of the rays of the frame, the jitter of their start is averaged by the resolve. The faces of the
+     * sky cube map have no history and take twice as many, they are a few percent of the pixels marched
+     */
+    static constexpr int MARCH_STEPS = 16;
+    static constexpr int SKY_MARCH_STEPS = 32;
+
+    /** side of the noise textures */
+    static constexpr int SHAPE_SIZE = 64;
+    static constexpr int BLUE_NOISE_SIZE = 64;
+
+private:
+    enum { MARCH, RESOLVE, COMPOSITE, PROGRAMS };
+
+    FullScreenQuad quad;
+    GLuint program_id_[PROGRAMS];
+
+    GLuint inverseVP_id, cameraPos_id, noiseOffset_id, jitterOffset_id, useDepth_id, marchSteps_id;
+    GLuint resolveInverseVP_id, cameraHeight_id, reprojection_id, historyValid_id;
+
+    GLuint shapeTexture_id_, blueNoiseTexture_id_, depthTexture_id_;
+    ColorFBO march;
+    ColorFBO history[2];
+    GLuint marchTexture_id_, historyTexture_id_[2];
+    int latest = 0;
+    bool historyValid = false;
+    int width, height;
+
+    Light* light;
+    SkyDome* sky;
+
+    // camera relative, scene coordinates of the frame
+    glm::vec3 cameraPos;
+    glm::mat4 inverseVP;
+    glm::mat4 viewProjection, previousViewProjection;
+    glm::vec3 noiseOffset, previousNoiseOffset;
+    unsigned int frame = 0;
+
+    // scene units per second, the clouds drift with it
+    const glm::vec3 wind = glm::vec3(0.4f, 0.0f, 0.15f);
+
+    /** marches the rays of the pixels of the bound target, unprojected by inverseVP */
+    void drawMarch(const glm::mat4 &inverseVP, bool useDepth, int steps) {
+        glUseProgram(program_id_[MARCH]);
+        quad.Bind(program_id_[MARCH]);
+
+        glUniformMatrix4fv(inverseVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(inverseVP));
+        glUniform3fv(cameraPos_id, ONE, glm::value_ptr(cameraPos));
+        glUniform3fv(noiseOffset_id, ONE, glm::value_ptr(noiseOffset));
+        glUniform1f(jitterOffset_id, std::fmod(frame * 0.618034f, 1.0f));
+        glUniform1i(useDepth_id, useDepth);
+        glUniform1i(marchSteps_id, steps);
+        light->updateProgram(program_id_[MARCH]);
+        sky->updateProgram(program_id_[MARCH]);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, shapeTexture_id_);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, blueNoiseTexture_id_);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, depthTexture_id_);
+
+        quad.Draw();
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_3D, 0);
+        glBindVertexArray(0);
+        glUseProgram(0);
+    }
+
+public:
+    /** width, height: resolution of the HDR scene, depthTexture: its depth, which stops the rays */
+    void Init(int width, int height, GLuint depthTexture, Light* light, SkyDome* sky) {
+        this->light = light;
+        this->sky = sky;
+        depthTexture_id_ = depthTexture;
+
+        shapeTexture_id_ = CloudNoise::createShapeTexture(SHAPE_SIZE);
+        blueNoiseTexture_id_ = CloudNoise::createBlueNoiseTexture(BLUE_NOISE_SIZE);
+
+        this->width = std::max(1, width / 2);
+        this->height = std::max(1, height / 2);
+        marchTexture_id_ = march.Init(this->width, this->height, GL_RGBA16F, GL_RGBA, GL_FLOAT, true);
+        historyTexture_id_[0] = history[0].Init(this->width, this->height, GL_RGBA16F, GL_RGBA, GL_FLOAT, true);
+        historyTexture_id_[1] = history[1].Init(this->width, this->height, GL_RGBA16F, GL_RGBA, GL_FLOAT, true);
+
+        // compile the shaders
+        program_id_[MARCH] = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                     "clouds_fshader.glsl");
+        program_id_[RESOLVE] = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                       "clouds_resolve_fshader.glsl");
+        program_id_[COMPOSITE] = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                         "clouds_composite_fshader.glsl");
+        if(!program_id_[MARCH] || !program_id_[RESOLVE] || !program_id_[COMPOSITE]) {
+            exit(EXIT_FAILURE);
+        }
+
+        for (int program = 0; program < PROGRAMS; ++program) {
+            quad.registerProgram(program_id_[program]);
+        }
+
+        glUseProgram(program_id_[MARCH]);
+        glUniform1i(glGetUniformLocation(program_id_[MARCH], "cloudNoise"), 0 /*GL_TEXTURE0*/);
+        glUniform1i(glGetUniformLocation(program_id_[MARCH], "blueNoise"), 1 /*GL_TEXTURE1*/);
+        glUniform1i(glGetUniformLocation(program_id_[MARCH], "depthTex"), 2 /*GL_TEXTURE2*/);
+        inverseVP_id = glGetUniformLocation(program_id_[MARCH], "inverseVP");
+        cameraPos_id = glGetUniformLocation(program_id_[MARCH], "cameraPos");
+        noiseOffset_id = glGetUniformLocation(program_id_[MARCH], "noiseOffset");
+        jitterOffset_id = glGetUniformLocation(program_id_[MARCH], "jitterOffset");
+        useDepth_id = glGetUniformLocation(program_id_[MARCH], "useDepth");
+        marchSteps_id = glGetUniformLocation(program_id_[MARCH], "marchSteps");
+        light->registerProgram(program_id_[MARCH]);
+        sky->registerProgram(program_id_[MARCH]);
+
+        glUseProgram(program_id_[RESOLVE]);
+        glUniform1i(glGetUniformLocation(program_id_[RESOLVE], "current"), 0 /*GL_TEXTURE0*/);
+        glUniform1i(glGetUniformLocation(program_id_[RESOLVE], "history"), 1 /*GL_TEXTURE1*/);
+        resolveInverseVP_id = glGetUniformLocation(program_id_[RESOLVE], "inverseVP");
+        cameraHeight_id = glGetUniformLocation(program_id_[RESOLVE], "cameraHeight");
+        reprojection_id = glGetUniformLocation(program_id_[RESOLVE], "reprojection");
+        historyValid_id = glGetUniformLocation(program_id_[RESOLVE], "historyValid");
+
+        glUseProgram(program_id_[COMPOSITE]);
+        glUniform1i(glGetUniformLocation(program_id_[COMPOSITE], "clouds"), 0 /*GL_TEXTURE0*/);
+        glUseProgram(0);
+    }
+
+    /** width, height: resolution of the HDR scene */
+    void Resize(int width, int height) {
+        this->width = std::max(1, width / 2);
+        this->height = std::max(1, height / 2);
+        march.Resize(this->width, this->height);
+        history[0].Resize(this->width, this->height);
+        history[1].Resize(this->width, this->height);
+        historyValid = false;
+    }
+
+    /**
+     * the camera of the frame, in scene coordinates, and the offset of the scene in the world:
+     * the clouds stay in place when the scene scrolls. Once per frame, before the sky cube map is updated
+     */
+    void update(const glm::vec3 &cameraPos, const glm::mat4 &VIEW, const glm::mat4 &PROJECTION,
+                const glm::vec3 &worldOffset) {
+        previousViewProjection = viewProjection;
+        previousNoiseOffset = noiseOffset;
+
+        this->cameraPos = cameraPos;
+        viewProjection = PROJECTION * VIEW;
+        inverseVP = glm::inverse(PROJECTION * glm::mat4(glm::mat3(VIEW)));
+        noiseOffset = worldOffset - wind * float(glfwGetTime());
+        frame++;
+    }
+
+    /** the clouds seen from the center of a face of the sky cube map, into the bound face */
+    void DrawInSky(const glm::mat4 &faceVP) {
+        drawMarch(glm::inverse(faceVP), false, SKY_MARCH_STEPS);
+    }
+
+    /** marches the clouds of the frame and accumulates them into the history. Leaves the default framebuffer bound */
+    void Render() {
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        march.Bind();
+        drawMarch(inverseVP, true, MARCH_STEPS);
+        march.Unbind();
+
+        // a cloud at p in the scene of this frame was at p + noiseOffset - previousNoiseOffset in the previous one
+        glm::mat4 reprojection = previousViewProjection
+                * glm::translate(IDENTITY_MATRIX, cameraPos + noiseOffset - previousNoiseOffset);
+
+        int next = 1 - latest;
+        history[next].Bind();
+        glUseProgram(program_id_[RESOLVE]);
+        quad.Bind(program_id_[RESOLVE]);
+        glUniformMatrix4fv(resolveInverseVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(inverseVP));
+        glUniform1f(cameraHeight_id, cameraPos.y);
+        glUniformMatrix4fv(reprojection_id, ONE, DONT_TRANSPOSE, glm::value_ptr(reprojection));
+        glUniform1i(historyValid_id, historyValid);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, marchTexture_id_);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, historyTexture_id_[latest]);
+        quad.Draw();
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        history[next].Unbind();
+
+        latest = next;
+        historyValid = true;
+        glEnable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    /** the accumulated clouds over the bound target, which holds the HDR scene */
+    void Composite() {
+        glUseProgram(program_id_[COMPOSITE]);
+        quad.Bind(program_id_[COMPOSITE]);
+        glDisable(GL_DEPTH_TEST);
+        glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, historyTexture_id_[latest]);
+        quad.Draw();
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glEnable(GL_DEPTH_TEST);
+        glBindVertexArray(0);
+        glUseProgram(0);
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    /** bytes of video memory held by the march, the history and the noise textures */
+    size_t memoryUsage() const {
+        size_t pixels = size_t(width) * height;
+        size_t shape = size_t(SHAPE_SIZE) * SHAPE_SIZE * SHAPE_SIZE * 2 * 8 / 7;
+        return 3 * pixels * 8 + shape + size_t(BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE;
+    }
+
+    void Cleanup() {
+        glUseProgram(0);
+        quad.Cleanup();
+        for (int program = 0; program < PROGRAMS; ++program) {
+            glDeleteProgram(program_id_[program]);
+        }
+        glDeleteTextures(1, &shapeTexture_id_);
+        glDeleteTextures(1, &blueNoiseTexture_id_);
+        march.Cleanup();
+        history[0].Cleanup();
+        history[1].Cleanup();
+    }
+};
@@ -0,0 +1,177 @@
+#version 410 core
+in vec2 uv;
+uniform sampler2D albedoTex;
+uniform sampler2D normalTex;
+uniform sampler2D depthTex;
+uniform mat4 inverseP;
+uniform mat4 inverseV;
+uniform mat4 NORMALM;
+uniform vec3 light_dir;
+uniform vec3 La, Ld, Ls;
+
+layout (location = 0) out vec4 color;
+
+// material IDs, stored in the 2 bits alpha channel of the normal texture
+const int MATERIAL_NONE = 0;
+const int MATERIAL_TERRAIN = 1;
+const int MATERIAL_WATER = 2;
+const int MATERIAL_MODEL = 3;
+
+const int NUM_CASCADES = 4;
+uniform sampler2DArrayShadow shadowMap;
+// to the light space of this frame, xy in world units and z the depth in the maps
+uniform mat4 SHADOWMV;
+// center and usable half side of each map in light space, 1 / its side
+uniform vec4 cascadeArea[NUM_CASCADES];
+// texture coordinates of the light space origin in each map, the maps wrap around
+uniform vec2 cascadeOffset[NUM_CASCADES];
+// light space depth covered by the maps, turns a world space bias into a depth offset
+uniform float shadowDepthRange;
+// blurred and mipmapped exponential variance moments of the maps, see evsm_fshader.glsl
+uniform sampler2DArray shadowMoments;
+// one filtered fetch of the moments, or the rotated PCF of the depth maps
+uniform bool prefilteredShadows;
+
+const int numSamplingPositions = 9;
+uniform vec2 kernel[9] = vec2[]
+(
+   vec2(0.95581f, -0.18159f), vec2(0.50147f, -0.35807f), vec2(0.69607f, 0.35559f),
+   vec2(-0.0036825f, -0.59150f), vec2(0.15930f, 0.089750f), vec2(-0.65031f, 0.058189f),
+   vec2(0.11915f, 0.78449f), vec2(-0.34296f, 0.51575f), vec2(-0.60380f, -0.41527f)
+);
+
+// generates pseudorandom number in [0, 1]
+// seed - world space position of a fragemnt
+// freq - modifier for seed. The bigger, the faster
+// the pseudorandom numbers will change with change of world space position
+float random(in vec3 seed, in float freq)
+{
+   // project seed on random constant vector
+   float dt = dot(floor(seed * freq), vec3(53.1215f, 21.1352f, 9.1322f));
+   // return only fractional part
+   return fract(sin(dt) * 2105.2354f);
+}
+
+// returns random angle
+float randomAngle(in vec3 seed, in float freq)
+{
+   return random(seed, freq) * 6.283285f;
+}
+
+#include "gbuffer_normal.glsl"
+
+// the finest map holding the given light space position, NUM_CASCADES outside of all of them
+int selectCascade(in vec2 lightPos)
+{
+    for(int i = 0; i < NUM_CASCADES; i++){
+        if(all(lessThan(abs(lightPos - cascadeArea[i].xy), vec2(cascadeArea[i].z)))){
+            return i;
+        }
+    }
+    return NUM_CASCADES;
+}
+
+// exponents of the warped depth, as in evsm_fshader.glsl
+const float positiveExponent = 5.54f;
+const float negativeExponent = 5.0f;
+
+// upper bound of the lit fraction from the mean and variance of the occluders warped depth
+float chebyshevUpperBound(in vec2 moments, in float mean, in float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    // cuts the tail of the bound to reduce light bleeding
+    float pMax = clamp((variance / (variance + d * d) - 0.2f) / 0.8f, 0.0f, 1.0f);
+    return (mean <= moments.x) ? 1.0f : pMax;
+}
+
+// one filtered fetch of the moments, the gradients come from the light space position so that they do not jump
+// where the cascade changes
+float evsmVisibility(in vec3 shadowCoord, in int cascade, in vec2 gradX, in vec2 gradY)
+{
+    vec4 moments = textureGrad(shadowMoments, vec3(shadowCoord.xy, cascade), gradX, gradY);
+    float depth = 2.0f * shadowCoord.z - 1.0f;
+    vec2 warped = vec2(exp(positiveExponent * depth), -exp(-negativeExponent * depth));
+    vec2 minVariance = 0.0001f * vec2(positiveExponent, negativeExponent) * warped;
+    minVariance *= minVariance;
+    return min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x),
+               chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+}
+
+// same cascade selection, prefiltered moments or rotated 9 taps PCF as the forward shaders
+float shadowVisibility(in vec3 vpoint, in float cosNL)
+{
+    vec3 shadowPos = (SHADOWMV * vec4(vpoint, 1.0f)).xyz;
+    // derivatives of the light space position, taken before branching
+    vec2 shadowGradX = dFdx(shadowPos.xy);
+    vec2 shadowGradY = dFdy(shadowPos.xy);
+    int cascade = selectCascade(shadowPos.xy);
+    if(cascade == NUM_CASCADES){
+        return 1.0f;
+    }
+    vec3 shadowCoord = vec3(shadowPos.xy * cascadeArea[cascade].w + cascadeOffset[cascade], shadowPos.z);
+    float bias = max(0.1f * (1.0f - cosNL), 0.01f) / shadowDepthRange;
+    if(prefilteredShadows){
+        return evsmVisibility(vec3(shadowCoord.xy, shadowCoord.z - bias), cascade,
+                              shadowGradX * cascadeArea[cascade].w, shadowGradY * cascadeArea[cascade].w);
+    }
+
+    float angle = randomAngle(vpoint, 15.0f);
+    float s = sin(angle);
+    float c = cos(angle);
+    float PCFRadius = 1.0f/1000.0f;
+    float visibility = 0.0f;
+    for(int i=0; i < numSamplingPositions; i++)
+    {
+      vec2 rotatedOffset = vec2(kernel[i].x * c + kernel[i].y * -s, kernel[i].x * s + kernel[i].y * c);
+      visibility += texture(shadowMap, vec4(shadowCoord.xy + rotatedOffset * PCFRadius, cascade, shadowCoord.z - bias));
+    }
+    return visibility / numSamplingPositions;
+}
+
+void main() {
+
+    vec4 normalMaterial = texture(normalTex, uv);
+    int material = int(normalMaterial.a * 3.0f + 0.5f);
+
+    // sky, the fog pass fills it
+    if(material == MATERIAL_NONE){
+        discard;
+    }
+
+    vec3 albedo = texture(albedoTex, uv).rgb;
+    float depth = texture(depthTex, uv).r;
+
+    vec4 vpoint_MV = inverseP * vec4(vec3(uv, depth) * 2.0f - 1.0f, 1.0f);
+    vpoint_MV /= vpoint_MV.w;
+    vec3 vpoint = (inverseV * vpoint_MV).xyz;
+
+    vec3 normal_MV = decodeNormal(normalMaterial.xy);
+    vec3 lightDir = normalize((NORMALM * vec4(light_dir, 1.0)).xyz);
+    vec3 viewDir = -normalize(vpoint_MV.xyz);
+    float cosNL = dot(normal_MV, lightDir);
+
+    // the blue channel holds the specular strength of the models, the horizon visibility of the terrain and the water
+    float specularStrength = (material == MATERIAL_MODEL) ? normalMaterial.b : ((material == MATERIAL_WATER) ? 1.0f : 0.0f);
+    float horizon = (material == MATERIAL_MODEL) ? 1.0f : normalMaterial.b;
+
+    float visibility = shadowVisibility(vpoint, cosNL) * horizon;
+
+    vec3 lightingResult = albedo * La;
+
+    if(cosNL > 0.0f){
+        float diffuseWeight = (material == MATERIAL_WATER) ? 0.8f : 1.0f;
+        float shininess = (material == MATERIAL_WATER) ? 512.0f : 256.0f;
+        vec3 reflectionDir = normalize(2.0f * normal_MV * cosNL - lightDir);
+        lightingResult += visibility *
+               ((diffuseWeight * albedo * cosNL * Ld)
+               +
+               (specularStrength * pow(max(0.0, dot(reflectionDir, viewDir)), shininess) * Ls));
+    }
+
+    if(material == MATERIAL_TERRAIN){
+        lightingResult = clamp(lightingResult, vec3(0.0f), vec3(1.0f));
+    }
+
+    color = vec4(lightingResult, 1.0f);
+}
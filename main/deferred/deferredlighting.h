@@ -0,0 +1,111 @@
+#pragma once
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "../light/light.h"
+#include "../light/lightable.h"
+#include "../shadow/shadowcascades.h"
+#include "../screenquad/fullscreenquad.h"
+
+/**
+ * @brief The DeferredLighting class shades the G-buffer in one full-screen pass:
+ * lighting and shadow PCF run once per pixel whatever the overdraw of the geometry passes.
+ * It writes the same HDR color as the forward shaders, so the bloom and tone mapping are unchanged.
+ */
+class DeferredLighting: public ILightable {
+
+    private:
+        FullScreenQuad quad;
+        GLuint program_id_;             // GLSL shader program ID
+        GLuint albedoTexture_id_, normalTexture_id_, depthTexture_id_, shadowTexture_id_;
+        GLuint inverseP_id, inverseV_id, NORMALM_id;
+        Light* light = nullptr;
+        ShadowCascades* shadowCascades = nullptr;
+
+    public:
+        void Init(GLuint albedoTexture, GLuint normalTexture, GLuint depthTexture, GLuint shadowTexture) {
+
+            // compile the shaders
+            program_id_ = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                  "deferred_lighting_fshader.glsl");
+            if(!program_id_) {
+                exit(EXIT_FAILURE);
+            }
+
+            glUseProgram(program_id_);
+
+            quad.registerProgram(program_id_);
+
+            // load/Assign textures
+            this->albedoTexture_id_ = albedoTexture;
+            this->normalTexture_id_ = normalTexture;
+            this->depthTexture_id_ = depthTexture;
+            this->shadowTexture_id_ = shadowTexture;
+            glUniform1i(glGetUniformLocation(program_id_, "albedoTex"), 0);
+            glUniform1i(glGetUniformLocation(program_id_, "normalTex"), 1);
+            glUniform1i(glGetUniformLocation(program_id_, "depthTex"), 2);
+            glUniform1i(glGetUniformLocation(program_id_, "shadowMap"), 3);
+
+            inverseP_id = glGetUniformLocation(program_id_, "inverseP");
+            inverseV_id = glGetUniformLocation(program_id_, "inverseV");
+            NORMALM_id = glGetUniformLocation(program_id_, "NORMALM");
+
+            // to avoid the current object being polluted
+            glUseProgram(0);
+        }
+
+        void useLight(Light* l){
+            this->light = l;
+            light->registerProgram(program_id_);
+        }
+
+        void useShadowCascades(ShadowCascades* c){
+            this->shadowCascades = c;
+            c->registerProgram(program_id_, 4 /*next to the shadow map*/);
+        }
+
+        void Cleanup() {
+            glUseProgram(0);
+            quad.Cleanup();
+            glDeleteProgram(program_id_);
+        }
+
+        /** PROJECTION and VIEW the G-buffer was rendered with, NORMALM its normal matrix */
+        void Draw(const glm::mat4 &PROJECTION,
+                  const glm::mat4 &VIEW,
+                  const glm::mat4 &NORMALM) {
+            glUseProgram(program_id_);
+            quad.Bind(program_id_);
+
+            glUniformMatrix4fv(inverseP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(glm::inverse(PROJECTION)));
+            glUniformMatrix4fv(inverseV_id, ONE, DONT_TRANSPOSE, glm::value_ptr(glm::inverse(VIEW)));
+            glUniformMatrix4fv(NORMALM_id, ONE, DONT_TRANSPOSE, glm::value_ptr(NORMALM));
+
+            if(light != nullptr)
+                light->updateProgram(program_id_);
+            if(shadowCascades != nullptr)
+                shadowCascades->updateProgram(program_id_);
+
+            // bind textures
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, albedoTexture_id_);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, normalTexture_id_);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, depthTexture_id_);
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTexture_id_);
+
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_BLEND);
+
+            // draw
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            quad.Draw();
+
+            glEnable(GL_DEPTH_TEST);
+            glEnable(GL_BLEND);
+
+            glBindVertexArray(0);
+            glUseProgram(0);
+        }
+};
@@ -0,0 +1,22 @@
+// included by the geometry passes writing the G-buffer and by the lighting pass reading it
+
+// octahedral mapping of a unit vector to [0, 1]^2, stored in the G-buffer
+vec2 encodeNormal(in vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    if(n.z < 0.0f){
+        n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return n.xy * 0.5f + 0.5f;
+}
+
+// inverse of encodeNormal
+vec3 decodeNormal(in vec2 e)
+{
+    e = e * 2.0f - 1.0f;
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = clamp(-n.z, 0.0f, 1.0f);
+    n.x += (n.x >= 0.0f) ? -t : t;
+    n.y += (n.y >= 0.0f) ? -t : t;
+    return normalize(n);
+}
@@ -0,0 +1,459 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "../light/light.h"
+#include "../shadow/shadowcascades.h"
+#include "../model/model.h"
+#include "../water/wavesampler.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+ * @brief The Fleet class sails many boats around the camera and draws them as instances of the yacht. The boats
+ * are kept as a structure of arrays, one array per quantity: Update steps them all in plain loops, then asks
+ * the WaveSampler for the water under four points of every hull in a single batch, four lanes at a time, and
+ * fits their heave, pitch and roll as the ship of LargeScene does. Draw culls the boats by the tiles the camera
+ * sees and by the frustum, sorts them by level of detail and draws each level with one instanced draw per mesh.
+ * DrawShadow draws the boats of a region of the shadow cascades at the coarsest level, in one instanced draw
+ */
+class Fleet {
+
+    private:
+        GLuint program_id_;             // GLSL shader program ID
+        GLuint MVP_id, MV_id, NORMALM_id, mirrorPass_id, deferredPass_id, translationToSceneCenter_id;
+        GLuint shadowTexture_id;
+
+        // the depth only, with the same instances
+        GLuint shadowProgram_id_;
+        GLuint SHADOWMVP_id;
+
+        Model* model = nullptr;
+        Light* light = nullptr;
+        ShadowCascades* shadowCascades = nullptr;
+        bool deferredPass = false;
+
+        // the boats, boat i is the entry i of every array. x and z are fixed in the world, the scene coordinates
+        // move with the band shifts
+        std::vector<float> x, z;
+        // about y in radians, the yacht points towards +z at 0
+        std::vector<float> heading;
+        // scene units per second, and the phase of the wander of the heading
+        std::vector<float> speed, wander;
+        // of the yacht
+        std::vector<float> scale;
+        std::vector<float> heave, pitch, roll;
+        // false while a boat is moved off the shore, until the water under it was checked
+        std::vector<char> afloat;
+
+        // bow, stern, starboard and port of every boat, the waves under them and the terrain below
+        static constexpr int HULL_POINTS = 4;
+        std::vector<float> hullX, hullZ, hullDx, hullDy, hullDz, hullTerrain;
+
+        std::mt19937 generator {11};
+        float lastUpdate = -1.0f;
+        double updateSeconds = 0.0;
+
+        // the boats stay in this square around the camera, in scene units from its center
+        const float halfExtent = 14.0f;
+        // in seconds, how slowly the boats follow the water under their hulls
+        const float inertia = 0.4f;
+        // the boats keep off the terrain above this height
+        const float shoreHeight = -0.05f;
+        // height of the yacht's waterline above its origin, as the ship of LargeScene
+        const float waterline = 0.035f;
+
+        // the middle of the yacht, and its length and beam
+        glm::vec3 modelMiddle;
+        float modelLength, modelBeam;
+
+        // level of detail i is drawn up to lodDistances[i] from the camera, none beyond the last one. The
+        // coarser levels merge the vertices of cells of these fractions of the yacht, see Model::buildLods
+        const std::vector<float> lodDistances = {4.0f, 10.0f, 24.0f};
+        const std::vector<float> lodCellFractions = {1.0f / 64.0f, 1.0f / 20.0f};
+
+        // the model matrices of a draw, grouped by level of detail
+        GLuint instancesVBO;
+        std::vector<std::vector<glm::mat4>> lodInstances;
+        std::vector<glm::mat4> instances;
+
+        int boatsLastDraw = 0;
+        int drawsLastDraw = 0;
+        size_t trianglesLastDraw = 0;
+
+    public:
+        /**
+         * boats: how many sail, model: the yacht they are drawn with, already initialized. It gets the levels of
+         * detail and reads the instances of the fleet. The rest as the arguments of Model::Init
+         */
+        void Init(int boats, Model* model, GLuint shadowTexture, int fogStop, int fogLength) {
+            this->model = model;
+            this->shadowTexture_id = shadowTexture;
+
+            program_id_ = icg_helper::LoadShaders("fleet_vshader.glsl",
+                                                  "yacht_fshader.glsl");
+            if(!program_id_) {
+                exit(EXIT_FAILURE);
+            }
+            glUseProgram(program_id_);
+            MVP_id = glGetUniformLocation(program_id_, "MVP");
+            MV_id = glGetUniformLocation(program_id_, "MV");
+            NORMALM_id = glGetUniformLocation(program_id_, "NORMALM");
+            mirrorPass_id = glGetUniformLocation(program_id_, "mirror_pass");
+            deferredPass_id = glGetUniformLocation(program_id_, "deferred_pass");
+            translationToSceneCenter_id = glGetUniformLocation(program_id_, "translationToSceneCenter");
+            glUniform1f(glGetUniformLocation(program_id_, "threshold_vpoint_World_F"), fogStop - fogLength);
+            glUniform1f(glGetUniformLocation(program_id_, "max_vpoint_World_F"), fogStop);
+            glUniform1i(glGetUniformLocation(program_id_, "shadowMap"), 7);
+
+            shadowProgram_id_ = icg_helper::LoadShaders("fleet_vshader_shadow.glsl",
+                                                        "model_fshader_shadow.glsl");
+            if(!shadowProgram_id_) {
+                exit(EXIT_FAILURE);
+            }
+            SHADOWMVP_id = glGetUniformLocation(shadowProgram_id_, "SHADOWMVP");
+            glUseProgram(0);
+
+            glm::vec3 bmin = model->getBoundsMin(), bmax = model->getBoundsMax();
+            modelMiddle = 0.5f * (bmin + bmax);
+            modelLength = bmax.z - bmin.z;
+            modelBeam = bmax.x - bmin.x;
+
+            glGenBuffers(1, &instancesVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, instancesVBO);
+            glBufferData(GL_ARRAY_BUFFER, boats * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            model->buildLods(lodCellFractions);
+            model->useInstances(instancesVBO);
+            lodInstances.resize(model->lods());
+            instances.reserve(boats);
+
+            x.resize(boats);
+            z.resize(boats);
+            heading.resize(boats);
+            speed.resize(boats);
+            wander.resize(boats);
+            scale.resize(boats);
+            heave.assign(boats, 0.0f);
+            pitch.assign(boats, 0.0f);
+            roll.assign(boats, 0.0f);
+            afloat.assign(boats, 0);
+            hullX.resize(HULL_POINTS * boats);
+            hullZ.resize(HULL_POINTS * boats);
+            hullDx.resize(HULL_POINTS * boats);
+            hullDy.resize(HULL_POINTS * boats);
+            hullDz.resize(HULL_POINTS * boats);
+            hullTerrain.resize(HULL_POINTS * boats);
+
+            std::uniform_real_distribution<float> angle(0.0f, 2.0f * float(M_PI));
+            std::uniform_real_distribution<float> speeds(0.15f, 0.45f), scales(0.35f, 0.8f);
+            for (int i = 0; i < boats; ++i) {
+                relocate(i, glm::vec2(0.0f));
+                heading[i] = angle(generator);
+                wander[i] = angle(generator);
+                speed[i] = speeds(generator);
+                scale[i] = scales(generator);
+            }
+        }
+
+        void useLight(Light* l) {
+            this->light = l;
+            light->registerProgram(program_id_);
+            glUseProgram(0);
+        }
+
+        void useShadowCascades(ShadowCascades* c) {
+            this->shadowCascades = c;
+            c->registerProgram(program_id_, 8 /*next to the shadow map*/);
+        }
+
+        /** the next draws write the G-buffer of the deferred path instead of lit colors */
+        void useDeferredPass(bool enabled) {
+            deferredPass = enabled;
+        }
+
+        /**
+         * sails the boats to the time, in seconds, and floats them on the waves. cameraPos: horizontal position
+         * of the camera in the scene, x and z, worldOffset: see LargeScene::worldOffset, waves: with the noise
+         * origin of this frame
+         */
+        void Update(float time, const glm::vec2 &cameraPos, const glm::vec3 &worldOffset, const WaveSampler &waves) {
+            double start = glfwGetTime();
+            float elapsed = lastUpdate < 0.0f ? 0.0f : std::min(time - lastUpdate, 0.1f);
+            lastUpdate = time;
+            const int boats = x.size();
+            const glm::vec2 cameraWorld = cameraPos + glm::vec2(worldOffset.x, worldOffset.z);
+
+            // sail, and wrap around the square that follows the camera
+            for (int i = 0; i < boats; ++i) {
+                heading[i] += 0.3f * std::sin(0.2f * time + wander[i]) * elapsed;
+                x[i] += std::sin(heading[i]) * speed[i] * elapsed;
+                z[i] += std::cos(heading[i]) * speed[i] * elapsed;
+                x[i] -= 2.0f * halfExtent * std::floor((x[i] - cameraWorld.x + halfExtent) / (2.0f * halfExtent));
+                z[i] -= 2.0f * halfExtent * std::floor((z[i] - cameraWorld.y + halfExtent) / (2.0f * halfExtent));
+            }
+
+            // the hull points in the scene, the boats rotate about their middle
+            for (int i = 0; i < boats; ++i) {
+                float s = std::sin(heading[i]), c = std::cos(heading[i]);
+                float halfLength = 0.5f * modelLength * scale[i], halfBeam = 0.5f * modelBeam * scale[i];
+                float middleX = x[i] - worldOffset.x, middleZ = z[i] - worldOffset.z;
+                float* px = &hullX[HULL_POINTS * i];
+                float* pz = &hullZ[HULL_POINTS * i];
+                px[0] = middleX + s * halfLength;  pz[0] = middleZ + c * halfLength;
+                px[1] = middleX - s * halfLength;  pz[1] = middleZ - c * halfLength;
+                px[2] = middleX + c * halfBeam;    pz[2] = middleZ - s * halfBeam;
+                px[3] = middleX - c * halfBeam;    pz[3] = middleZ + s * halfBeam;
+            }
+            const int points = HULL_POINTS * boats;
+            waves.evaluate(points, &hullX[0], &hullZ[0], &hullDx[0], &hullDy[0], &hullDz[0]);
+            waves.evaluateTerrain(points, &hullX[0], &hullZ[0], &hullTerrain[0]);
+
+            // the planes through the water under the hulls, as LargeScene::hullMotion
+            float follow = 1.0f - std::exp(-elapsed / inertia);
+            for (int i = 0; i < boats; ++i) {
+                const float* dy = &hullDy[HULL_POINTS * i];
+                float targetHeave = 0.25f * (dy[0] + dy[1] + dy[2] + dy[3]);
+                float targetPitch = -std::atan((dy[0] - dy[1]) / (modelLength * scale[i]));
+                float targetRoll = std::atan((dy[2] - dy[3]) / (modelBeam * scale[i]));
+                heave[i] += (targetHeave - heave[i]) * follow;
+                pitch[i] += (targetPitch - pitch[i]) * follow;
+                roll[i] += (targetRoll - roll[i]) * follow;
+            }
+
+            // a bow over the shallows turns back, a boat already aground moves somewhere else
+            if (waves.isReady()) {
+                for (int i = 0; i < boats; ++i) {
+                    const float* terrain = &hullTerrain[HULL_POINTS * i];
+                    afloat[i] = terrain[1] < shoreHeight && terrain[2] < shoreHeight && terrain[3] < shoreHeight;
+                    if (!afloat[i]) {
+                        relocate(i, cameraWorld);
+                    } else if (terrain[0] >= shoreHeight) {
+                        heading[i] += float(M_PI);
+                    }
+                }
+            }
+            updateSeconds = glfwGetTime() - start;
+        }
+
+        /**
+         * draws the boats whose middle lies on a visible tile, onVisibleTile(p) tells for the scene position p,
+         * and that intersect the frustum of MVP. The reflection draws them with the mirrored matrices, one level
+         * of detail coarser. translationToSceneCenter: from the scene to the center of the fog
+         */
+        template <class TileVisibility>
+        void Draw(const glm::mat4 &MVP,
+                  const glm::mat4 &MV,
+                  const glm::mat4 &NORMALM,
+                  const glm::vec3 &worldOffset,
+                  const glm::vec2 &translationToSceneCenter,
+                  bool mirrorPass,
+                  const TileVisibility &onVisibleTile) {
+            boatsLastDraw = 0;
+            drawsLastDraw = 0;
+            trianglesLastDraw = 0;
+
+            // the planes of the frustum, normalized to test the spheres around the boats
+            glm::vec4 planes[6];
+            frustumPlanes(MVP, planes);
+            glm::vec3 cameraPos = glm::vec3(glm::inverse(MV)[3]);
+
+            for (std::vector<glm::mat4>& lod : lodInstances) {
+                lod.clear();
+            }
+            const int lods = lodInstances.size();
+            for (size_t i = 0; i < x.size(); ++i) {
+                glm::vec3 middle(x[i] - worldOffset.x, heave[i], z[i] - worldOffset.z);
+                float distance = glm::length(middle - cameraPos);
+                if (!afloat[i] || distance >= lodDistances.back() || !onVisibleTile(middle)) {
+                    continue;
+                }
+                if (!insideFrustum(planes, middle, boatRadius(i))) {
+                    continue;
+                }
+                int lod = 0;
+                while (distance >= lodDistances[lod]) {
+                    ++lod;
+                }
+                lod = std::min(lod + (mirrorPass ? 1 : 0), lods - 1);
+                lodInstances[lod].push_back(boatMatrix(i, middle));
+            }
+
+            instances.clear();
+            for (const std::vector<glm::mat4>& lod : lodInstances) {
+                instances.insert(instances.end(), lod.begin(), lod.end());
+            }
+            if (instances.empty()) {
+                return;
+            }
+            // a new store per draw, the reflection's instances may still be read
+            glBindBuffer(GL_ARRAY_BUFFER, instancesVBO);
+            glBufferData(GL_ARRAY_BUFFER, x.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(glm::mat4), &instances[0]);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            glUseProgram(program_id_);
+            glUniformMatrix4fv(MVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(MVP));
+            glUniformMatrix4fv(MV_id, ONE, DONT_TRANSPOSE, glm::value_ptr(MV));
+            glUniformMatrix4fv(NORMALM_id, ONE, DONT_TRANSPOSE, glm::value_ptr(NORMALM));
+            glUniform2fv(translationToSceneCenter_id, 1, glm::value_ptr(translationToSceneCenter));
+            glUniform1i(mirrorPass_id, mirrorPass);
+            glUniform1i(deferredPass_id, deferredPass && !mirrorPass);
+            if (light != nullptr) {
+                light->updateProgram(program_id_);
+            }
+            // the instances are placed in the scene, the cascades need no model matrix
+            if (shadowCascades != nullptr) {
+                shadowCascades->updateProgram(program_id_);
+            }
+            glActiveTexture(GL_TEXTURE0 + 7);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTexture_id);
+
+            GLintptr offset = 0;
+            for (int lod = 0; lod < lods; ++lod) {
+                GLsizei count = lodInstances[lod].size();
+                if (count > 0) {
+                    model->DrawInstanced(program_id_, lod, offset, count);
+                    boatsLastDraw += count;
+                    drawsLastDraw++;
+                    trianglesLastDraw += size_t(model->triangles(lod)) * count;
+                }
+                offset += count * sizeof(glm::mat4);
+            }
+
+            glActiveTexture(GL_TEXTURE0 + 7);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            glActiveTexture(GL_TEXTURE0);
+            glUseProgram(0);
+        }
+
+        /**
+         * draws the depth of the boats that intersect the region of the shadow cascades of SHADOWMVP, at the
+         * coarsest level of detail. worldOffset: see LargeScene::worldOffset
+         */
+        void DrawShadow(const glm::mat4 &SHADOWMVP, const glm::vec3 &worldOffset) {
+            glm::vec4 planes[6];
+            frustumPlanes(SHADOWMVP, planes);
+
+            instances.clear();
+            for (size_t i = 0; i < x.size(); ++i) {
+                glm::vec3 middle(x[i] - worldOffset.x, heave[i], z[i] - worldOffset.z);
+                if (afloat[i] && insideFrustum(planes, middle, boatRadius(i))) {
+                    instances.push_back(boatMatrix(i, middle));
+                }
+            }
+            if (instances.empty()) {
+                return;
+            }
+            // a new store per region, the previous region's instances may still be read
+            glBindBuffer(GL_ARRAY_BUFFER, instancesVBO);
+            glBufferData(GL_ARRAY_BUFFER, x.size() * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(glm::mat4), &instances[0]);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            glUseProgram(shadowProgram_id_);
+            glUniformMatrix4fv(SHADOWMVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(SHADOWMVP));
+            model->DrawInstanced(shadowProgram_id_, lodInstances.size() - 1, 0, instances.size());
+            glActiveTexture(GL_TEXTURE0);
+            glUseProgram(0);
+        }
+
+        /**
+         * the box of the scene holding the boats afloat, false when there is none. worldOffset: see
+         * LargeScene::worldOffset
+         */
+        bool getBounds(const glm::vec3 &worldOffset, glm::vec3 &bmin, glm::vec3 &bmax) const {
+            bmin = glm::vec3(FLT_MAX);
+            bmax = glm::vec3(-FLT_MAX);
+            for (size_t i = 0; i < x.size(); ++i) {
+                if (afloat[i]) {
+                    glm::vec3 middle(x[i] - worldOffset.x, heave[i], z[i] - worldOffset.z);
+                    bmin = glm::min(bmin, middle - boatRadius(i));
+                    bmax = glm::max(bmax, middle + boatRadius(i));
+                }
+            }
+            return bmin.x <= bmax.x;
+        }
+
+        int boats() const {
+            return x.size();
+        }
+
+        /** boats, levels of detail drawn and triangles of the last Draw */
+        int getBoatsLastDraw() const {
+            return boatsLastDraw;
+        }
+
+        int getDrawsLastDraw() const {
+            return drawsLastDraw;
+        }
+
+        size_t getTrianglesLastDraw() const {
+            return trianglesLastDraw;
+        }
+
+        /** in seconds, the CPU time of the last Update */
+        double getUpdateSeconds() const {
+            return updateSeconds;
+        }
+
+        void Cleanup() {
+            glBindVertexArray(0);
+            glUseProgram(0);
+            glDeleteBuffers(1, &instancesVBO);
+            glDeleteProgram(program_id_);
+            glDeleteProgram(shadowProgram_id_);
+        }
+
+    private:
+        /** moves the boat to a random place of the square around the point of the world, hidden until checked */
+        void relocate(int i, const glm::vec2 &around) {
+            std::uniform_real_distribution<float> inSquare(-halfExtent, halfExtent);
+            x[i] = around.x + inSquare(generator);
+            z[i] = around.y + inSquare(generator);
+            afloat[i] = 0;
+        }
+
+        /** the radius of the sphere around the middle of the boat holding it */
+        float boatRadius(size_t i) const {
+            return 0.5f * glm::length(model->getBoundsMax() - model->getBoundsMin()) * scale[i];
+        }
+
+        /** the planes of the frustum of MVP, normalized to test spheres */
+        static void frustumPlanes(const glm::mat4 &MVP, glm::vec4 planes[6]) {
+            for (int axis = 0; axis < 3; ++axis) {
+                glm::vec4 row(MVP[0][axis], MVP[1][axis], MVP[2][axis], MVP[3][axis]);
+                glm::vec4 w(MVP[0][3], MVP[1][3], MVP[2][3], MVP[3][3]);
+                planes[2 * axis] = w + row;
+                planes[2 * axis + 1] = w - row;
+            }
+            for (int plane = 0; plane < 6; ++plane) {
+                planes[plane] /= glm::length(glm::vec3(planes[plane]));
+            }
+        }
+
+        static bool insideFrustum(const glm::vec4 planes[6], const glm::vec3 &center, float radius) {
+            for (int plane = 0; plane < 6; ++plane) {
+                if (glm::dot(planes[plane], glm::vec4(center, 1.0f)) <= -radius) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /** the yacht scaled, rotated about its middle as the ship of LargeScene and floated at middle */
+        glm::mat4 boatMatrix(size_t i, const glm::vec3 &middle) const {
+            glm::mat4 boat = glm::translate(IDENTITY_MATRIX, middle + glm::vec3(0.0f, waterline * scale[i], 0.0f));
+            boat = glm::rotate(boat, heading[i], glm::vec3(0.0f, 1.0f, 0.0f));
+            boat = glm::rotate(boat, pitch[i], glm::vec3(1.0f, 0.0f, 0.0f));
+            boat = glm::rotate(boat, roll[i], glm::vec3(0.0f, 0.0f, 1.0f));
+            boat = glm::scale(boat, glm::vec3(scale[i]));
+            return glm::translate(boat, -glm::vec3(modelMiddle.x, 0.0f, modelMiddle.z));
+        }
+};
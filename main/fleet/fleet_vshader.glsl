@@ -0,0 +1,44 @@
+#version 410 core
+// the boats of the fleet: the yacht meshes, placed in the scene by a model matrix per instance, lit by
+// yacht_fshader.glsl with the scene matrices instead of the model ones
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 texCoords;
+layout (location = 3) in mat4 boatModel;
+
+uniform mat4 MVP;
+uniform mat4 MV;
+uniform mat4 NORMALM;
+uniform vec2 translationToSceneCenter;
+// the cached models quantize the positions over the bounds of each mesh, see modelcache.h
+uniform vec3 positionScale = vec3(1.0f);
+uniform vec3 positionOffset = vec3(0.0f);
+
+out vec2 uv_F;
+out vec2 TexCoords;
+out vec3 normal_MV_F;
+out vec3 viewDir_MV_F;
+// in the scene, the shadow cascades are given no model matrix
+out vec3 vpoint_F;
+out vec3 vpoint_MV_F;
+out vec2 vpoint_World_F;
+
+
+void main()
+{
+    vec4 vpoint = boatModel * vec4(positionOffset + positionScale * position, 1.0);
+    vpoint_F = vpoint.xyz;
+    vec4 vpoint_MV = MV * vpoint;
+    vpoint_MV_F = vpoint_MV.xyz;
+    // rotated and uniformly scaled, the normal matrix of the boat is its own upper part
+    vec3 normal_scene = mat3(boatModel) * normal;
+    normal_MV_F = normalize((NORMALM * vec4(normal_scene, 0.0f)).xyz);
+    viewDir_MV_F = -normalize(vpoint_MV.xyz);
+
+    gl_Position = MVP * vpoint;
+
+    vpoint_World_F = translationToSceneCenter + vec2(vpoint.x, -vpoint.z);
+
+    uv_F = texCoords;
+    TexCoords = texCoords;
+}
@@ -0,0 +1,14 @@
+#version 410 core
+// the depth of the boats of the fleet into the shadow cascades, placed as in fleet_vshader.glsl
+layout (location = 0) in vec3 position;
+layout (location = 3) in mat4 boatModel;
+
+uniform mat4 SHADOWMVP;
+// the cached models quantize the positions over the bounds of each mesh, see modelcache.h
+uniform vec3 positionScale = vec3(1.0f);
+uniform vec3 positionOffset = vec3(0.0f);
+
+void main()
+{
+    gl_Position = SHADOWMVP * boatModel * vec4(positionOffset + positionScale * position, 1.0f);
+}
@@ -0,0 +1,31 @@
+#version 410 core
+in vec2 uv;
+uniform sampler2D depthTex;
+uniform sampler2D skyTex;
+uniform mat4 inverseVP;
+uniform vec2 center;
+uniform float threshold_vpoint_World;
+uniform float max_vpoint_World;
+
+layout (location = 0) out vec4 color;
+
+void main() {
+
+    float depth = texture(depthTex, uv).r;
+
+    // nothing was drawn: only the sky is visible
+    float fadingValue = 1.0f;
+
+    if(depth < 1.0f){
+        vec4 vpoint = inverseVP * vec4(vec3(uv, depth) * 2.0f - 1.0f, 1.0f);
+        vpoint /= vpoint.w;
+
+        // tiles map their vertices with vpoint = (x, h, -y), vpoint_World is relative to the scene center
+        vec2 vpoint_World = vec2(vpoint.x, -vpoint.z) - center;
+        fadingValue = smoothstep(threshold_vpoint_World, max_vpoint_World,
+                                 max(abs(vpoint_World.x), abs(vpoint_World.y)));
+    }
+
+    vec3 sky = texture(skyTex, uv).rgb;
+    color = vec4(sky, fadingValue);
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "../screenquad/fullscreenquad.h"
+
+/**
+ * @brief The FogQuad class fades the scene into the sky at the edge of the LargeScene.
+ * It is drawn over the opaque scene with alpha blending: the fading value is recomputed per pixel
+ * from the depth buffer, using the same distance to the scene center as the tiles did.
+ */
+class FogQuad {
+
+    private:
+        FullScreenQuad quad;
+        GLuint program_id_;             // GLSL shader program ID
+        GLuint depthTexture_id_;
+        GLuint skyTexture_id_;
+        GLuint inverseVP_id, center_id;
+
+    public:
+        void Init(GLuint depthTexture, GLuint skyTexture, int fogStop, int fogLength) {
+
+            // compile the shaders
+            program_id_ = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                  "fog_fshader.glsl");
+            if(!program_id_) {
+                exit(EXIT_FAILURE);
+            }
+
+            glUseProgram(program_id_);
+
+            quad.registerProgram(program_id_);
+
+            // load/Assign textures
+            this->depthTexture_id_ = depthTexture;
+            glUniform1i(glGetUniformLocation(program_id_, "depthTex"), 0 /*GL_TEXTURE0*/);
+            this->skyTexture_id_ = skyTexture;
+            glUniform1i(glGetUniformLocation(program_id_, "skyTex"), 1 /*GL_TEXTURE1*/);
+
+            glUniform1f(glGetUniformLocation(program_id_, "threshold_vpoint_World"), fogStop - fogLength);
+            glUniform1f(glGetUniformLocation(program_id_, "max_vpoint_World"), fogStop);
+
+            inverseVP_id = glGetUniformLocation(program_id_, "inverseVP");
+            center_id = glGetUniformLocation(program_id_, "center");
+
+            // to avoid the current object being polluted
+            glUseProgram(0);
+        }
+
+        void updateSkyTextureId(GLuint tid){
+            this->skyTexture_id_ = tid;
+        }
+
+        void Cleanup() {
+            glUseProgram(0);
+            quad.Cleanup();
+            glDeleteProgram(program_id_);
+        }
+
+        /** VP: the view projection the depth buffer was rendered with, center: the LargeScene center */
+        void Draw(const glm::mat4 &VP, const glm::vec2 &center) {
+            glUseProgram(program_id_);
+            quad.Bind(program_id_);
+
+            glm::mat4 inverseVP = glm::inverse(VP);
+            glUniformMatrix4fv(inverseVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(inverseVP));
+            glUniform2fv(center_id, 1, glm::value_ptr(center));
+
+            // bind textures
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, depthTexture_id_);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, skyTexture_id_);
+
+            glDisable(GL_DEPTH_TEST);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+            // draw
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            quad.Draw();
+
+            glEnable(GL_DEPTH_TEST);
+
+            glBindVertexArray(0);
+            glUseProgram(0);
+        }
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "icg_helper.h"
+#include <cmath>
 
 class FrameBuffer {
 
@@ -16,6 +17,27 @@ public:
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 
+    /** copies the first color attachment into the rectangle [x0, x1[ x [y0, y1[ of the target's, filtered */
+    void BlitColorTo(FrameBuffer& target, int x0, int y0, int x1, int y1) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebufferObjectId);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target.framebufferObjectId);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glBlitFramebuffer(0, 0, width, height, x0, y0, x1, y1, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    /**
+     * reads the rectangle of the first color attachment at (x, y), into pixels or, when a pixel pack buffer is
+     * bound, at the offset pixels of the buffer without waiting for the GPU
+     */
+    void ReadColor(int x, int y, int w, int h, GLenum format, GLenum type, void* pixels) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebufferObjectId);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glReadPixels(x, y, w, h, format, type, pixels);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
     void checkFrameBufferStatus(){
         switch(glCheckFramebufferStatus(GL_FRAMEBUFFER)){
         case GL_FRAMEBUFFER_COMPLETE:
@@ -114,23 +136,413 @@ public:
     }
 };
 
+/**
+ * @brief The DepthArrayFBO class renders depth into the layers of a texture array,
+ * one layer at a time, e.g. one per shadow cascade.
+ */
+class DepthArrayFBO: public FrameBuffer{
+
+private:
+    GLuint depthTextureId;
+    int layers;
+
+public:
+    int Init(int imageWidth, int imageHeight, int layers,
+             GLint internalFormat, GLint type){
+        this->width = imageWidth;
+        this->height = imageHeight;
+        this->layers = layers;
+
+        // create the depth attachments
+        {
+            glGenTextures(1, &depthTextureId);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, depthTextureId);
+
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LESS);
+
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, layers, 0,
+                         GL_DEPTH_COMPONENT, type, NULL);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+
+        // tie it all together
+        {
+            glGenFramebuffers(1, &framebufferObjectId);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                      depthTextureId, 0, 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+
+            this->checkFrameBufferStatus();
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0); // avoid pollution
+        }
+
+        return depthTextureId;
+    }
+
+    void Bind(){
+        BindLayer(0);
+    }
+
+    /** the next draws write the depth of the given layer only */
+    void BindLayer(int layer){
+        glViewport(0, 0, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                  depthTextureId, 0, layer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+
+    int getSize() const {
+        return width;
+    }
+
+    int getLayers() const {
+        return layers;
+    }
+
+    void Cleanup(){
+        glDeleteTextures(1, &depthTextureId);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
+        glDeleteFramebuffers(1, &framebufferObjectId);
+    }
+};
+
+/**
+ * @brief The ColorArrayFBO class renders color into the layers of a mipmapped texture array,
+ * one layer and one level at a time, so that the coarser levels of a single layer can be rebuilt.
+ */
+class ColorArrayFBO: public FrameBuffer{
+
+private:
+    GLuint colorTextureId;
+    int layers;
+    int levels;
+
+public:
+    int Init(int imageWidth, int imageHeight, int layers,
+             GLint internalFormat, GLint format, GLint type){
+        this->width = imageWidth;
+        this->height = imageHeight;
+        this->layers = layers;
+        this->levels = 1 + int(std::floor(std::log2(std::max(imageWidth, imageHeight))));
+
+        // create the color attachments
+        {
+            glGenTextures(1, &colorTextureId);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, colorTextureId);
+
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+            for (int level = 0; level < levels; ++level) {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat,
+                             std::max(1, width >> level), std::max(1, height >> level), layers, 0,
+                             format, type, NULL);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+
+        // tie it all together
+        {
+            glGenFramebuffers(1, &framebufferObjectId);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                      colorTextureId, 0, 0);
+
+            this->checkFrameBufferStatus();
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0); // avoid pollution
+        }
+
+        return colorTextureId;
+    }
+
+    void Bind(){
+        BindLayer(0);
+    }
+
+    /** the next draws write the color of the given layer only, at the given level */
+    void BindLayer(int layer, int level = 0){
+        glViewport(0, 0, std::max(1, width >> level), std::max(1, height >> level));
+        glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                  colorTextureId, level, layer);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    /** the samplers see the given level only, so that the next level can be rendered from it without a feedback loop */
+    void RestrictToLevel(int level){
+        glBindTexture(GL_TEXTURE_2D_ARRAY, colorTextureId);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, level);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    /** the samplers see every level again */
+    void RestoreLevels(){
+        glBindTexture(GL_TEXTURE_2D_ARRAY, colorTextureId);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    int getLevels() const {
+        return levels;
+    }
+
+    void Cleanup(){
+        glDeleteTextures(1, &colorTextureId);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
+        glDeleteFramebuffers(1, &framebufferObjectId);
+    }
+};
+
+class ColorMipFBO: public FrameBuffer{
+
+private:
+    GLuint colorTextureId;
+    GLint internalFormat, format, type;
+    int levels;
+
+    void allocate(){
+        this->levels = 1 + int(std::floor(std::log2(std::max(width, height))));
+        glBindTexture(GL_TEXTURE_2D, colorTextureId);
+        for (int level = 0; level < levels; ++level) {
+            glTexImage2D(GL_TEXTURE_2D, level, internalFormat, getLevelWidth(level), getLevelHeight(level), 0,
+                         format, type, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+public:
+    /**
+     * a full mip chain, every level can be rendered to. useInterpolation: bilinear within a level,
+     * repeat: the texture tiles, e.g. it is filled by a periodic simulation
+     */
+    int Init(int imageWidth, int imageHeight,
+             GLint internalFormat, GLint format, GLint type, bool useInterpolation = false, bool repeat = false){
+        this->width = imageWidth;
+        this->height = imageHeight;
+        this->internalFormat = internalFormat;
+        this->format = format;
+        this->type = type;
+
+        // create the color attachment
+        {
+            glGenTextures(1, &colorTextureId);
+            glBindTexture(GL_TEXTURE_2D, colorTextureId);
+
+            if(useInterpolation){
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            } else {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+            allocate();
+        }
+
+        // tie it all together
+        {
+            glGenFramebuffers(1, &framebufferObjectId);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, colorTextureId, 0 /*level*/);
+
+            this->checkFrameBufferStatus();
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0); // avoid pollution
+        }
+
+        return colorTextureId;
+    }
+
+    void Bind(){
+        BindLevel(0);
+    }
+
+    /** the next draws write the given level only */
+    void BindLevel(int level){
+        glViewport(0, 0, getLevelWidth(level), getLevelHeight(level));
+        glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, colorTextureId, level);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    /** the samplers see the given level only, so that the next level can be rendered from it without a feedback loop */
+    void RestrictToLevel(int level){
+        glBindTexture(GL_TEXTURE_2D, colorTextureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    /** the coarser levels filtered from the first one, when they are not rendered one by one */
+    void GenerateMipmaps(){
+        glBindTexture(GL_TEXTURE_2D, colorTextureId);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    /** the samplers see every level again */
+    void RestoreLevels(){
+        glBindTexture(GL_TEXTURE_2D, colorTextureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    GLuint id() {
+        return colorTextureId;
+    }
+
+    int getLevels() const {
+        return levels;
+    }
+
+    int getLevelWidth(int level) const {
+        return std::max(1, width >> level);
+    }
+
+    int getLevelHeight(int level) const {
+        return std::max(1, height >> level);
+    }
+
+    // re-allocates the chain in place, texture id stays valid
+    void Resize(int imageWidth, int imageHeight){
+        this->width = imageWidth;
+        this->height = imageHeight;
+        allocate();
+    }
+
+    void Cleanup() {
+        glDeleteTextures(1, &colorTextureId);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
+        glDeleteFramebuffers(1, &framebufferObjectId);
+    }
+};
+
+/**
+ * @brief The ColorCubeFBO class renders color into the faces of a cube map, one face at a time.
+ */
+class ColorCubeFBO: public FrameBuffer{
+
+private:
+    GLuint colorTextureId;
+
+public:
+    /** size: side of every face */
+    int Init(int size, GLint internalFormat, GLint format, GLint type){
+        this->width = size;
+        this->height = size;
+
+        // create the color attachment
+        {
+            glGenTextures(1, &colorTextureId);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, colorTextureId);
+
+            for (int face = 0; face < 6; ++face) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, internalFormat, size, size, 0,
+                             format, type, NULL);
+            }
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        }
+
+        // tie it all together
+        {
+            glGenFramebuffers(1, &framebufferObjectId);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_CUBE_MAP_POSITIVE_X, colorTextureId, 0 /*level*/);
+
+            this->checkFrameBufferStatus();
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0); // avoid pollution
+        }
+
+        return colorTextureId;
+    }
+
+    void Bind(){
+        BindFace(0);
+    }
+
+    /** face: 0 to 5, in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X and following */
+    void BindFace(int face){
+        glViewport(0, 0, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, colorTextureId, 0);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    GLuint id() {
+        return colorTextureId;
+    }
+
+    int getSize() const {
+        return width;
+    }
+
+    void Cleanup() {
+        glDeleteTextures(1, &colorTextureId);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
+        glDeleteFramebuffers(1, &framebufferObjectId);
+    }
+};
+
 class ColorFBO: public FrameBuffer{
 
 private:
     GLuint colorTextureId;
+    GLint internalFormat, format, type;
 public:
+    /** repeat: the texture tiles instead of clamping to its edges */
     int Init(int imageWidth, int imageHeight,
-             GLint internalFormat, GLint format, GLint type, bool useInterpolation){
+             GLint internalFormat, GLint format, GLint type, bool useInterpolation, bool repeat = false){
         this->width = imageWidth;
         this->height = imageHeight;
+        this->internalFormat = internalFormat;
+        this->format = format;
+        this->type = type;
 
         // create color attachment
         {
             glGenTextures(1, &colorTextureId);
             glBindTexture(GL_TEXTURE_2D, colorTextureId);
 
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
 
             if(useInterpolation){
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -167,6 +579,16 @@ public:
         return colorTextureId;
     }
 
+    // re-allocates the storage in place, texture id stays valid
+    void Resize(int imageWidth, int imageHeight){
+        this->width = imageWidth;
+        this->height = imageHeight;
+        glBindTexture(GL_TEXTURE_2D, colorTextureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+                     format, type, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
     void Bind(){
         glViewport(0, 0, width, height);
         glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
@@ -186,6 +608,7 @@ class ColorAndDepthFBO: public FrameBuffer{
 private:
     GLuint colorTextureId;
     GLuint depthRenderBufferId;
+    GLint internalFormat, format, type;
 
 public:
     virtual void Bind() {
@@ -199,6 +622,9 @@ public:
              GLint internalFormat, GLint format, GLint type, bool useInterpolation = false, bool mirrorRepeat = false) {
         this->width = imageWidth;
         this->height = imageHeight;
+        this->internalFormat = internalFormat;
+        this->format = format;
+        this->type = type;
 
         // create color attachment
         {
@@ -257,6 +683,29 @@ public:
         return colorTextureId;
     }
 
+    int getWidth(){
+        return width;
+    }
+
+    int getHeight(){
+        return height;
+    }
+
+    // re-allocates the attachments in place, texture ids stay valid
+    void Resize(int imageWidth, int imageHeight){
+        this->width = imageWidth;
+        this->height = imageHeight;
+
+        glBindTexture(GL_TEXTURE_2D, colorTextureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+                     format, type, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderBufferId);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    }
+
     void Cleanup() {
         glDeleteTextures(1, &colorTextureId);
         glDeleteRenderbuffers(1, &depthRenderBufferId);
@@ -265,31 +714,48 @@ public:
     }
 };
 
-class DoubleColorAndDepthFBO: public FrameBuffer{
+/**
+ * @brief The HDRColorAndDepthFBO class holds the HDR scene: one color attachment and a depth texture
+ * that the fog, the deferred lighting and the screen-space reflection can sample.
+ * The bloom is extracted from the color afterwards, the geometry passes write a single target.
+ */
+class HDRColorAndDepthFBO: public FrameBuffer{
 
 private:
-    GLuint colorTexturesIds[2];
-    GLuint depthRenderBufferId;
+    GLuint colorTextureId;
+    GLuint depthTextureId;
+    // same color attachment without the depth, so full-screen passes can sample the depth
+    GLuint colorOnlyFramebufferObjectId;
+    GLint internalFormat, format, type;
 
 public:
     virtual void Bind() {
         glViewport(0, 0, width, height);
         glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
-        GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-        glDrawBuffers(2, attachments);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+    }
+
+    /** binds the color attachment only, the depth texture can then be sampled without a feedback loop */
+    void BindColorOnly() {
+        glViewport(0, 0, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, colorOnlyFramebufferObjectId);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
     }
 
     int Init(int imageWidth, int imageHeight,
              GLint internalFormat, GLint format, GLint type, bool useInterpolation = false, bool mirrorRepeat = false) {
         this->width = imageWidth;
         this->height = imageHeight;
-
-        glGenTextures(2, colorTexturesIds);
+        this->internalFormat = internalFormat;
+        this->format = format;
+        this->type = type;
 
         // create color attachment
-        for(GLuint i = 0 ; i < 2; i++)
         {
-            glBindTexture(GL_TEXTURE_2D, colorTexturesIds[i]);
+            glGenTextures(1, &colorTextureId);
+            glBindTexture(GL_TEXTURE_2D, colorTextureId);
 
             if(mirrorRepeat){
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
@@ -311,12 +777,21 @@ public:
                          format, type, NULL);
         }
 
-        // create render buffer (for depth channel)
+        // create depth attachment (can be sampled), 24 bits so that world positions
+        // can be reconstructed at the fog distance
+        {
+            glGenTextures(1, &depthTextureId);
+            glBindTexture(GL_TEXTURE_2D, depthTextureId);
 
-        glGenRenderbuffers(1, &depthRenderBufferId);
-        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderBufferId);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT16, width, height);
-        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0,
+                         GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
 
 
         // tie it all together
@@ -324,32 +799,56 @@ public:
             glGenFramebuffers(1, &framebufferObjectId);
             glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
 
-            for(int i = 0; i < 2; i++){
-            glFramebufferTexture2D(GL_FRAMEBUFFER,
-                                   GL_COLOR_ATTACHMENT0 + i,
-                                   GL_TEXTURE_2D, colorTexturesIds[i],
-                                   0 /*level*/);
-            }
-            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                                      GL_RENDERBUFFER, depthRenderBufferId);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, colorTextureId, 0 /*level*/);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_TEXTURE_2D, depthTextureId, 0);
+
+            checkFrameBufferStatus();
+
+            glGenFramebuffers(1, &colorOnlyFramebufferObjectId);
+            glBindFramebuffer(GL_FRAMEBUFFER, colorOnlyFramebufferObjectId);
+
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, colorTextureId, 0 /*level*/);
 
             checkFrameBufferStatus();
 
             glBindFramebuffer(GL_FRAMEBUFFER, 0); // avoid pollution
         }
 
-        return colorTexturesIds[0];
+        return colorTextureId;
+    }
+
+    GLuint getColorTexture(){
+        return colorTextureId;
+    }
+
+    GLuint getDepthTexture(){
+        return depthTextureId;
     }
 
-    GLuint getColorTexture(int i){
-        return colorTexturesIds[i];
+    // re-allocates the attachments in place, texture ids stay valid
+    void Resize(int imageWidth, int imageHeight){
+        this->width = imageWidth;
+        this->height = imageHeight;
+
+        glBindTexture(GL_TEXTURE_2D, colorTextureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+                     format, type, NULL);
+
+        glBindTexture(GL_TEXTURE_2D, depthTextureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0,
+                     GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
 
     void Cleanup() {
-        glDeleteTextures(2, colorTexturesIds);
-        glDeleteRenderbuffers(1, &depthRenderBufferId);
+        glDeleteTextures(1, &colorTextureId);
+        glDeleteTextures(1, &depthTextureId);
         glBindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
         glDeleteFramebuffers(1, &framebufferObjectId);
+        glDeleteFramebuffers(1, &colorOnlyFramebufferObjectId);
     }
 };
 
@@ -462,3 +961,94 @@ public:
         glDeleteFramebuffers(1, &framebufferObjectId);
     }
 };
+
+/**
+ * G-buffer of the deferred path: albedo (alpha used to blend the water over the sea bed) and the
+ * view space octahedral normal, specular strength and material ID packed in RGB10_A2.
+ * The albedo is half float, the water stores its reflection of the HDR sky there.
+ * The depth attachment is borrowed, so that later forward passes and the fog test against it.
+ */
+class GBufferFBO: public FrameBuffer{
+
+private:
+    GLuint albedoTextureId;
+    GLuint normalTextureId;
+
+    void allocate(){
+        glBindTexture(GL_TEXTURE_2D, albedoTextureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0,
+                     GL_RGBA, GL_FLOAT, NULL);
+        glBindTexture(GL_TEXTURE_2D, normalTextureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB10_A2, width, height, 0,
+                     GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+public:
+    void Bind() {
+        glViewport(0, 0, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+        GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, attachments);
+    }
+
+    /** depthTexture: a depth texture of the same size, owned and resized by the caller */
+    void Init(int imageWidth, int imageHeight, GLuint depthTexture) {
+        this->width = imageWidth;
+        this->height = imageHeight;
+
+        GLuint textures[2];
+        glGenTextures(2, textures);
+        albedoTextureId = textures[0];
+        normalTextureId = textures[1];
+
+        // attributes are fetched per pixel, never interpolated
+        for(GLuint id : textures){
+            glBindTexture(GL_TEXTURE_2D, id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+        allocate();
+
+        // tie it all together
+        {
+            glGenFramebuffers(1, &framebufferObjectId);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebufferObjectId);
+
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, albedoTextureId, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                                   GL_TEXTURE_2D, normalTextureId, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_TEXTURE_2D, depthTexture, 0);
+
+            checkFrameBufferStatus();
+
+            glBindFramebuffer(GL_FRAMEBUFFER, 0); // avoid pollution
+        }
+    }
+
+    GLuint getAlbedoTexture(){
+        return albedoTextureId;
+    }
+
+    GLuint getNormalTexture(){
+        return normalTextureId;
+    }
+
+    // re-allocates the color attachments in place, the borrowed depth must be resized by its owner
+    void Resize(int imageWidth, int imageHeight){
+        this->width = imageWidth;
+        this->height = imageHeight;
+        allocate();
+    }
+
+    void Cleanup() {
+        glDeleteTextures(1, &albedoTextureId);
+        glDeleteTextures(1, &normalTextureId);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0 /*UNBIND*/);
+        glDeleteFramebuffers(1, &framebufferObjectId);
+    }
+};
@@ -1,4 +1,8 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
 #include "icg_helper.h"
 #include <glm/gtc/type_ptr.hpp>
 #include "../gridmesh.h"
@@ -10,16 +14,28 @@ using namespace glm;
 #define M_PI 3.14159265358979323846
 #endif
 
+struct GrassProgramIds {
+    GLuint program_id;
+    GLuint translation_id, VP_id, time_id, cameraPos_id, lodDistances_id, placedInstances_id;
+};
+
+/**
+ * @brief The Grass class draws the bushes of the tiles. The placement rules, the height of the terrain and the grass
+ * map, are evaluated once per tile by Place, which feeds the accepted bushes back into the slot of the tile in one
+ * instance buffer, and counts them with a query. The candidates are grouped by cell of the tile, so that Draw can
+ * cull the whole tile against the frustum and the LOD radius, then draw as many of the kept bushes of each cell as
+ * its distance to the camera needs: the vertices follow the screen coverage of the grass rather than the number of
+ * tiles, and few of them are thinned out by the vertex shader.
+ * DrawShadow casts the same bushes into the shadow cascades, see its LOD.
+ */
 class Grass: public GridMesh {
 
 private:
 
-    GLuint program_id_;             // GLSL shader program ID
+    GrassProgramIds programIds_;    // GLSL shader program and its uniforms
+    GrassProgramIds shadowProgramIds_;  // the same vertices, the alpha test only
     GLuint vertex_buffer_object_;   // memory buffer
     GLuint grassAlpha_id_;             // texture ID
-    GLuint translation_id_;
-    GLuint translationToSceneCenter_id_;
-    GLuint VP_id_;          // view, projection matrix ID
 
     GLuint quadVAO, quadVBO;
     GLuint rows = 40;
@@ -30,37 +46,69 @@ private:
     GLfloat bushScaleRatio = 0.08;
     GLfloat bushHeight = 2 * bushScaleRatio;
     GLuint translationsVBO;
-    GLuint time_id;
 
+    // feeds the accepted bushes back, the rasterization is discarded
+    GLuint placeProgram_id_;
+    GLuint placeVAO;
+
+    // the cells along each side of a tile, the candidates of the cell c are [cellFirst[c], cellFirst[c + 1])
+    static constexpr int CELLS_PER_SIDE = 2;
+    static constexpr int CELLS = CELLS_PER_SIDE * CELLS_PER_SIDE;
+    GLuint cellFirst[CELLS + 1];
+
+    // one slot of nBush instances per tile, the kept bushes of a cell start where its candidates do
+    // and their count comes back with the query of the cell
+    struct TilePlacement {
+        GLuint query[CELLS];
+        bool pending;
+        GLuint instances[CELLS];
+    };
+    std::vector<TilePlacement> tilePlacements;
+    // the tiles whose counts came back since the last takeResolvedTiles
+    std::vector<int> resolvedTiles;
+    GLuint instancesVBO;
+    static constexpr GLsizeiptr instanceSize = 3 * sizeof(GLfloat);
+
+    // distance to the camera beyond which no bush is drawn, the other LOD distances are fractions of it
+    GLfloat lodRadius = 10.0f;
+    // full bushes up to there, fewer and wider ones beyond
+    const GLfloat fullDensityFraction = 0.3f;
+    // the bushes turn into single quads facing the camera over this band
+    const GLfloat impostorStartFraction = 0.45f;
+    const GLfloat impostorEndFraction = 0.6f;
+    // how far the wind and the widest quads of a bush reach out of its tile
+    const GLfloat bushReach = 0.35f;
+    // the heights the placement keeps the bushes in, see grass_place_vshader.glsl
+    const GLfloat minBushHeight = 0.25f;
+    const GLfloat maxBushHeight = 0.5f;
+
+    // the bushes are opaque, the fragments below this alpha are discarded
+    const GLfloat alphaThreshold = 0.2f;
+
+    GLuint instancesLastFrame = 0;
+    GLuint tilesLastFrame = 0;
+    size_t verticesLastFrame = 0;
 
 public:
 
     Grass(){
 
     }
-    void Init(GLuint heightMap, GLuint grassMap) {
+    /** tiles: how many tiles the bushes are placed and cached for, see Place */
+    void Init(int tiles) {
         // compile the shaders
-        program_id_ = icg_helper::LoadShaders("grass_vshader.glsl",
-                                              "grass_fshader.glsl");
+        programIds_.program_id = icg_helper::LoadShaders("grass_vshader.glsl",
+                                                         "grass_fshader.glsl");
+        shadowProgramIds_.program_id = icg_helper::LoadShaders("grass_vshader.glsl",
+                                                               "grass_fshader_shadow.glsl");
 
-        if(!program_id_) {
+        if(!programIds_.program_id || !shadowProgramIds_.program_id) {
             exit(EXIT_FAILURE);
         }
 
-        glUseProgram(program_id_);
-
-        translation_id_ = glGetUniformLocation(program_id_, "translation");
-        VP_id_ = glGetUniformLocation(program_id_, "VP");
-
-        time_id = glGetUniformLocation(program_id_, "time");
-
-        translationToSceneCenter_id_ = glGetUniformLocation(program_id_, "translationToSceneCenter");
-        if (translationToSceneCenter_id_ == 0) {
-            cout << "Unable to init translationToSceneCenter_id_" << endl;
-            exit(EXIT_FAILURE);
-        }
-        glUniform1f(glGetUniformLocation(program_id_, "threshold_vpoint_World_F"), 2.0f);//fogStop - fogLength);
-        glUniform1f(glGetUniformLocation(program_id_, "max_vpoint_World_F"), 10.0f);//fogStop);
+        setupLocations(programIds_);
+        setupLocations(shadowProgramIds_);
+        glUseProgram(programIds_.program_id);
 
         // vertex coordinates and indices
         genGrid(2);
@@ -69,30 +117,41 @@ public:
         glGenVertexArrays(1, &quadVAO);
         glBindVertexArray(quadVAO);
 
-        srand(glfwGetTime()); // initialize random seed
+        // the same bushes on every run
+        std::mt19937 generator(1);
 
         GLfloat colWidth = 2.f/rows;
         GLfloat rowHeight = 2.f/rows;
         glm::vec3 originOffset = glm::vec3(-1, 0, -1);
+        std::uniform_real_distribution<GLfloat> randomOffset(-colWidth, colWidth);
 
+        std::vector<vec2> cells[CELLS];
         for (int iBush = 0; iBush < rows; ++iBush) {
             for (int jBush = 0; jBush < cols; ++jBush) {
-                GLfloat x_random_offset = (rand() % (GLint)(2 * colWidth * 100)) / 100.0f - colWidth;
-                GLfloat xBush = colWidth  * jBush + originOffset.x + x_random_offset;
-                GLfloat z_random_offset = (rand() % (GLint)(2 * colWidth * 100)) / 100.0f - colWidth;
-                GLfloat zBush = (rowHeight * iBush + originOffset.z + z_random_offset);
-
-                int curBushNumber = iBush + jBush * rows;
-
-                translations[curBushNumber] = vec2(xBush, zBush);
+                GLfloat xBush = colWidth  * jBush + originOffset.x + randomOffset(generator);
+                GLfloat zBush = (rowHeight * iBush + originOffset.z + randomOffset(generator));
+                cells[cellOf(vec2(xBush, zBush))].push_back(vec2(xBush, zBush));
             }
         }
 
+        // cell by cell, in random order inside each cell, the placement keeps it:
+        // any first bushes of a cell are spread over the whole cell
+        translations.clear();
+        for (int cell = 0; cell < CELLS; ++cell) {
+            std::shuffle(cells[cell].begin(), cells[cell].end(), generator);
+            cellFirst[cell] = translations.size();
+            translations.insert(translations.end(), cells[cell].begin(), cells[cell].end());
+        }
+        cellFirst[CELLS] = translations.size();
+
         // Instances translations Vertex Buffer Object
         glGenBuffers(1, &translationsVBO);
         glBindBuffer(GL_ARRAY_BUFFER, translationsVBO);
         glBufferData(GL_ARRAY_BUFFER, nBush * sizeof(vec2), &translations[0], GL_STATIC_DRAW);
 
+        initPlacement(tiles);
+        glUseProgram(programIds_.program_id);
+
         // Generate quad VAO
         float second_quad_angle = M_PI / 3;
         float third_quad_angle = 2 * M_PI / 3;
@@ -144,10 +203,10 @@ public:
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), (GLvoid*)0);
 
-        //generate translations instance data
-        glBindBuffer(GL_ARRAY_BUFFER, translationsVBO);
+        //the placed bushes instance data, Draw points it at the slot of the tile
+        glBindBuffer(GL_ARRAY_BUFFER, instancesVBO);
         glEnableVertexAttribArray(7);
-        glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+        glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, instanceSize, (GLvoid*)0);
         glVertexAttribDivisor(7, 1);
 
         // texture coordinates
@@ -183,8 +242,8 @@ public:
             glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_texture_coordinates),
                          vertex_texture_coordinates, GL_STATIC_DRAW);
 
-            // attribute
-            GLuint vertex_texture_coord_id = glGetAttribLocation(program_id_,
+            // attribute, at the same location in both programs
+            GLuint vertex_texture_coord_id = glGetAttribLocation(programIds_.program_id,
                                                                  "vtexcoord");
             glEnableVertexAttribArray(vertex_texture_coord_id);
             glVertexAttribPointer(vertex_texture_coord_id, 2, GL_FLOAT,
@@ -194,70 +253,364 @@ public:
 
         // load texture
         {
-            this->heightMapTexture_id_ = heightMap;
-            glUseProgram(program_id_);
-            glUniform1i(grassMapTexture_id_, 0);
+            grassAlpha_id_ = Utils::loadImageCoveragePreserving("grassAlpha.tga", alphaThreshold);
+            for (GLuint program_id : {programIds_.program_id, shadowProgramIds_.program_id}) {
+                glUseProgram(program_id);
+                glUniform1f(glGetUniformLocation(program_id, "alphaThreshold"), alphaThreshold);
+                int grass_id = glGetUniformLocation(program_id, "grassAlpha");
+                glUniform1i(grass_id, grass_tex_location);
+            }
+        }
 
-            this->grassMapTexture_id_ = grassMap;
-            glUseProgram(program_id_);
-            glUniform1i(grassMapTexture_id_, 4);
+        // to avoid the current object being polluted
+        glBindVertexArray(0);
+        glUseProgram(0);
+    }
 
-            grassAlpha_id_ = Utils::loadImage("grassAlpha.tga");
-            int grass_id = glGetUniformLocation(program_id_, "grassAlpha");
-            glUniform1i(grass_id, grass_tex_location);
+    /**
+     * evaluates the placement rules of every bush of the tile and caches the accepted ones until the next call
+     * for the tile. heightMap, grassMap: the maps of the tile, on the units Draw used to sample them
+     */
+    void Place(int tile, GLuint heightMap, GLuint grassMap) {
+        TilePlacement& placement = tilePlacements[tile];
+
+        glEnable(GL_RASTERIZER_DISCARD);
+        glUseProgram(placeProgram_id_);
+        glBindVertexArray(placeVAO);
+        glActiveTexture(GL_TEXTURE0 + 0);
+        glBindTexture(GL_TEXTURE_2D, heightMap);
+        glActiveTexture(GL_TEXTURE0 + 4);
+        glBindTexture(GL_TEXTURE_2D, grassMap);
+
+        for (int cell = 0; cell < CELLS; ++cell) {
+            GLuint candidates = cellFirst[cell + 1] - cellFirst[cell];
+            glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, instancesVBO,
+                              (tile * nBush + cellFirst[cell]) * instanceSize, candidates * instanceSize);
+            glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, placement.query[cell]);
+            glBeginTransformFeedback(GL_POINTS);
+            glDrawArrays(GL_POINTS, cellFirst[cell], candidates);
+            glEndTransformFeedback();
+            glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+            placement.instances[cell] = 0;
         }
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
 
-        // to avoid the current object being polluted
+        // the counts come back with a later Draw, the tile draws nothing until then
+        placement.pending = true;
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, 0);
         glBindVertexArray(0);
         glUseProgram(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+    }
+
+    /** bushes kept by the placement of every tile */
+    size_t placedInstances() const {
+        size_t placed = 0;
+        for (const TilePlacement& placement : tilePlacements) {
+            for (int cell = 0; cell < CELLS; ++cell) {
+                placed += placement.instances[cell];
+            }
+        }
+        return placed;
+    }
+
+    /** must be called once per frame before the draws, the counters restart */
+    void beginFrame() {
+        instancesLastFrame = 0;
+        tilesLastFrame = 0;
+        verticesLastFrame = 0;
+    }
+
+    /** distance to the camera beyond which no bush is drawn */
+    void setLodRadius(float radius) {
+        lodRadius = radius;
+    }
+
+    float getLodRadius() const {
+        return lodRadius;
+    }
+
+    /**
+     * distance to the center of the central tile beyond which no bush casts a shadow: the LOD radius from wherever
+     * the camera is in that tile
+     */
+    float getShadowRadius() const {
+        return lodRadius + std::sqrt(2.0f);
+    }
+
+    /** the box holding the bushes of the tile drawn at translation, whatever their LOD */
+    void getTileBounds(const vec2 &translation, vec3 &bmin, vec3 &bmax) const {
+        bmin = vec3(translation.x - 1.0f - bushReach, minBushHeight - 0.03f, -translation.y - 1.0f - bushReach);
+        bmax = vec3(translation.x + 1.0f + bushReach, maxBushHeight + bushHeight, -translation.y + 1.0f + bushReach);
+    }
+
+    /** checks the placements waiting for their counts, then returns the tiles that got theirs since the last call */
+    std::vector<int> takeResolvedTiles() {
+        for (int tile = 0; tile < int(tilePlacements.size()); ++tile) {
+            resolvePlacement(tile);
+        }
+        std::vector<int> tiles;
+        tiles.swap(resolvedTiles);
+        return tiles;
+    }
+
+    /** bushes and tiles drawn since beginFrame */
+    GLuint getInstancesLastFrame() const {
+        return instancesLastFrame;
+    }
+
+    GLuint getTilesLastFrame() const {
+        return tilesLastFrame;
+    }
+
+    size_t getVerticesLastFrame() const {
+        return verticesLastFrame;
+    }
+
+    /** bytes of video memory held by the placed bushes */
+    size_t memoryUsage() const {
+        return tilePlacements.size() * nBush * instanceSize;
     }
 
     void Cleanup() {
         glBindVertexArray(0);
         glUseProgram(0);
         glDeleteBuffers(1, &vertex_buffer_object_);
-        glDeleteProgram(program_id_);
+        glDeleteBuffers(1, &translationsVBO);
+        glDeleteBuffers(1, &instancesVBO);
+        for (TilePlacement& placement : tilePlacements) {
+            glDeleteQueries(CELLS, placement.query);
+        }
+        tilePlacements.clear();
+        glDeleteProgram(programIds_.program_id);
+        glDeleteProgram(shadowProgramIds_.program_id);
+        glDeleteProgram(placeProgram_id_);
         glDeleteVertexArrays(1, &quadVAO);
+        glDeleteVertexArrays(1, &placeVAO);
         glDeleteTextures(1, &grassAlpha_id_);
     }
 
-    void Draw(const mat4 &VP = IDENTITY_MATRIX,
+    /**
+     * draws the bushes placed for the tile as its distance to the camera needs, unless the tile is out of the
+     * frustum or beyond the LOD radius. cameraPos: horizontal position of the camera, x and z
+     */
+    void Draw(int tile,
+              const mat4 &VP = IDENTITY_MATRIX,
               const vec2 &translation = vec2(0.f, 0.f),
-              const vec2 &translationToSceneCenter = glm::vec2(0,0),
               const vec2 &cameraPos = vec2(0.f, 0.f)) {
-        glUseProgram(program_id_);
+        if (!resolvePlacement(tile) || !isVisible(VP, translation, cameraPos, lodRadius)) {
+            return;
+        }
 
+        //grass quads must be able to overlap: the alpha part of the texture is discarded, the rest is opaque
+        //and writes its depth, so that the bushes need neither blending nor sorting
+        //We want to see grass from any direction (from the back)
+        glDisable(GL_CULL_FACE);
 
-        // bind textures
-        bindHeightMapTexture();
-        bindGrassMapTexture();
+        size_t instances = 0, vertices = 0;
+        drawCells(programIds_, tile, VP, translation, glfwGetTime(), cameraPos, lodRadius, instances, vertices);
+        instancesLastFrame += instances;
+        verticesLastFrame += vertices;
+        if (instances > 0) {
+            tilesLastFrame++;
+        }
+
+        glEnable(GL_CULL_FACE);
+    }
+
+    /**
+     * draws the bushes placed for the tile into the shadow map of SHADOWMVP. The maps are cached while the camera
+     * moves: the bushes cast their shadows at rest, with the LOD of a camera at the center of the central tile
+     * out to getShadowRadius. Takes the cull face state of the caller
+     */
+    void DrawShadow(int tile, const mat4 &SHADOWMVP, const vec2 &translation) {
+        const vec2 center(0.0f, 0.0f);
+        if (!resolvePlacement(tile) || !isVisible(SHADOWMVP, translation, center, getShadowRadius())) {
+            return;
+        }
+        size_t instances = 0, vertices = 0;
+        drawCells(shadowProgramIds_, tile, SHADOWMVP, translation, 0.0f, center, getShadowRadius(),
+                  instances, vertices);
+    }
+
+private:
+    static void setupLocations(GrassProgramIds &ids) {
+        ids.translation_id = glGetUniformLocation(ids.program_id, "translation");
+        ids.VP_id = glGetUniformLocation(ids.program_id, "VP");
+        ids.time_id = glGetUniformLocation(ids.program_id, "time");
+        ids.cameraPos_id = glGetUniformLocation(ids.program_id, "cameraPos");
+        ids.lodDistances_id = glGetUniformLocation(ids.program_id, "lodDistances");
+        ids.placedInstances_id = glGetUniformLocation(ids.program_id, "placedInstances");
+    }
+
+    /** whether the counts of the placement of the tile came back, they are read once available */
+    bool resolvePlacement(int tile) {
+        TilePlacement& placement = tilePlacements[tile];
+        if (placement.pending) {
+            // the queries end in order, the last one is available once they all are
+            GLint available = 0;
+            glGetQueryObjectiv(placement.query[CELLS - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                return false;
+            }
+            for (int cell = 0; cell < CELLS; ++cell) {
+                glGetQueryObjectuiv(placement.query[cell], GL_QUERY_RESULT, &placement.instances[cell]);
+            }
+            placement.pending = false;
+            resolvedTiles.push_back(tile);
+        }
+        return true;
+    }
+
+    /**
+     * draws as many bushes of each cell of the tile as its distance to cameraPos needs, with the LOD of the radius.
+     * Adds the bushes and the vertices drawn to instances and vertices
+     */
+    void drawCells(const GrassProgramIds &ids, int tile, const mat4 &VP, const vec2 &translation, float time,
+                   const vec2 &cameraPos, float radius, size_t &instances, size_t &vertices) {
+        const TilePlacement& placement = tilePlacements[tile];
+        vec2 tileCenter(translation.x, -translation.y);
+
+        glUseProgram(ids.program_id);
 
         // setup MVP
-        glUniformMatrix4fv(VP_id_, ONE, DONT_TRANSPOSE, value_ptr(VP));
-        glUniform2fv(translation_id_, 1, value_ptr(translation));
-        glUniform2fv(translationToSceneCenter_id_, 1, value_ptr(translationToSceneCenter));
-        glUniform1f(time_id, glfwGetTime());
+        glUniformMatrix4fv(ids.VP_id, ONE, DONT_TRANSPOSE, value_ptr(VP));
+        glUniform2fv(ids.translation_id, 1, value_ptr(translation));
+        glUniform1f(ids.time_id, time);
+        glUniform2fv(ids.cameraPos_id, 1, value_ptr(cameraPos));
+        glUniform4f(ids.lodDistances_id, fullDensityFraction * radius, radius,
+                    impostorStartFraction * radius, impostorEndFraction * radius);
 
         glActiveTexture(GL_TEXTURE0 + grass_tex_location);
         glBindTexture(GL_TEXTURE_2D, grassAlpha_id_);
 
         glBindVertexArray(quadVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instancesVBO);
+
+        const float cellHalfSize = 1.0f / CELLS_PER_SIDE;
+        for (int cell = 0; cell < CELLS; ++cell) {
+            // the cell draws the bushes its closest point needs, the farther ones are thinned by the vertex shader
+            float closest = closestDistance(tileCenter + cellCenter(cell), cellHalfSize, cameraPos);
+            GLsizei count = closest < impostorEndFraction * radius ? 18 : 6;
+            GLsizei instanceCount = GLsizei(std::ceil(placement.instances[cell] * density(closest, radius)));
+            if (instanceCount == 0) {
+                continue;
+            }
+            instances += instanceCount;
+            vertices += size_t(count) * instanceCount;
 
-        //grass quads must be able to overlap
+            glUniform1f(ids.placedInstances_id, placement.instances[cell]);
+            glVertexAttribPointer(7, 3, GL_FLOAT, GL_FALSE, instanceSize,
+                                  (GLvoid*)((tile * nBush + cellFirst[cell]) * instanceSize));
 
-        //We don't want the alpha part of the texture to occlude other bushes or quads
-        //So we activate alpha blending
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glEnable(GL_BLEND);
-        //We want to see grass from any direction (from the back)
-        glDisable(GL_CULL_FACE);
+            //(3 quads of 3 triangles of 3 vertices = 3 quads of 6 vertices = 18 vertices)
+            //the first bushes kept by the placement in the cell, their first quad only when far
+            glDrawArraysInstanced(GL_TRIANGLES, 0, count, instanceCount);
+        }
 
-        //(3 quads of 3 triangles of 3 vertices = 3 quads of 6 vertices = 18 vertices)
-        glDrawArraysInstanced(GL_TRIANGLES, 0, 18, nBush); // nBush bushes of 18 vertices each
+        glActiveTexture(GL_TEXTURE0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        glUseProgram(0);
+    }
 
-        glEnable(GL_CULL_FACE);
+    void initPlacement(int tiles) {
+        placeProgram_id_ = icg_helper::LoadShaders("grass_place_vshader.glsl",
+                                                   "grass_place_fshader.glsl",
+                                                   NULL, NULL,
+                                                   "grass_place_gshader.glsl");
+        if(!placeProgram_id_) {
+            exit(EXIT_FAILURE);
+        }
+        // the captured outputs are only known at link time
+        const GLchar* feedback[] = {"bushInstance"};
+        glTransformFeedbackVaryings(placeProgram_id_, 1, feedback, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(placeProgram_id_);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(placeProgram_id_, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            cout << "Unable to link the grass placement with its feedback" << endl;
+            exit(EXIT_FAILURE);
+        }
 
+        glUseProgram(placeProgram_id_);
+        glUniform1i(glGetUniformLocation(placeProgram_id_, "heightMap"), 0);
+        glUniform1i(glGetUniformLocation(placeProgram_id_, "grassMap"), 4);
+
+        // every candidate bush is a point
+        glGenVertexArrays(1, &placeVAO);
+        glBindVertexArray(placeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, translationsVBO);
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
         glBindVertexArray(0);
-        glUseProgram(0);
+
+        glGenBuffers(1, &instancesVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, instancesVBO);
+        glBufferData(GL_ARRAY_BUFFER, tiles * nBush * instanceSize, NULL, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        tilePlacements.resize(tiles);
+        for (TilePlacement& placement : tilePlacements) {
+            glGenQueries(CELLS, placement.query);
+            placement.pending = false;
+            std::fill(placement.instances, placement.instances + CELLS, 0);
+        }
+    }
+
+    /** fraction of the bushes drawn at the distance to the camera with the LOD radius, as in grass_vshader.glsl */
+    float density(float distanceToCamera, float radius) const {
+        float fullDensity = fullDensityFraction * radius;
+        float t = glm::clamp((distanceToCamera - fullDensity) / (radius - fullDensity), 0.0f, 1.0f);
+        return 1.0f - t * t * (3.0f - 2.0f * t);
+    }
+
+    /** the cell of a candidate bush, from its translation in the tile */
+    static int cellOf(const vec2 &bladeTranslation) {
+        ivec2 cell = glm::clamp(ivec2(glm::floor((bladeTranslation + 1.0f) * 0.5f * float(CELLS_PER_SIDE))),
+                                ivec2(0), ivec2(CELLS_PER_SIDE - 1));
+        return cell.y * CELLS_PER_SIDE + cell.x;
+    }
+
+    /** the center of the cell, horizontally from the center of the tile */
+    static vec2 cellCenter(int cell) {
+        vec2 index(cell % CELLS_PER_SIDE, cell / CELLS_PER_SIDE);
+        return (index + 0.5f) * (2.0f / CELLS_PER_SIDE) - 1.0f;
+    }
+
+    /** horizontal distance from the camera to the closest bush a square of the tiles can hold, x and z */
+    float closestDistance(const vec2 &center, float halfSize, const vec2 &cameraPos) const {
+        vec2 outside = glm::max(glm::abs(cameraPos - center) - vec2(halfSize + bushReach), vec2(0.0f));
+        return glm::length(outside);
+    }
+
+    /** whether the tile drawn at translation is closer to the camera than radius and can overlap the frustum of VP */
+    bool isVisible(const mat4 &VP, const vec2 &translation, const vec2 &cameraPos, float radius) const {
+        if (closestDistance(vec2(translation.x, -translation.y), 1.0f, cameraPos) >= radius) {
+            return false;
+        }
+
+        // culled when all the corners of the bounds are outside the same clip plane
+        vec3 bmin, bmax;
+        getTileBounds(translation, bmin, bmax);
+        int outside[6] = {0, 0, 0, 0, 0, 0};
+        for (int k = 0; k < 8; ++k) {
+            vec4 p = VP * vec4((k & 1) ? bmax.x : bmin.x, (k & 2) ? bmax.y : bmin.y, (k & 4) ? bmax.z : bmin.z, 1.0f);
+            outside[0] += p.x < -p.w;
+            outside[1] += p.x > p.w;
+            outside[2] += p.y < -p.w;
+            outside[3] += p.y > p.w;
+            outside[4] += p.z < -p.w;
+            outside[5] += p.z > p.w;
+        }
+        for (int plane = 0; plane < 6; ++plane) {
+            if (outside[plane] == 8) {
+                return false;
+            }
+        }
+        return true;
     }
 };
@@ -1,16 +1,14 @@
 #version 410 core
 in vec2 uv;
-in vec2 vpoint_World_F;
 in vec3 lightDir;
 out vec4 color;
 
 uniform float time;
-uniform float max_vpoint_World_F;
-uniform float threshold_vpoint_World_F;
 uniform sampler2D grassAlpha;
+// the mip levels of grassAlpha keep the texels passing it as many as in the full image, see Utils
+uniform float alphaThreshold;
 //uniform vec3 La, Ld;
 
-const float alpha_threshold = 0.2;
 const float radius = 10.0f;
 const vec3 sunOrbitXAxis = vec3(1.0, 0.0, 0.0);
 const vec3 sunOrbitYAxis = vec3(0.0, 0.958, 0.287);
@@ -26,7 +24,7 @@ void main() {
 
     //discard fragment if it's alpha value is under some threshold
    vec4 color_value = texture(grassAlpha, vec2(uv.x, 1.05f - uv.y));
-    if(color_value.a < alpha_threshold){
+    if(color_value.a < alphaThreshold){
         discard;
     }
 
@@ -39,10 +37,6 @@ void main() {
 
     }
 
+    //the bushes thin out with the distance instead of fading, see grass_vshader.glsl
     color =  vec4(lightingResult, 1.f);
-
-    //fragments disappear as they come close to the fog at the edges of the terrain
-    color.a *= 1 - smoothstep(threshold_vpoint_World_F, max_vpoint_World_F,
-                              max(abs(vpoint_World_F.x), abs(vpoint_World_F.y))
-                              );
 }
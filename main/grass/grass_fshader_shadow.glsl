@@ -0,0 +1,13 @@
+#version 410 core
+in vec2 uv;
+
+uniform sampler2D grassAlpha;
+// the same test as grass_fshader.glsl, the bushes cast the shadow of what they show
+uniform float alphaThreshold;
+
+void main() {
+    // only the depth of the opaque part is written
+    if (texture(grassAlpha, vec2(uv.x, 1.05f - uv.y)).a < alphaThreshold) {
+        discard;
+    }
+}
@@ -0,0 +1,7 @@
+#version 410 core
+// the placement only feeds back the bushes, the rasterization is discarded
+out vec4 color;
+
+void main() {
+    color = vec4(0.0f);
+}
@@ -0,0 +1,18 @@
+#version 410 core
+// keeps the accepted bushes only, the transform feedback packs them one after the other
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in vec3 placement_G[];
+in float accepted_G[];
+
+// the translation of the bush in the tile in xy, the height of the terrain under it in z
+out vec3 bushInstance;
+
+void main() {
+    if (accepted_G[0] > 0.5f) {
+        bushInstance = placement_G[0];
+        EmitVertex();
+        EndPrimitive();
+    }
+}
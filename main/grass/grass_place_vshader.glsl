@@ -0,0 +1,32 @@
+#version 410 core
+// the placement rules of a bush, evaluated once per tile when its maps change, see Grass::Place
+layout (location = 7) in vec2 bladeTranslation;
+
+out vec3 placement_G;
+out float accepted_G;
+
+uniform sampler2D heightMap;
+uniform sampler2D grassMap;
+
+const float SAND_HEIGHT = 0.25f,
+GRASS_HEIGHT = 0.4f,
+ROCK_HEIGHT = 0.5f;
+const float ground_threshold = 0.6;
+
+void main() {
+    //normalize translation coordinates
+    vec2 coord = (bladeTranslation + vec2(1.0f, 1.0f)) * 0.5f;
+
+    //y axis from translation is reversed from the texture one
+    coord.y = 1.f - coord.y;
+
+    //lookup height value and grass_noise map value
+    float height = textureLod(heightMap, coord, 0.0f).x;
+    float grass_coef_noise = clamp(textureLod(grassMap, coord, 0.0f).g, 0.f, 1.f);
+
+    // the bush grows inside the grass altitude range, where the coefficient found in grassMap is small enough
+    bool grows = SAND_HEIGHT <= height && height <= ROCK_HEIGHT && grass_coef_noise <= ground_threshold;
+
+    placement_G = vec3(bladeTranslation, height);
+    accepted_G = grows ? 1.0f : 0.0f;
+}
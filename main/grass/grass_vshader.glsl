@@ -1,11 +1,12 @@
 #version 410 core
 layout (location = 0) in vec3 vpoint;
-layout (location = 7) in vec2 bladeTranslation;
+// a bush kept by the placement: its translation in the tile in xy, the height of the terrain under it in z
+layout (location = 7) in vec3 bushInstance;
 
-in vec2 vtexcoord;
+// fixed, the shadow program shares the vertex array
+layout (location = 1) in vec2 vtexcoord;
 in vec2 gridPos;
 out vec2 uv;
-out vec2 vpoint_World_F;
 out vec3 lightDir;
 
 uniform float time;
@@ -13,38 +14,57 @@ uniform mat4 V;
 uniform mat4 MV;
 uniform mat4 VP;
 uniform vec2 translation;
-uniform vec2 translationToSceneCenter;
-uniform sampler2D heightMap;
-uniform sampler2D grassMap;
+// the level of detail depends on the horizontal distance to the camera, see Grass::Draw
+uniform vec2 cameraPos;
+// full bushes up to x, fewer and wider ones until y where none is left, bushes turn into quads from z to w
+uniform vec4 lodDistances;
+// the bushes placed in the cell of the tile drawn, they come in random order so that any first ones are spread
+// over the cell
+uniform float placedInstances;
+
+// the widest a thinned bush gets, it makes up for the missing ones
+const float maxWidening = 2.0f;
+// a quad facing the camera covers about as much as the three quads of a bush seen from the side
+const float impostorWidth = 1.3f;
+
+float density(in float distanceToCamera)
+{
+    return 1.0f - smoothstep(lodDistances.x, lodDistances.y, distanceToCamera);
+}
 
-const float SAND_HEIGHT = 0.25f,
-GRASS_HEIGHT = 0.4f,
-ROCK_HEIGHT = 0.5f;
-const float ground_threshold = 0.6;
+float hash(in vec2 p)
+{
+    return fract(sin(dot(p, vec2(12.9898f, 78.233f))) * 43758.5453f);
+}
 
 void main() {
-
-
-
-    //normalize translation coordinates
-    vec2 coord = (bladeTranslation + vec2(1.0f, 1.0f)) * 0.5f;
-
-    //y axis from translation is reversed from the texture one
-    coord.y = 1.f - coord.y;
-
-    //lookup height value and grass_noise map value
-    float height = texture(heightMap, coord).x;
-    float grass_coef_noise = clamp(texture(grassMap, coord).g, 0.f, 1.f);
-
-    // early culling when the vertex is not inside the grass altitude range
-    if (height < SAND_HEIGHT || ROCK_HEIGHT < height ||
-            //if the coefficient found in grassMap is too big -> cull
-            grass_coef_noise > ground_threshold) {
-
+    vec2 bladeTranslation = bushInstance.xy;
+    float height = bushInstance.z;
+
+    vec2 bushPos = vec2(translation.x + bladeTranslation.x, -translation.y + bladeTranslation.y);
+    vec2 toCamera = cameraPos - bushPos;
+    float distanceToCamera = length(toCamera);
+
+    // the thinning keeps the first bushes of the cell, a dithered fade since their order is random. The draw holds
+    // the bushes the closest point of the cell needs, only the farther ones of a cell end here
+    float bushDensity = density(distanceToCamera);
+    float rank = (gl_InstanceID + 0.5f) / placedInstances;
+    // the bushes turn into quads one by one, in an order independent of the thinning
+    bool impostor = hash(bladeTranslation) < smoothstep(lodDistances.z, lodDistances.w, distanceToCamera);
+    if (rank >= bushDensity || (impostor && gl_VertexID >= 6)) {
         gl_Position = vec4(0, 0, 0, 0); //(0,0) is outside frustrum
-        vpoint_World_F = vec2(0, 0);
         return;
     }
+
+    vec3 bushPoint = vpoint;
+    bushPoint.xz *= min(1.0f / bushDensity, maxWidening);
+    if (impostor) {
+        // the first quad of the bush turns to face the camera
+        vec2 front = distanceToCamera > 0.0f ? toCamera / distanceToCamera : vec2(0.0f, 1.0f);
+        vec2 side = vec2(front.y, -front.x);
+        bushPoint.xz = impostorWidth * (bushPoint.x * side + bushPoint.z * front);
+    }
+
     //compute the model matrix (which is only translations) from the bladeTranslations
     mat4 model = mat4(1.f);
     model[3][0] = bladeTranslation.x;
@@ -67,13 +87,9 @@ void main() {
         model[3][2] = bladeTranslation.y + displacementY;
 
     }
-    vec4 vertexModelPos = (model * vec4(vpoint, 1.0) + vec4(translation.x, height - 0.03, -translation.y, 0));
-
-    vertexModelPos = (model * vec4(vpoint, 1.0) + vec4(translation.x, height - 0.03, -translation.y, 0));
+    vec4 vertexModelPos = (model * vec4(bushPoint, 1.0) + vec4(translation.x, height - 0.03, -translation.y, 0));
 
     gl_Position = VP * vertexModelPos;
 
     uv = vtexcoord;
-    vpoint_World_F = translationToSceneCenter + bladeTranslation;
-
 }
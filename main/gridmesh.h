@@ -5,15 +5,18 @@
 #include "light/lightable.h"
 #include "material/material.h"
 #include "camera/fractionalview.h"
+#include "shadow/shadowcascades.h"
+#include "horizon/horizonmaps.h"
 
 struct ProgramIds{
     GLuint program_id;
-    GLuint MVP_id, MV_id, NORMALM_id, SHADOWMVP_id;
+    GLuint MVP_id, MV_id, NORMALM_id;
     GLuint zoom_id, zoomOffset_id, translation_id;
     GLuint heightMap_id, mirrorMap_id;
     GLuint grassMap_id;
     GLuint alpha_id;
     GLuint translationToSceneCenter_id;
+    GLuint deferredPass_id;
 };
 
 class GridMesh: public ILightable{
@@ -27,17 +30,21 @@ class GridMesh: public ILightable{
         GLuint normalTexture_id_;
         GLuint shadowTexture_id_;
         GLuint mirrorTexture_id_;
+        GLuint horizonMapTexture_id_ = 0;
 
         //IDs needed in the draw call
-        ProgramIds currentProgramIds, normalProgramIds, shadowProgramIds, debugProgramIds;
+        ProgramIds currentProgramIds, normalProgramIds, debugProgramIds;
 
         GLuint num_indices_;
         int firstCorner;
         Light* light;
+        ShadowCascades* shadowCascades = nullptr;
+        HorizonMaps* horizonMaps = nullptr;
         Material material;
         int gridDimensions;
         bool debug;
         bool wireframeDebugEnabled;
+        bool deferredPass = false;
 
     public:
         GridMesh(int firstCorner = 0)
@@ -103,26 +110,29 @@ class GridMesh: public ILightable{
         }
 
         void setupLocations(){
-            for (auto pProgramIds : {&shadowProgramIds, &debugProgramIds, &normalProgramIds}) {
-                auto& programIds = *pProgramIds;
-                glUseProgram(programIds.program_id);
-                programIds.MVP_id = glGetUniformLocation(programIds.program_id, "MVP");
-                programIds.MV_id = glGetUniformLocation(programIds.program_id, "MV");
-                programIds.NORMALM_id = glGetUniformLocation(programIds.program_id, "NORMALM");
-                programIds.SHADOWMVP_id = glGetUniformLocation(programIds.program_id, "SHADOWMVP");
-                programIds.zoom_id = glGetUniformLocation(programIds.program_id, "zoom");
-                programIds.zoomOffset_id = glGetUniformLocation(programIds.program_id, "zoomOffset");
-                programIds.translation_id = glGetUniformLocation(programIds.program_id, "translation");
-                programIds.heightMap_id = glGetUniformLocation(programIds.program_id, "heightMap");
-                programIds.grassMap_id = glGetUniformLocation(programIds.program_id, "grassMap");
-                programIds.alpha_id = glGetUniformLocation(programIds.program_id, "alpha");
-                programIds.translationToSceneCenter_id = glGetUniformLocation(programIds.program_id,
-                                                                              "translationToSceneCenter");
+            for (auto pProgramIds : {&debugProgramIds, &normalProgramIds}) {
+                setupLocations(*pProgramIds);
             }
 
             //normapProgramIds must be used last, or use: glUseProgram(normalProgramIds.program_id) here
         }
 
+        void setupLocations(ProgramIds& programIds){
+            glUseProgram(programIds.program_id);
+            programIds.MVP_id = glGetUniformLocation(programIds.program_id, "MVP");
+            programIds.MV_id = glGetUniformLocation(programIds.program_id, "MV");
+            programIds.NORMALM_id = glGetUniformLocation(programIds.program_id, "NORMALM");
+            programIds.zoom_id = glGetUniformLocation(programIds.program_id, "zoom");
+            programIds.zoomOffset_id = glGetUniformLocation(programIds.program_id, "zoomOffset");
+            programIds.translation_id = glGetUniformLocation(programIds.program_id, "translation");
+            programIds.heightMap_id = glGetUniformLocation(programIds.program_id, "heightMap");
+            programIds.grassMap_id = glGetUniformLocation(programIds.program_id, "grassMap");
+            programIds.alpha_id = glGetUniformLocation(programIds.program_id, "alpha");
+            programIds.translationToSceneCenter_id = glGetUniformLocation(programIds.program_id,
+                                                                          "translationToSceneCenter");
+            programIds.deferredPass_id = glGetUniformLocation(programIds.program_id, "deferredPass");
+        }
+
         void useLight(Light* l){
             this->light = l;
             light->registerProgram(normalProgramIds.program_id);
@@ -130,6 +140,16 @@ class GridMesh: public ILightable{
             glUseProgram(normalProgramIds.program_id);
         }
 
+        void useShadowCascades(ShadowCascades* c){
+            this->shadowCascades = c;
+            c->registerProgram(normalProgramIds.program_id, 9 /*the moments come after the terrain materials*/);
+        }
+
+        void useHorizonMaps(HorizonMaps* h){
+            this->horizonMaps = h;
+            h->registerProgram(normalProgramIds.program_id, 10 /*after the shadow moments*/);
+        }
+
         void useMaterial(Material m){
             this->material = m;
             material.Setup(normalProgramIds.program_id);
@@ -164,6 +184,11 @@ class GridMesh: public ILightable{
             this->heightMapTexture_id_ = heightMap;
         }
 
+        /** the horizon map baked for the height map in use */
+        void useHorizonMap(GLuint horizonMap) {
+            this->horizonMapTexture_id_ = horizonMap;
+        }
+
         void useGrassMap(GLuint grassMap){
             this->grassMapTexture_id_ = grassMap;
         }
@@ -196,6 +221,11 @@ class GridMesh: public ILightable{
             glUseProgram(normalProgramIds.program_id);
         }
 
+        /** the next draws write the G-buffer of the deferred path instead of lit colors */
+        void useDeferredPass(bool enabled){
+            deferredPass = enabled;
+        }
+
         void toggleDebugMode(){
             debug = !debug;
         }
@@ -211,7 +241,6 @@ class GridMesh: public ILightable{
             glDeleteBuffers(1, &vertex_buffer_object_index_);
             glDeleteVertexArrays(1, &vertex_array_id_);
             glDeleteProgram(normalProgramIds.program_id);
-            glDeleteProgram(shadowProgramIds.program_id);
             glDeleteProgram(debugProgramIds.program_id);
             glDeleteTextures(1, &heightMapTexture_id_);
             glDeleteTextures(1, &grassMapTexture_id_);
@@ -252,6 +281,7 @@ class GridMesh: public ILightable{
             }
             bindShadowTexture();
             bindMirrorTexture();
+            bindHorizonMapTexture();
         }
 
         void bindHeightMapTexture() {
@@ -266,7 +296,7 @@ class GridMesh: public ILightable{
 
         void bindShadowTexture() {
             glActiveTexture(GL_TEXTURE0 + 2);
-            glBindTexture(GL_TEXTURE_2D, shadowTexture_id_);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTexture_id_);
         }
 
         void bindMirrorTexture() {
@@ -275,6 +305,11 @@ class GridMesh: public ILightable{
 
         }
 
+        void bindHorizonMapTexture() {
+            glActiveTexture(GL_TEXTURE0 + 10);
+            glBindTexture(GL_TEXTURE_2D, horizonMapTexture_id_);
+        }
+
         void bindGrassMapTexture() {
             glActiveTexture(GL_TEXTURE0 + 4);
             glBindTexture(GL_TEXTURE_2D, grassMapTexture_id_);
@@ -0,0 +1,43 @@
+#version 410 core
+// bakes the horizon of a tile: for each azimuth, the sine of the highest elevation of the terrain seen from the texel
+
+in vec2 uv;
+out vec4 color;
+
+// heights of the 3 x 3 tiles around the baked one, which is in the middle
+uniform sampler2D heights;
+// side of a tile in world units
+uniform float tileSize;
+
+const int NUM_AZIMUTHS = 4;
+const float PI = 3.14159265f;
+
+// the horizon is searched up to one tile away, the steps grow geometrically from one texel
+const int NUM_STEPS = 24;
+const float MIN_DISTANCE = 1.0f / 128.0f;
+const float MAX_DISTANCE = 1.0f;
+
+// the sun over the sea is seen from the water surface, not from the sea bed
+const float WATER_HEIGHT = 0.0f;
+
+void main() {
+    vec2 center = (uv + vec2(1.0f)) / 3.0f;
+    float height = max(texture(heights, center).r, WATER_HEIGHT);
+
+    float stepRatio = pow(MAX_DISTANCE / MIN_DISTANCE, 1.0f / (NUM_STEPS - 1));
+
+    for(int a = 0; a < NUM_AZIMUTHS; a++){
+        // azimuth a is at the angle 2 pi a / NUM_AZIMUTHS from +uv.x (+x) towards +uv.y (-z)
+        float angle = 2.0f * PI * a / NUM_AZIMUTHS;
+        vec2 dir = vec2(cos(angle), sin(angle));
+
+        float maxSlope = 0.0f;
+        float distance = MIN_DISTANCE;
+        for(int i = 0; i < NUM_STEPS; i++){
+            float h = texture(heights, center + dir * distance / 3.0f).r;
+            maxSlope = max(maxSlope, (h - height) / (distance * tileSize));
+            distance *= stepRatio;
+        }
+        color[a] = maxSlope * inversesqrt(1.0f + maxSlope * maxSlope);
+    }
+}
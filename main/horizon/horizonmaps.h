@@ -0,0 +1,151 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <map>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "../framebuffer.h"
+#include "../screenquad/fullscreenquad.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct HorizonMapsProgramIds{
+    GLuint horizonWeights_id, sunSine_id;
+};
+
+/**
+ * @brief The HorizonMaps class bakes, for each terrain tile, the elevation of the horizon seen from its texels
+ * in NUM_AZIMUTHS directions, from the height map of the tile and those of its 8 neighbours.
+ * A map is baked when its tile or one of its neighbours is generated, never per frame.
+ * The shaders interpolate the horizon at the sun azimuth with one fetch and compare it to the sun elevation:
+ * the terrain self-shadowing needs no shadow pass.
+ */
+class HorizonMaps{
+
+public:
+    /** +x, -z, -x, +z, i.e. along +uv.x, +uv.y, -uv.x and -uv.y of the tiles, in the channels of one texture */
+    enum { NUM_AZIMUTHS = 4 };
+
+    /** the height maps around a tile, [1 + dRow][1 + dCol], nullptr outside of the scene */
+    typedef std::array<std::array<ColorFBO*, 3>, 3> Neighbourhood;
+
+private:
+    FullScreenQuad quad;
+    GLuint program_id_;             // GLSL shader program ID
+
+    /** the 3 x 3 height maps around the baked tile, resampled to sourceSize each */
+    ColorFBO neighbourhood;
+    GLuint neighbourhoodTexture_id_;
+    int sourceSize;
+    int size;
+    int bakedMaps = 0;
+
+    std::map<GLuint, HorizonMapsProgramIds> programToIds;
+
+public:
+    /** size: resolution of the horizon maps, sourceSize: resolution the heights are resampled to, tileSize in world units */
+    void Init(int size, int sourceSize, float tileSize) {
+        this->size = size;
+        this->sourceSize = sourceSize;
+        neighbourhoodTexture_id_ = neighbourhood.Init(3 * sourceSize, 3 * sourceSize, GL_R32F, GL_RED, GL_FLOAT, true);
+
+        // compile the shaders
+        program_id_ = icg_helper::LoadShaders("perlin_vshader.glsl",
+                                              "horizon_fshader.glsl");
+        if(!program_id_) {
+            exit(EXIT_FAILURE);
+        }
+
+        glUseProgram(program_id_);
+
+        quad.registerProgram(program_id_);
+
+        glUniform1i(glGetUniformLocation(program_id_, "heights"), 0 /*GL_TEXTURE0*/);
+        glUniform1f(glGetUniformLocation(program_id_, "tileSize"), tileSize);
+
+        // to avoid the current object being polluted
+        glUseProgram(0);
+    }
+
+    /** allocates the horizon map of a tile */
+    void InitMap(ColorFBO& map) {
+        map.Init(size, size, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, true);
+    }
+
+    /** bakes the horizon map of the tile in the middle of the neighbourhood */
+    void Bake(ColorFBO& map, const Neighbourhood& heightMaps) {
+        // missing neighbours are far below the terrain, they hide nothing
+        const GLfloat noTerrain[] = { -1000.0f, 0.0f, 0.0f, 0.0f };
+        neighbourhood.Bind();
+        glClearBufferfv(GL_COLOR, 0, noTerrain);
+        for (int dRow = 0; dRow < 3; ++dRow) {
+            for (int dCol = 0; dCol < 3; ++dCol) {
+                if (heightMaps[dRow][dCol] != nullptr) {
+                    heightMaps[dRow][dCol]->BlitColorTo(neighbourhood,
+                                                        dCol * sourceSize, dRow * sourceSize,
+                                                        (dCol + 1) * sourceSize, (dRow + 1) * sourceSize);
+                }
+            }
+        }
+
+        map.Bind();
+        glUseProgram(program_id_);
+        quad.Bind(program_id_);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, neighbourhoodTexture_id_);
+        quad.Draw();
+        glBindVertexArray(0);
+        glUseProgram(0);
+        map.Unbind();
+        bakedMaps++;
+    }
+
+    /** maps baked since the start */
+    int getBakedMaps() const {
+        return bakedMaps;
+    }
+
+    /** bytes of video memory held by each horizon map */
+    size_t mapMemoryUsage() const {
+        return size_t(size) * size * 4;
+    }
+
+    /** unit: the texture unit the program samples the horizon map of the drawn tile from */
+    void registerProgram(GLuint program_id, int unit) {
+        glUseProgram(program_id);
+        glUniform1i(glGetUniformLocation(program_id, "horizonMap"), unit);
+        glUseProgram(0);
+
+        HorizonMapsProgramIds ids;
+        ids.horizonWeights_id = glGetUniformLocation(program_id, "horizonWeights");
+        ids.sunSine_id = glGetUniformLocation(program_id, "sunSine");
+        programToIds[program_id] = ids;
+    }
+
+    /** uploads the weights of the azimuths around the sun azimuth and the sine of the sun elevation */
+    void updateProgram(GLuint program_id, const glm::vec3 &lightPos) {
+        HorizonMapsProgramIds ids = programToIds[program_id];
+        glm::vec3 sunDir = glm::normalize(lightPos);
+
+        // the azimuths are spread evenly from +uv.x (+x) towards +uv.y (-z)
+        float azimuth = std::atan2(-sunDir.z, sunDir.x) / (2.0f * float(M_PI)) * NUM_AZIMUTHS;
+        azimuth -= NUM_AZIMUTHS * std::floor(azimuth / NUM_AZIMUTHS);
+        int first = int(azimuth) % NUM_AZIMUTHS;
+        float t = azimuth - std::floor(azimuth);
+        glm::vec4 weights(0.0f);
+        weights[first] = 1.0f - t;
+        weights[(first + 1) % NUM_AZIMUTHS] = t;
+
+        glUniform4fv(ids.horizonWeights_id, ONE, glm::value_ptr(weights));
+        glUniform1f(ids.sunSine_id, sunDir.y);
+    }
+
+    void Cleanup() {
+        glUseProgram(0);
+        quad.Cleanup();
+        glDeleteProgram(program_id_);
+        neighbourhood.Cleanup();
+    }
+};
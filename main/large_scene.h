@@ -4,11 +4,19 @@
 #include <array>
 #include <iostream>
 #include <algorithm>
+#include <random>
 #include "water/water.h"
+#include "water/wavesampler.h"
+#include "water/waveprobe.h"
 #include "terrain/terrain.h"
 #include "perlin/perlin.h"
 #include "grass/grass.h"
+#include "scatter/scatter.h"
+#include "fleet/fleet.h"
 #include "model/model.h"
+#include "fog/fogquad.h"
+#include "shadow/shadowcascades.h"
+#include "horizon/horizonmaps.h"
 
 /** A LargeScene is an infinite procedural terrain. Internally, it is a circular matrix of Grid objects */
 class LargeScene {
@@ -46,15 +54,74 @@ class LargeScene {
     /** the grid's grass tile we reuse at each (i,j) position */
     Grass grass;
 
+    /** the rocks, shrubs and trees of every tile */
+    Scatter scatter;
+
+    /** fades the opaque scene into the sky at the edge of the grid */
+    FogQuad fog;
+
     /** the noise algorithm */
     Perlin perlin;
 
+    /** bakes the horizon maps, the terrain self-shadowing */
+    HorizonMaps horizonMaps;
+
+    /** resolution of the horizon maps, and of the heights they are baked from */
+    static constexpr int horizonMapSize = 128;
+    static constexpr int horizonSourceSize = 256;
+
+    /**
+     * the heights and the horizon maps of every tile side by side, the cell (i,j) holds the tile (i,j) so that
+     * the atlases repeat like the noise positions of the tiles: the projected water samples them without knowing
+     * the tiles. Texels per tile along each side
+     */
+    static constexpr int atlasTileSize = 32;
+
+    /** points the wave sampler is checked and timed with */
+    static constexpr int waveCheckPoints = 4096;
+    ColorFBO heightAtlas;
+    ColorFBO horizonAtlas;
+
+    /** the height atlas on the CPU, read back cell by cell with the tiles, for the waves under the ship */
+    SampledField terrainHeights;
+
+    /** reads of the atlas cells in flight, two band shifts: the GPU copies the heights while the CPU goes on */
+    enum { HEIGHT_READBACK_SLOTS = 2 * (NROW > NCOL ? NROW : NCOL) };
+
+    // ring of pixel pack buffers as in Ocean, the fence of a slot is 0 once it has been read
+    GLuint heightReadbackBuffer_[HEIGHT_READBACK_SLOTS];
+    GLsync heightReadbackFence_[HEIGHT_READBACK_SLOTS];
+    /** the cell of the atlas each slot holds, column and row */
+    glm::ivec2 heightReadbackCell[HEIGHT_READBACK_SLOTS];
+    int heightReadbackWrite = 0, heightReadbackRead = 0;
+
+    /** the water surface on the CPU, and its counterpart on the GPU to check it against */
+    WaveSampler waveSampler;
+    WaveProbe waveProbe;
+    Ocean* ocean = nullptr;
+
+    /** the ship's wake, and the ship motion it was last pushed with */
+    Ripples* ripples = nullptr;
+    glm::vec3 rippleShipMotion {0.0f, 0.0f, 0.0f};
+
     /** A glorious ship with its shader program */
     Model mightyShip{"yacht.3ds"};
     GLuint mightyShipShaderProgram;
     glm::mat4 shipModelMatrix;
+    glm::vec3 shipPos;
+    /** heave, pitch and roll the ship follows the waves with, and when it last moved */
+    glm::vec3 shipMotion {0.0f, 0.0f, 0.0f};
+    float lastShipUpdate = 0.0f;
+    /** in seconds, how slowly the ship follows the water under its hull */
+    const float shipInertia = 0.4f;
     //glm::vec2 shipWorldPos{}
 
+    /** the boats sailing around the camera, drawn as instances of the ship's model */
+    Fleet fleet;
+    static constexpr int fleetBoats = 256;
+    /** the tiles the last drawFleetTiles saw, by their translation */
+    std::vector<char> fleetTileVisible = std::vector<char>(NROW * NCOL, 0);
+
     /** resolution of the height maps */
     int heightMapWidth, heightMapHeight;
 
@@ -64,6 +131,13 @@ class LargeScene {
     /** this large scene's center */
     glm::vec2 center;
 
+    /** the shadow maps hold the models, the boats, the bushes and the objects, the terrain shadows itself */
+    ShadowCascades* shadowCascades = nullptr;
+
+    /** conservative bounds of the terrain heights, they bound the shadow casters and receivers */
+    float minTerrainHeight = -1.5f;
+    float maxTerrainHeight = 2.0f;
+
 public:
     enum Direction { UP = +1, DOWN = -1 };
 
@@ -78,17 +152,39 @@ public:
         vector<pair<Index, float>> tiles;
     };
 
+
     /** initializes the heightMaps */
     void initHeightMap(int textureWidth = 1024, int textureHeight = 1024) {
         heightMapWidth = textureWidth;
         heightMapHeight = textureHeight;
         perlin.Init();
+        heightAtlas.Init(NCOL * atlasTileSize, NROW * atlasTileSize, GL_R16F, GL_RED, GL_FLOAT, true, true);
+        horizonAtlas.Init(NCOL * atlasTileSize, NROW * atlasTileSize, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, true, true);
+        terrainHeights.resize(NCOL * atlasTileSize, NROW * atlasTileSize, 1);
+        glGenBuffers(HEIGHT_READBACK_SLOTS, heightReadbackBuffer_);
+        for (int slot = 0; slot < HEIGHT_READBACK_SLOTS; ++slot) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, heightReadbackBuffer_[slot]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, atlasTileSize * atlasTileSize * sizeof(GLfloat), NULL, GL_STREAM_READ);
+            heightReadbackFence_[slot] = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
         for (int iRow = 0; iRow < NROW; ++iRow) {
             for (int jCol = 0; jCol < NCOL; ++jCol) {
                 heightMap(iRow, jCol).Init(textureWidth, textureHeight, GL_RGB32F, GL_RGB, GL_FLOAT, true);
                 recomputeHeightMap(iRow, jCol);
             }
         }
+        // the first frame samples every cell
+        collectTerrainHeights(true);
+
+        // the horizons need the heights of the neighbours
+        horizonMaps.Init(horizonMapSize, horizonSourceSize, gridSize);
+        for (int iRow = 0; iRow < NROW; ++iRow) {
+            for (int jCol = 0; jCol < NCOL; ++jCol) {
+                horizonMaps.InitMap(horizonMap(iRow, jCol));
+                recomputeHorizonMap(iRow, jCol);
+            }
+        }
     }
 
     /** initializes the grassMaps */
@@ -105,39 +201,298 @@ public:
     }
 
     /** initializes the tile objects (grid, water, etc.) */
-    void init(int shadowBuffer_texture_id, int reflectionBuffer_texture_id, Light* light) {
-        grass.Init(0 /*heightMap*/, 0 /*grassMap*/);
-        grid.Init(0, shadowBuffer_texture_id, 0, fogStop, nMountainTilesInFog);
-        water.Init(0, reflectionBuffer_texture_id, shadowBuffer_texture_id, fogStop, nWaterTilesInFog);
+    void init(ShadowCascades* shadowCascades, int reflectionBuffer_texture_id, Light* light) {
+        grass.Init(NROW * NCOL);
+        scatter.Init(NROW * NCOL);
+        scatter.useLight(light);
+        for (int iRow = 0; iRow < NROW; ++iRow) {
+            for (int jCol = 0; jCol < NCOL; ++jCol) {
+                placeGrass(iRow, jCol);
+                placeScatter(iRow, jCol);
+            }
+        }
+        grid.Init(0, shadowCascades->getTexture(), 0, fogStop, nMountainTilesInFog);
+        water.Init(0, reflectionBuffer_texture_id, shadowCascades->getTexture(), fogStop, nWaterTilesInFog);
         grid.useLight(light);
         water.useLight(light);
         grass.useLight(light);
+        grid.useShadowCascades(shadowCascades);
+        water.useShadowCascades(shadowCascades);
+        grid.useHorizonMaps(&horizonMaps);
+        water.useHorizonMaps(&horizonMaps);
+        // the storage (i,j) holds the noise position (j - NCOL / 2, i - NROW / 2) modulo the size of the matrix
+        water.setProjectedGridAtlas(NCOL, NCOL / 2, gridSize);
+        this->shadowCascades = shadowCascades;
 
         mightyShipShaderProgram = icg_helper::LoadShaders("yacht_vshader.glsl", "yacht_fshader.glsl");
-        mightyShip.Init(mightyShipShaderProgram, shadowBuffer_texture_id, fogStop, nMountainTilesInFog);
+        mightyShip.Init(mightyShipShaderProgram, shadowCascades->getTexture(), fogStop, nMountainTilesInFog);
         mightyShip.useLight(light);
+        mightyShip.useShadowCascades(shadowCascades);
+
+        fleet.Init(fleetBoats, &mightyShip, shadowCascades->getTexture(), fogStop, nWaterTilesInFog);
+        fleet.useLight(light);
+        fleet.useShadowCascades(shadowCascades);
+    }
+
+    /** initializes the fog pass, it reads the scene depth and the sky rendered on its own */
+    void initFog(GLuint sceneDepthTexture_id, GLuint skyTexture_id) {
+        fog.Init(sceneDepthTexture_id, skyTexture_id, fogStop, nMountainTilesInFog);
+    }
+
+    /** blends the sky over the scene as it gets closer to the edge of the grid, VP: the view projection of the scene */
+    void drawFog(const glm::mat4 &VP, GLuint skyTexture_id) {
+        fog.updateSkyTextureId(skyTexture_id);
+        fog.Draw(VP, center);
+    }
+
+    /** bushes drawn by the last drawGrassTiles, out of those placed on every tile */
+    int grassInstancesDrawn() const {
+        return grass.getInstancesLastFrame();
+    }
+
+    int grassTilesDrawn() const {
+        return grass.getTilesLastFrame();
+    }
+
+    size_t grassVerticesDrawn() const {
+        return grass.getVerticesLastFrame();
+    }
+
+    /** height of the near plane the reflection is rendered with, the terrain skips the patches below it */
+    void setMirrorClipHeight(float height) {
+        grid.useMirrorClipHeight(height);
+    }
+
+    /** distance to the camera beyond which no bush is drawn */
+    void setGrassLodRadius(float radius) {
+        invalidateTileShadows();
+        grass.setLodRadius(radius);
+        invalidateTileShadows();
+    }
+
+    float grassLodRadius() const {
+        return grass.getLodRadius();
+    }
+
+    size_t grassInstancesPlaced() const {
+        return grass.placedInstances();
+    }
+
+    size_t grassMemoryUsage() const {
+        return grass.memoryUsage();
+    }
+
+    /** what the last drawScatterTiles drew, and the objects placed on every tile */
+    const Scatter& scatterStatistics() const {
+        return scatter;
+    }
+
+    /** horizon maps baked since the start */
+    int bakedHorizonMaps() const {
+        return horizonMaps.getBakedMaps();
+    }
+
+    /** bytes of video memory held by the horizon maps of the tiles */
+    size_t horizonMapsMemoryUsage() const {
+        return horizonMaps.mapMemoryUsage() * NROW * NCOL;
+    }
+
+    /** bytes of video memory held by the height and horizon atlases of the projected water */
+    size_t waterAtlasMemoryUsage() const {
+        return size_t(NROW * atlasTileSize) * (NCOL * atlasTileSize) * (2 + 4);
     }
 
-    /** draws every Mountain grid tile side by side in an ordered manner */
-    void drawMountains(const glm::mat4 &MVP = IDENTITY_MATRIX,
-              const glm::mat4 &MV = IDENTITY_MATRIX,
-              const glm::mat4 &NORMALM = IDENTITY_MATRIX,
-              const glm::mat4 &SHADOWMVP = IDENTITY_MATRIX,
-              const FractionalView &FV = FractionalView(),
-              bool mirrorPass = false,
-              bool shadowPass = false)
+    /** the water samples the reflection from where it was rendered */
+    void useReflection(PlanarReflection* reflection) {
+        water.useReflection(reflection);
+    }
+
+    /** the water may trace its reflection in the opaque scene instead */
+    void useScreenSpaceReflection(ScreenSpaceReflection* screenSpaceReflection) {
+        water.useScreenSpaceReflection(screenSpaceReflection);
+    }
+
+    /** the water tiles share the surface of the ocean */
+    void useOcean(Ocean* ocean) {
+        this->ocean = ocean;
+        water.useOcean(ocean);
+        waveSampler.Init(gridSize, ocean->getScale(), NCOL, NCOL / 2);
+        waveSampler.useFields(&ocean->getSurface(), &terrainHeights);
+        waveProbe.Init(waveCheckPoints, ocean, gridSize, NCOL, NCOL / 2);
+    }
+
+    /** the water tiles add the ship's ripples, updateRipples steps them */
+    void useRipples(Ripples* ripples) {
+        this->ripples = ripples;
+        water.useRipples(ripples);
+    }
+
+    /** steps the ripples with the hull motion since the previous call, updateShip must be called first */
+    void updateRipples(float time) {
+        if (ripples == nullptr) {
+            return;
+        }
+        glm::vec3 bmin = mightyShip.getBoundsMin(), bmax = mightyShip.getBoundsMax();
+        glm::vec3 middle = shipPos + 0.5f * (bmin + bmax);
+        glm::vec3 change = shipMotion - rippleShipMotion;
+        rippleShipMotion = shipMotion;
+
+        Ripples::Disturbance hull;
+        hull.center = glm::vec2(middle.x, -middle.z) / gridSize + 0.5f + noisePosition;
+        hull.halfSize = 0.5f * glm::vec2(bmax.x - bmin.x, bmax.z - bmin.z) / gridSize;
+        // the hull rises towards -z as it pitches and towards +x as it rolls, see hullMotion
+        hull.heightChange = change.x;
+        hull.slopeChange = gridSize * glm::vec2(change.z, change.y);
+        ripples->update(time, hull);
+    }
+
+    /**
+     * compares the CPU evaluation of the water with the shaders' at random points of the scene, then times it
+     * against the plain one. Waits for the GPU
+     */
+    void checkWaveSampler() {
+        if (ocean == nullptr) {
+            return;
+        }
+        // the surface the textures hold now, not the one of a few frames ago
+        SampledField surfaceNow;
+        ocean->readSurfaceNow(surfaceNow);
+        collectTerrainHeights(true);
+        WaveSampler sampler = waveSampler;
+        sampler.useFields(&surfaceNow, &terrainHeights);
+        sampler.setNoiseOrigin(noisePosition);
+
+        const int count = waveCheckPoints;
+        std::vector<float> x(count), z(count), cpu(3 * count), gpu(3 * count);
+        std::mt19937 generator(7);
+        std::uniform_real_distribution<float> inScene(-float(fogStop), float(fogStop));
+        for (int i = 0; i < count; ++i) {
+            x[i] = center.x + inScene(generator);
+            z[i] = -(center.y + inScene(generator));
+        }
+
+        sampler.evaluate(count, &x[0], &z[0], &cpu[0], &cpu[count], &cpu[2 * count]);
+        waveProbe.Evaluate(heightAtlas.id(), noisePosition, count, &x[0], &z[0], &gpu[0], &gpu[count], &gpu[2 * count]);
+        float maxError = 0.0f, maxDisplacement = 0.0f;
+        for (int i = 0; i < 3 * count; ++i) {
+            maxError = std::max(maxError, std::abs(cpu[i] - gpu[i]));
+            maxDisplacement = std::max(maxDisplacement, std::abs(gpu[i]));
+        }
+        // the GPU filters with fixed point weights, a few bits of the texel differences
+        bool matches = maxError <= 2e-3f * std::max(maxDisplacement, 1e-3f) + 1e-5f;
+        std::cout << "Wave sampler: " << (matches ? "matches" : "DIFFERS FROM") << " the shaders, max error "
+                  << maxError << " for displacements up to " << maxDisplacement << std::endl;
+
+        // the same points over and over, the fields stay in the cache like the ship's would
+        const int batches = 256;
+        for (int simd = 1; simd >= 0; --simd) {
+            double start = glfwGetTime();
+            for (int b = 0; b < batches; ++b) {
+                if (simd) {
+                    sampler.evaluate(count, &x[0], &z[0], &cpu[0], &cpu[count], &cpu[2 * count]);
+                } else {
+                    sampler.evaluateReference(count, &x[0], &z[0], &cpu[0], &cpu[count], &cpu[2 * count]);
+                }
+            }
+            double seconds = glfwGetTime() - start;
+            std::cout << "Wave sampler (" << (simd ? "4 lanes" : "scalar") << "): "
+                      << batches * count / (seconds * 1e6) << " M points/s" << std::endl;
+        }
+    }
+
+    /**
+     * draws the models, the boats, the bushes and the objects overlapping each dirty region of the cascades,
+     * updateShip, updateFleet and updateTileShadows must be called first
+     */
+    void drawShadowCascades(ShadowCascades& cascades)
     {
-        for (int iRow = 0; iRow < NROW; ++iRow) {
-            for (int jCol = 0; jCol < NCOL; ++jCol) {
-                grid.useHeightMap(heightMap(iRow, jCol).id());
-                grid.useGrassMap(grassMap(iRow, jCol).id());
-                grid.Draw(MVP, MV, NORMALM, SHADOWMVP, FV,
-                          mirrorPass, shadowPass,
-                          gridSize * translation(iRow, jCol));
+        for (auto& region : cascades.getDirtyRegions()) {
+            cascades.beginRegion(region);
+            if (overlapsClipSpace(region.SHADOWMVP * shipModelMatrix,
+                                  mightyShip.getBoundsMin(), mightyShip.getBoundsMax())) {
+                mightyShip.DrawShadow(region.SHADOWMVP * shipModelMatrix);
             }
+            fleet.DrawShadow(region.SHADOWMVP, worldOffset());
+            // Grass and Scatter cull the tiles out of the region or beyond their shadow radius
+            for (int iRow = 0; iRow < NROW; ++iRow) {
+                for (int jCol = 0; jCol < NCOL; ++jCol) {
+                    grass.DrawShadow(iRow * NCOL + jCol, region.SHADOWMVP, gridSize * translation(iRow, jCol));
+                    scatter.DrawShadow(iRow * NCOL + jCol, region.SHADOWMVP, gridSize * translation(iRow, jCol));
+                }
+            }
+        }
+        cascades.endRegions();
+    }
+
+    /** the shadow cascades redraw the tiles whose bushes or objects were placed since the last call */
+    void updateTileShadows() {
+        for (int tile : grass.takeResolvedTiles()) {
+            glm::vec3 bmin, bmax;
+            grass.getTileBounds(gridSize * translation(tile / NCOL, tile % NCOL), bmin, bmax);
+            invalidateShadow(bmin, bmax);
+        }
+        for (int tile : scatter.takeResolvedTiles()) {
+            glm::vec3 bmin, bmax;
+            scatter.getTileBounds(gridSize * translation(tile / NCOL, tile % NCOL), bmin, bmax);
+            invalidateShadow(bmin, bmax);
         }
     }
 
+    /** moves the ship for this frame, the shadow cascades redraw the area it leaves and the one it enters */
+    void updateShip() {
+        invalidateShipShadow();
+        collectTerrainHeights();
+
+        float time = glfwGetTime();
+        float elapsed = std::min(time - lastShipUpdate, 0.1f);
+        lastShipUpdate = time;
+
+        shipPos = glm::vec3(
+                    6.0 - noisePosition.x * worldGridSize,
+                    0.035,
+                    12.0 + noisePosition.y * worldGridSize);
+
+        waveSampler.setNoiseOrigin(noisePosition);
+        shipMotion += (hullMotion() - shipMotion) * (1.0f - std::exp(-elapsed / shipInertia));
+
+        shipModelMatrix =
+                glm::translate(IDENTITY_MATRIX, shipPos + glm::vec3(0.0f, shipMotion.x, 0.0f))
+                *
+                glm::rotate(IDENTITY_MATRIX, shipMotion.y, glm::vec3(1.0, 0.0, 0.0))
+                *
+                glm::rotate(IDENTITY_MATRIX, shipMotion.z, glm::vec3(0.0, 0.0, 1.0));
+
+        invalidateShipShadow();
+    }
+
+    /**
+     * sails the fleet around the camera and floats it on the waves, the shadow cascades redraw the area it leaves
+     * and the one it enters. updateShip must be called first
+     */
+    void updateFleet(const glm::vec3 &cameraPos) {
+        invalidateFleetShadow();
+        fleet.Update(glfwGetTime(), glm::vec2(cameraPos.x, cameraPos.z), worldOffset(), waveSampler);
+        invalidateFleetShadow();
+    }
+
+    const Fleet& fleetStatistics() const {
+        return fleet;
+    }
+
+    /** from the coordinates the tiles are drawn in to coordinates fixed in the world, moved by each band shift */
+    glm::vec3 worldOffset() const {
+        return gridSize * glm::vec3(noisePosition.x, 0.0f, -noisePosition.y);
+    }
+
+    /** bounds of the terrain heights, conservative */
+    float getMinTerrainHeight() const {
+        return minTerrainHeight;
+    }
+
+    float getMaxTerrainHeight() const {
+        return maxTerrainHeight;
+    }
+
     void writeVisibleTilesOnly(TileSet& visible, const glm::vec3 &pointInPlane, const glm::vec3 &planeNormal)
     {
         visible.tiles.clear();
@@ -177,25 +532,47 @@ public:
         }
     }
 
-    /** draws every non-culled mountain tile side by side in an ordered manner */
+    /** writes the depth of every non-culled mountain tile, front to back */
+    void drawMountainTilesDepth(
+            TileSet const& tilesToDraw,
+            const glm::mat4 &MVP = IDENTITY_MATRIX,
+            const glm::mat4 &MV = IDENTITY_MATRIX)
+    {
+        for (auto&& i : tilesToDraw.tiles) {
+            grid.useHeightMap(heightMap(i.first.iRow, i.first.jCol).id());
+            grid.DrawDepth(MVP, MV,
+                           gridSize * translation(i.first.iRow, i.first.jCol),
+                           gridSize * translation(i.first.iRow, i.first.jCol) - center);
+        }
+    }
+
+    /**
+     * draws every non-culled mountain tile side by side in an ordered manner,
+     * depthPrepassed: drawMountainTilesDepth was called with the same tiles and matrices
+     */
     void drawMountainTiles(
             TileSet const& tilesToDraw,
             const glm::mat4 &MVP = IDENTITY_MATRIX,
             const glm::mat4 &MV = IDENTITY_MATRIX,
             const glm::mat4 &NORMALM = IDENTITY_MATRIX,
-            const glm::mat4 &SHADOWMVP = IDENTITY_MATRIX,
             const FractionalView &FV = FractionalView(),
-            bool mirrorPass = false)
+            bool mirrorPass = false,
+            bool depthPrepassed = false,
+            float tessellationScale = 1.0f)
     {
+        grid.useDepthPrepass(depthPrepassed);
+        grid.useTessellationScale(tessellationScale);
         for (auto&& i : tilesToDraw.tiles) {
             grid.useHeightMap(heightMap(i.first.iRow, i.first.jCol).id());
+            grid.useHorizonMap(horizonMap(i.first.iRow, i.first.jCol).id());
             grid.useGrassMap(grassMap(i.first.iRow, i.first.jCol).id());
-            grid.Draw(MVP, MV, NORMALM, SHADOWMVP, FV,
-                      mirrorPass, false,
+            grid.Draw(MVP, MV, NORMALM, FV, mirrorPass,
                       gridSize * translation(i.first.iRow, i.first.jCol),
                       gridSize * translation(i.first.iRow, i.first.jCol) - center);
 
         }
+        grid.useDepthPrepass(false);
+        grid.useTessellationScale(1.0f);
     }
 
     /** draws every non-culled water tile side by side in an ordered manner */
@@ -204,82 +581,141 @@ public:
             const glm::mat4 &MVP = IDENTITY_MATRIX,
             const glm::mat4 &MV = IDENTITY_MATRIX,
             const glm::mat4 &NORMALM = IDENTITY_MATRIX,
-            const glm::mat4 &SHADOWMVP = IDENTITY_MATRIX,
             const FractionalView &FV = FractionalView())
     {
         for (auto&& i : tilesToDraw.tiles)  {
             water.useHeightMap(heightMap(i.first.iRow, i.first.jCol).id());
-            water.Draw(MVP, MV, NORMALM, SHADOWMVP, FV,
+            water.useHorizonMap(horizonMap(i.first.iRow, i.first.jCol).id());
+            water.Draw(MVP, MV, NORMALM, FV,
                        noisePosFor(i.first.iRow, i.first.jCol),
                        gridSize * translation(i.first.iRow, i.first.jCol),
                        gridSize * translation(i.first.iRow, i.first.jCol) - center);
         }
     }
 
+    /** draws the water of the whole scene in one call, with a grid projected from the screen onto the sea */
+    void drawWaterProjected(
+            const glm::mat4 &MVP,
+            const glm::mat4 &MV,
+            const glm::mat4 &NORMALM)
+    {
+        water.useHeightMap(heightAtlas.id());
+        water.useHorizonMap(horizonAtlas.id());
+        water.DrawProjected(MVP, MV, NORMALM, noisePosition, -center, maximumExtent());
+    }
+
+    /** draws the bushes placed on every non-culled tile, Grass culls the tiles out of VP or beyond its LOD radius */
     void drawGrassTiles(TileSet const& tilesToDraw,
                         const mat4 &VP = IDENTITY_MATRIX,
                         const vec2 &cameraPos = vec2(0.f, 0.f)) {
+        grass.beginFrame();
         for (auto&& i : tilesToDraw.tiles)  {
-            grass.useHeightMap(heightMap(i.first.iRow, i.first.jCol).id());
-            grass.Draw(VP,
+            grass.Draw(i.first.iRow * NCOL + i.first.jCol, VP,
                        gridSize * translation(i.first.iRow, i.first.jCol),
-                       gridSize * translation(i.first.iRow, i.first.jCol) - center,
                        cameraPos);
         }
     }
 
+    /** draws the rocks, shrubs and trees of every non-culled tile, Scatter culls them per tile and kind */
+    void drawScatterTiles(TileSet const& tilesToDraw,
+                          const glm::mat4 &MVP,
+                          const glm::mat4 &MV,
+                          const glm::mat4 &NORMALM,
+                          const glm::vec2 &cameraPos) {
+        scatter.beginFrame();
+        for (auto&& i : tilesToDraw.tiles)  {
+            scatter.Draw(i.first.iRow * NCOL + i.first.jCol, MVP, MV, NORMALM,
+                         gridSize * translation(i.first.iRow, i.first.jCol),
+                         cameraPos);
+        }
+    }
+
     void drawModels(
             const glm::mat4 &MVP = IDENTITY_MATRIX,
             const glm::mat4 &MV = IDENTITY_MATRIX,
-            const glm::mat4 &SHADOWMVP = IDENTITY_MATRIX,
             bool mirrorPass = false){
 
-      float time = glfwGetTime();
-      float pitching = cos(time * 0.9) * 0.10;
-
-      glm::vec3 shipPos = glm::vec3(
-                  6.0 - noisePosition.x * worldGridSize,
-                  0.035,
-                  12.0 + noisePosition.y * worldGridSize);
-
-      shipModelMatrix =
-              glm::translate(IDENTITY_MATRIX, shipPos)
-              *
-              glm::rotate(IDENTITY_MATRIX, pitching, glm::vec3(1.0, 0.0, 0.0));
-
-
       //std::cout << (-noisePosition.x * worldGridSize) << " : " << (noisePosition.y* worldGridSize) << std::endl;
       glm::mat4 shipMVP = MVP * shipModelMatrix;
       glm::mat4 shipMV = MV * shipModelMatrix;
       glm::mat4 shipNORMALM = inverse(transpose(shipMV));
       glDisable(GL_CULL_FACE);
-      mightyShip.Draw(shipMVP, shipMV, shipNORMALM, SHADOWMVP, glm::vec2(shipPos.x, -shipPos.z) - center, mirrorPass);
+      mightyShip.Draw(shipMVP, shipMV, shipNORMALM, shipModelMatrix, glm::vec2(shipPos.x, -shipPos.z) - center, mirrorPass);
       glEnable(GL_CULL_FACE);
     }
 
+    /** draws the boats of the fleet that lie on the non-culled tiles, in the reflection with the mirrored matrices */
+    void drawFleetTiles(TileSet const& tilesToDraw,
+                        const glm::mat4 &MVP,
+                        const glm::mat4 &MV,
+                        const glm::mat4 &NORMALM,
+                        bool mirrorPass = false) {
+        std::fill(fleetTileVisible.begin(), fleetTileVisible.end(), 0);
+        for (auto&& i : tilesToDraw.tiles)  {
+            glm::vec2 t = translation(i.first.iRow, i.first.jCol);
+            fleetTileVisible[(int(t.y) + NROW / 2) * NCOL + int(t.x) + NCOL / 2] = 1;
+        }
+        const float size = gridSize;
+        const std::vector<char>& visible = fleetTileVisible;
+        auto onVisibleTile = [size, &visible](const glm::vec3 &p) {
+            glm::ivec2 t = glm::ivec2(glm::round(glm::vec2(p.x, -p.z) / size)) + glm::ivec2(NCOL / 2, NROW / 2);
+            return t.x >= 0 && t.x < NCOL && t.y >= 0 && t.y < NROW && visible[t.y * NCOL + t.x];
+        };
+        glDisable(GL_CULL_FACE);
+        fleet.Draw(MVP, MV, NORMALM, worldOffset(), -center, mirrorPass, onVisibleTile);
+        glEnable(GL_CULL_FACE);
+    }
+
     /** moves the heightMaps one column in the given direction, recomputes only obsolete heightMaps */
     void moveCols(Direction d) {
         int oldColStart = colStart;
-        colStart = (colStart - d + NCOL) % NCOL;
+        int newColStart = (colStart - d + NCOL) % NCOL;
+        int col = (d == DOWN) ? oldColStart : newColStart;
+
+        // the bushes and objects casting shadows are those around the central tile, before and after the move
+        invalidateTileShadows();
+        colStart = newColStart;
         noisePosition.x -= d;
+        invalidateTileShadows();
 
-        int col = (d == DOWN) ? oldColStart : colStart;
         for(int iRow = 0; iRow < NROW; ++iRow) {
             recomputeHeightMap(iRow, col);
             recomputeGrassMap(iRow, col);
+            placeGrass(iRow, col);
+            placeScatter(iRow, col);
+        }
+
+        // the band has new heights and new neighbours, the bands on both of its sides have a new neighbour
+        for(int iRow = 0; iRow < NROW; ++iRow) {
+            for(int dCol = -1; dCol <= 1; ++dCol) {
+                recomputeHorizonMap(iRow, (col + dCol + NCOL) % NCOL);
+            }
         }
     }
 
     /** moves the heightMaps one row in the given direction, recomputes only obsolete heightMaps */
     void moveRows(Direction d) {
         int oldRowStart = rowStart;
-        rowStart = (rowStart - d + NROW) % NROW;
+        int newRowStart = (rowStart - d + NROW) % NROW;
+        int row = (d == DOWN) ? oldRowStart : newRowStart;
+
+        invalidateTileShadows();
+        rowStart = newRowStart;
         noisePosition.y -= d;
+        invalidateTileShadows();
 
-        int row = (d == DOWN) ? oldRowStart : rowStart;
         for(int jCol = 0; jCol < NCOL; ++jCol) {
             recomputeHeightMap(row, jCol);
             recomputeGrassMap(row, jCol);
+            placeGrass(row, jCol);
+            placeScatter(row, jCol);
+        }
+
+        // the band has new heights and new neighbours, the bands on both of its sides have a new neighbour
+        for(int jCol = 0; jCol < NCOL; ++jCol) {
+            for(int dRow = -1; dRow <= 1; ++dRow) {
+                recomputeHorizonMap((row + dRow + NROW) % NROW, jCol);
+            }
         }
     }
 
@@ -294,6 +730,15 @@ public:
         grid.toggleWireFrame();
     }
 
+    /** Grid, Water and Model write the G-buffer instead of lit colors until disabled again */
+    void useDeferredPass(bool enabled) {
+        grid.useDeferredPass(enabled);
+        water.useDeferredPass(enabled);
+        mightyShip.useDeferredPass(enabled);
+        fleet.useDeferredPass(enabled);
+        scatter.useDeferredPass(enabled);
+    }
+
     void toggleDebugMode() {
         water.toggleDebugMode();
         grid.toggleDebugMode();
@@ -302,9 +747,24 @@ public:
     void cleanup() {
         water.Cleanup();
         grid.Cleanup();
+        grass.Cleanup();
+        scatter.Cleanup();
+        fleet.Cleanup();
+        fog.Cleanup();
+        horizonMaps.Cleanup();
+        heightAtlas.Cleanup();
+        horizonAtlas.Cleanup();
+        glDeleteBuffers(HEIGHT_READBACK_SLOTS, heightReadbackBuffer_);
+        for (int slot = 0; slot < HEIGHT_READBACK_SLOTS; ++slot) {
+            if (heightReadbackFence_[slot] != 0) {
+                glDeleteSync(heightReadbackFence_[slot]);
+            }
+        }
+        waveProbe.Cleanup();
         for (int iRow = 0; iRow < NROW; ++iRow) {
             for (int jCol = 0; jCol < NCOL; ++jCol) {
                 heightMap(iRow, jCol).Cleanup();
+                horizonMap(iRow, jCol).Cleanup();
                 grassMap(iRow, jCol).Cleanup();
             }
         }
@@ -334,6 +794,81 @@ private:
         heightMap(iRow, jCol).Bind();
         perlin.Draw(textureCorrection(noisePosFor(iRow, jCol), heightMapWidth, heightMapHeight));
         heightMap(iRow, jCol).Unbind();
+        heightMap(iRow, jCol).BlitColorTo(heightAtlas, jCol * atlasTileSize, iRow * atlasTileSize,
+                                          (jCol + 1) * atlasTileSize, (iRow + 1) * atlasTileSize);
+        readBackTerrainHeights(iRow, jCol);
+    }
+
+    /** starts the read of the atlas cell (i,j) into a free buffer, waits for the reads in flight if there is none */
+    void readBackTerrainHeights(int iRow, int jCol) {
+        if (heightReadbackFence_[heightReadbackWrite] != 0) {
+            collectTerrainHeights(true);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, heightReadbackBuffer_[heightReadbackWrite]);
+        heightAtlas.ReadColor(jCol * atlasTileSize, iRow * atlasTileSize, atlasTileSize, atlasTileSize,
+                              GL_RED, GL_FLOAT, nullptr /*offset in the buffer*/);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        heightReadbackFence_[heightReadbackWrite] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        heightReadbackCell[heightReadbackWrite] = glm::ivec2(jCol, iRow);
+        heightReadbackWrite = (heightReadbackWrite + 1) % HEIGHT_READBACK_SLOTS;
+    }
+
+    /**
+     * copies the reads the GPU is done with into terrainHeights, oldest first.
+     * wait: blocks until every read in flight is done, otherwise stops at the first one that is not
+     */
+    void collectTerrainHeights(bool wait = false) {
+        const GLsizeiptr bytes = atlasTileSize * atlasTileSize * sizeof(GLfloat);
+        while (heightReadbackFence_[heightReadbackRead] != 0) {
+            GLsync& oldest = heightReadbackFence_[heightReadbackRead];
+            GLenum status = glClientWaitSync(oldest, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                                             wait ? 1000000000 /*1 s in ns*/ : 0 /*do not wait*/);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                return;
+            }
+            glDeleteSync(oldest);
+            oldest = 0;
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, heightReadbackBuffer_[heightReadbackRead]);
+            const GLfloat* texels = (const GLfloat*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+            if (texels != nullptr) {
+                glm::ivec2 cell = heightReadbackCell[heightReadbackRead] * int(atlasTileSize); // glm takes the scalar by reference
+                float* heights = terrainHeights.plane(0) + size_t(cell.y) * terrainHeights.width + cell.x;
+                for (int row = 0; row < atlasTileSize; ++row) {
+                    std::copy(texels + row * atlasTileSize, texels + (row + 1) * atlasTileSize,
+                              heights + size_t(row) * terrainHeights.width);
+                }
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            heightReadbackRead = (heightReadbackRead + 1) % HEIGHT_READBACK_SLOTS;
+        }
+    }
+
+    /** the horizon map buffer (i,j) */
+    ColorFBO& horizonMap(int iRow, int jCol) {
+        static Matrix<ColorFBO> maps;
+        return maps[iRow][jCol];
+    }
+
+    /** bakes the horizon map (i,j) from its height map and those of its neighbours on screen */
+    void recomputeHorizonMap(int iRow, int jCol) {
+        HorizonMaps::Neighbourhood neighbours;
+        // position on screen, the storage wraps around between the first and the last row or column
+        int screenRow = (NROW - rowStart + iRow) % NROW;
+        int screenCol = (NCOL - colStart + jCol) % NCOL;
+        for (int dRow = -1; dRow <= 1; ++dRow) {
+            for (int dCol = -1; dCol <= 1; ++dCol) {
+                bool inside = screenRow + dRow >= 0 && screenRow + dRow < NROW
+                        && screenCol + dCol >= 0 && screenCol + dCol < NCOL;
+                neighbours[1 + dRow][1 + dCol] = inside
+                        ? &heightMap((iRow + dRow + NROW) % NROW, (jCol + dCol + NCOL) % NCOL)
+                        : nullptr;
+            }
+        }
+        horizonMaps.Bake(horizonMap(iRow, jCol), neighbours);
+        horizonMap(iRow, jCol).BlitColorTo(horizonAtlas, jCol * atlasTileSize, iRow * atlasTileSize,
+                                           (jCol + 1) * atlasTileSize, (iRow + 1) * atlasTileSize);
     }
 
     /** the grass map buffer (i,j) */
@@ -349,6 +884,111 @@ private:
         grassMap(iRow, jCol).Unbind();
     }
 
+    /** places the bushes of the tile (i,j) on its new maps, they stay cached until then */
+    void placeGrass(int iRow, int jCol) {
+        grass.Place(iRow * NCOL + jCol, heightMap(iRow, jCol).id(), grassMap(iRow, jCol).id());
+    }
+
+    /** places the rocks, shrubs and trees of the tile (i,j) on its new maps, seeded by its noise position */
+    void placeScatter(int iRow, int jCol) {
+        glm::vec2 noisePos = noisePosFor(iRow, jCol);
+        scatter.Place(iRow * NCOL + jCol, glm::ivec2(std::round(noisePos.x), std::round(noisePos.y)),
+                      heightMap(iRow, jCol).id(), grassMap(iRow, jCol).id());
+    }
+
+    /**
+     * heave, pitch and roll of the plane fitted through the water under the hull, sampled on a grid over the
+     * bounds of the ship. In scene units and radians
+     */
+    glm::vec3 hullMotion() {
+        constexpr int ACROSS = 3, ALONG = 5, SAMPLES = ACROSS * ALONG;
+        glm::vec3 bmin = mightyShip.getBoundsMin(), bmax = mightyShip.getBoundsMax();
+        glm::vec3 middle = 0.5f * (bmin + bmax);
+        float x[SAMPLES], z[SAMPLES], offsetX[SAMPLES], offsetZ[SAMPLES];
+        float dx[SAMPLES], dy[SAMPLES], dz[SAMPLES];
+        for (int a = 0; a < ACROSS; ++a) {
+            for (int b = 0; b < ALONG; ++b) {
+                int k = a * ALONG + b;
+                offsetX[k] = (bmax.x - bmin.x) * ((a + 0.5f) / ACROSS - 0.5f);
+                offsetZ[k] = (bmax.z - bmin.z) * ((b + 0.5f) / ALONG - 0.5f);
+                x[k] = shipPos.x + middle.x + offsetX[k];
+                z[k] = shipPos.z + middle.z + offsetZ[k];
+            }
+        }
+        waveSampler.evaluate(SAMPLES, x, z, dx, dy, dz);
+
+        // the samples are symmetric around the middle: the least squares plane has independent slopes
+        float heave = 0.0f, slopeX = 0.0f, slopeZ = 0.0f, normX = 0.0f, normZ = 0.0f;
+        for (int k = 0; k < SAMPLES; ++k) {
+            heave += dy[k];
+            slopeX += offsetX[k] * dy[k];
+            slopeZ += offsetZ[k] * dy[k];
+            normX += offsetX[k] * offsetX[k];
+            normZ += offsetZ[k] * offsetZ[k];
+        }
+        heave /= SAMPLES;
+        slopeX = normX > 0.0f ? slopeX / normX : 0.0f;
+        slopeZ = normZ > 0.0f ? slopeZ / normZ : 0.0f;
+        // rotating about x lifts the -z end, rotating about z lifts the +x end
+        return glm::vec3(heave, -std::atan(slopeZ), std::atan(slopeX));
+    }
+
+    /** tells the shadow cascades that the casters in the bounds of the ship change */
+    void invalidateShipShadow() {
+        glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX);
+        for (int k = 0; k < 8; ++k) {
+            glm::vec3 corner = boxCorner(mightyShip.getBoundsMin(), mightyShip.getBoundsMax(), k);
+            glm::vec3 p = glm::vec3(shipModelMatrix * glm::vec4(corner, 1.0f));
+            bmin = glm::min(bmin, p);
+            bmax = glm::max(bmax, p);
+        }
+        invalidateShadow(bmin, bmax);
+    }
+
+    /** tells the shadow cascades that the casters in the bounds of the boats afloat change */
+    void invalidateFleetShadow() {
+        glm::vec3 bmin, bmax;
+        if (fleet.getBounds(worldOffset(), bmin, bmax)) {
+            invalidateShadow(bmin, bmax);
+        }
+    }
+
+    /** tells the shadow cascades that the bushes and the objects casting shadows around the central tile change */
+    void invalidateTileShadows() {
+        glm::vec3 grassMin, grassMax, scatterMin, scatterMax;
+        grass.getTileBounds(glm::vec2(0.0f), grassMin, grassMax);
+        scatter.getTileBounds(glm::vec2(0.0f), scatterMin, scatterMax);
+        glm::vec3 grassRadius(grass.getShadowRadius(), 0.0f, grass.getShadowRadius());
+        glm::vec3 scatterRadius(scatter.getShadowRadius(), 0.0f, scatter.getShadowRadius());
+        invalidateShadow(glm::min(grassMin - grassRadius, scatterMin - scatterRadius),
+                         glm::max(grassMax + grassRadius, scatterMax + scatterRadius));
+    }
+
+    /** tells the shadow cascades that the casters inside this box of the scene change */
+    void invalidateShadow(const glm::vec3 &bmin, const glm::vec3 &bmax) {
+        if (shadowCascades != nullptr) {
+            shadowCascades->invalidate(bmin + worldOffset(), bmax + worldOffset());
+        }
+    }
+
+    /** whether the box can overlap the [-1, 1] x [-1, 1] clip space square of the transformation */
+    static bool overlapsClipSpace(const glm::mat4 &transformation, const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+        glm::vec2 bmin(FLT_MAX), bmax(-FLT_MAX);
+        for (int k = 0; k < 8; ++k) {
+            glm::vec2 p = glm::vec2(transformation * glm::vec4(boxCorner(boxMin, boxMax, k), 1.0f));
+            bmin = glm::min(bmin, p);
+            bmax = glm::max(bmax, p);
+        }
+        return bmin.x <= 1.0f && bmax.x >= -1.0f && bmin.y <= 1.0f && bmax.y >= -1.0f;
+    }
+
+    /** the corner k in [0, 8[ of the box */
+    static glm::vec3 boxCorner(const glm::vec3 &boxMin, const glm::vec3 &boxMax, int k) {
+        return glm::vec3((k & 1) ? boxMax.x : boxMin.x,
+                         (k & 2) ? boxMax.y : boxMin.y,
+                         (k & 4) ? boxMax.z : boxMin.z);
+    }
+
     /** the noise position of the grid (i,j) */
     glm::vec2 noisePosFor(int iRow, int jCol) {
         return noisePosition + translation(iRow, jCol);
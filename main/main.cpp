@@ -7,6 +7,7 @@
 #include "gridmesh.h"
 #include "terrain/terrain.h"
 #include "framebuffer.h"
+#include "render_target_pool.h"
 #include "screenquad/screenquad.h"
 #include "scene_controler.h"
 #include "camera/camera.h"
@@ -14,10 +15,18 @@
 #include "light/light.h"
 #include "material/material.h"
 #include "skyDome/skyDome.h"
-#include "blurQuad/blurquad.h"
+#include "clouds/volumetricclouds.h"
+#include "bloom/bloom.h"
+#include "reflection/planarreflection.h"
+#include "ssr/screenspacereflection.h"
 #include "large_scene.h"
 #include "bezier/BezierCurve.h"
 #include "model/model.h"
+#include "profiling/gpu_profiler.h"
+#include "profiling/dynamic_resolution.h"
+#include "profiling/sample_counter.h"
+#include "profiling/flythrough.h"
+#include "deferred/deferredlighting.h"
 
 using namespace glm;
 
@@ -25,12 +34,24 @@ float grid_size = 1.0f;
 LargeScene scene(2 * grid_size);
 SceneControler sceneControler(scene, grid_size, grid_size);
 SkyDome skyDome;
+VolumetricClouds clouds;
 Camera camera;
-ColorAndDepthFBO screenQuadBuffer, reflectionBuffer, screenQuadBufferPostProcessing;
-DoubleColorAndDepthFBO bloomHDRBuffer;
-DepthFBO shadowBuffer;
+HDRColorAndDepthFBO hdrBuffer;
+GBufferFBO gBuffer;
+DeferredLighting deferredLighting;
+RenderTargetPool renderTargets;
+ColorAndDepthFBO *reflectionBuffer;
+ShadowCascades shadowCascades;
 ScreenQuad screenquad;
-BlurQuad blurQuad;
+Bloom bloom;
+PlanarReflection planarReflection;
+Ocean ocean;
+Ripples ripples;
+ScreenSpaceReflection screenSpaceReflection;
+GpuProfiler gpuProfiler;
+SampleCounter sampleCounter;
+// holds 60 fps, the scene is never rendered below half the window resolution
+DynamicResolution dynamicResolution(16.0f, 0.5f, 1.0f);
 Light light;
 Material material;
 
@@ -43,6 +64,12 @@ bool keys[1024];
 bool firstMouse = false;
 bool wireframeDebugEnabled = false;
 bool enableBlurPostProcess = true;
+bool enableTerrainDepthPrepass = true;
+bool enableDeferredShading = false;
+bool enableScreenSpaceReflections = false;
+bool enableProjectedWater = false;
+// the per system breakdown after the frame rate, every second
+bool showStatistics = false;
 
 // Window size in screen coordinates
 int window_width_sc;
@@ -51,12 +78,21 @@ int window_height_sc;
 int window_width = 1600;
 int window_height = 1200;
 const bool FULLSCREEN = true;
-// native render dimensions in pixels
+// internal render dimensions in pixels, the framebuffer size times the dynamic resolution scale
 int screenWidth = 1440;
 int screenHeight = 1080;
+
+// post-processing targets, their resolution is relative to the internal render dimensions.
+// alpha is never read back from them so the packed float format halves their size.
+// the reflection is rendered at the resolution of planarReflection then downsampled into REFLECTION_TARGET
+const RenderTargetDesc REFLECTION_TARGET = {0.25f, GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, true, true};
+const RenderTargetDesc SKY_TARGET        = {1.0f, GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, true, false};
 float lastX = 0.0f;
 float lastY = 0.0f;
 
+// the reflection keeps what is above this height, slightly below the water to hide the seams at the shore
+const float MIRROR_CLIP_HEIGHT = -0.005f;
+
 const float DISPLACEMENT_TIME = 10.f;
 const float OFFSET_QTY = 0.04f;
 float start_time1 = 100.f;
@@ -65,7 +101,6 @@ float start_time3;
 float totalDispX = 0.f;
 float totalDispY = 0.f;
 mat4 projection_matrix, view_matrix, mirrored_view_matrix, quad_model_matrix;
-mat4 depth_projection_matrix, depth_bias_matrix, depth_view_matrix, depth_model_matrix, depth_mvp;
 mat4 MVP, mMVP, MV, mMV, NORMALM, mNORMALM;
 //mat4 shipM, mShipMVP, mShipMV, mShipNORMALM;
 
@@ -113,12 +148,10 @@ BezierCurve bezier3({
                     });
 
 
-mat4 biasMatrix = mat4(
-            0.5, 0.0, 0.0, 0.0,
-            0.0, 0.5, 0.0, 0.0,
-            0.0, 0.0, 0.5, 0.0,
-            0.5, 0.5, 0.5, 1.0
-            );
+// resolution of each shadow cascade, the 4 of them hold a quarter of the texels of a single 4096x4096 map
+const int SHADOW_CASCADE_SIZE = 1024;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 5000.0f;
 
 const GLfloat SEC_DURATION = 1.0;
 GLfloat deltaTime = 0.0f;	// Time between current frame and last frame
@@ -128,6 +161,24 @@ GLuint frameCount = 0;
 LargeScene::TileSet visibleTiles;
 FractionalView fractionalView;
 
+// low altitude path across the mountains, forward and deferred frames are interleaved
+Flythrough deferredFlythrough({
+                                  vec3(-6.f, 1.4f, 6.f),
+                                  vec3(-2.f, 0.9f, 2.f),
+                                  vec3(2.f, 1.2f, -3.f),
+                                  vec3(6.f, 1.5f, -6.f)
+                              }, 20.f, "scene forward", "scene deferred");
+// the flythroughs run at a fixed resolution, the dynamic resolution is restored once they end
+bool dynamicResolutionBeforeFlythrough = false;
+
+// over the sea around the ship, frames with the planar and the screen-space reflection are interleaved
+Flythrough reflectionFlythrough({
+                                    vec3(0.f, 0.8f, 16.f),
+                                    vec3(4.f, 0.6f, 11.f),
+                                    vec3(9.f, 0.7f, 14.f),
+                                    vec3(12.f, 1.0f, 8.f)
+                                }, 20.f, "frame planar", "frame ssr");
+
 //Model mightyShip("yacht.3ds");
 //GLuint mightyShipShaderProgram;
 
@@ -144,36 +195,47 @@ void Init() {
     light    = Light{vec3(0.0, 2.0, -4.0)};
     material = Material{};
 
+    gpuProfiler.Init();
+
     // buffers must be initialized in that order
-    int screenQuadBuffer_texture_id = screenQuadBuffer.Init(screenWidth, screenHeight, GL_RGB16F, GL_RGB, GL_FLOAT, false, false);
-    bloomHDRBuffer.Init(screenWidth, screenHeight, GL_RGB16F, GL_RGB, GL_FLOAT, true, false);
+    renderTargets.Init(screenWidth, screenHeight);
+    hdrBuffer.Init(screenWidth, screenHeight, GL_RGB16F, GL_RGB, GL_FLOAT, true, false);
+    gBuffer.Init(screenWidth, screenHeight, hdrBuffer.getDepthTexture());
     scene.initHeightMap(perlinTextureSize, perlinTextureSize);
-    reflectionBuffer.Init(screenWidth, screenHeight, GL_RGBA16F, GL_RGBA, GL_FLOAT, true, true);
-    screenQuadBufferPostProcessing.Init(screenWidth, screenHeight, GL_RGBA16F, GL_RGBA, GL_FLOAT, true, true);
-
-    int shadowBuffer_texture_id     = shadowBuffer.Init(4096, 4096, GL_DEPTH_COMPONENT32, GL_UNSIGNED_INT);
-
-    //screenquad.Init(bloomHDRBuffer.getColorTexture(0), screenQuadBuffer_texture_id);
-    screenquad.Init(bloomHDRBuffer.getColorTexture(0), screenQuadBuffer_texture_id);
-    blurQuad.Init(screenWidth, screenHeight, reflectionBuffer.getColorTexture());
-    scene.init(shadowBuffer_texture_id, reflectionBuffer.getColorTexture(), &light);
+    reflectionBuffer = renderTargets.acquire(REFLECTION_TARGET);
+
+    // the cascades hold the casters up to the edge of the scene, the camera can be anywhere in the central tile
+    GLuint shadowCascades_texture_id = shadowCascades.Init(SHADOW_CASCADE_SIZE, NEAR_PLANE,
+                                                           scene.maximumExtent() / 2.0f, scene.maximumExtent());
+
+    bloom.Init(screenWidth, screenHeight);
+    screenquad.Init(hdrBuffer.getColorTexture(), bloom.getTexture());
+    scene.init(&shadowCascades, reflectionBuffer->getColorTexture(), &light);
+    planarReflection.Init();
+    scene.useReflection(&planarReflection);
+    scene.setMirrorClipHeight(MIRROR_CLIP_HEIGHT);
+    scene.initFog(hdrBuffer.getDepthTexture(), 0 /*the sky target is acquired every frame*/);
+    deferredLighting.Init(gBuffer.getAlbedoTexture(), gBuffer.getNormalTexture(),
+                          hdrBuffer.getDepthTexture(), shadowCascades_texture_id);
+    deferredLighting.useLight(&light);
+    deferredLighting.useShadowCascades(&shadowCascades);
     skyDome.Init();
     skyDome.useLight(&light);
+    clouds.Init(screenWidth, screenHeight, hdrBuffer.getDepthTexture(), &light, &skyDome);
+    skyDome.useSkyLayer(&clouds);
+    screenSpaceReflection.Init(screenWidth, screenHeight, &skyDome);
+    scene.useScreenSpaceReflection(&screenSpaceReflection);
+    ocean.Init();
+    scene.useOcean(&ocean);
+    ripples.Init();
+    scene.useRipples(&ripples);
 
     //mightyShipShaderProgram = icg_helper::LoadShaders("yacht_vshader.glsl", "yacht_fshader.glsl");
     //mightyShip.Init(mightyShipShaderProgram, shadowBuffer_texture_id);
     //mightyShip.useLight(&light);
 
-    float skyDomeRadius = skyDome.getRadius();
-    float sceneHalfMaxSize = scene.maximumExtent() / 2.0;
-
     view_matrix             = camera.GetViewMatrix();
-    depth_projection_matrix = glm::ortho(-sceneHalfMaxSize, sceneHalfMaxSize, -sceneHalfMaxSize, sceneHalfMaxSize, skyDomeRadius - sceneHalfMaxSize, skyDomeRadius + sceneHalfMaxSize);
-    depth_view_matrix       = lookAt(light.getPos(), vec3(0.0,0.0,0.0), vec3(0, 0, 0));
     quad_model_matrix       = IDENTITY_MATRIX;
-    depth_mvp               = depth_projection_matrix * depth_view_matrix * depth_model_matrix;
-    depth_bias_matrix       = biasMatrix * depth_mvp;
-    depth_model_matrix      = quad_model_matrix;
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -186,21 +248,127 @@ void Init() {
 
 void computeReflections(LargeScene::TileSet const& visibleTiles);
 void computeBloom();
+void drawTerrain();
+void drawSceneForward();
+void drawSceneDeferred();
+void updateRenderResolution();
 void drawMightyShip(glm::mat4 const& , glm::mat4 const&, glm::mat4 const& , glm::mat4 const& );
 
+/** the cost of each system, averaged since the last statistics of Display */
+void printStatistics() {
+    // overdraw: terrain fragments surviving the depth test per rendered pixel
+    float pixels = float(screenWidth) * screenHeight;
+    std::cout << "Terrain: " << gpuProfiler.averageMs("terrain") << " ms, "
+              << sampleCounter.averageSamples("terrain") / pixels << " shaded fragments/px";
+    if(enableTerrainDepthPrepass){
+        std::cout << " | depth pre-pass: " << gpuProfiler.averageMs("terrain prepass") << " ms, "
+                  << sampleCounter.averageSamples("terrain prepass") / pixels << " fragments/px";
+    }
+    std::cout << std::endl;
+
+    std::cout << "Shadows (" << (shadowCascades.isPrefiltered() ? "EVSM" : "PCF") << "): "
+              << gpuProfiler.averageMs("shadows") << " ms, "
+              << 100.0f * shadowCascades.skippedFraction() << "% frames skipped, "
+              << 100.0f * shadowCascades.redrawnFraction() << "% texels redrawn, "
+              << shadowCascades.memoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    std::cout << "Reflection: " << gpuProfiler.averageMs("reflection") << " ms, scale "
+              << planarReflection.getScale() << ", "
+              << 100.0f * planarReflection.updatedFraction() << "% frames rendered" << std::endl;
+
+    if(screenSpaceReflection.isEnabled()){
+        std::cout << "Screen-space reflection: capture " << gpuProfiler.averageMs("ssr capture") << " ms, "
+                  << screenSpaceReflection.memoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+
+    std::cout << "Sky cube map: " << gpuProfiler.averageMs("sky cubemap") << " ms, "
+              << skyDome.getFacesRendered() << " faces rendered, "
+              << skyDome.memoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    std::cout << "Clouds: " << gpuProfiler.averageMs("clouds") << " ms ("
+              << clouds.getWidth() << "x" << clouds.getHeight() << "), "
+              << clouds.memoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    std::cout << "Bloom (" << (bloom.isUsingCompute() ? "compute" : "fragment") << "): "
+              << gpuProfiler.averageMs("bloom") << " ms, "
+              << bloom.memoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    std::cout << "Ocean: " << gpuProfiler.averageMs("ocean") << " ms, "
+              << Ocean::SIZE << "x" << Ocean::SIZE << " FFT, "
+              << ocean.memoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    std::cout << "Ripples: " << gpuProfiler.averageMs("ripples") << " ms, "
+              << Ripples::SIZE << "x" << Ripples::SIZE << ", "
+              << ripples.getStepsLastUpdate() << " steps, "
+              << ripples.memoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    std::cout << "Water (" << (enableProjectedWater ? "projected grid" : "tiles") << "): "
+              << gpuProfiler.averageMs("water") << " ms, atlases "
+              << scene.waterAtlasMemoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    std::cout << "Grass: " << gpuProfiler.averageMs("grass") << " ms, "
+              << scene.grassInstancesDrawn() << " bushes in " << scene.grassTilesDrawn() << " tiles drawn, "
+              << scene.grassVerticesDrawn() << " vertices, radius " << scene.grassLodRadius() << ", "
+              << scene.grassInstancesPlaced() << " placed, "
+              << scene.grassMemoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    const Scatter& scatter = scene.scatterStatistics();
+    std::cout << "Scatter: " << gpuProfiler.averageMs("scatter") << " ms, "
+              << scatter.getInstancesLastFrame() << " objects in " << scatter.getDrawsLastFrame() << " draws, "
+              << scatter.getTrianglesLastFrame() << " triangles, "
+              << scatter.placedInstances() << " placed, "
+              << scatter.memoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+
+    const Fleet& fleet = scene.fleetStatistics();
+    std::cout << "Fleet: " << gpuProfiler.averageMs("fleet") << " ms, "
+              << fleet.getBoatsLastDraw() << " of " << fleet.boats() << " boats in "
+              << fleet.getDrawsLastDraw() << " levels drawn, "
+              << fleet.getTrianglesLastDraw() << " triangles, update "
+              << fleet.getUpdateSeconds() * 1000.0 << " ms" << std::endl;
+
+    std::cout << "Horizon maps: " << scene.bakedHorizonMaps() << " baked, "
+              << scene.horizonMapsMemoryUsage() / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
 void Display() {
     glClear(GL_DEPTH_BUFFER_BIT);
 
     GLfloat currentFrame = glfwGetTime();
+    // the first delta holds the loading
+    bool firstFrame = lastFrame == 0.0f;
     deltaTime = currentFrame - lastFrame;
     lastFrame = currentFrame;
 
     if(currentFrame - lastSec > SEC_DURATION){
-        std::cout << "Frames per second: " << frameCount << std::endl;
+        std::cout << "Frames per second: " << frameCount
+                  << " | GPU frame: " << gpuProfiler.averageMs("frame") << " ms"
+                  << " | render scale: " << dynamicResolution.getScale()
+                  << " (" << screenWidth << "x" << screenHeight << ")" << std::endl;
+
+        if(showStatistics){
+            printStatistics();
+        }
+        shadowCascades.resetStats();
+        planarReflection.resetStats();
+        skyDome.resetStats();
+        gpuProfiler.resetAverages();
+        sampleCounter.resetAverages();
         lastSec = currentFrame;
         frameCount = 0;
     }
 
+    gpuProfiler.beginFrame();
+    sampleCounter.beginFrame();
+    gpuProfiler.begin("frame");
+
+    // the screen-space reflection needs the lit opaque scene before the water, the deferred path has none
+    bool deferred = deferredFlythrough.isRunning() ? deferredFlythrough.useModeB() : enableDeferredShading;
+    bool ssr = !deferred &&
+            (reflectionFlythrough.isRunning() ? reflectionFlythrough.useModeB() : enableScreenSpaceReflections);
+    screenSpaceReflection.setEnabled(ssr);
+    const char* frameSection = ssr ? "frame ssr" : "frame planar";
+    gpuProfiler.begin(frameSection);
+
     scene.writeVisibleTilesOnly(visibleTiles, camera.getPos(), camera.getFront());
 
     //Compute matrices
@@ -213,109 +381,244 @@ void Display() {
     MVP = projection_matrix * MV;
     NORMALM = inverse(transpose(MV));
 
-    //shadow matrices
-    depth_view_matrix = lookAt(light.getPos(), vec3(0.0,0.0,0.0), vec3(0, 1, 0));
-    depth_model_matrix = IDENTITY_MATRIX;
-    depth_mvp = depth_projection_matrix * depth_view_matrix * depth_model_matrix;
-    depth_bias_matrix = biasMatrix * depth_mvp;
-
-    shadowBuffer.Bind();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // shadow cascades, cached: only the regions that scrolled in or that the ship crossed are redrawn,
+    // the terrain shadows itself with the horizon maps baked with its tiles
+    // the sun moves before anything is shadowed or lit, one face of the sky cube map follows it
+    skyDome.update(camera.getPos());
+    clouds.update(camera.getPos(), view_matrix, projection_matrix, scene.worldOffset());
+    gpuProfiler.begin("sky cubemap");
+    skyDome.updateCubemap();
+    gpuProfiler.end("sky cubemap");
+
+    // the surface every water tile samples, once per frame
+    gpuProfiler.begin("ocean");
+    ocean.update(currentFrame);
+    gpuProfiler.end("ocean");
+
+    gpuProfiler.begin("shadows");
+    scene.updateShip();
+    scene.updateFleet(camera.getPos());
+    scene.updateTileShadows();
+    shadowCascades.update(camera.getPos(), scene.worldOffset(), light.getPos());
     glDisable(GL_CULL_FACE);
-    scene.drawMountains(MVP, MV, IDENTITY_MATRIX, depth_mvp, fractionalView, false, true);
+    scene.drawShadowCascades(shadowCascades);
     glEnable(GL_CULL_FACE);
-    shadowBuffer.Unbind();
-
-    computeReflections(visibleTiles);
+    gpuProfiler.end("shadows");
+
+    // the ship's wake, after the ship moved
+    gpuProfiler.begin("ripples");
+    scene.updateRipples(currentFrame);
+    gpuProfiler.end("ripples");
+
+    if(!ssr){
+        gpuProfiler.begin("reflection");
+        computeReflections(visibleTiles);
+        gpuProfiler.end("reflection");
+    } else {
+        // the mirror map gets stale
+        planarReflection.invalidate();
+    }
 
-    bloomHDRBuffer.Bind();
+    // the sky is kept apart so that the fog pass can fade the opaque scene into it
+    ColorAndDepthFBO* skyBuffer = renderTargets.acquire(SKY_TARGET);
+    skyBuffer->Bind();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    skyDome.Draw(quad_model_matrix, view_matrix, projection_matrix, camera.getPos());
-    scene.drawMountainTiles(visibleTiles, MVP, MV, NORMALM, depth_bias_matrix, fractionalView, false);
-    scene.drawWaterTiles(visibleTiles, MVP, MV, NORMALM, depth_bias_matrix, fractionalView);
-    scene.drawGrassTiles(visibleTiles, projection_matrix * view_matrix,
-                         vec2(camera.getPos().x, camera.getPos().z));
-    scene.drawModels(MVP, MV, depth_bias_matrix);
-    //glm::mat4 shipMV = view_matrix * shipM;
-    //glm::mat4 shipMVP = projection_matrix * shipMV;
-    //glm::mat4 shipNORMALM = inverse(transpose(shipMV));
+    // the clouds of the main view are marched at their own resolution
+    skyDome.Draw(view_matrix, projection_matrix, false);
+    skyBuffer->Unbind();
+
+    const char* sceneSection = deferred ? "scene deferred" : "scene forward";
+    gpuProfiler.begin(sceneSection);
+    if(deferred){
+        drawSceneDeferred();
+    } else {
+        drawSceneForward();
+    }
+    gpuProfiler.end(sceneSection);
 
-    //glDisable(GL_CULL_FACE);
-    //mightyShip.Draw(shipMVP, shipMV, shipNORMALM, depth_bias_matrix);
-    //glEnable(GL_CULL_FACE);
+    hdrBuffer.BindColorOnly();
+    scene.drawFog(projection_matrix * view_matrix, skyBuffer->getColorTexture());
+    hdrBuffer.Unbind();
+    renderTargets.release(skyBuffer);
 
-    // END OF MODEL LOADING INTEGRATION
-    bloomHDRBuffer.Unbind();
+    // over the fogged scene, the rays stop at its depth
+    gpuProfiler.begin("clouds");
+    clouds.Render();
+    hdrBuffer.BindColorOnly();
+    clouds.Composite();
+    hdrBuffer.Unbind();
+    gpuProfiler.end("clouds");
 
     computeBloom();
 
     glViewport(0, 0, window_width, window_height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    screenquad.Draw();
+    screenquad.Draw(dynamicResolution.getScale() < 1.0f);
+    gpuProfiler.end(frameSection);
+    gpuProfiler.end("frame");
+
+    // the timer queries are read back LATENCY frames late so this never stalls. Without them (some software
+    // rasterizers) the CPU frame delta stands in, the swap blocks once the GPU falls behind
+    float frameMs = gpuProfiler.isSupported() ? gpuProfiler.lastMs("frame") : 1000.0f * deltaTime;
+    if(!firstFrame && dynamicResolution.update(frameMs, currentFrame)){
+        updateRenderResolution();
+    }
     frameCount++;
 }
 
 
-void computeReflections(LargeScene::TileSet const& visibleTiles) {
+// optional depth pre-pass then the terrain, into the bound target
+void drawTerrain() {
+    // depth-only terrain first so that the expensive terrain shading runs once per pixel
+    if(enableTerrainDepthPrepass){
+        gpuProfiler.begin("terrain prepass");
+        sampleCounter.begin("terrain prepass");
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        scene.drawMountainTilesDepth(visibleTiles, MVP, MV);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        sampleCounter.end("terrain prepass");
+        gpuProfiler.end("terrain prepass");
+    }
 
-    //mirror matrices
-    mMV = mirrored_view_matrix * quad_model_matrix;
-    mMVP = projection_matrix * mMV;
-    mNORMALM = inverse(transpose(mMV));
+    gpuProfiler.begin("terrain");
+    sampleCounter.begin("terrain");
+    scene.drawMountainTiles(visibleTiles, MVP, MV, NORMALM, fractionalView, false,
+                            enableTerrainDepthPrepass);
+    sampleCounter.end("terrain");
+    gpuProfiler.end("terrain");
+}
 
-    //mShipMV = mirrored_view_matrix * shipM;
-    //mShipMVP = projection_matrix * mShipMV;
-    //mShipNORMALM = inverse(transpose(mShipMV));
+// the tiles, each one tessellated, or the whole sea at once
+void drawWater() {
+    gpuProfiler.begin("water");
+    if(enableProjectedWater){
+        scene.drawWaterProjected(MVP, MV, NORMALM);
+    } else {
+        scene.drawWaterTiles(visibleTiles, MVP, MV, NORMALM, fractionalView);
+    }
+    gpuProfiler.end("water");
+}
+
+// the rocks, shrubs and trees are placed once per tile, drawn instanced per tile and kind
+void drawScatter() {
+    gpuProfiler.begin("scatter");
+    scene.drawScatterTiles(visibleTiles, MVP, MV, NORMALM, vec2(camera.getPos().x, camera.getPos().z));
+    gpuProfiler.end("scatter");
+}
+
+// the boats are drawn instanced per level of detail, culled by the tiles and the frustum
+void drawFleet() {
+    gpuProfiler.begin("fleet");
+    scene.drawFleetTiles(visibleTiles, MVP, MV, NORMALM);
+    gpuProfiler.end("fleet");
+}
 
-    reflectionBuffer.Bind();
+// the bushes are placed once per tile, only the culling of the tiles runs every frame
+void drawGrass() {
+    gpuProfiler.begin("grass");
+    scene.drawGrassTiles(visibleTiles, projection_matrix * view_matrix,
+                         vec2(camera.getPos().x, camera.getPos().z));
+    gpuProfiler.end("grass");
+}
+
+void drawSceneForward() {
+    hdrBuffer.Bind();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    skyDome.Draw(quad_model_matrix, mirrored_view_matrix, projection_matrix, camera.getPos());
-    scene.drawMountainTiles(visibleTiles, mMVP, mMV, mNORMALM, depth_bias_matrix, fractionalView, true);
-    scene.drawModels(mMVP, mMV, depth_bias_matrix, true);
-    //glDisable(GL_CULL_FACE);
-    //mightyShip.Draw(mShipMVP, mShipMV, mShipNORMALM, depth_bias_matrix, true);
-    //glEnable(GL_CULL_FACE);
-    reflectionBuffer.Unbind();
-
-    //Code below performs blur on reflection
-    if(enableBlurPostProcess){
-        blurQuad.setRenderingPassNumber(0);
-        blurQuad.updateTextureId(reflectionBuffer.getColorTexture());
-
-        screenQuadBufferPostProcessing.Bind();
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        blurQuad.Draw(1.0);
-        screenQuadBufferPostProcessing.Unbind();
-
-        blurQuad.setRenderingPassNumber(1);
-        blurQuad.updateTextureId(screenQuadBufferPostProcessing.getColorTexture());
-
-        reflectionBuffer.Bind();
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        blurQuad.Draw(1.0);
-        reflectionBuffer.Unbind();
+
+    // terrain, models and grass are opaque, the fog pass does the fading
+    glDisable(GL_BLEND);
+    drawTerrain();
+    scene.drawModels(MVP, MV);
+    drawFleet();
+    drawScatter();
+    drawGrass();
+
+    // the water reflects this frame's opaque scene
+    if(screenSpaceReflection.isEnabled()){
+        gpuProfiler.begin("ssr capture");
+        screenSpaceReflection.Capture(hdrBuffer, projection_matrix);
+        hdrBuffer.Bind();
+        gpuProfiler.end("ssr capture");
     }
+
+    // water blends over the sea bed
+    glEnable(GL_BLEND);
+    drawWater();
+    hdrBuffer.Unbind();
 }
 
-void computeBloom() {
+// terrain, models and water fill the G-buffer, which shares its depth with hdrBuffer
+void drawSceneDeferred() {
+    gBuffer.Bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    scene.useDeferredPass(true);
+
+    glDisable(GL_BLEND);
+    drawTerrain();
+    scene.drawModels(MVP, MV);
+    drawFleet();
+    drawScatter();
+
+    // the water albedo blends over the sea bed one, its normal and material replace them
+    glEnablei(GL_BLEND, 0);
+    drawWater();
+
+    scene.useDeferredPass(false);
+    gBuffer.Unbind();
+
+    gpuProfiler.begin("lighting");
+    hdrBuffer.BindColorOnly();
+    deferredLighting.Draw(projection_matrix, view_matrix, NORMALM);
+    hdrBuffer.Unbind();
+    gpuProfiler.end("lighting");
+
+    // grass stays forward with its own lighting, opaque and alpha tested over the lit scene
+    hdrBuffer.Bind();
+    glDisable(GL_BLEND);
+    drawGrass();
+    glEnable(GL_BLEND);
+    hdrBuffer.Unbind();
+}
 
-    blurQuad.setRenderingPassNumber(0);
-    blurQuad.updateTextureId(bloomHDRBuffer.getColorTexture(1));
+void computeReflections(LargeScene::TileSet const& visibleTiles) {
 
-    screenQuadBufferPostProcessing.Bind();
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    blurQuad.Draw(0.5);
-    screenQuadBufferPostProcessing.Unbind();
+    //mirror matrices, the near plane clips what is below the water before rasterization
+    mMV = mirrored_view_matrix * quad_model_matrix;
+    mMVP = camera.GetObliqueProjectionMatrix(projection_matrix, mirrored_view_matrix, MIRROR_CLIP_HEIGHT) * mMV;
+    mNORMALM = inverse(transpose(mMV));
 
-    blurQuad.setRenderingPassNumber(1);
-    blurQuad.updateTextureId(screenQuadBufferPostProcessing.getColorTexture());
+    // on alternate frames the water reprojects the last reflection
+    planarReflection.beginFrame(scene.worldOffset());
+    if(!planarReflection.needsUpdate()){
+        return;
+    }
 
-    screenQuadBuffer.Bind();
+    // lower resolution and tessellation, the reflection is blurred and broken by the waves
+    ColorAndDepthFBO* renderBuffer = renderTargets.acquire(planarReflection.renderTarget());
+    renderBuffer->Bind();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    blurQuad.Draw(0.5);
-    screenQuadBuffer.Unbind();
+    skyDome.Draw(mirrored_view_matrix, projection_matrix);
+    scene.drawMountainTiles(visibleTiles, mMVP, mMV, mNORMALM, fractionalView, true, false,
+                            planarReflection.tessellationScale());
+    scene.drawModels(mMVP, mMV, true);
+    scene.drawFleetTiles(visibleTiles, mMVP, mMV, mNORMALM, true);
+    renderBuffer->Unbind();
+
+    // the blur is done while downsampling
+    reflectionBuffer->Bind();
+    planarReflection.Downsample(renderBuffer->getColorTexture(), enableBlurPostProcess);
+    reflectionBuffer->Unbind();
+
+    renderTargets.release(renderBuffer);
+    planarReflection.rendered(mMVP);
+}
 
+// bright pass and mip chain from the HDR scene, the geometry passes write a single target
+void computeBloom() {
+    gpuProfiler.begin("bloom");
+    bloom.Compute(hdrBuffer.getColorTexture());
+    gpuProfiler.end("bloom");
 }
 
 
@@ -346,11 +649,16 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 void scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(yoffset);
-    projection_matrix = perspective(glm::radians(camera.Fov), (GLfloat)screenWidth / (GLfloat)screenHeight, 0.1f, 5000.0f);
+    projection_matrix = perspective(glm::radians(camera.Fov), (GLfloat)window_width / (GLfloat)window_height, NEAR_PLANE, FAR_PLANE);
 }
 
 // Gets called when the windows/framebuffer is resized.
 void SetupProjection(GLFWwindow* window, int width, int height) {
+    // minimized window, keep the render targets as they are
+    if(width == 0 || height == 0){
+        return;
+    }
+
     window_width = width;
     window_height = height;
 
@@ -359,11 +667,49 @@ void SetupProjection(GLFWwindow* window, int width, int height) {
 
     glViewport(0, 0, window_width, window_height);
 
-    projection_matrix = glm::perspective(glm::radians(camera.Fov), (GLfloat)screenWidth / screenHeight, 0.1f, 5000.0f);
+    updateRenderResolution();
+    renderTargets.printStats();
+
+    projection_matrix = glm::perspective(glm::radians(camera.Fov), (GLfloat)window_width / window_height, NEAR_PLANE, FAR_PLANE);
 
     glfwGetWindowSize(window, &window_width_sc, &window_height_sc);
 }
 
+// Scales the internal render resolution from the framebuffer size, every target follows.
+void updateRenderResolution() {
+    screenWidth = std::max(1, int(window_width * dynamicResolution.getScale()));
+    screenHeight = std::max(1, int(window_height * dynamicResolution.getScale()));
+    hdrBuffer.Resize(screenWidth, screenHeight);
+    screenSpaceReflection.Resize(screenWidth, screenHeight);
+    gBuffer.Resize(screenWidth, screenHeight);
+    renderTargets.Resize(screenWidth, screenHeight);
+    bloom.Resize(screenWidth, screenHeight);
+    clouds.Resize(screenWidth, screenHeight);
+    // the resized targets lost their content
+    planarReflection.invalidate();
+}
+
+/** fixed resolution so that both modes of a flythrough render the same pixels, to call before it starts */
+void pauseDynamicResolution() {
+    if(!deferredFlythrough.isRunning() && !reflectionFlythrough.isRunning()){
+        dynamicResolutionBeforeFlythrough = dynamicResolution.isEnabled();
+    }
+    if(dynamicResolution.isEnabled() && dynamicResolution.toggle()){
+        updateRenderResolution();
+    }
+}
+
+/** turns the dynamic resolution back on if it was before the flythroughs, once they all ended */
+void resumeDynamicResolution() {
+    if(deferredFlythrough.isRunning() || reflectionFlythrough.isRunning()){
+        return;
+    }
+    if(dynamicResolutionBeforeFlythrough && !dynamicResolution.isEnabled()){
+        dynamicResolution.toggle();
+        updateRenderResolution();
+    }
+}
+
 void ErrorCallback(int error, const char* description) {
     fputs(description, stderr);
 }
@@ -404,6 +750,71 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
         case GLFW_KEY_P:
             screenquad.updateGamma(0.1);
             break;
+        case GLFW_KEY_Z:
+            enableTerrainDepthPrepass = !enableTerrainDepthPrepass;
+            std::cout << "Terrain depth pre-pass: " << (enableTerrainDepthPrepass ? "on" : "off") << std::endl;
+            break;
+        case GLFW_KEY_X:
+            enableDeferredShading = !enableDeferredShading;
+            std::cout << "Deferred shading: " << (enableDeferredShading ? "on" : "off") << std::endl;
+            break;
+        case GLFW_KEY_V:
+            // compare the terrain pass timings of both filterings
+            shadowCascades.togglePrefiltering();
+            std::cout << "Shadow filtering: " << (shadowCascades.isPrefiltered() ? "EVSM" : "PCF") << std::endl;
+            break;
+        case GLFW_KEY_T:
+            pauseDynamicResolution();
+            deferredFlythrough.start(glfwGetTime(), camera, gpuProfiler);
+            break;
+        case GLFW_KEY_Y:
+            enableScreenSpaceReflections = !enableScreenSpaceReflections;
+            std::cout << "Water reflection: " << (enableScreenSpaceReflections ? "screen-space" : "planar") << std::endl;
+            break;
+        case GLFW_KEY_1:
+            enableProjectedWater = !enableProjectedWater;
+            std::cout << "Water: " << (enableProjectedWater ? "projected grid" : "tiles") << std::endl;
+            break;
+        case GLFW_KEY_2:
+            // the ship floats on the CPU copy of the waves
+            scene.checkWaveSampler();
+            break;
+        case GLFW_KEY_3:
+            // the grass LOD radius cycles through a few distances
+            scene.setGrassLodRadius(scene.grassLodRadius() >= 14.0f ? 6.0f : scene.grassLodRadius() + 4.0f);
+            std::cout << "Grass LOD radius: " << scene.grassLodRadius() << std::endl;
+            break;
+        case GLFW_KEY_E:
+            // same comparison as T, planar against screen-space reflections
+            pauseDynamicResolution();
+            reflectionFlythrough.start(glfwGetTime(), camera, gpuProfiler);
+            break;
+        case GLFW_KEY_Q:
+            bloom.toggleCompute();
+            if(!bloom.isComputeSupported()){
+                std::cout << "Bloom: compute shaders are not supported" << std::endl;
+            }
+            std::cout << "Bloom passes: " << (bloom.isUsingCompute() ? "compute" : "fragment") << std::endl;
+            break;
+        case GLFW_KEY_C:
+            planarReflection.cycleScale();
+            std::cout << "Reflection scale: " << planarReflection.getScale() << std::endl;
+            break;
+        case GLFW_KEY_M:
+            planarReflection.toggleAlternateFrames();
+            std::cout << "Reflection on alternate frames: "
+                      << (planarReflection.isAlternatingFrames() ? "on" : "off") << std::endl;
+            break;
+        case GLFW_KEY_4:
+            showStatistics = !showStatistics;
+            std::cout << "Statistics: " << (showStatistics ? "on" : "off") << std::endl;
+            break;
+        case GLFW_KEY_R:
+            if(dynamicResolution.toggle()){
+                updateRenderResolution();
+            }
+            std::cout << "Dynamic resolution: " << (dynamicResolution.isEnabled() ? "on" : "off") << std::endl;
+            break;
         }
     } else if(action == GLFW_RELEASE){
         keys[key] = false;
@@ -413,6 +824,13 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 
 void doMovement()
 {
+    if(deferredFlythrough.update(glfwGetTime(), camera, gpuProfiler)){
+        resumeDynamicResolution();
+    }
+    if(reflectionFlythrough.update(glfwGetTime(), camera, gpuProfiler)){
+        resumeDynamicResolution();
+    }
+
     // Camera controls
     if(keys[GLFW_KEY_W])
         camera.ProcessKeyboard(FORWARD, deltaTime);
@@ -606,8 +1024,20 @@ int main(int argc, char *argv[]) {
     }
 
     scene.cleanup();
-    reflectionBuffer.Cleanup();
-    shadowBuffer.Cleanup();
+    gpuProfiler.Cleanup();
+    sampleCounter.Cleanup();
+    deferredLighting.Cleanup();
+    planarReflection.Cleanup();
+    screenSpaceReflection.Cleanup();
+    bloom.Cleanup();
+    ocean.Cleanup();
+    ripples.Cleanup();
+    clouds.Cleanup();
+    skyDome.Cleanup();
+    gBuffer.Cleanup();
+    renderTargets.Cleanup();
+    hdrBuffer.Cleanup();
+    shadowCascades.Cleanup();
 
     // close OpenGL window and terminate GLFW
     glfwDestroyWindow(window);
@@ -9,6 +9,11 @@
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <cfloat>
+#include <cstdint>
+#include <utility>
 using namespace std;
 // GL Includes
 #include <GL/glew.h> // Contains all the necessery OpenGL includes
@@ -25,10 +30,25 @@ struct Vertex {
     glm::vec2 TexCoords;
 };
 
+// Vertex of the model cache, half the size of Vertex: the position quantized over the bounds of its mesh and
+// padded to 8 bytes, the normal in 10 bits per axis and the texture coordinates in half floats
+struct PackedVertex {
+    GLushort Position[4];
+    GLuint Normal;
+    GLuint TexCoords;
+};
+
 struct Texture {
     GLuint id;
     string type;
-    aiString path;
+    string path;
+};
+
+// Locations of the material uniforms in one program, looked up once
+struct MeshProgramIds {
+    vector<GLint> texture_ids;
+    GLint diffuseColor_id, specularColor_id, useTex_id;
+    GLint positionScale_id, positionOffset_id;
 };
 
 class Mesh {
@@ -42,50 +62,225 @@ public:
     glm::vec3 specularColor;
     bool textured;
 
+    // Bounds of the vertices, in model space
+    glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+    glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+
     /*  Functions  */
-    // Constructor
+    // Constructor, the vectors are moved in
     Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures, glm::vec3 diffuseColor, glm::vec3 specularColor, bool textured)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
         this->diffuseColor = diffuseColor;
         this->specularColor = specularColor;
         this->textured = textured;
+        this->positions.reserve(this->vertices.size());
+        for (const Vertex& v : this->vertices) {
+            boundsMin = glm::min(boundsMin, v.Position);
+            boundsMax = glm::max(boundsMax, v.Position);
+            this->positions.push_back(v.Position);
+        }
 
         // Now that we have all the required data, set the vertex buffers and its attribute pointers.
         this->setupMesh();
     }
 
+    // Constructor from the model cache: the packed vertices and the indices go to the buffers as they are, the
+    // positions are decoded over the bounds of the mesh by the shaders, see ModelCache
+    Mesh(const PackedVertex* packed, GLuint vertexCount, const GLuint* indices, GLuint indexCount,
+         vector<Texture> textures, glm::vec3 diffuseColor, glm::vec3 specularColor, bool textured,
+         glm::vec3 boundsMin, glm::vec3 boundsMax)
+    {
+        this->indices.assign(indices, indices + indexCount);
+        this->textures = std::move(textures);
+        this->diffuseColor = diffuseColor;
+        this->specularColor = specularColor;
+        this->textured = textured;
+        this->boundsMin = boundsMin;
+        this->boundsMax = boundsMax;
+        this->positionOffset = boundsMin;
+        this->positionScale = boundsMax - boundsMin;
+        // the levels of detail are built on the CPU, from the decoded positions only
+        this->positions.resize(vertexCount);
+        for (GLuint v = 0; v < vertexCount; v++)
+        {
+            glm::vec3 q(packed[v].Position[0], packed[v].Position[1], packed[v].Position[2]);
+            this->positions[v] = this->positionOffset + this->positionScale * (q / 65535.0f);
+        }
+
+        this->setupPackedMesh(packed, vertexCount, indices, indexCount);
+    }
+
     // Render the mesh
     void Draw(GLuint shader)
     {
-        // Bind appropriate textures
-        GLuint diffuseNr = 1;
-        GLuint specularNr = 1;
-        for (GLuint i = 0; i < this->textures.size(); i++)
-		{
-		glActiveTexture(GL_TEXTURE0 + i);
+        this->bindMaterial(shader);
 
-		std::string name = this->textures[i].type;
-		std::string number = (name == "texture_diffuse") ? std::to_string(diffuseNr++) : std::to_string(specularNr++);
+        // Draw mesh
+        glBindVertexArray(this->VAO);
+        glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
 
-        glUniform1i(glGetUniformLocation(shader, ("material." + name + number).c_str()), i);
-        glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
-		}
-        
-        // Also set each mesh's shininess property to a default value (if you want you could extend this to another mesh property and possibly change this value)
-        //glUniform1f(glGetUniformLocation(shader, "material.shininess"), 16.0f);
+        this->unbindMaterial();
+    }
 
-        glUniform3fv(glGetUniformLocation(shader, "diffuse_color"), 1, glm::value_ptr(this->diffuseColor));
-        glUniform3fv(glGetUniformLocation(shader, "specular_color"), 1, glm::value_ptr(this->specularColor));
-        glUniform1i(glGetUniformLocation(shader, "use_tex"), this->textured);
+    // Render count instances of the level of detail lod, their model matrices from the byte offset of the
+    // buffer given to useInstances
+    void DrawInstanced(GLuint shader, int lod, GLintptr offset, GLsizei count)
+    {
+        if (this->lodCount[lod] == 0)
+            return;
+        this->bindMaterial(shader);
 
-        // Draw mesh
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->instances);
+        for (GLuint column = 0; column < 4; column++)
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (GLvoid*)(offset + column * sizeof(glm::vec4)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDrawElementsInstanced(GL_TRIANGLES, this->lodCount[lod], GL_UNSIGNED_INT,
+                                (GLvoid*)(this->lodFirst[lod] * sizeof(GLuint)), count);
+        glBindVertexArray(0);
+
+        this->unbindMaterial();
+    }
+
+    // Reads a model matrix per instance from the buffer, at the locations 3 to 6, for DrawInstanced
+    void useInstances(GLuint buffer)
+    {
+        this->instances = buffer;
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for (GLuint column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                                  (GLvoid*)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + column, 1);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Adds a coarser level of detail per cell size, in model units: the vertices of a cell of a grid merge into
+    // the first of them and the triangles they collapse disappear. The small parts vanish at the coarse levels
+    void buildLods(const vector<float>& cellSizes)
+    {
+        vector<GLuint> all = this->indices;
+        this->lodFirst.assign(1, 0);
+        this->lodCount.assign(1, this->indices.size());
+        for (float cell : cellSizes)
+        {
+            unordered_map<uint64_t, GLuint> representatives;
+            vector<GLuint> remap(this->positions.size());
+            for (GLuint v = 0; v < this->positions.size(); v++)
+            {
+                glm::uvec3 c = glm::uvec3((this->positions[v] - boundsMin) / cell);
+                uint64_t key = (uint64_t(c.x) << 42) | (uint64_t(c.y) << 21) | uint64_t(c.z);
+                remap[v] = representatives.insert(std::make_pair(key, v)).first->second;
+            }
+
+            this->lodFirst.push_back(all.size());
+            for (GLuint f = 0; f + 2 < this->indices.size(); f += 3)
+            {
+                GLuint a = remap[this->indices[f]], b = remap[this->indices[f + 1]], c = remap[this->indices[f + 2]];
+                if (a != b && b != c && c != a)
+                    all.insert(all.end(), {a, b, c});
+            }
+            this->lodCount.push_back(all.size() - this->lodFirst.back());
+        }
+
+        // the levels follow each other in the index buffer, the full one first as setupMesh left it
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, all.size() * sizeof(GLuint), &all[0], GL_STATIC_DRAW);
+        glBindVertexArray(0);
+    }
+
+    // Levels of detail, and the triangles of each
+    int lods() const
+    {
+        return this->lodCount.size();
+    }
+
+    GLsizei triangles(int lod) const
+    {
+        return this->lodCount[lod] / 3;
+    }
+
+    // Render the depth of the mesh only, with the program in use
+    void DrawDepth(GLuint shader)
+    {
+        const MeshProgramIds& ids = this->programIds(shader);
+        glUniform3fv(ids.positionScale_id, 1, glm::value_ptr(this->positionScale));
+        glUniform3fv(ids.positionOffset_id, 1, glm::value_ptr(this->positionOffset));
         glBindVertexArray(this->VAO);
         glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
+    }
+
+private:
+    /*  Render data  */
+    GLuint VAO, VBO, EBO;
+    GLuint instances = 0;
+    // the levels of detail, in indices of the index buffer
+    vector<GLuint> lodFirst;
+    vector<GLsizei> lodCount;
+    map<GLuint, MeshProgramIds> programToIds;
+    // the positions on the CPU, and how the shaders decode the ones of the vertex buffer
+    vector<glm::vec3> positions;
+    glm::vec3 positionScale = glm::vec3(1.0f);
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+
+    // The uniform locations of the program, looked up on its first draw
+    const MeshProgramIds& programIds(GLuint shader)
+    {
+        auto it = this->programToIds.find(shader);
+        if (it == this->programToIds.end())
+        {
+            MeshProgramIds ids;
+            GLuint diffuseNr = 1;
+            GLuint specularNr = 1;
+            for (GLuint i = 0; i < this->textures.size(); i++)
+            {
+                std::string name = this->textures[i].type;
+                std::string number = (name == "texture_diffuse") ? std::to_string(diffuseNr++) : std::to_string(specularNr++);
+                ids.texture_ids.push_back(glGetUniformLocation(shader, ("material." + name + number).c_str()));
+            }
+            ids.diffuseColor_id = glGetUniformLocation(shader, "diffuse_color");
+            ids.specularColor_id = glGetUniformLocation(shader, "specular_color");
+            ids.useTex_id = glGetUniformLocation(shader, "use_tex");
+            ids.positionScale_id = glGetUniformLocation(shader, "positionScale");
+            ids.positionOffset_id = glGetUniformLocation(shader, "positionOffset");
+            it = this->programToIds.insert(std::make_pair(shader, ids)).first;
+        }
+        return it->second;
+    }
+
+    // Binds the textures and uploads the colors of the material to the program in use
+    void bindMaterial(GLuint shader)
+    {
+        const MeshProgramIds& ids = this->programIds(shader);
+
+        // Bind appropriate textures
+        for (GLuint i = 0; i < this->textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glUniform1i(ids.texture_ids[i], i);
+            glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+        }
 
+        glUniform3fv(ids.diffuseColor_id, 1, glm::value_ptr(this->diffuseColor));
+        glUniform3fv(ids.specularColor_id, 1, glm::value_ptr(this->specularColor));
+        glUniform1i(ids.useTex_id, this->textured);
+        glUniform3fv(ids.positionScale_id, 1, glm::value_ptr(this->positionScale));
+        glUniform3fv(ids.positionOffset_id, 1, glm::value_ptr(this->positionOffset));
+    }
+
+    void unbindMaterial()
+    {
         // Always good practice to set everything back to defaults once configured.
         for (GLuint i = 0; i < this->textures.size(); i++)
         {
@@ -94,10 +289,6 @@ public:
         }
     }
 
-private:
-    /*  Render data  */
-    GLuint VAO, VBO, EBO;
-
     /*  Functions    */
     // Initializes all the buffer objects/arrays
     void setupMesh()
@@ -130,8 +321,38 @@ private:
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
 
         glBindVertexArray(0);
+
+        this->lodFirst.assign(1, 0);
+        this->lodCount.assign(1, this->indices.size());
     }
-};
 
+    // Initializes the buffer objects/arrays with the packed vertices, see PackedVertex
+    void setupPackedMesh(const PackedVertex* packed, GLuint vertexCount, const GLuint* indices, GLuint indexCount)
+    {
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->VBO);
+        glGenBuffers(1, &this->EBO);
 
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), packed, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indices, GL_STATIC_DRAW);
 
+        // Vertex Positions, in [0, 1] over the bounds
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+        // Vertex Normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+        // Vertex Texture Coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+
+        glBindVertexArray(0);
+
+        this->lodFirst.assign(1, 0);
+        this->lodCount.assign(1, indexCount);
+    }
+};
@@ -9,6 +9,8 @@
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
+#include <cfloat>
 #include <vector>
 using namespace std;
 // GL Includes
@@ -20,9 +22,11 @@ using namespace std;
 #include <postprocess.h>
 #include "../light/light.h"
 #include "../light/lightable.h"
+#include "../shadow/shadowcascades.h"
 #include "../utils.h"
 
-#include "Mesh.h"
+#include "mesh.h"
+#include "modelcache.h"
 
 GLint TextureFromFile(const char* path, string directory);
 
@@ -45,8 +49,8 @@ public:
         MVP_id = glGetUniformLocation(shaderProgram, "MVP");
         MV_id = glGetUniformLocation(shaderProgram, "MV");
         NORMALM_id = glGetUniformLocation(shaderProgram, "NORMALM");
-        SHADOWMVP_id = glGetUniformLocation(shaderProgram, "SHADOWMVP");
         mirrorPass_id = glGetUniformLocation(shaderProgram, "mirror_pass");
+        deferredPass_id = glGetUniformLocation(shaderProgram, "deferred_pass");
         shadowTexture_id = glGetUniformLocation(shaderProgram, "shadowMap");
         translationToSceneCenter_id = glGetUniformLocation(shaderProgram, "translationToSceneCenter");
         glUniform1f(glGetUniformLocation(shaderProgram, "threshold_vpoint_World_F"), fogStop - fogLength);
@@ -55,13 +59,39 @@ public:
         this->shadowTexture_id = shadowTexture;
         GLuint shadowMapLocation = glGetUniformLocation(shaderProgram, "shadowMap");
         glUniform1i(shadowMapLocation, 7);
+
+        shadowProgram = icg_helper::LoadShaders("model_vshader_shadow.glsl", "model_fshader_shadow.glsl");
+        if(!shadowProgram) {
+            exit(EXIT_FAILURE);
+        }
+        shadowSHADOWMVP_id = glGetUniformLocation(shadowProgram, "SHADOWMVP");
+        glUseProgram(0);
+    }
+
+    // Draws the depth of the model into the shadow map bound, SHADOWMVP goes from the model to its clip space
+    void DrawShadow(const glm::mat4 &SHADOWMVP)
+    {
+        glUseProgram(shadowProgram);
+        glUniformMatrix4fv(shadowSHADOWMVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(SHADOWMVP));
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].DrawDepth(shadowProgram);
+        glUseProgram(0);
+    }
+
+    // Bounds of the vertices of the model, in model space
+    glm::vec3 getBoundsMin() const {
+        return boundsMin;
+    }
+
+    glm::vec3 getBoundsMax() const {
+        return boundsMax;
     }
 
-    // Draws the model, and thus all its meshes
+    // Draws the model, and thus all its meshes, MODEL places it in the shadow cascades
     void Draw(const glm::mat4 &MVP = IDENTITY_MATRIX,
               const glm::mat4 &MV = IDENTITY_MATRIX,
               const glm::mat4 &NORMALM = IDENTITY_MATRIX,
-              const glm::mat4 &SHADOWMVP = IDENTITY_MATRIX,
+              const glm::mat4 &MODEL = IDENTITY_MATRIX,
               const glm::vec2 &translationToSceneCenter = glm::vec2(0.0, 0.0),
               bool mirrorPass = false)
     {
@@ -70,44 +100,111 @@ public:
         glUniformMatrix4fv(MVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(MVP));
         glUniformMatrix4fv(MV_id, ONE, DONT_TRANSPOSE, glm::value_ptr(MV));
         glUniformMatrix4fv(NORMALM_id, ONE, DONT_TRANSPOSE, glm::value_ptr(NORMALM));
-        glUniformMatrix4fv(SHADOWMVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(SHADOWMVP));
         glUniform2fv(translationToSceneCenter_id, 1, glm::value_ptr(translationToSceneCenter));
         glUniform1i(mirrorPass_id, mirrorPass);
+        glUniform1i(deferredPass_id, deferredPass && !mirrorPass);
 
         if(light != nullptr)
             light->updateProgram(this->shaderProgram);
+        if(shadowCascades != nullptr)
+            shadowCascades->updateProgram(this->shaderProgram, MODEL);
 
         glActiveTexture(GL_TEXTURE0 + 7);
-        glBindTexture(GL_TEXTURE_2D, this->shadowTexture_id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, this->shadowTexture_id);
 
         for(GLuint i = 0; i < this->meshes.size(); i++)
             this->meshes[i].Draw(this->shaderProgram);
 
         glActiveTexture(GL_TEXTURE0 + 7);
-        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    // Draws count instances of the level of detail lod of every mesh with the program in use, their model
+    // matrices from the byte offset of the buffer given to useInstances. The caller sets the other uniforms
+    void DrawInstanced(GLuint program, int lod, GLintptr offset, GLsizei count)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].DrawInstanced(program, lod, offset, count);
+    }
+
+    // the meshes read a model matrix per instance from the buffer, see DrawInstanced
+    void useInstances(GLuint buffer){
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].useInstances(buffer);
+    }
+
+    // adds a coarser level of detail of every mesh per fraction of the diagonal of the model, see Mesh::buildLods
+    void buildLods(const vector<float>& fractions){
+        vector<float> cellSizes;
+        for(float fraction : fractions)
+            cellSizes.push_back(fraction * glm::length(boundsMax - boundsMin));
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].buildLods(cellSizes);
+    }
+
+    int lods() const {
+        return meshes.empty() ? 1 : meshes[0].lods();
+    }
+
+    // triangles of the level of detail lod of all the meshes
+    GLsizei triangles(int lod) const {
+        GLsizei count = 0;
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            count += this->meshes[i].triangles(lod);
+        return count;
     }
 
     void useLight(Light* l){
         this->light = l;
         light->registerProgram(shaderProgram);
     }
+
+    void useShadowCascades(ShadowCascades* c){
+        this->shadowCascades = c;
+        c->registerProgram(shaderProgram, 8 /*next to the shadow map*/);
+    }
+
+    // the next draws write the G-buffer of the deferred path instead of lit colors
+    void useDeferredPass(bool enabled){
+        this->deferredPass = enabled;
+    }
     
 private:
     /*  Model Data  */
     Light* light;
+    ShadowCascades* shadowCascades = nullptr;
     GLuint shaderProgram;
-    GLuint MVP_id, MV_id, NORMALM_id, SHADOWMVP_id, mirrorPass_id, translationToSceneCenter_id;
+    GLuint shadowProgram, shadowSHADOWMVP_id;
+    glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+    glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+    GLuint MVP_id, MV_id, NORMALM_id, mirrorPass_id, deferredPass_id, translationToSceneCenter_id;
+    bool deferredPass = false;
     GLuint shadowTexture_id;
     GLchar* modelPath;
+    float assimpMilliseconds = 0.0f;
     vector<Mesh> meshes;
     string directory;
-    vector<Texture> textures_loaded;	// Stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    unordered_map<string, Texture> textures_loaded;	// Stores all the textures loaded so far by path, optimization to make sure textures aren't loaded more than once.
 
     /*  Functions   */
-    // Loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // Loads a model from its cache file next to it, see ModelCache. Without a cache, or with a cache of an older
+    // source, loads it with supported ASSIMP extensions from file and writes the cache for the next launches
     void loadModel()
     {
         string path = this->modelPath;
+        // Retrieve the directory path of the filepath
+        this->directory = path.substr(0, path.find_last_of('/'));
+
+        double start = glfwGetTime();
+        ModelCache::Stamp stamp = ModelCache::stampOf(path);
+        string cachePath = path + ".mesh";
+        if(this->loadCache(cachePath, stamp))
+        {
+            cout << "Model " << path << ": " << (glfwGetTime() - start) * 1000.0 << " ms from " << cachePath
+                 << ", " << this->assimpMilliseconds << " ms with Assimp" << endl;
+            return;
+        }
+
         // Read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
@@ -117,12 +214,55 @@ private:
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // Retrieve the directory path of the filepath
-        this->directory = path.substr(0, path.find_last_of('/'));
 
         // Process ASSIMP's root node recursively
         this->processNode(scene->mRootNode, scene);
-        int breakpoint = 0;
+        this->assimpMilliseconds = (glfwGetTime() - start) * 1000.0;
+        bool cached = ModelCache::Write(cachePath, stamp, this->assimpMilliseconds, this->meshes, boundsMin, boundsMax);
+        cout << "Model " << path << ": " << this->assimpMilliseconds << " ms with Assimp"
+             << (cached ? ", cached in " + cachePath : ", not cached") << endl;
+    }
+
+    // Loads the meshes from the mapped cache file, false when it is missing or stale
+    bool loadCache(const string& cachePath, const ModelCache::Stamp& stamp)
+    {
+        MappedFile file;
+        if(!file.Open(cachePath))
+            return false;
+        const ModelCacheHeader* header = ModelCache::validHeader(file, stamp);
+        if(!header)
+        {
+            file.Close();
+            return false;
+        }
+        const ModelCacheMesh* records = (const ModelCacheMesh*)(file.data() + sizeof(ModelCacheHeader));
+        const ModelCacheTexture* textureRecords = (const ModelCacheTexture*)(records + header->meshCount);
+
+        this->assimpMilliseconds = header->assimpMilliseconds;
+        boundsMin = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+        boundsMax = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+        this->meshes.reserve(header->meshCount);
+        for(GLuint m = 0; m < header->meshCount; m++)
+        {
+            const ModelCacheMesh& record = records[m];
+            vector<Texture> textures;
+            for(GLuint t = record.firstTexture; t < record.firstTexture + record.textureCount; t++)
+            {
+                const ModelCacheTexture& entry = textureRecords[t];
+                textures.push_back(this->loadTexture(string(entry.path, strnlen(entry.path, sizeof(entry.path))),
+                                                     string(entry.type, strnlen(entry.type, sizeof(entry.type)))));
+            }
+            this->meshes.emplace_back((const PackedVertex*)(file.data() + record.vertexOffset), record.vertexCount,
+                                      (const GLuint*)(file.data() + record.indexOffset), record.indexCount,
+                                      std::move(textures),
+                                      glm::vec3(record.diffuseColor[0], record.diffuseColor[1], record.diffuseColor[2]),
+                                      glm::vec3(record.specularColor[0], record.specularColor[1], record.specularColor[2]),
+                                      record.textured != 0,
+                                      glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]),
+                                      glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]));
+        }
+        file.Close();
+        return true;
     }
 
     // Processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -164,6 +304,8 @@ private:
             vector.y = mesh->mVertices[i].y;
             vector.z = mesh->mVertices[i].z;
             vertex.Position = vector;
+            boundsMin = glm::min(boundsMin, vector);
+            boundsMax = glm::max(boundsMax, vector);
             // Normals
             vector.x = mesh->mNormals[i].x;
             vector.y = mesh->mNormals[i].y;
@@ -223,7 +365,7 @@ private:
         }
         
         // Return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures, diffuseColor, specularColor, textured);
+        return Mesh(std::move(vertices), std::move(indices), std::move(textures), diffuseColor, specularColor, textured);
     }
 
     // Checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -235,29 +377,24 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // Check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            GLboolean skip = false;
-            for(GLuint j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.C_Str(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // A texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // If texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str;
-                textures.push_back(texture);
-                this->textures_loaded.push_back(texture);  // Store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
-            }
+            textures.push_back(this->loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // The texture of the path, loaded on its first use only
+    Texture loadTexture(const string& path, const string& typeName)
+    {
+        auto loaded = this->textures_loaded.find(path);
+        if(loaded != this->textures_loaded.end())
+            return loaded->second;
+        Texture texture;
+        texture.id = TextureFromFile(path.c_str(), this->directory);
+        texture.type = typeName;
+        texture.path = path;
+        this->textures_loaded[path] = texture;
+        return texture;
+    }
 };
 
 
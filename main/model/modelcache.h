@@ -0,0 +1,428 @@
+#pragma once
+// Std. Includes
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#ifdef _WIN32
+// the min and max macros of windows.h would break std::min and glm::min
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+using namespace std;
+// GL Includes
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include "mesh.h"
+
+/*
+ * The model cache file: a header, the mesh and texture records, then the vertices and the indices of each mesh.
+ * Every block starts on a 16 bytes boundary of the file so that the mapped file is handed to glBufferData as is
+ */
+
+struct ModelCacheHeader {
+    char magic[8];
+    GLuint version;
+    GLuint meshCount;
+    GLuint textureCount;
+    // how long the source took to import when the cache was written
+    float assimpMilliseconds;
+    // the source the cache was written from, it is stale when they change
+    int64_t sourceSize;
+    int64_t sourceTime;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+static_assert(sizeof(ModelCacheHeader) == 64, "the cache header is 64 bytes");
+
+struct ModelCacheMesh {
+    GLuint vertexCount;
+    GLuint indexCount;
+    // in bytes from the start of the file
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    float boundsMin[3];
+    float boundsMax[3];
+    float diffuseColor[3];
+    float specularColor[3];
+    GLuint firstTexture;
+    GLuint textureCount;
+    GLuint textured;
+    GLuint padding[3];
+};
+static_assert(sizeof(ModelCacheMesh) == 96, "the cache mesh records are 96 bytes");
+
+struct ModelCacheTexture {
+    char type[32];
+    char path[96];
+};
+static_assert(sizeof(ModelCacheTexture) == 128, "the cache texture records are 128 bytes");
+
+// A file mapped read-only in memory, with mmap or with a file mapping on Windows
+class MappedFile {
+public:
+    bool Open(const string& path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (mapping == NULL)
+            return false;
+        // the view keeps the mapping alive until it is unmapped
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (view == NULL)
+            return false;
+        this->bytes = (const char*)view;
+        this->length = size_t(fileSize.QuadPart);
+        return true;
+#else
+        int descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            return false;
+        struct stat status;
+        if (fstat(descriptor, &status) != 0 || status.st_size <= 0) {
+            close(descriptor);
+            return false;
+        }
+        void* mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        close(descriptor);
+        if (mapping == MAP_FAILED)
+            return false;
+        this->bytes = (const char*)mapping;
+        this->length = status.st_size;
+        return true;
+#endif
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    void Close()
+    {
+        if (bytes != nullptr) {
+#ifdef _WIN32
+            UnmapViewOfFile(bytes);
+#else
+            munmap((void*)bytes, length);
+#endif
+        }
+        bytes = nullptr;
+        length = 0;
+    }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+};
+
+/**
+ * @brief The ModelCache class converts the meshes Assimp imported into the cache file and checks the file before
+ * it is loaded, see Model::loadModel. The positions are quantized to 16 bits over the bounds of their mesh, the
+ * normals to 10 bits per axis and the texture coordinates to half floats. The triangles are reordered for the
+ * vertex cache of the GPU and the vertices in the order the triangles first use them
+ */
+class ModelCache {
+public:
+    static constexpr GLuint VERSION = 1;
+
+    // size and modification time of the source
+    struct Stamp {
+        int64_t size = -1;
+        int64_t time = -1;
+    };
+
+    static Stamp stampOf(const string& path)
+    {
+        Stamp stamp;
+        struct stat status;
+        if (stat(path.c_str(), &status) == 0) {
+            stamp.size = status.st_size;
+            stamp.time = status.st_mtime;
+        }
+        return stamp;
+    }
+
+    // The header of the mapped file, if it is a cache of the stamped source whose blocks all lie in the file
+    static const ModelCacheHeader* validHeader(const MappedFile& file, const Stamp& stamp)
+    {
+        if (file.size() < sizeof(ModelCacheHeader))
+            return nullptr;
+        const ModelCacheHeader* header = (const ModelCacheHeader*)file.data();
+        if (strncmp(header->magic, "ICGMESH", 8) != 0 || header->version != VERSION
+                || header->sourceSize != stamp.size || header->sourceTime != stamp.time)
+            return nullptr;
+        uint64_t records = sizeof(ModelCacheHeader) + uint64_t(header->meshCount) * sizeof(ModelCacheMesh)
+                + uint64_t(header->textureCount) * sizeof(ModelCacheTexture);
+        if (records > file.size())
+            return nullptr;
+        const ModelCacheMesh* meshes = (const ModelCacheMesh*)(file.data() + sizeof(ModelCacheHeader));
+        for (GLuint m = 0; m < header->meshCount; m++) {
+            const ModelCacheMesh& mesh = meshes[m];
+            if (mesh.vertexOffset + uint64_t(mesh.vertexCount) * sizeof(PackedVertex) > file.size()
+                    || mesh.indexOffset + uint64_t(mesh.indexCount) * sizeof(GLuint) > file.size()
+                    || uint64_t(mesh.firstTexture) + mesh.textureCount > header->textureCount)
+                return nullptr;
+        }
+        return header;
+    }
+
+    // Writes the meshes, imported in assimpMilliseconds from the stamped source, to the cache file
+    static bool Write(const string& path, const Stamp& stamp, float assimpMilliseconds, const vector<Mesh>& meshes,
+                      const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        ModelCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "ICGMESH", 8);
+        header.version = VERSION;
+        header.meshCount = meshes.size();
+        header.assimpMilliseconds = assimpMilliseconds;
+        header.sourceSize = stamp.size;
+        header.sourceTime = stamp.time;
+        copy3(boundsMin, header.boundsMin);
+        copy3(boundsMax, header.boundsMax);
+
+        vector<ModelCacheMesh> records(meshes.size());
+        vector<ModelCacheTexture> textures;
+        vector<vector<PackedVertex>> vertices(meshes.size());
+        vector<vector<GLuint>> indices(meshes.size());
+        for (size_t m = 0; m < meshes.size(); m++) {
+            const Mesh& mesh = meshes[m];
+            ModelCacheMesh& record = records[m];
+            memset(&record, 0, sizeof(record));
+            pack(mesh, vertices[m], indices[m]);
+            record.vertexCount = vertices[m].size();
+            record.indexCount = indices[m].size();
+            copy3(mesh.boundsMin, record.boundsMin);
+            copy3(mesh.boundsMax, record.boundsMax);
+            copy3(mesh.diffuseColor, record.diffuseColor);
+            copy3(mesh.specularColor, record.specularColor);
+            record.textured = mesh.textured;
+            record.firstTexture = textures.size();
+            record.textureCount = mesh.textures.size();
+            for (const Texture& texture : mesh.textures) {
+                ModelCacheTexture entry;
+                memset(&entry, 0, sizeof(entry));
+                if (texture.type.size() >= sizeof(entry.type) || texture.path.size() >= sizeof(entry.path))
+                    return false;
+                memcpy(entry.type, texture.type.c_str(), texture.type.size());
+                memcpy(entry.path, texture.path.c_str(), texture.path.size());
+                textures.push_back(entry);
+            }
+        }
+        header.textureCount = textures.size();
+
+        // the blocks after the records, each aligned
+        uint64_t offset = sizeof(ModelCacheHeader) + records.size() * sizeof(ModelCacheMesh)
+                + textures.size() * sizeof(ModelCacheTexture);
+        for (size_t m = 0; m < meshes.size(); m++) {
+            records[m].vertexOffset = offset = align(offset);
+            offset += vertices[m].size() * sizeof(PackedVertex);
+            records[m].indexOffset = offset = align(offset);
+            offset += indices[m].size() * sizeof(GLuint);
+        }
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+        if (!records.empty())
+            written = written && fwrite(&records[0], sizeof(ModelCacheMesh), records.size(), file) == records.size();
+        if (!textures.empty())
+            written = written && fwrite(&textures[0], sizeof(ModelCacheTexture), textures.size(), file) == textures.size();
+        for (size_t m = 0; m < meshes.size() && written; m++) {
+            written = pad(file, records[m].vertexOffset) && (vertices[m].empty()
+                    || fwrite(&vertices[m][0], sizeof(PackedVertex), vertices[m].size(), file) == vertices[m].size());
+            written = written && pad(file, records[m].indexOffset) && (indices[m].empty()
+                    || fwrite(&indices[m][0], sizeof(GLuint), indices[m].size(), file) == indices[m].size());
+        }
+        written = fclose(file) == 0 && written;
+        if (!written)
+            remove(path.c_str());
+        return written;
+    }
+
+    /**
+     * Reorders the triangles for a post-transform vertex cache of cacheSize vertices, after Forsyth's linear-speed
+     * vertex cache optimisation: the next triangle has the best score among the triangles of the cached vertices,
+     * a vertex scores by its place in the cache and by the few triangles it has left
+     */
+    static void optimizeVertexCache(vector<GLuint>& indices, size_t vertexCount, int cacheSize = 32)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return;
+
+        // the triangles left of each vertex, as ranges of one array
+        vector<GLuint> remaining(vertexCount, 0), first(vertexCount + 1, 0);
+        for (size_t i = 0; i < 3 * triangleCount; i++)
+            remaining[indices[i]]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            first[v + 1] = first[v] + remaining[v];
+        vector<GLuint> triangles(first[vertexCount]), filled(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < 3 * triangleCount; i++)
+            triangles[filled[indices[i]]++] = i / 3;
+
+        vector<int> cachePosition(vertexCount, -1);
+        vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = score(-1, remaining[v], cacheSize);
+        vector<float> triangleScore(triangleCount, 0.0f);
+        vector<char> emitted(triangleCount, 0);
+        for (size_t t = 0; t < triangleCount; t++)
+            for (int k = 0; k < 3; k++)
+                triangleScore[t] += vertexScore[indices[3 * t + k]];
+
+        vector<GLuint> ordered;
+        ordered.reserve(3 * triangleCount);
+        vector<GLuint> cache, nextCache;
+        size_t best = std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin();
+        size_t scan = 0;
+        while (ordered.size() < 3 * triangleCount)
+        {
+            // when the cache holds no triangle left, the next one in the original order
+            if (best == triangleCount) {
+                while (emitted[scan])
+                    scan++;
+                best = scan;
+            }
+            emitted[best] = 1;
+
+            nextCache.clear();
+            for (int k = 0; k < 3; k++) {
+                GLuint v = indices[3 * best + k];
+                ordered.push_back(v);
+                GLuint* own = &triangles[first[v]];
+                for (GLuint j = 0; j < remaining[v]; j++) {
+                    if (own[j] == best) {
+                        std::swap(own[j], own[remaining[v] - 1]);
+                        break;
+                    }
+                }
+                remaining[v]--;
+                nextCache.push_back(v);
+            }
+            for (GLuint v : cache)
+                if (v != nextCache[0] && v != nextCache[1] && v != nextCache[2])
+                    nextCache.push_back(v);
+            cache.swap(nextCache);
+
+            // new scores for the vertices whose place changed, those pushed out of the cache included
+            for (size_t i = 0; i < cache.size(); i++) {
+                GLuint v = cache[i];
+                int position = int(i) < cacheSize ? int(i) : -1;
+                cachePosition[v] = position;
+                float updated = score(position, remaining[v], cacheSize);
+                float change = updated - vertexScore[v];
+                vertexScore[v] = updated;
+                for (GLuint j = 0; j < remaining[v]; j++)
+                    triangleScore[triangles[first[v] + j]] += change;
+            }
+            if (int(cache.size()) > cacheSize)
+                cache.resize(cacheSize);
+
+            best = triangleCount;
+            float bestScore = -1.0f;
+            for (GLuint v : cache) {
+                for (GLuint j = 0; j < remaining[v]; j++) {
+                    GLuint t = triangles[first[v] + j];
+                    if (triangleScore[t] > bestScore) {
+                        bestScore = triangleScore[t];
+                        best = t;
+                    }
+                }
+            }
+        }
+        indices.swap(ordered);
+    }
+
+private:
+    static void copy3(const glm::vec3& v, float* out)
+    {
+        out[0] = v.x;
+        out[1] = v.y;
+        out[2] = v.z;
+    }
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~uint64_t(15);
+    }
+
+    // zeros up to the offset of the next block
+    static bool pad(FILE* file, uint64_t offset)
+    {
+        long position = ftell(file);
+        static const char zeros[16] = {0};
+        return position >= 0 && uint64_t(position) <= offset
+                && fwrite(zeros, 1, offset - position, file) == offset - position;
+    }
+
+    static float score(int cachePosition, GLuint remaining, int cacheSize)
+    {
+        if (remaining == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            // the last triangle's vertices score a bit less, it should not be drawn twice
+            score = cachePosition < 3 ? 0.75f
+                                      : std::pow(1.0f - float(cachePosition - 3) / (cacheSize - 3), 1.5f);
+        }
+        // the vertices with few triangles left go first, they leave the cache for good
+        return score + 2.0f / std::sqrt(float(remaining));
+    }
+
+    // The optimized triangles and the vertices in the order they first use them, packed
+    static void pack(const Mesh& mesh, vector<PackedVertex>& packed, vector<GLuint>& indices)
+    {
+        indices = mesh.indices;
+        optimizeVertexCache(indices, mesh.vertices.size());
+
+        vector<GLuint> remap(mesh.vertices.size(), GLuint(-1));
+        packed.clear();
+        packed.reserve(mesh.vertices.size());
+        glm::vec3 extent = mesh.boundsMax - mesh.boundsMin;
+        glm::vec3 inverseExtent = glm::vec3(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                                            extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                                            extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+        for (GLuint& index : indices) {
+            if (remap[index] == GLuint(-1)) {
+                const Vertex& vertex = mesh.vertices[index];
+                glm::vec3 position = (vertex.Position - mesh.boundsMin) * inverseExtent;
+                PackedVertex p;
+                for (int c = 0; c < 3; c++)
+                    p.Position[c] = glm::packUnorm1x16(position[c]);
+                p.Position[3] = 0;
+                p.Normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.Normal, 0.0f));
+                p.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+                remap[index] = packed.size();
+                packed.push_back(p);
+            }
+            index = remap[index];
+        }
+    }
+};
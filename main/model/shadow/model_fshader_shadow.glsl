@@ -0,0 +1,6 @@
+#version 410 core
+
+void main()
+{
+    // only the depth is written
+}
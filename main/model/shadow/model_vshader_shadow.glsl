@@ -0,0 +1,12 @@
+#version 410 core
+layout (location = 0) in vec3 position;
+
+uniform mat4 SHADOWMVP;
+// the cached models quantize the positions over the bounds of each mesh, see modelcache.h
+uniform vec3 positionScale = vec3(1.0f);
+uniform vec3 positionOffset = vec3(0.0f);
+
+void main()
+{
+    gl_Position = SHADOWMVP * vec4(positionOffset + positionScale * position, 1.0f);
+}
@@ -3,12 +3,14 @@
 in vec2 TexCoords;
 
 layout (location = 0) out vec4 color;
-layout (location = 1) out vec4 brightColor;
+// the G-buffer normal and material, the forward passes write the HDR color only
+layout (location = 1) out vec4 gNormal;
 
 uniform sampler2D texture_diffuse1;
-uniform sampler2DShadow shadowMap;
 uniform bool use_tex;
 uniform bool mirror_pass;
+// writes the G-buffer (albedo, normal and material) instead of the lit color
+uniform bool deferred_pass;
 uniform vec3 diffuse_color;
 uniform vec3 specular_color;
 uniform vec3 light_dir;
@@ -27,11 +29,24 @@ in vec3 normal_MV_F;
 in vec3 vpoint_MV_F;
 in vec3 vpoint_F;
 in vec3 viewDir_MV_F;
-in vec4 shadowCoord_F;
 in vec2 vpoint_World_F;
 
+const int NUM_CASCADES = 4;
+uniform sampler2DArrayShadow shadowMap;
+// to the light space of this frame * model, xy in world units and z the depth in the maps
+uniform mat4 SHADOWMV;
+// center and usable half side of each map in light space, 1 / its side
+uniform vec4 cascadeArea[NUM_CASCADES];
+// texture coordinates of the light space origin in each map, the maps wrap around
+uniform vec2 cascadeOffset[NUM_CASCADES];
+// light space depth covered by the maps, turns a world space bias into a depth offset
+uniform float shadowDepthRange;
+// blurred and mipmapped exponential variance moments of the maps, see evsm_fshader.glsl
+uniform sampler2DArray shadowMoments;
+// one filtered fetch of the moments, or the rotated PCF of the depth maps
+uniform bool prefilteredShadows;
+
 const int numSamplingPositions = 9;
-const vec3 brightnessTreshold = vec3(1.0, 1.0, 1.0);
 
 uniform vec2 kernel[9] = vec2[]
 (
@@ -58,12 +73,48 @@ float randomAngle(in vec3 seed, in float freq)
    return random(seed, freq) * 6.283285f;
 }
 
-void main()
+// the finest map holding the given light space position, NUM_CASCADES outside of all of them
+int selectCascade(in vec2 lightPos)
 {
-    if (mirror_pass && vpoint_F.y < -0.005f) {
-        discard;
+    for(int i = 0; i < NUM_CASCADES; i++){
+        if(all(lessThan(abs(lightPos - cascadeArea[i].xy), vec2(cascadeArea[i].z)))){
+            return i;
+        }
     }
+    return NUM_CASCADES;
+}
+
+// exponents of the warped depth, as in evsm_fshader.glsl
+const float positiveExponent = 5.54f;
+const float negativeExponent = 5.0f;
+
+// upper bound of the lit fraction from the mean and variance of the occluders warped depth
+float chebyshevUpperBound(in vec2 moments, in float mean, in float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    // cuts the tail of the bound to reduce light bleeding
+    float pMax = clamp((variance / (variance + d * d) - 0.2f) / 0.8f, 0.0f, 1.0f);
+    return (mean <= moments.x) ? 1.0f : pMax;
+}
+
+// one filtered fetch of the moments, the gradients come from the light space position so that they do not jump
+// where the cascade changes
+float evsmVisibility(in vec3 shadowCoord, in int cascade, in vec2 gradX, in vec2 gradY)
+{
+    vec4 moments = textureGrad(shadowMoments, vec3(shadowCoord.xy, cascade), gradX, gradY);
+    float depth = 2.0f * shadowCoord.z - 1.0f;
+    vec2 warped = vec2(exp(positiveExponent * depth), -exp(-negativeExponent * depth));
+    vec2 minVariance = 0.0001f * vec2(positiveExponent, negativeExponent) * warped;
+    minVariance *= minVariance;
+    return min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x),
+               chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+}
 
+#include "gbuffer_normal.glsl"
+
+void main()
+{
     vec3 lightDir = normalize((NORMALM * vec4(light_dir, 1.0)).xyz);
 
     vec3 viewDir = normalize(viewDir_MV_F);
@@ -77,11 +128,50 @@ void main()
         diffuse_component = texCol;
     }
 
+    // model material: the specular color is reduced to its strength
+    if (deferred_pass) {
+        color = vec4(diffuse_component, 1.0f);
+        float specularStrength = clamp(max(specular_color.r, max(specular_color.g, specular_color.b)), 0.0f, 1.0f);
+        gNormal = vec4(encodeNormal(normal), specularStrength, 1.0f);
+        return;
+    }
+
     // -------------SHADOW MAPS----------------------//
 
-    float bias = max(0.05f * (1.0f - cosNL), 0.005f);
+    // in world units, the depth range of the maps turns it into a depth offset
+    float bias = max(0.1f * (1.0f - cosNL), 0.01f);
     float visibility = 1.0;
 
+    vec3 shadowPos = (SHADOWMV * vec4(vpoint_F, 1.0f)).xyz;
+    // derivatives of the light space position, taken before branching
+    vec2 shadowGradX = dFdx(shadowPos.xy);
+    vec2 shadowGradY = dFdy(shadowPos.xy);
+    int cascade = selectCascade(shadowPos.xy);
+    // the reflection is blurred and seen through the waves, it skips the shadow lookups
+    if(!mirror_pass && cascade < NUM_CASCADES){
+        vec3 shadowCoord = vec3(shadowPos.xy * cascadeArea[cascade].w + cascadeOffset[cascade], shadowPos.z);
+        float depthBias = bias / shadowDepthRange;
+        if(prefilteredShadows){
+            visibility = evsmVisibility(vec3(shadowCoord.xy, shadowCoord.z - depthBias), cascade,
+                                        shadowGradX * cascadeArea[cascade].w, shadowGradY * cascadeArea[cascade].w);
+        } else {
+            visibility = 0.0f;
+
+            // generate random rotation angle for each fragment
+            float angle = randomAngle(vpoint_F, 15.0f);
+            float s = sin(angle);
+            float c = cos(angle);
+            float PCFRadius = 1.0f/1000.0f;
+            for(int i=0; i < numSamplingPositions; i++)
+            {
+              // rotate offset
+              vec2 rotatedOffset = vec2(kernel[i].x * c + kernel[i].y * -s, kernel[i].x * s + kernel[i].y * c);
+              visibility += texture(shadowMap, vec4(shadowCoord.xy + rotatedOffset * PCFRadius, cascade, shadowCoord.z - depthBias));
+            }
+            visibility /= numSamplingPositions;
+        }
+    }
+
 
     // --------------- SHADING ----------------- //
     vec3 lightingResult = diffuse_component * La;
@@ -98,12 +188,10 @@ void main()
     }
 
     color = vec4(lightingResult, 1.0);
-    color.a *= 1- smoothstep(threshold_vpoint_World_F, max_vpoint_World_F,
-                              max(abs(vpoint_World_F.x), abs(vpoint_World_F.y))
-                              );
-
-    float brightness = dot(color.rgb, brightnessTreshold);
-
-    brightColor = mix(vec4(0.0, 0.0, 0.0, 1.0), vec4(color), smoothstep(1.5, 6.0, brightness));
-    brightColor.a = color.a;
+    // the main pass is opaque and faded into the sky by the fog pass, the reflection has no depth to do so
+    if (mirror_pass) {
+        color.a *= 1- smoothstep(threshold_vpoint_World_F, max_vpoint_World_F,
+                                  max(abs(vpoint_World_F.x), abs(vpoint_World_F.y))
+                                  );
+    }
 }
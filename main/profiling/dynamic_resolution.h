@@ -0,0 +1,82 @@
+#pragma once
+#include <cmath>
+#include <glm/glm.hpp>
+
+/**
+ * @brief The DynamicResolution class picks the internal render scale that holds a target frame time.
+ * The pixel cost is roughly proportional to the square of the scale, so the scale is corrected by
+ * the square root of the time ratio. The measured time is smoothed, changes are quantized to STEP and
+ * rate limited by COOLDOWN since each change re-allocates the render targets.
+ */
+class DynamicResolution {
+
+    static constexpr float STEP = 0.05f;
+    static constexpr float COOLDOWN = 0.5f;       // seconds between two scale changes
+    static constexpr float SMOOTHING = 0.9f;      // weight of the history in the filtered frame time
+
+    float targetMs;
+    float minScale;
+    float maxScale;
+    float scale;
+    float filteredMs = 0.0f;
+    float lastChange = 0.0f;
+    bool enabled = true;
+
+public:
+    DynamicResolution(float targetMs = 16.0f, float minScale = 0.5f, float maxScale = 1.0f)
+        : targetMs{targetMs}
+        , minScale{minScale}
+        , maxScale{maxScale}
+        , scale{maxScale}
+    {}
+
+    /**
+     * feeds the last measured frame time, returns true when the render scale changed
+     * and the render targets must be resized
+     */
+    bool update(float frameMs, float now) {
+        if (!enabled || frameMs <= 0.0f) {
+            return false;
+        }
+
+        filteredMs = (filteredMs == 0.0f) ? frameMs : SMOOTHING * filteredMs + (1.0f - SMOOTHING) * frameMs;
+
+        if (now - lastChange < COOLDOWN) {
+            return false;
+        }
+
+        float desired = glm::clamp(scale * std::sqrt(targetMs / filteredMs), minScale, maxScale);
+        desired = std::round(desired / STEP) * STEP;
+
+        // hysteresis: only move once the error is worth a full step
+        if (std::abs(desired - scale) < STEP * 0.99f) {
+            return false;
+        }
+
+        scale = glm::clamp(desired, minScale, maxScale);
+        lastChange = now;
+        return true;
+    }
+
+    /** toggles the controller, returns true when the scale was reset to its maximum */
+    bool toggle() {
+        enabled = !enabled;
+        if (!enabled && scale != maxScale) {
+            scale = maxScale;
+            return true;
+        }
+        return false;
+    }
+
+    bool isEnabled() const {
+        return enabled;
+    }
+
+    float getScale() const {
+        return scale;
+    }
+
+    float getFilteredMs() const {
+        return filteredMs;
+    }
+};
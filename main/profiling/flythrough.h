@@ -0,0 +1,95 @@
+#pragma once
+#include <string>
+#include "gpu_profiler.h"
+#include "../bezier/BezierCurve.h"
+#include "../camera/camera.h"
+
+/**
+ * @brief The Flythrough class replays a fixed camera path to compare two render modes.
+ * The modes alternate every frame so that both render the same views and the same tiles,
+ * their GPU time is accumulated in two GpuProfiler sections and compared at the end of the path.
+ */
+class Flythrough {
+
+    BezierCurve path;
+    float duration;
+    float startTime = 0.0f;
+    bool running = false;
+    long frame = 0;
+    vec3 lastPos;
+
+    std::string sectionA, sectionB;
+    double startMsA = 0.0, startMsB = 0.0;
+    long startCountA = 0, startCountB = 0;
+
+public:
+    Flythrough(const vector<vec3>& points, float duration, std::string sectionA, std::string sectionB)
+        : path{points}
+        , duration{duration}
+        , sectionA{sectionA}
+        , sectionB{sectionB}
+    {}
+
+    void start(float now, Camera& camera, GpuProfiler& profiler) {
+        running = true;
+        startTime = now;
+        frame = 0;
+        lastPos = path.getPoint(0.0f);
+        camera.setPos(lastPos);
+
+        startMsA = profiler.totalMs(sectionA);
+        startMsB = profiler.totalMs(sectionB);
+        startCountA = profiler.totalCount(sectionA);
+        startCountB = profiler.totalCount(sectionB);
+        cout << "Flythrough: " << sectionA << " vs " << sectionB << ", " << duration << " s" << endl;
+    }
+
+    bool isRunning() const {
+        return running;
+    }
+
+    /** true on the frames rendered with the second mode */
+    bool useModeB() const {
+        return running && (frame % 2 == 1);
+    }
+
+    /** moves the camera along the path, prints the comparison and returns true once the path is complete */
+    bool update(float now, Camera& camera, GpuProfiler& profiler) {
+        if (!running) {
+            return false;
+        }
+
+        float t = (now - startTime) / duration;
+        if (t > 1.0f) {
+            running = false;
+            printResults(profiler);
+            return true;
+        }
+
+        vec3 pos = path.getPoint(t);
+        vec3 delta = pos - lastPos;
+        lastPos = pos;
+        camera.move(delta);
+        if (length(delta) > 0.0f) {
+            // looks slightly down so that the mountains fill the screen
+            camera.setFront(normalize(delta) - vec3(0.0f, 0.3f, 0.0f));
+        }
+        frame++;
+        return false;
+    }
+
+private:
+    void printResults(GpuProfiler& profiler) {
+        long countA = profiler.totalCount(sectionA) - startCountA;
+        long countB = profiler.totalCount(sectionB) - startCountB;
+        if (countA == 0 || countB == 0) {
+            cout << "Flythrough: no GPU timings collected" << endl;
+            return;
+        }
+        double msA = (profiler.totalMs(sectionA) - startMsA) / countA;
+        double msB = (profiler.totalMs(sectionB) - startMsB) / countB;
+        cout << "Flythrough: " << sectionA << " " << msA << " ms/frame (" << countA << " frames), "
+             << sectionB << " " << msB << " ms/frame (" << countB << " frames), "
+             << "ratio " << msB / msA << endl;
+    }
+};
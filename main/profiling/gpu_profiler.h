@@ -0,0 +1,138 @@
+#pragma once
+#include <map>
+#include <string>
+#include "icg_helper.h"
+
+/**
+ * @brief The GpuProfiler class measures GPU time of named sections with timestamp queries.
+ * Timestamps (rather than GL_TIME_ELAPSED) let sections overlap or nest. Each section keeps
+ * LATENCY sets of queries and a result is only read back LATENCY frames after it was issued,
+ * so reading never stalls the pipeline.
+ */
+class GpuProfiler {
+
+    static constexpr int LATENCY = 3;
+
+    struct Section {
+        GLuint queries[LATENCY][2];
+        bool issued[LATENCY];
+        double lastMs;
+        double accumulatedMs;
+        int accumulatedCount;
+        // never reset, for measurements spanning several seconds
+        double totalMs;
+        long totalCount;
+    };
+
+    std::map<std::string, Section> sections;
+    int slot = 0;
+    bool supported = false;
+
+    Section& section(const std::string& name) {
+        auto it = sections.find(name);
+        if (it == sections.end()) {
+            Section s;
+            glGenQueries(2 * LATENCY, &s.queries[0][0]);
+            for (int i = 0; i < LATENCY; ++i) {
+                s.issued[i] = false;
+            }
+            s.lastMs = 0.0;
+            s.accumulatedMs = 0.0;
+            s.accumulatedCount = 0;
+            s.totalMs = 0.0;
+            s.totalCount = 0;
+            it = sections.insert({name, s}).first;
+        }
+        return it->second;
+    }
+
+public:
+    void Init() {
+        // software rasterizers may expose the query without a usable counter
+        GLint counterBits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &counterBits);
+        supported = counterBits > 0;
+        if (!supported) {
+            cout << "GpuProfiler: timestamp queries unavailable, GPU timings disabled" << endl;
+        }
+    }
+
+    bool isSupported() const {
+        return supported;
+    }
+
+    /** must be called once per frame before any begin(), collects the results issued LATENCY frames ago */
+    void beginFrame() {
+        slot = (slot + 1) % LATENCY;
+        if (!supported) {
+            return;
+        }
+        for (auto& entry : sections) {
+            Section& s = entry.second;
+            if (!s.issued[slot]) {
+                continue;
+            }
+            GLint available = 0;
+            glGetQueryObjectiv(s.queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 start, stop;
+                glGetQueryObjectui64v(s.queries[slot][0], GL_QUERY_RESULT, &start);
+                glGetQueryObjectui64v(s.queries[slot][1], GL_QUERY_RESULT, &stop);
+                s.lastMs = (stop - start) * 1e-6;
+                s.accumulatedMs += s.lastMs;
+                s.accumulatedCount++;
+                s.totalMs += s.lastMs;
+                s.totalCount++;
+            }
+            s.issued[slot] = false;
+        }
+    }
+
+    void begin(const std::string& name) {
+        if (supported) {
+            glQueryCounter(section(name).queries[slot][0], GL_TIMESTAMP);
+        }
+    }
+
+    void end(const std::string& name) {
+        if (supported) {
+            Section& s = section(name);
+            glQueryCounter(s.queries[slot][1], GL_TIMESTAMP);
+            s.issued[slot] = true;
+        }
+    }
+
+    /** latest available measurement of the section, in milliseconds */
+    double lastMs(const std::string& name) {
+        return section(name).lastMs;
+    }
+
+    /** average since the last resetAverages(), in milliseconds */
+    double averageMs(const std::string& name) {
+        Section& s = section(name);
+        return (s.accumulatedCount > 0) ? s.accumulatedMs / s.accumulatedCount : 0.0;
+    }
+
+    /** sum of every measurement of the section since it was created, in milliseconds */
+    double totalMs(const std::string& name) {
+        return section(name).totalMs;
+    }
+
+    long totalCount(const std::string& name) {
+        return section(name).totalCount;
+    }
+
+    void resetAverages() {
+        for (auto& entry : sections) {
+            entry.second.accumulatedMs = 0.0;
+            entry.second.accumulatedCount = 0;
+        }
+    }
+
+    void Cleanup() {
+        for (auto& entry : sections) {
+            glDeleteQueries(2 * LATENCY, &entry.second.queries[0][0]);
+        }
+        sections.clear();
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <map>
+#include <string>
+#include "icg_helper.h"
+
+/**
+ * @brief The SampleCounter class counts the samples passing the depth test in named sections,
+ * i.e. the fragments actually shaded, which measures overdraw. GL_SAMPLES_PASSED queries cannot
+ * nest, so sections must not overlap. Like the GpuProfiler, results are read back LATENCY frames later.
+ */
+class SampleCounter {
+
+    static constexpr int LATENCY = 3;
+
+    struct Section {
+        GLuint queries[LATENCY];
+        bool issued[LATENCY];
+        GLuint64 accumulatedSamples;
+        int accumulatedCount;
+    };
+
+    std::map<std::string, Section> sections;
+    int slot = 0;
+
+    Section& section(const std::string& name) {
+        auto it = sections.find(name);
+        if (it == sections.end()) {
+            Section s;
+            glGenQueries(LATENCY, s.queries);
+            for (int i = 0; i < LATENCY; ++i) {
+                s.issued[i] = false;
+            }
+            s.accumulatedSamples = 0;
+            s.accumulatedCount = 0;
+            it = sections.insert({name, s}).first;
+        }
+        return it->second;
+    }
+
+public:
+    /** must be called once per frame before any begin(), collects the results issued LATENCY frames ago */
+    void beginFrame() {
+        slot = (slot + 1) % LATENCY;
+        for (auto& entry : sections) {
+            Section& s = entry.second;
+            if (!s.issued[slot]) {
+                continue;
+            }
+            GLint available = 0;
+            glGetQueryObjectiv(s.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 samples;
+                glGetQueryObjectui64v(s.queries[slot], GL_QUERY_RESULT, &samples);
+                s.accumulatedSamples += samples;
+                s.accumulatedCount++;
+            }
+            s.issued[slot] = false;
+        }
+    }
+
+    void begin(const std::string& name) {
+        glBeginQuery(GL_SAMPLES_PASSED, section(name).queries[slot]);
+    }
+
+    void end(const std::string& name) {
+        glEndQuery(GL_SAMPLES_PASSED);
+        section(name).issued[slot] = true;
+    }
+
+    /** average samples per frame since the last resetAverages() */
+    double averageSamples(const std::string& name) {
+        Section& s = section(name);
+        return (s.accumulatedCount > 0) ? double(s.accumulatedSamples) / s.accumulatedCount : 0.0;
+    }
+
+    void resetAverages() {
+        for (auto& entry : sections) {
+            entry.second.accumulatedSamples = 0;
+            entry.second.accumulatedCount = 0;
+        }
+    }
+
+    void Cleanup() {
+        for (auto& entry : sections) {
+            glDeleteQueries(LATENCY, entry.second.queries);
+        }
+        sections.clear();
+    }
+};
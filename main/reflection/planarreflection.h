@@ -0,0 +1,158 @@
+#pragma once
+#include <map>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include "../render_target_pool.h"
+#include "../screenquad/fullscreenquad.h"
+
+/**
+ * @brief The PlanarReflection class drives the reflection of the scene in the water.
+ * The mirrored scene is rendered at a fraction of the internal resolution with a reduced tessellation,
+ * then downsampled and blurred in one pass into the target the water samples.
+ * It can be re-rendered every other frame only: in between, the water reprojects the last reflection,
+ * which is exact on the mirror plane since a point of the plane is its own reflection.
+ */
+class PlanarReflection {
+
+    public:
+        /** resolutions of the rendered reflection, relative to the internal render resolution */
+        static constexpr int NUM_SCALES = 3;
+
+    private:
+        FullScreenQuad quad;
+        GLuint program_id_;             // GLSL shader program ID
+        GLuint blur_id;
+
+        const float scales[NUM_SCALES] = {0.5f, 0.35f, 0.25f};
+        int scaleIndex = 0;
+        bool alternateFrames = false;
+
+        /** mirrored view projection and world offset of the scene when the reflection was last rendered */
+        glm::mat4 renderedVP;
+        glm::vec3 renderedOffset;
+        glm::vec3 currentOffset;
+        bool valid = false;
+        bool updateThisFrame = true;
+        int frame = 0;
+
+        int frames = 0;
+        int updates = 0;
+
+        std::map<GLuint, GLuint> programToMirrorVP;
+
+    public:
+        void Init() {
+            // compile the shaders
+            program_id_ = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                  "reflection_fshader.glsl");
+            if(!program_id_) {
+                exit(EXIT_FAILURE);
+            }
+
+            glUseProgram(program_id_);
+
+            quad.registerProgram(program_id_);
+
+            glUniform1i(glGetUniformLocation(program_id_, "tex"), 0 /*GL_TEXTURE0*/);
+            blur_id = glGetUniformLocation(program_id_, "blur");
+
+            // to avoid the current object being polluted
+            glUseProgram(0);
+        }
+
+        /** to call once per frame before needsUpdate, worldOffset: the world position of the scene origin */
+        void beginFrame(const glm::vec3 &worldOffset) {
+            currentOffset = worldOffset;
+            updateThisFrame = !valid || !alternateFrames || (frame % 2 == 0);
+            frame++;
+            frames++;
+        }
+
+        /** whether the reflection is rendered this frame, otherwise the water reprojects the last one */
+        bool needsUpdate() const {
+            return updateThisFrame;
+        }
+
+        /** the transient target the mirrored scene is rendered into */
+        RenderTargetDesc renderTarget() const {
+            return RenderTargetDesc{scales[scaleIndex], GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, true, false};
+        }
+
+        /** the tessellation follows the resolution, the reflection is blurred and broken by the waves anyway */
+        float tessellationScale() const {
+            return scales[scaleIndex];
+        }
+
+        /** writes the rendered reflection, downsampled and optionally blurred, into the bound target */
+        void Downsample(GLuint renderedTexture, bool blur) {
+            glUseProgram(program_id_);
+            quad.Bind(program_id_);
+            glUniform1i(blur_id, blur);
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, renderedTexture);
+            quad.Draw();
+
+            glBindVertexArray(0);
+            glUseProgram(0);
+        }
+
+        /** to call once the reflection is rendered with the mirrored view projection mirroredVP */
+        void rendered(const glm::mat4 &mirroredVP) {
+            renderedVP = mirroredVP;
+            renderedOffset = currentOffset;
+            valid = true;
+            updates++;
+        }
+
+        /** the next frame re-renders the reflection, e.g. when the target it is sampled from changes */
+        void invalidate() {
+            valid = false;
+        }
+
+        /** cycles through the resolutions of the rendered reflection */
+        void cycleScale() {
+            scaleIndex = (scaleIndex + 1) % NUM_SCALES;
+            invalidate();
+        }
+
+        float getScale() const {
+            return scales[scaleIndex];
+        }
+
+        void toggleAlternateFrames() {
+            alternateFrames = !alternateFrames;
+        }
+
+        bool isAlternatingFrames() const {
+            return alternateFrames;
+        }
+
+        /** fraction of the frames since the last resetStats that rendered the reflection */
+        float updatedFraction() const {
+            return frames > 0 ? float(updates) / frames : 0.0f;
+        }
+
+        void resetStats() {
+            frames = 0;
+            updates = 0;
+        }
+
+        void registerProgram(GLuint program_id) {
+            programToMirrorVP[program_id] = glGetUniformLocation(program_id, "mirrorVP");
+        }
+
+        /** uploads the projection of the last reflection, from the scene coordinates of this frame */
+        void updateProgram(GLuint program_id) {
+            // the scene origin moves with the tiles, bring the points back where they were when it was rendered
+            glm::mat4 mirrorVP = renderedVP * glm::translate(glm::mat4(1.0f), currentOffset - renderedOffset);
+            glUniformMatrix4fv(programToMirrorVP[program_id], ONE, DONT_TRANSPOSE, glm::value_ptr(mirrorVP));
+        }
+
+        void Cleanup() {
+            glUseProgram(0);
+            quad.Cleanup();
+            glDeleteProgram(program_id_);
+        }
+};
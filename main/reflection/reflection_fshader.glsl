@@ -0,0 +1,25 @@
+#version 410 core
+// downsamples the rendered reflection into the one the water samples, the blur is part of the downsample:
+// 4 bilinear taps one source texel away from the pixel center average a 4x4 box of source texels
+
+in vec2 uv;
+
+out vec4 color;
+
+uniform sampler2D tex;
+uniform bool blur;
+
+void main() {
+    if(!blur){
+        color = vec4(texture(tex, uv).rgb, 1.0f);
+        return;
+    }
+
+    vec2 texel = 1.0f / vec2(textureSize(tex, 0));
+    vec3 sum = texture(tex, uv + vec2(-texel.x, -texel.y)).rgb
+             + texture(tex, uv + vec2(+texel.x, -texel.y)).rgb
+             + texture(tex, uv + vec2(-texel.x, +texel.y)).rgb
+             + texture(tex, uv + vec2(+texel.x, +texel.y)).rgb;
+
+    color = vec4(0.25f * sum, 1.0f);
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include <list>
+#include "icg_helper.h"
+#include "framebuffer.h"
+
+/** Describes a render target relatively to the native render resolution */
+struct RenderTargetDesc {
+    /** fraction of the native resolution along each axis, 0.5 means a quarter of the pixels */
+    float scale;
+    GLint internalFormat;
+    GLint format;
+    GLint type;
+    bool useInterpolation;
+    bool mirrorRepeat;
+
+    bool operator==(const RenderTargetDesc& o) const {
+        return scale == o.scale && internalFormat == o.internalFormat && format == o.format
+                && type == o.type && useInterpolation == o.useInterpolation && mirrorRepeat == o.mirrorRepeat;
+    }
+};
+
+/**
+ * @brief The RenderTargetPool class owns every post-processing ColorAndDepthFBO.
+ * Targets are keyed by their size and format: a pass acquires a target matching its RenderTargetDesc,
+ * uses it and releases it so that another pass with the same key can reuse the same memory.
+ * Targets held for the whole frame (e.g. the reflection) are simply never released.
+ * On a window resize every target is re-allocated in place, so texture ids handed to shaders stay valid.
+ */
+class RenderTargetPool {
+
+    struct Entry {
+        RenderTargetDesc desc;
+        ColorAndDepthFBO fbo;
+        bool inUse;
+    };
+
+    // std::list so that handed out pointers stay valid when the pool grows
+    std::list<Entry> entries;
+    int nativeWidth;
+    int nativeHeight;
+
+public:
+    void Init(int nativeWidth, int nativeHeight) {
+        this->nativeWidth = nativeWidth;
+        this->nativeHeight = nativeHeight;
+    }
+
+    /** returns a free target matching desc, allocating a new one if the pool has none */
+    ColorAndDepthFBO* acquire(const RenderTargetDesc& desc) {
+        for (auto& entry : entries) {
+            if (!entry.inUse && entry.desc == desc) {
+                entry.inUse = true;
+                return &entry.fbo;
+            }
+        }
+
+        entries.push_back(Entry{desc, ColorAndDepthFBO(), true});
+        Entry& entry = entries.back();
+        entry.fbo.Init(scaledWidth(desc.scale), scaledHeight(desc.scale),
+                       desc.internalFormat, desc.format, desc.type,
+                       desc.useInterpolation, desc.mirrorRepeat);
+        return &entry.fbo;
+    }
+
+    /** hands the target back to the pool, its content must not be used afterwards */
+    void release(ColorAndDepthFBO* target) {
+        for (auto& entry : entries) {
+            if (&entry.fbo == target) {
+                entry.inUse = false;
+                return;
+            }
+        }
+        throw std::runtime_error{"RenderTargetPool::release unknown render target"};
+    }
+
+    /** follows the native resolution, every target keeps its scale */
+    void Resize(int nativeWidth, int nativeHeight) {
+        if (nativeWidth == this->nativeWidth && nativeHeight == this->nativeHeight) {
+            return;
+        }
+        this->nativeWidth = nativeWidth;
+        this->nativeHeight = nativeHeight;
+        for (auto& entry : entries) {
+            entry.fbo.Resize(scaledWidth(entry.desc.scale), scaledHeight(entry.desc.scale));
+        }
+    }
+
+    int scaledWidth(float scale) const {
+        return std::max(1, int(nativeWidth * scale));
+    }
+
+    int scaledHeight(float scale) const {
+        return std::max(1, int(nativeHeight * scale));
+    }
+
+    /** bytes of video memory held by the pool, color + 16 bits depth attachments */
+    size_t memoryUsage() const {
+        size_t total = 0;
+        for (auto& entry : entries) {
+            size_t pixels = size_t(scaledWidth(entry.desc.scale)) * scaledHeight(entry.desc.scale);
+            total += pixels * (bytesPerPixel(entry.desc.internalFormat) + 2);
+        }
+        return total;
+    }
+
+    void printStats() const {
+        cout << "Render targets: " << entries.size() << " targets, "
+             << memoryUsage() / (1024.0 * 1024.0) << " MB" << endl;
+    }
+
+    /** bytes per pixel as stored by the driver, RGB16F is padded to RGBA16F by most drivers */
+    static size_t bytesPerPixel(GLint internalFormat) {
+        switch (internalFormat) {
+        case GL_R11F_G11F_B10F:
+        case GL_RGBA8:
+        case GL_RGB8:
+        case GL_R32F:
+        case GL_RG16F:
+            return 4;
+        case GL_RGB16F:
+        case GL_RGBA16F:
+        case GL_RG32F:
+            return 8;
+        case GL_RGB32F:
+        case GL_RGBA32F:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    void Cleanup() {
+        for (auto& entry : entries) {
+            entry.fbo.Cleanup();
+        }
+        entries.clear();
+    }
+};
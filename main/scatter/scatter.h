@@ -0,0 +1,488 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "../light/light.h"
+#include "scattermesh.h"
+
+/** the rules a kind of object is placed with, and how it is drawn */
+struct ScatterKind {
+    /** candidates per tile, each kept or not by the rules */
+    int candidates;
+    /** terrain heights, largest slope and grass map values the kind grows in */
+    glm::vec2 heightRange;
+    float maxSlope;
+    glm::vec2 grassRange;
+    /** in scene units per mesh unit */
+    glm::vec2 scaleRange;
+    /** highest point of the meshes, in mesh units */
+    float meshHeight;
+    /** level of detail i is drawn up to lodDistances[i] from the camera, none beyond the last one */
+    std::vector<float> lodDistances;
+    std::vector<ScatterMesh> lods;
+};
+
+/**
+ * @brief The Scatter class places rocks, shrubs and trees on the tiles and draws them instanced. As the grass, the
+ * placement rules are evaluated once per tile and kind by Place, which feeds the kept objects back into the slot
+ * of the tile in one instance buffer: the slots of a band are overwritten when it shifts. The candidates are
+ * seeded by the noise position of the tile, a tile always holds the same objects. Draw culls each tile against
+ * the frustum and picks the level of detail of each kind from its distance to the camera. DrawShadow casts the
+ * same objects into the shadow cascades
+ */
+class Scatter {
+
+    private:
+        GLuint program_id_;             // GLSL shader program ID
+        GLuint MVP_id, MV_id, NORMALM_id, translation_id, scaleRange_id, deferredPass_id;
+
+        // the same vertices, the depth only
+        GLuint shadowProgram_id_;
+        GLuint shadowMVP_id, shadowTranslation_id, shadowScaleRange_id;
+
+        // feeds the kept objects back, the rasterization is discarded
+        GLuint placeProgram_id_;
+        GLuint placeVAO;
+        GLuint noiseTile_id, kind_id, heightRange_id, maxSlope_id, grassRange_id;
+
+        std::vector<ScatterKind> kinds;
+        // the slot of (tile, kind) holds the candidates of the kind, the largest count of all kinds
+        int slotCapacity = 0;
+        static constexpr GLsizeiptr instanceSize = 4 * sizeof(GLfloat);
+
+        struct SlotPlacement {
+            GLuint query;
+            bool pending;
+            GLuint instances;
+        };
+        std::vector<SlotPlacement> slots;
+        GLuint instancesVBO;
+        // the tiles with a slot whose count came back since the last takeResolvedTiles
+        std::vector<int> resolvedTiles;
+
+        Light* light = nullptr;
+        bool deferredPass = false;
+
+        size_t instancesLastFrame = 0;
+        size_t trianglesLastFrame = 0;
+        int drawsLastFrame = 0;
+
+    public:
+        /** tiles: how many tiles the objects are placed and cached for, see Place */
+        void Init(int tiles) {
+            program_id_ = icg_helper::LoadShaders("scatter_vshader.glsl",
+                                                  "scatter_fshader.glsl");
+            if(!program_id_) {
+                exit(EXIT_FAILURE);
+            }
+            MVP_id = glGetUniformLocation(program_id_, "MVP");
+            MV_id = glGetUniformLocation(program_id_, "MV");
+            NORMALM_id = glGetUniformLocation(program_id_, "NORMALM");
+            translation_id = glGetUniformLocation(program_id_, "translation");
+            scaleRange_id = glGetUniformLocation(program_id_, "scaleRange");
+            deferredPass_id = glGetUniformLocation(program_id_, "deferredPass");
+
+            shadowProgram_id_ = icg_helper::LoadShaders("scatter_vshader.glsl",
+                                                        "model_fshader_shadow.glsl");
+            if(!shadowProgram_id_) {
+                exit(EXIT_FAILURE);
+            }
+            shadowMVP_id = glGetUniformLocation(shadowProgram_id_, "MVP");
+            shadowTranslation_id = glGetUniformLocation(shadowProgram_id_, "translation");
+            shadowScaleRange_id = glGetUniformLocation(shadowProgram_id_, "scaleRange");
+
+            initKinds();
+            for (const ScatterKind& kind : kinds) {
+                slotCapacity = std::max(slotCapacity, kind.candidates);
+            }
+
+            glGenBuffers(1, &instancesVBO);
+            glBindBuffer(GL_ARRAY_BUFFER, instancesVBO);
+            glBufferData(GL_ARRAY_BUFFER, tiles * kinds.size() * slotCapacity * instanceSize, NULL, GL_DYNAMIC_COPY);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            for (ScatterKind& kind : kinds) {
+                for (ScatterMesh& lod : kind.lods) {
+                    lod.Init(instancesVBO);
+                }
+            }
+
+            slots.resize(tiles * kinds.size());
+            for (SlotPlacement& slot : slots) {
+                glGenQueries(1, &slot.query);
+                slot.pending = false;
+                slot.instances = 0;
+            }
+
+            initPlacement();
+            glUseProgram(0);
+        }
+
+        void useLight(Light* l) {
+            this->light = l;
+            light->registerProgram(program_id_);
+            glUseProgram(0);
+        }
+
+        /** the next draws write the G-buffer of the deferred path instead of lit colors */
+        void useDeferredPass(bool enabled) {
+            deferredPass = enabled;
+        }
+
+        /**
+         * places the objects of every kind on the tile and caches them until the next call for the tile.
+         * noiseTile: the noise position of the tile, heightMap, grassMap: its maps
+         */
+        void Place(int tile, const glm::ivec2 &noiseTile, GLuint heightMap, GLuint grassMap) {
+            glEnable(GL_RASTERIZER_DISCARD);
+            glUseProgram(placeProgram_id_);
+            glBindVertexArray(placeVAO);
+            glActiveTexture(GL_TEXTURE0 + 0);
+            glBindTexture(GL_TEXTURE_2D, heightMap);
+            glActiveTexture(GL_TEXTURE0 + 4);
+            glBindTexture(GL_TEXTURE_2D, grassMap);
+            glUniform2i(noiseTile_id, noiseTile.x, noiseTile.y);
+
+            for (size_t k = 0; k < kinds.size(); ++k) {
+                const ScatterKind& kind = kinds[k];
+                int s = slot(tile, k);
+                glUniform1i(kind_id, k);
+                glUniform2fv(heightRange_id, 1, glm::value_ptr(kind.heightRange));
+                glUniform1f(maxSlope_id, kind.maxSlope);
+                glUniform2fv(grassRange_id, 1, glm::value_ptr(kind.grassRange));
+
+                glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, instancesVBO,
+                                  s * slotCapacity * instanceSize, slotCapacity * instanceSize);
+                glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, slots[s].query);
+                glBeginTransformFeedback(GL_POINTS);
+                glDrawArrays(GL_POINTS, 0, kind.candidates);
+                glEndTransformFeedback();
+                glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+
+                // the count comes back with a later Draw, the slot draws nothing until then
+                slots[s].pending = true;
+                slots[s].instances = 0;
+            }
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glBindVertexArray(0);
+            glUseProgram(0);
+            glDisable(GL_RASTERIZER_DISCARD);
+        }
+
+        /** must be called once per frame before the draws, the counters restart */
+        void beginFrame() {
+            instancesLastFrame = 0;
+            trianglesLastFrame = 0;
+            drawsLastFrame = 0;
+        }
+
+        /**
+         * draws the objects placed on the tile, each kind with the level of detail of its distance to the camera.
+         * translation: of the tile in the scene, cameraPos: horizontal position of the camera, x and z
+         */
+        void Draw(int tile,
+                  const glm::mat4 &MVP,
+                  const glm::mat4 &MV,
+                  const glm::mat4 &NORMALM,
+                  const glm::vec2 &translation,
+                  const glm::vec2 &cameraPos) {
+            float closest = closestDistance(translation, cameraPos);
+            bool programBound = false;
+
+            for (size_t k = 0; k < kinds.size(); ++k) {
+                const ScatterKind& kind = kinds[k];
+                SlotPlacement& placement = slots[slot(tile, k)];
+                if (!resolvePlacement(tile, k) || placement.instances == 0 || closest >= kind.lodDistances.back()
+                        || !insideFrustum(MVP, translation, kind)) {
+                    continue;
+                }
+                size_t lod = levelOfDetail(kind, closest);
+
+                if (!programBound) {
+                    glUseProgram(program_id_);
+                    glUniformMatrix4fv(MVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(MVP));
+                    glUniformMatrix4fv(MV_id, ONE, DONT_TRANSPOSE, glm::value_ptr(MV));
+                    glUniformMatrix4fv(NORMALM_id, ONE, DONT_TRANSPOSE, glm::value_ptr(NORMALM));
+                    glUniform2fv(translation_id, 1, glm::value_ptr(translation));
+                    glUniform1i(deferredPass_id, deferredPass);
+                    if (light != nullptr) {
+                        light->updateProgram(program_id_);
+                    }
+                    programBound = true;
+                }
+                glUniform2fv(scaleRange_id, 1, glm::value_ptr(kind.scaleRange));
+                kind.lods[lod].DrawInstanced(instancesVBO, slot(tile, k) * slotCapacity * instanceSize,
+                                             placement.instances);
+
+                instancesLastFrame += placement.instances;
+                trianglesLastFrame += size_t(kind.lods[lod].triangles()) * placement.instances;
+                drawsLastFrame++;
+            }
+
+            if (programBound) {
+                glUseProgram(0);
+            }
+        }
+
+        /**
+         * draws the objects placed on the tile into the shadow map of SHADOWMVP. The maps are cached while the
+         * camera moves: each kind casts its shadows with the level of detail of a camera at the center of the
+         * central tile, out to its last LOD distance grown by the distance the camera can be from there
+         */
+        void DrawShadow(int tile, const glm::mat4 &SHADOWMVP, const glm::vec2 &translation) {
+            float closest = closestDistance(translation, glm::vec2(0.0f));
+            bool programBound = false;
+
+            for (size_t k = 0; k < kinds.size(); ++k) {
+                const ScatterKind& kind = kinds[k];
+                const SlotPlacement& placement = slots[slot(tile, k)];
+                if (!resolvePlacement(tile, k) || placement.instances == 0
+                        || closest >= kind.lodDistances.back() + centralTileReach()
+                        || !insideFrustum(SHADOWMVP, translation, kind)) {
+                    continue;
+                }
+                size_t lod = levelOfDetail(kind, closest);
+
+                if (!programBound) {
+                    glUseProgram(shadowProgram_id_);
+                    glUniformMatrix4fv(shadowMVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(SHADOWMVP));
+                    glUniform2fv(shadowTranslation_id, 1, glm::value_ptr(translation));
+                    programBound = true;
+                }
+                glUniform2fv(shadowScaleRange_id, 1, glm::value_ptr(kind.scaleRange));
+                kind.lods[lod].DrawInstanced(instancesVBO, slot(tile, k) * slotCapacity * instanceSize,
+                                             placement.instances);
+            }
+
+            if (programBound) {
+                glUseProgram(0);
+            }
+        }
+
+        /** distance to the center of the central tile beyond which no object casts a shadow */
+        float getShadowRadius() const {
+            float radius = 0.0f;
+            for (const ScatterKind& kind : kinds) {
+                radius = std::max(radius, kind.lodDistances.back() + centralTileReach());
+            }
+            return radius;
+        }
+
+        /** the box holding the objects of every kind on the tile drawn at translation */
+        void getTileBounds(const glm::vec2 &translation, glm::vec3 &bmin, glm::vec3 &bmax) const {
+            bmin = glm::vec3(FLT_MAX);
+            bmax = glm::vec3(-FLT_MAX);
+            for (const ScatterKind& kind : kinds) {
+                glm::vec3 kindMin, kindMax;
+                kindBounds(translation, kind, kindMin, kindMax);
+                bmin = glm::min(bmin, kindMin);
+                bmax = glm::max(bmax, kindMax);
+            }
+        }
+
+        /** checks the placements waiting for their counts, then returns the tiles that got one since the last call */
+        std::vector<int> takeResolvedTiles() {
+            for (size_t s = 0; s < slots.size(); ++s) {
+                resolvePlacement(int(s / kinds.size()), s % kinds.size());
+            }
+            std::sort(resolvedTiles.begin(), resolvedTiles.end());
+            resolvedTiles.erase(std::unique(resolvedTiles.begin(), resolvedTiles.end()), resolvedTiles.end());
+            std::vector<int> tiles;
+            tiles.swap(resolvedTiles);
+            return tiles;
+        }
+
+        /** objects, triangles and instanced draws since beginFrame */
+        size_t getInstancesLastFrame() const {
+            return instancesLastFrame;
+        }
+
+        size_t getTrianglesLastFrame() const {
+            return trianglesLastFrame;
+        }
+
+        int getDrawsLastFrame() const {
+            return drawsLastFrame;
+        }
+
+        /** objects kept by the placement of every tile */
+        size_t placedInstances() const {
+            size_t placed = 0;
+            for (const SlotPlacement& placement : slots) {
+                placed += placement.instances;
+            }
+            return placed;
+        }
+
+        /** bytes of video memory held by the placed objects */
+        size_t memoryUsage() const {
+            return slots.size() * slotCapacity * instanceSize;
+        }
+
+        void Cleanup() {
+            glBindVertexArray(0);
+            glUseProgram(0);
+            for (ScatterKind& kind : kinds) {
+                for (ScatterMesh& lod : kind.lods) {
+                    lod.Cleanup();
+                }
+            }
+            for (SlotPlacement& placement : slots) {
+                glDeleteQueries(1, &placement.query);
+            }
+            slots.clear();
+            glDeleteBuffers(1, &instancesVBO);
+            glDeleteProgram(program_id_);
+            glDeleteProgram(shadowProgram_id_);
+            glDeleteProgram(placeProgram_id_);
+            glDeleteVertexArrays(1, &placeVAO);
+        }
+
+    private:
+        int slot(int tile, size_t kind) const {
+            return tile * kinds.size() + kind;
+        }
+
+        /** whether the count of the placement of the kind on the tile came back, it is read once available */
+        bool resolvePlacement(int tile, size_t kind) {
+            SlotPlacement& placement = slots[slot(tile, kind)];
+            if (placement.pending) {
+                GLint available = 0;
+                glGetQueryObjectiv(placement.query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available) {
+                    return false;
+                }
+                glGetQueryObjectuiv(placement.query, GL_QUERY_RESULT, &placement.instances);
+                placement.pending = false;
+                resolvedTiles.push_back(tile);
+            }
+            return true;
+        }
+
+        /** the level of detail of the kind at the distance to the camera, below its last LOD distance */
+        static size_t levelOfDetail(const ScatterKind &kind, float distanceToCamera) {
+            size_t lod = 0;
+            while (lod + 1 < kind.lods.size() && distanceToCamera >= kind.lodDistances[lod]) {
+                ++lod;
+            }
+            return lod;
+        }
+
+        /** how far the camera can be from the center of the central tile, half its diagonal */
+        static float centralTileReach() {
+            return std::sqrt(2.0f);
+        }
+
+        /** rocks on the shores and the slopes, shrubs and trees in the heights of the grass, see grass_place_vshader.glsl */
+        void initKinds() {
+            ScatterKind rocks;
+            rocks.candidates = 40;
+            rocks.heightRange = glm::vec2(0.2f, 1.2f);
+            rocks.maxSlope = 1.5f;
+            rocks.grassRange = glm::vec2(0.0f, 1.0f);
+            rocks.scaleRange = glm::vec2(0.06f, 0.16f);
+            rocks.meshHeight = 0.4f;
+            rocks.lodDistances = {3.0f, 8.0f};
+            rocks.lods = {ScatterMesh::rock(2), ScatterMesh::rock(0)};
+            kinds.push_back(rocks);
+
+            ScatterKind shrubs;
+            shrubs.candidates = 48;
+            shrubs.heightRange = glm::vec2(0.25f, 0.5f);
+            shrubs.maxSlope = 0.6f;
+            shrubs.grassRange = glm::vec2(0.0f, 0.5f);
+            shrubs.scaleRange = glm::vec2(0.1f, 0.18f);
+            shrubs.meshHeight = 0.75f;
+            shrubs.lodDistances = {3.0f, 8.0f};
+            shrubs.lods = {ScatterMesh::shrub(1), ScatterMesh::shrub(0)};
+            kinds.push_back(shrubs);
+
+            ScatterKind trees;
+            trees.candidates = 16;
+            trees.heightRange = glm::vec2(0.3f, 0.55f);
+            trees.maxSlope = 0.4f;
+            trees.grassRange = glm::vec2(0.0f, 0.35f);
+            trees.scaleRange = glm::vec2(0.35f, 0.6f);
+            trees.meshHeight = 1.0f;
+            trees.lodDistances = {4.0f, 9.0f, 16.0f};
+            trees.lods = {ScatterMesh::tree(10, 3), ScatterMesh::tree(6, 2), ScatterMesh::tree(4, 1)};
+            kinds.push_back(trees);
+        }
+
+        void initPlacement() {
+            placeProgram_id_ = icg_helper::LoadShaders("scatter_place_vshader.glsl",
+                                                       "scatter_place_fshader.glsl",
+                                                       NULL, NULL,
+                                                       "scatter_place_gshader.glsl");
+            if(!placeProgram_id_) {
+                exit(EXIT_FAILURE);
+            }
+            // the captured outputs are only known at link time
+            const GLchar* feedback[] = {"scatterInstance"};
+            glTransformFeedbackVaryings(placeProgram_id_, 1, feedback, GL_INTERLEAVED_ATTRIBS);
+            glLinkProgram(placeProgram_id_);
+            GLint linked = GL_FALSE;
+            glGetProgramiv(placeProgram_id_, GL_LINK_STATUS, &linked);
+            if (!linked) {
+                cout << "Unable to link the scatter placement with its feedback" << endl;
+                exit(EXIT_FAILURE);
+            }
+
+            glUseProgram(placeProgram_id_);
+            glUniform1i(glGetUniformLocation(placeProgram_id_, "heightMap"), 0);
+            glUniform1i(glGetUniformLocation(placeProgram_id_, "grassMap"), 4);
+            noiseTile_id = glGetUniformLocation(placeProgram_id_, "noiseTile");
+            kind_id = glGetUniformLocation(placeProgram_id_, "kind");
+            heightRange_id = glGetUniformLocation(placeProgram_id_, "heightRange");
+            maxSlope_id = glGetUniformLocation(placeProgram_id_, "maxSlope");
+            grassRange_id = glGetUniformLocation(placeProgram_id_, "grassRange");
+
+            // the candidates are generated from their index, the points have no attributes
+            glGenVertexArrays(1, &placeVAO);
+        }
+
+        /** horizontal distance from the camera to the tile */
+        static float closestDistance(const glm::vec2 &translation, const glm::vec2 &cameraPos) {
+            glm::vec2 tileCenter(translation.x, -translation.y);
+            glm::vec2 outside = glm::max(glm::abs(cameraPos - tileCenter) - glm::vec2(1.0f), glm::vec2(0.0f));
+            return glm::length(outside);
+        }
+
+        /** the box holding the objects of the kind on the tile */
+        static void kindBounds(const glm::vec2 &translation, const ScatterKind &kind, glm::vec3 &bmin, glm::vec3 &bmax) {
+            float reach = 0.5f * kind.scaleRange.y;
+            bmin = glm::vec3(translation.x - 1.0f - reach, kind.heightRange.x - reach, -translation.y - 1.0f - reach);
+            bmax = glm::vec3(translation.x + 1.0f + reach, kind.heightRange.y + kind.meshHeight * kind.scaleRange.y,
+                             -translation.y + 1.0f + reach);
+        }
+
+        /** whether the bounds of the objects of the kind on the tile can overlap the frustum of MVP */
+        static bool insideFrustum(const glm::mat4 &MVP, const glm::vec2 &translation, const ScatterKind &kind) {
+            glm::vec3 bmin, bmax;
+            kindBounds(translation, kind, bmin, bmax);
+            // culled when all the corners are outside the same clip plane
+            int outside[6] = {0, 0, 0, 0, 0, 0};
+            for (int k = 0; k < 8; ++k) {
+                glm::vec4 p = MVP * glm::vec4((k & 1) ? bmax.x : bmin.x, (k & 2) ? bmax.y : bmin.y,
+                                              (k & 4) ? bmax.z : bmin.z, 1.0f);
+                outside[0] += p.x < -p.w;
+                outside[1] += p.x > p.w;
+                outside[2] += p.y < -p.w;
+                outside[3] += p.y > p.w;
+                outside[4] += p.z < -p.w;
+                outside[5] += p.z > p.w;
+            }
+            for (int plane = 0; plane < 6; ++plane) {
+                if (outside[plane] == 8) {
+                    return false;
+                }
+            }
+            return true;
+        }
+};
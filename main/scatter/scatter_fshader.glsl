@@ -0,0 +1,30 @@
+#version 410 core
+in vec3 color_F;
+in vec3 normal_MV_F;
+
+layout (location = 0) out vec4 color;
+// the G-buffer normal and material, the forward passes write the HDR color only
+layout (location = 1) out vec4 gNormal;
+
+// writes the G-buffer (albedo, normal and material) instead of the lit color
+uniform bool deferredPass;
+uniform vec3 light_dir;
+uniform mat4 NORMALM;
+uniform vec3 La, Ld;
+
+#include "gbuffer_normal.glsl"
+
+void main() {
+    vec3 normal = normalize(normal_MV_F);
+
+    // lit as the models, without specular
+    if (deferredPass) {
+        color = vec4(color_F, 1.0f);
+        gNormal = vec4(encodeNormal(normal), 0.0f, 1.0f);
+        return;
+    }
+
+    vec3 lightDir = normalize((NORMALM * vec4(light_dir, 1.0)).xyz);
+    float cosNL = max(dot(normal, lightDir), 0.0f);
+    color = vec4(color_F * (La + cosNL * Ld), 1.0f);
+}
@@ -0,0 +1,18 @@
+#version 410 core
+// keeps the accepted candidates only, the transform feedback packs them one after the other
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+in vec4 placement_G[];
+in float accepted_G[];
+
+// the position of the object in the tile in xy, the height of the terrain under it in z, its seed in w
+out vec4 scatterInstance;
+
+void main() {
+    if (accepted_G[0] > 0.5f) {
+        scatterInstance = placement_G[0];
+        EmitVertex();
+        EndPrimitive();
+    }
+}
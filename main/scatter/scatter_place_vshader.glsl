@@ -0,0 +1,66 @@
+#version 410 core
+// the placement rules of one candidate object of a kind, evaluated once per tile when its maps change, see
+// Scatter::Place. The candidates only depend on the noise position of the tile and on the kind
+
+out vec4 placement_G;
+out float accepted_G;
+
+uniform sampler2D heightMap;
+uniform sampler2D grassMap;
+// noise position of the tile, the seed of its candidates
+uniform ivec2 noiseTile;
+uniform int kind;
+// the heights, the largest slope and the range of the grass map value the kind grows in
+uniform vec2 heightRange;
+uniform float maxSlope;
+uniform vec2 grassRange;
+
+uint hash(in uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// in [0, 1[, moves the state on
+float random(inout uint state)
+{
+    state = hash(state);
+    return float(state >> 8) / 16777216.0f;
+}
+
+// as the grass, a tile spans [-1, 1] and the y axis of the tile is reversed from the texture one
+vec2 mapCoordinates(in vec2 tilePosition)
+{
+    vec2 coord = (tilePosition + vec2(1.0f, 1.0f)) * 0.5f;
+    coord.y = 1.f - coord.y;
+    return coord;
+}
+
+void main() {
+    uint state = hash(uint(noiseTile.x) * 73856093u ^ uint(noiseTile.y) * 19349663u
+                      ^ uint(kind) * 83492791u ^ uint(gl_VertexID) * 2654435761u);
+    vec2 tilePosition = vec2(random(state), random(state)) * 2.0f - 1.0f;
+    float seed = random(state);
+
+    vec2 coord = mapCoordinates(tilePosition);
+    float height = textureLod(heightMap, coord, 0.0f).x;
+    float grass = clamp(textureLod(grassMap, coord, 0.0f).g, 0.0f, 1.0f);
+
+    // a texel of the map is 2 / its size scene units wide
+    vec2 texel = 1.0f / vec2(textureSize(heightMap, 0));
+    float dx = textureLod(heightMap, coord + vec2(texel.x, 0.0f), 0.0f).x
+             - textureLod(heightMap, coord - vec2(texel.x, 0.0f), 0.0f).x;
+    float dy = textureLod(heightMap, coord + vec2(0.0f, texel.y), 0.0f).x
+             - textureLod(heightMap, coord - vec2(0.0f, texel.y), 0.0f).x;
+    float slope = length(vec2(dx, dy) / (4.0f * texel));
+
+    bool grows = heightRange.x <= height && height <= heightRange.y && slope <= maxSlope
+            && grassRange.x <= grass && grass <= grassRange.y;
+
+    placement_G = vec4(tilePosition, height, seed);
+    accepted_G = grows ? 1.0f : 0.0f;
+}
@@ -0,0 +1,36 @@
+#version 410 core
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec3 color;
+// an object kept by the placement: its position in the tile in xy, the height of the terrain under it in z, its
+// seed in w, which turns and scales it
+layout (location = 3) in vec4 scatterInstance;
+
+uniform mat4 MVP;
+uniform mat4 MV;
+uniform mat4 NORMALM;
+// translation of the tile, as the grass
+uniform vec2 translation;
+// smallest and largest scale of the kind, in scene units per mesh unit
+uniform vec2 scaleRange;
+
+out vec3 color_F;
+out vec3 normal_MV_F;
+
+void main() {
+    float seed = scatterInstance.w;
+    float angle = 6.2831853f * seed;
+    float scale = mix(scaleRange.x, scaleRange.y, fract(seed * 7.31f));
+    float c = cos(angle), s = sin(angle);
+    mat3 turn = mat3(c, 0.0f, -s,
+                     0.0f, 1.0f, 0.0f,
+                     s, 0.0f, c);
+
+    vec3 vpoint = vec3(translation.x + scatterInstance.x, scatterInstance.z, -translation.y + scatterInstance.y)
+            + scale * (turn * position);
+    gl_Position = MVP * vec4(vpoint, 1.0f);
+
+    normal_MV_F = normalize((NORMALM * vec4(turn * normal, 1.0f)).xyz);
+    // the objects of a kind differ a little in color
+    color_F = color * mix(0.8f, 1.2f, fract(seed * 13.7f));
+}
@@ -0,0 +1,218 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct ScatterVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 color;
+};
+
+/**
+ * @brief The ScatterMesh class holds one level of detail of a scattered object, generated here since the scene
+ * has no assets for them: rocks, shrubs and trees are built from displaced spheres and cones, about one unit
+ * wide and standing on y = 0. Its vertex array reads one instance per object from the buffer given to Init, see Scatter
+ */
+class ScatterMesh {
+
+    private:
+        GLuint vertex_array_id_;        // vertex array object
+        GLuint vertex_buffer_object_;   // memory buffer for the vertices
+        GLuint index_buffer_object_;    // memory buffer for the indices
+        GLsizei num_indices_;
+
+    public:
+        std::vector<ScatterVertex> vertices;
+        std::vector<GLuint> indices;
+
+        /** instances: the buffer of the scattered instances, a vec4 each, bound at location 3 */
+        void Init(GLuint instances) {
+            glGenVertexArrays(1, &vertex_array_id_);
+            glBindVertexArray(vertex_array_id_);
+
+            glGenBuffers(1, &vertex_buffer_object_);
+            glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ScatterVertex), &vertices[0], GL_STATIC_DRAW);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ScatterVertex), (GLvoid*)offsetof(ScatterVertex, position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ScatterVertex), (GLvoid*)offsetof(ScatterVertex, normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(ScatterVertex), (GLvoid*)offsetof(ScatterVertex, color));
+
+            glGenBuffers(1, &index_buffer_object_);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer_object_);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+            num_indices_ = indices.size();
+
+            // the instances, DrawInstanced points the attribute at the slot drawn
+            glBindBuffer(GL_ARRAY_BUFFER, instances);
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)0);
+            glVertexAttribDivisor(3, 1);
+
+            // to avoid the current object being polluted
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+        /** draws count instances from the byte offset of the instance buffer, with the program in use */
+        void DrawInstanced(GLuint instances, GLintptr offset, GLsizei count) const {
+            glBindVertexArray(vertex_array_id_);
+            glBindBuffer(GL_ARRAY_BUFFER, instances);
+            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (GLvoid*)offset);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glDrawElementsInstanced(GL_TRIANGLES, num_indices_, GL_UNSIGNED_INT, 0, count);
+            glBindVertexArray(0);
+        }
+
+        GLsizei triangles() const {
+            return num_indices_ / 3;
+        }
+
+        void Cleanup() {
+            glDeleteBuffers(1, &vertex_buffer_object_);
+            glDeleteBuffers(1, &index_buffer_object_);
+            glDeleteVertexArrays(1, &vertex_array_id_);
+        }
+
+        /** a lumpy rock, subdivisions: 0 for 20 triangles, each one more multiplies them by 4 */
+        static ScatterMesh rock(int subdivisions) {
+            ScatterMesh mesh;
+            mesh.addLumpySphere(subdivisions, glm::vec3(0.5f, 0.3f, 0.5f), glm::vec3(0.0f, 0.1f, 0.0f),
+                                0.25f, glm::vec3(0.42f, 0.40f, 0.37f));
+            return mesh;
+        }
+
+        /** a round shrub, as rock */
+        static ScatterMesh shrub(int subdivisions) {
+            ScatterMesh mesh;
+            mesh.addLumpySphere(subdivisions, glm::vec3(0.5f, 0.4f, 0.5f), glm::vec3(0.0f, 0.35f, 0.0f),
+                                0.15f, glm::vec3(0.16f, 0.32f, 0.10f));
+            return mesh;
+        }
+
+        /** a conifer one unit high, sides: around the trunk and the foliage, layers: cones of foliage */
+        static ScatterMesh tree(int sides, int layers) {
+            ScatterMesh mesh;
+            const glm::vec3 bark(0.30f, 0.20f, 0.12f), foliage(0.10f, 0.26f, 0.12f);
+            if (layers > 1) {
+                mesh.addCone(0.0f, 0.3f, 0.05f, 0.04f, std::max(3, sides / 2), bark, false);
+            }
+            for (int layer = 0; layer < layers; ++layer) {
+                float base = 0.2f + 0.75f * layer / layers;
+                float radius = 0.3f * (1.0f - 0.35f * layer / layers);
+                mesh.addCone(base, layer + 1 == layers ? 1.0f : base + 0.45f, radius, 0.0f, sides, foliage, true);
+            }
+            return mesh;
+        }
+
+    private:
+        /** a unit icosphere scaled by radii, moved by center, its radius changed by up to lumpiness */
+        void addLumpySphere(int subdivisions, glm::vec3 radii, glm::vec3 center, float lumpiness, glm::vec3 color) {
+            const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+            std::vector<glm::vec3> points = {
+                {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+                {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+                {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+            std::vector<GLuint> faces = {
+                0, 11, 5,  0, 5, 1,  0, 1, 7,  0, 7, 10,  0, 10, 11,
+                1, 5, 9,  5, 11, 4,  11, 10, 2,  10, 7, 6,  7, 1, 8,
+                3, 9, 4,  3, 4, 2,  3, 2, 6,  3, 6, 8,  3, 8, 9,
+                4, 9, 5,  2, 4, 11,  6, 2, 10,  8, 6, 7,  9, 8, 1};
+            for (glm::vec3& p : points) {
+                p = glm::normalize(p);
+            }
+
+            for (int s = 0; s < subdivisions; ++s) {
+                std::map<std::pair<GLuint, GLuint>, GLuint> middles;
+                auto middle = [&](GLuint a, GLuint b) {
+                    std::pair<GLuint, GLuint> key(std::min(a, b), std::max(a, b));
+                    auto it = middles.find(key);
+                    if (it != middles.end()) {
+                        return it->second;
+                    }
+                    points.push_back(glm::normalize(points[a] + points[b]));
+                    GLuint m = points.size() - 1;
+                    middles[key] = m;
+                    return m;
+                };
+                std::vector<GLuint> finer;
+                for (size_t f = 0; f < faces.size(); f += 3) {
+                    GLuint a = faces[f], b = faces[f + 1], c = faces[f + 2];
+                    GLuint ab = middle(a, b), bc = middle(b, c), ca = middle(c, a);
+                    finer.insert(finer.end(), {a, ab, ca,  b, bc, ab,  c, ca, bc,  ab, bc, ca});
+                }
+                faces.swap(finer);
+            }
+
+            // the lumps depend on the direction only, the levels of detail keep the same shape
+            GLuint first = vertices.size();
+            for (const glm::vec3& p : points) {
+                float lump = std::sin(5.1f * p.x + 1.3f) * std::sin(4.3f * p.y + 0.7f) * std::sin(6.7f * p.z + 2.1f);
+                ScatterVertex v;
+                v.position = center + radii * p * (1.0f + lumpiness * lump);
+                v.normal = glm::vec3(0.0f);
+                v.color = color;
+                vertices.push_back(v);
+            }
+            addFaces(first, faces);
+        }
+
+        /** a frustum of cone around y between the heights, closed below when cap */
+        void addCone(float bottom, float top, float bottomRadius, float topRadius, int sides, glm::vec3 color, bool cap) {
+            GLuint first = vertices.size();
+            for (int i = 0; i <= sides; ++i) {
+                float angle = 2.0f * float(M_PI) * i / sides;
+                glm::vec2 around(std::cos(angle), std::sin(angle));
+                glm::vec3 normal = glm::normalize(glm::vec3(around.x * (top - bottom), bottomRadius - topRadius,
+                                                            around.y * (top - bottom)));
+                ScatterVertex low = {glm::vec3(bottomRadius * around.x, bottom, bottomRadius * around.y), normal, color};
+                ScatterVertex high = {glm::vec3(topRadius * around.x, top, topRadius * around.y), normal, color};
+                vertices.push_back(low);
+                vertices.push_back(high);
+            }
+            for (int i = 0; i < sides; ++i) {
+                GLuint low = first + 2 * i, high = low + 1, nextLow = low + 2, nextHigh = low + 3;
+                indices.insert(indices.end(), {low, high, nextLow,  nextLow, high, nextHigh});
+            }
+            if (cap) {
+                GLuint center = vertices.size();
+                ScatterVertex c = {glm::vec3(0.0f, bottom, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), color};
+                vertices.push_back(c);
+                for (int i = 0; i <= sides; ++i) {
+                    ScatterVertex rim = vertices[first + 2 * i];
+                    rim.normal = c.normal;
+                    vertices.push_back(rim);
+                }
+                for (int i = 0; i < sides; ++i) {
+                    indices.insert(indices.end(), {center, center + 1 + i, center + 2 + i});
+                }
+            }
+        }
+
+        /** appends the triangles of the vertices from first on, with the normals averaged over their triangles */
+        void addFaces(GLuint first, const std::vector<GLuint>& faces) {
+            for (size_t f = 0; f < faces.size(); f += 3) {
+                GLuint a = first + faces[f], b = first + faces[f + 1], c = first + faces[f + 2];
+                glm::vec3 n = glm::cross(vertices[b].position - vertices[a].position,
+                                         vertices[c].position - vertices[a].position);
+                vertices[a].normal += n;
+                vertices[b].normal += n;
+                vertices[c].normal += n;
+                indices.insert(indices.end(), {a, b, c});
+            }
+            for (GLuint v = first; v < vertices.size(); ++v) {
+                vertices[v].normal = glm::normalize(vertices[v].normal);
+            }
+        }
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <map>
+#include "icg_helper.h"
+
+/**
+ * @brief The FullScreenQuad class holds the 4 vertices covering the viewport that the screen-space passes
+ * draw as a triangle strip, read by screenquad_vshader.glsl (or any vertex shader taking vpoint and vtexcoord).
+ * The buffers are shared by the programs of a pass, each registered program gets its own vertex array
+ * since the attribute locations are those of the program.
+ */
+class FullScreenQuad {
+
+    private:
+        GLuint vertex_buffer_object_ = 0;
+        GLuint texcoord_buffer_object_ = 0;
+        std::map<GLuint, GLuint> programToVertexArray;
+
+        void initBuffers() {
+            const GLfloat vertex_point[] = { /*V1*/ -1.0f, -1.0f, 0.0f,
+                                             /*V2*/ +1.0f, -1.0f, 0.0f,
+                                             /*V3*/ -1.0f, +1.0f, 0.0f,
+                                             /*V4*/ +1.0f, +1.0f, 0.0f};
+            glGenBuffers(1, &vertex_buffer_object_);
+            glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_point),
+                         vertex_point, GL_STATIC_DRAW);
+
+            const GLfloat vertex_texture_coordinates[] = { /*V1*/ 0.0f, 0.0f,
+                                                           /*V2*/ 1.0f, 0.0f,
+                                                           /*V3*/ 0.0f, 1.0f,
+                                                           /*V4*/ 1.0f, 1.0f};
+            glGenBuffers(1, &texcoord_buffer_object_);
+            glBindBuffer(GL_ARRAY_BUFFER, texcoord_buffer_object_);
+            glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_texture_coordinates),
+                         vertex_texture_coordinates, GL_STATIC_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+
+    public:
+        /** creates the vertex array of the program, the buffers are created with the first one */
+        void registerProgram(GLuint program_id) {
+            if (vertex_buffer_object_ == 0) {
+                initBuffers();
+            }
+
+            GLuint vertex_array_id;
+            glGenVertexArrays(1, &vertex_array_id);
+            glBindVertexArray(vertex_array_id);
+
+            // an attribute the program does not use has no location
+            GLint vertex_point_id = glGetAttribLocation(program_id, "vpoint");
+            if (vertex_point_id >= 0) {
+                glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+                glEnableVertexAttribArray(vertex_point_id);
+                glVertexAttribPointer(vertex_point_id, 3, GL_FLOAT, DONT_NORMALIZE,
+                                      ZERO_STRIDE, ZERO_BUFFER_OFFSET);
+            }
+            GLint vertex_texture_coord_id = glGetAttribLocation(program_id, "vtexcoord");
+            if (vertex_texture_coord_id >= 0) {
+                glBindBuffer(GL_ARRAY_BUFFER, texcoord_buffer_object_);
+                glEnableVertexAttribArray(vertex_texture_coord_id);
+                glVertexAttribPointer(vertex_texture_coord_id, 2, GL_FLOAT, DONT_NORMALIZE,
+                                      ZERO_STRIDE, ZERO_BUFFER_OFFSET);
+            }
+
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            programToVertexArray[program_id] = vertex_array_id;
+        }
+
+        /** binds the vertex array of a registered program for the next Draw calls */
+        void Bind(GLuint program_id) {
+            glBindVertexArray(programToVertexArray[program_id]);
+        }
+
+        void Draw() {
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+
+        void Cleanup() {
+            glBindVertexArray(0);
+            for (auto& entry : programToVertexArray) {
+                glDeleteVertexArrays(1, &entry.second);
+            }
+            programToVertexArray.clear();
+            glDeleteBuffers(1, &vertex_buffer_object_);
+            glDeleteBuffers(1, &texcoord_buffer_object_);
+            vertex_buffer_object_ = 0;
+            texcoord_buffer_object_ = 0;
+        }
+};
@@ -10,7 +10,7 @@ class ScreenQuad {
         GLuint vertex_buffer_object_;   // memory buffer
         GLuint texture_id_;             // texture ID
         GLuint bloomTexture_id_;
-        GLuint exposure_id, gamma_id;
+        GLuint exposure_id, gamma_id, upscale_id;
         float exposure = 2.4;
         float gamma = 0.7;
 
@@ -85,6 +85,7 @@ class ScreenQuad {
 
             exposure_id = glGetUniformLocation(program_id_, "exposure");
             gamma_id = glGetUniformLocation(program_id_, "gamma");
+            upscale_id = glGetUniformLocation(program_id_, "upscale");
 
             // to avoid the current object being polluted
             glBindVertexArray(0);
@@ -110,12 +111,14 @@ class ScreenQuad {
             glDeleteTextures(1, &texture_id_);
         }
 
-        void Draw() {
+        /** upscale: the color texture is smaller than the window and is upsampled with an edge-aware filter */
+        void Draw(bool upscale = false) {
             glUseProgram(program_id_);
             glBindVertexArray(vertex_array_id_);
 
             glUniform1f(exposure_id, exposure);
             glUniform1f(gamma_id, gamma);
+            glUniform1i(upscale_id, upscale);
 
             // bind texture
             glActiveTexture(GL_TEXTURE0);
@@ -6,13 +6,43 @@ out vec4 color;
 
 uniform float exposure;
 uniform float gamma;
+uniform bool upscale;
 
-void main() {
+// larger values keep silhouettes crisper but let more aliasing through
+const float EDGE_SHARPNESS = 8.0;
+
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// bilinear upsampling whose weights are attenuated across luminance edges: the texel nearest
+// to the fragment guides the filter so that edges are not smeared when the scene is rendered
+// below the window resolution
+vec3 edgeAwareUpsample(vec2 uv) {
+    ivec2 size = textureSize(colorTex, 0);
+    vec2 pos = uv * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(pos));
+    vec2 f = pos - floor(pos);
+
+    ivec2 maxTexel = size - 1;
+    vec3 c00 = texelFetch(colorTex, clamp(base,               ivec2(0), maxTexel), 0).rgb;
+    vec3 c10 = texelFetch(colorTex, clamp(base + ivec2(1, 0), ivec2(0), maxTexel), 0).rgb;
+    vec3 c01 = texelFetch(colorTex, clamp(base + ivec2(0, 1), ivec2(0), maxTexel), 0).rgb;
+    vec3 c11 = texelFetch(colorTex, clamp(base + ivec2(1, 1), ivec2(0), maxTexel), 0).rgb;
 
-    color = texture(colorTex, uv);
+    vec4 l = vec4(luminance(c00), luminance(c10), luminance(c01), luminance(c11));
+    float guide = (f.y < 0.5) ? ((f.x < 0.5) ? l.x : l.y) : ((f.x < 0.5) ? l.z : l.w);
 
+    vec4 w = vec4((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+    // relative difference since the colors are HDR
+    w /= 1.0 + EDGE_SHARPNESS * abs(l - guide) / (guide + 0.1);
+
+    return (c00 * w.x + c10 * w.y + c01 * w.z + c11 * w.w) / (w.x + w.y + w.z + w.w);
+}
+
+void main() {
 
-    vec3 hdrColor = texture(colorTex, uv).rgb;
+    vec3 hdrColor = upscale ? edgeAwareUpsample(uv) : texture(colorTex, uv).rgb;
     vec3 bloomColor = texture(bloomTex, uv).rgb;
     vec3 result = hdrColor + bloomColor; // additive blending
     // tone mapping
@@ -0,0 +1,60 @@
+#version 410 core
+// turns the depth of the shadow maps into blurred exponential variance moments, one separable pass at a time:
+// the first pass warps the depth and blurs along x into a scratch texture, the second blurs it along y into the layer.
+// The downsample pass then rebuilds each coarser level of the layer from the previous one
+
+// exponents of the warped depth, the lit shaders use the same. The moments are half floats,
+// exp(2 * 5.54) is just below their 65504 maximum
+const float positiveExponent = 5.54f;
+const float negativeExponent = 5.0f;
+
+// binomial 1 4 6 4 1 weights
+const int RADIUS = 2;
+const float weights[RADIUS + 1] = float[](0.375f, 0.25f, 0.0625f);
+
+uniform sampler2DArray depthTex;
+uniform sampler2D momentsTex;
+// restricted to the level above the one written
+uniform sampler2DArray previousLevel;
+uniform int layer;
+// 0: first pass, 1: second pass, 2: downsample
+uniform int pass;
+// side of the maps, they wrap around
+uniform int size;
+
+out vec4 color;
+
+vec4 warpedMoments(in float depth)
+{
+    depth = 2.0f * depth - 1.0f;
+    float positive = exp(positiveExponent * depth);
+    float negative = -exp(-negativeExponent * depth);
+    return vec4(positive, positive * positive, negative, negative * negative);
+}
+
+void main() {
+    // the passes are drawn in regions of the maps, the fragment is the texel
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+
+    // 2x2 box filter, the maps are square powers of two
+    if(pass == 2){
+        ivec2 base = 2 * texel;
+        color = 0.25f * (texelFetch(previousLevel, ivec3(base, layer), 0) +
+                         texelFetch(previousLevel, ivec3(base + ivec2(1, 0), layer), 0) +
+                         texelFetch(previousLevel, ivec3(base + ivec2(0, 1), layer), 0) +
+                         texelFetch(previousLevel, ivec3(base + ivec2(1, 1), layer), 0));
+        return;
+    }
+
+    vec4 moments = vec4(0.0f);
+    for(int k = -RADIUS; k <= RADIUS; k++){
+        if(pass == 1){
+            ivec2 p = ivec2(texel.x, (texel.y + k + size) % size);
+            moments += weights[abs(k)] * texelFetch(momentsTex, p, 0);
+        } else {
+            ivec2 p = ivec2((texel.x + k + size) % size, texel.y);
+            moments += weights[abs(k)] * warpedMoments(texelFetch(depthTex, ivec3(p, layer), 0).r);
+        }
+    }
+    color = moments;
+}
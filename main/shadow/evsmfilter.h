@@ -0,0 +1,155 @@
+#pragma once
+#include "icg_helper.h"
+#include "../framebuffer.h"
+#include "../screenquad/fullscreenquad.h"
+
+/**
+ * @brief The EVSMFilter class prefilters shadow maps as exponential variance shadow maps:
+ * the depth of a region is warped into moments and blurred with a separable filter,
+ * along x into a scratch texture then along y into the layer of the moments array. The coarser levels are
+ * rebuilt by 2x2 box filters under the filtered regions of that layer only.
+ * The lit shaders take one filtered fetch of the moments instead of many depth comparisons.
+ */
+class EVSMFilter {
+
+    private:
+        FullScreenQuad quad;
+        GLuint program_id_;             // GLSL shader program ID
+        GLuint depthTexture_id_;
+        GLuint depthSampler_id_;        // reads the depth without comparison
+        GLuint layer_id, pass_id;
+
+        ColorFBO scratch;
+        ColorArrayFBO moments;
+        GLuint scratchTexture_id_, momentsTexture_id_;
+        int size, layers;
+
+        // passes of evsm_fshader.glsl
+        enum { FIRST_PASS = 0, SECOND_PASS = 1, DOWNSAMPLE = 2 };
+
+    public:
+        /** texels of the blur on each side, as in evsm_fshader.glsl */
+        enum { RADIUS = 2 };
+
+        /** returns the id of the moments texture array, same layout as the size x size depth texture array */
+        GLuint Init(GLuint depthTexture, int size, int layers) {
+            this->depthTexture_id_ = depthTexture;
+            this->size = size;
+            this->layers = layers;
+
+            // half floats: the exponents of evsm_fshader.glsl keep the second moments below 65504
+            scratchTexture_id_ = scratch.Init(size, size, GL_RGBA16F, GL_RGBA, GL_FLOAT, false);
+            momentsTexture_id_ = moments.Init(size, size, layers, GL_RGBA16F, GL_RGBA, GL_FLOAT);
+
+            // the maps wrap around as the camera moves
+            glBindTexture(GL_TEXTURE_2D_ARRAY, momentsTexture_id_);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+            // the depth texture compares to a reference for PCF, the filter reads the raw depth
+            glGenSamplers(1, &depthSampler_id_);
+            glSamplerParameteri(depthSampler_id_, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+            glSamplerParameteri(depthSampler_id_, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glSamplerParameteri(depthSampler_id_, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+            // compile the shaders
+            program_id_ = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                  "evsm_fshader.glsl");
+            if(!program_id_) {
+                exit(EXIT_FAILURE);
+            }
+
+            glUseProgram(program_id_);
+
+            quad.registerProgram(program_id_);
+
+            glUniform1i(glGetUniformLocation(program_id_, "depthTex"), 0 /*GL_TEXTURE0*/);
+            glUniform1i(glGetUniformLocation(program_id_, "momentsTex"), 1 /*GL_TEXTURE1*/);
+            glUniform1i(glGetUniformLocation(program_id_, "previousLevel"), 2 /*GL_TEXTURE2*/);
+            glUniform1i(glGetUniformLocation(program_id_, "size"), size);
+            layer_id = glGetUniformLocation(program_id_, "layer");
+            pass_id = glGetUniformLocation(program_id_, "pass");
+
+            // to avoid the current object being polluted
+            glUseProgram(0);
+
+            return momentsTexture_id_;
+        }
+
+        /** the next filtered regions belong to this layer, the first pass goes to the scratch texture */
+        void beginFirstPass(int layer) {
+            scratch.Bind();
+            bindProgram(layer, FIRST_PASS);
+        }
+
+        /** the next filtered regions go to the layer given to beginFirstPass */
+        void beginSecondPass(int layer) {
+            moments.BindLayer(layer);
+            bindProgram(layer, SECOND_PASS);
+        }
+
+        /** the next filtered regions rebuild this level of the layer from the previous one, in texels of the level */
+        void beginDownsample(int layer, int level) {
+            moments.RestrictToLevel(level - 1);
+            moments.BindLayer(layer, level);
+            bindProgram(layer, DOWNSAMPLE);
+        }
+
+        int getLevels() const {
+            return moments.getLevels();
+        }
+
+        /** runs the current pass over the region of the maps, in texels */
+        void filterRegion(int x, int y, int width, int height) {
+            glViewport(x, y, width, height);
+            glScissor(x, y, width, height);
+            quad.Draw();
+        }
+
+        /** to call once every region of every layer is filtered and downsampled */
+        void end() {
+            glBindSampler(0, 0);
+            glBindVertexArray(0);
+            glUseProgram(0);
+            moments.Unbind();
+            moments.RestoreLevels();
+        }
+
+        GLuint getTexture() const {
+            return momentsTexture_id_;
+        }
+
+        /** bytes of video memory held by the moments, their mipmaps and the scratch texture */
+        size_t memoryUsage() const {
+            size_t layerBytes = size_t(size) * size * 8;
+            return layerBytes * layers * 4 / 3 + layerBytes;
+        }
+
+        void Cleanup() {
+            glUseProgram(0);
+            quad.Cleanup();
+            glDeleteProgram(program_id_);
+            glDeleteSamplers(1, &depthSampler_id_);
+            scratch.Cleanup();
+            moments.Cleanup();
+        }
+
+    private:
+        void bindProgram(int layer, int pass) {
+            glUseProgram(program_id_);
+            quad.Bind(program_id_);
+            glUniform1i(layer_id, layer);
+            glUniform1i(pass_id, pass);
+
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture_id_);
+            glBindSampler(0, depthSampler_id_);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, (pass == SECOND_PASS) ? scratchTexture_id_ : 0);
+            // the moments are attached one level below the one they are restricted to
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, (pass == DOWNSAMPLE) ? momentsTexture_id_ : 0);
+            glActiveTexture(GL_TEXTURE0);
+        }
+};
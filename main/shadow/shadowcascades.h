@@ -0,0 +1,446 @@
+#pragma once
+#include <array>
+#include <map>
+#include <vector>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+#include "icg_helper.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "../framebuffer.h"
+#include "evsmfilter.h"
+
+struct ShadowCascadesProgramIds{
+    GLuint SHADOWMV_id, cascadeArea_id, cascadeOffset_id, shadowDepthRange_id, prefilteredShadows_id;
+    int momentsUnit;
+};
+
+/**
+ * @brief The ShadowCascades class keeps NUM_CASCADES shadow maps of growing size centered on the camera,
+ * in the layers of one depth texture array. The maps are cached from frame to frame:
+ * - each map is a window on a grid of texels fixed in the world, snapped to its texels,
+ *   and is addressed with wrap around: when the camera moves only the strips that scrolled in are redrawn,
+ * - the light direction is kept until it drifts by more than maxLightAngle, then every map is redrawn,
+ * - the scene reports the casters that move through invalidate, only their area is redrawn.
+ * The casters are the ship, the fleet, the bushes and the scattered objects, the terrain shadows itself through
+ * the horizon maps: with the cache a frame redraws and filters the old and new bounds of the ship and of the
+ * fleet, the tiles whose bushes and objects were placed again and the strips that scrolled in, not the maps.
+ * Each frame, update collects the dirty regions and the scene draws its casters into each of them.
+ * Shaders pick the finest map holding a fragment from its light space position.
+ * The redrawn regions are prefiltered into exponential variance moments (see EVSMFilter), shaders take one
+ * filtered fetch of them; the depth maps stay available for the rotated PCF when prefiltering is toggled off.
+ */
+class ShadowCascades{
+
+public:
+    enum { NUM_CASCADES = 4 };
+
+    /** a rectangle of the map of one cascade to clear and redraw, SHADOWMVP renders the casters into it */
+    struct Region {
+        int cascade;
+        int x, y, width, height;
+        glm::mat4 SHADOWMVP;
+    };
+
+private:
+    /** a rectangle of texels of the world fixed grid of a cascade, [x0, x1[ x [y0, y1[ */
+    struct TexelRect {
+        long long x0, y0, x1, y1;
+    };
+
+    /** blend between logarithmic (1) and uniform (0) split distances */
+    const float splitLambda = 0.75f;
+
+    /** texels left between the usable area of a map and its border: snapping, PCF radius and filtering */
+    const int borderTexels = 3;
+
+    /** all maps are redrawn when the light direction drifts by more than this angle (radians) */
+    const double maxLightAngle = 0.005;
+
+    DepthArrayFBO depthArray;
+    GLuint depthTexture_id;
+    int size;
+
+    /** distance to the camera up to which each cascade holds the casters */
+    std::array<float, NUM_CASCADES> cascadeEnd;
+
+    /** side of the square covered by each map and of its texels, in world units */
+    std::array<double, NUM_CASCADES> extent, texelSize;
+
+    /** the light direction the maps were drawn with, and the matching rotation from world to light space */
+    glm::dvec3 cachedLightDir;
+    glm::dmat3 lightRotation;
+
+    /** the light space depth covered by the maps, [depthCenter - depthHalfRange, depthCenter + depthHalfRange] */
+    double depthCenter;
+    double depthHalfRange;
+
+    /** the window of each map on its texel grid */
+    std::array<TexelRect, NUM_CASCADES> windows;
+    bool valid = false;
+
+    /** world space boxes whose casters changed since the last update */
+    std::vector<std::pair<glm::dvec3, glm::dvec3>> invalidatedBounds;
+
+    std::vector<Region> dirtyRegions;
+
+    /** the areas of the moments to filter again, the blur spreads the redrawn regions */
+    EVSMFilter filter;
+    bool prefiltered = true;
+    std::vector<Region> firstPassRegions, secondPassRegions;
+
+    /** uniforms of the current frame */
+    glm::mat4 shadowMV;
+    std::array<glm::vec4, NUM_CASCADES> cascadeArea;
+    std::array<glm::vec2, NUM_CASCADES> cascadeOffset;
+
+    /** cache statistics, since the last resetStats */
+    int frames = 0;
+    int skippedFrames = 0;
+    double redrawnTexels = 0.0;
+
+    std::map<GLuint, ShadowCascadesProgramIds> programToIds;
+
+public:
+    /**
+     * returns the id of the depth texture array, one layer of size x size per cascade.
+     * shadowDistance: the last cascade holds the casters up to this distance to the camera,
+     * sceneRadius: every caster and receiver is within this distance of the camera
+     */
+    GLuint Init(int size, float zNear, float shadowDistance, float sceneRadius) {
+        this->size = size;
+        depthTexture_id = depthArray.Init(size, size, NUM_CASCADES, GL_DEPTH_COMPONENT24, GL_UNSIGNED_INT);
+
+        // the maps wrap around as the camera moves
+        glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture_id);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        filter.Init(depthTexture_id, size, NUM_CASCADES);
+
+        for (int i = 0; i < NUM_CASCADES; ++i) {
+            // practical split scheme
+            float t = float(i + 1) / NUM_CASCADES;
+            float logSplit = zNear * std::pow(shadowDistance / zNear, t);
+            float uniformSplit = zNear + (shadowDistance - zNear) * t;
+            cascadeEnd[i] = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+
+            extent[i] = 2.0 * cascadeEnd[i] * size / (size - 2.0 * borderTexels);
+            texelSize[i] = extent[i] / size;
+        }
+
+        // the depth range is re-centered on the camera when it gets closer than a quarter of it to a bound
+        depthHalfRange = sceneRadius * 4.0 / 3.0;
+        valid = false;
+        return depthTexture_id;
+    }
+
+    /** the casters inside this world space box changed, their area is redrawn by the next update */
+    void invalidate(const glm::vec3 &worldMin, const glm::vec3 &worldMax) {
+        invalidatedBounds.push_back({glm::dvec3(worldMin), glm::dvec3(worldMax)});
+    }
+
+    /**
+     * moves the maps with the camera and collects the regions to redraw,
+     * cameraPos: in scene coordinates, worldOffset: from scene to world coordinates (see LargeScene::worldOffset)
+     */
+    void update(const glm::vec3 &cameraPos, const glm::vec3 &worldOffset, const glm::vec3 &lightPos) {
+        dirtyRegions.clear();
+        firstPassRegions.clear();
+        secondPassRegions.clear();
+        bool redrawAll = !valid;
+
+        glm::dvec3 lightDir = glm::normalize(glm::dvec3(lightPos));
+        if (!valid || std::acos(glm::clamp(glm::dot(lightDir, cachedLightDir), -1.0, 1.0)) > maxLightAngle) {
+            cachedLightDir = lightDir;
+            lightRotation = glm::dmat3(glm::lookAt(lightDir, glm::dvec3(0.0), glm::dvec3(0.0, 1.0, 0.0)));
+            redrawAll = true;
+        }
+
+        // the depth range follows the ground below the camera, whatever its altitude
+        glm::dvec3 cameraLight = lightRotation * (glm::dvec3(cameraPos) + glm::dvec3(worldOffset));
+        glm::dvec3 groundLight = lightRotation * (glm::dvec3(cameraPos.x, 0.0, cameraPos.z) + glm::dvec3(worldOffset));
+        if (redrawAll || std::abs(groundLight.z - depthCenter) > depthHalfRange / 4.0) {
+            depthCenter = groundLight.z;
+            redrawAll = true;
+        }
+
+        // light space frame of this frame: world fixed orientation, origin near the camera to keep floats precise
+        glm::dvec3 origin(cameraLight.x, cameraLight.y, depthCenter);
+        glm::dvec3 sceneToFrame = lightRotation * glm::dvec3(worldOffset) - origin;
+        glm::mat4 frame = glm::mat4(glm::mat3(lightRotation));
+        frame[3] = glm::vec4(glm::vec3(sceneToFrame), 1.0f);
+
+        for (int i = 0; i < NUM_CASCADES; ++i) {
+            TexelRect window;
+            window.x0 = (long long)std::floor(cameraLight.x / texelSize[i]) - size / 2;
+            window.y0 = (long long)std::floor(cameraLight.y / texelSize[i]) - size / 2;
+            window.x1 = window.x0 + size;
+            window.y1 = window.y0 + size;
+
+            const TexelRect &old = windows[i];
+            if (redrawAll || std::llabs(window.x0 - old.x0) >= size || std::llabs(window.y0 - old.y0) >= size) {
+                addRegion(i, window, origin, frame);
+            } else {
+                // strips scrolled in along x over the whole window, then along y over the rest
+                TexelRect xStrip = window;
+                if (window.x0 > old.x0) {
+                    xStrip.x0 = old.x1;
+                } else {
+                    xStrip.x1 = old.x0;
+                }
+                TexelRect yStrip = window;
+                yStrip.x0 = std::max(window.x0, old.x0);
+                yStrip.x1 = std::min(window.x1, old.x1);
+                if (window.y0 > old.y0) {
+                    yStrip.y0 = old.y1;
+                } else {
+                    yStrip.y1 = old.y0;
+                }
+                addRegion(i, xStrip, origin, frame);
+                addRegion(i, yStrip, origin, frame);
+
+                for (auto& bounds : invalidatedBounds) {
+                    addRegion(i, intersect(window, texelBounds(i, bounds.first, bounds.second)), origin, frame);
+                }
+            }
+            windows[i] = window;
+
+            // usable area of the map in the frame, and texture coordinates offset of its wrapped texels
+            cascadeArea[i] = glm::vec4((window.x0 + size / 2) * texelSize[i] - origin.x,
+                                       (window.y0 + size / 2) * texelSize[i] - origin.y,
+                                       (size / 2 - borderTexels) * texelSize[i],
+                                       1.0 / extent[i]);
+            cascadeOffset[i] = glm::vec2(fract(origin.x / extent[i]), fract(origin.y / extent[i]));
+        }
+        invalidatedBounds.clear();
+        valid = true;
+
+        // xy in the frame, z the [0, 1] depth of the maps
+        glm::mat4 toDepth(1.0f);
+        toDepth[2][2] = float(-0.5 / depthHalfRange);
+        toDepth[3][2] = 0.5f;
+        shadowMV = toDepth * frame;
+
+        frames++;
+        if (dirtyRegions.empty()) {
+            skippedFrames++;
+        }
+    }
+
+    /** the regions to redraw this frame, each of them is cleared by beginRegion */
+    const std::vector<Region>& getDirtyRegions() const {
+        return dirtyRegions;
+    }
+
+    /** the next draws write the depth of the region only */
+    void beginRegion(const Region &region) {
+        depthArray.BindLayer(region.cascade);
+        glViewport(region.x, region.y, region.width, region.height);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(region.x, region.y, region.width, region.height);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    /** to call once every dirty region is drawn, prefilters them */
+    void endRegions() {
+        depthArray.Unbind();
+        if (prefiltered) {
+            for (int i = 0; i < NUM_CASCADES; ++i) {
+                // the scratch texture of the first pass is shared by the cascades
+                filter.beginFirstPass(i);
+                for (auto& region : firstPassRegions) {
+                    if (region.cascade == i) {
+                        filter.filterRegion(region.x, region.y, region.width, region.height);
+                    }
+                }
+                filter.beginSecondPass(i);
+                bool layerDirty = false;
+                for (auto& region : secondPassRegions) {
+                    if (region.cascade == i) {
+                        filter.filterRegion(region.x, region.y, region.width, region.height);
+                        layerDirty = true;
+                    }
+                }
+                // the coarser levels of this layer, under the filtered regions only
+                for (int level = 1; layerDirty && level < filter.getLevels(); ++level) {
+                    filter.beginDownsample(i, level);
+                    for (auto& region : secondPassRegions) {
+                        if (region.cascade == i) {
+                            int x0 = region.x >> level;
+                            int y0 = region.y >> level;
+                            int x1 = ((region.x + region.width - 1) >> level) + 1;
+                            int y1 = ((region.y + region.height - 1) >> level) + 1;
+                            filter.filterRegion(x0, y0, x1 - x0, y1 - y0);
+                        }
+                    }
+                }
+            }
+            filter.end();
+        }
+        glDisable(GL_SCISSOR_TEST);
+    }
+
+    /** switches between the prefiltered moments and the rotated PCF of the depth maps */
+    void togglePrefiltering() {
+        prefiltered = !prefiltered;
+        // the moments were not kept up to date
+        valid = false;
+    }
+
+    bool isPrefiltered() const {
+        return prefiltered;
+    }
+
+    GLuint getTexture() const {
+        return depthTexture_id;
+    }
+
+    /** bytes of video memory held by the cascades, 24 bits depth is stored on 32 bits, and by their moments */
+    size_t memoryUsage() const {
+        return size_t(size) * size * NUM_CASCADES * 4 + filter.memoryUsage();
+    }
+
+    /** fraction of the frames since resetStats that did not draw any caster */
+    float skippedFraction() const {
+        return frames > 0 ? float(skippedFrames) / frames : 0.0f;
+    }
+
+    /** texels redrawn per frame since resetStats, relative to the texels of all cascades */
+    float redrawnFraction() const {
+        return frames > 0 ? float(redrawnTexels / frames / (double(size) * size * NUM_CASCADES)) : 0.0f;
+    }
+
+    void resetStats() {
+        frames = 0;
+        skippedFrames = 0;
+        redrawnTexels = 0.0;
+    }
+
+    /** momentsUnit: the texture unit the program samples the moments from */
+    void registerProgram(GLuint program_id, int momentsUnit) {
+        glUseProgram(program_id);
+        glUniform1i(glGetUniformLocation(program_id, "shadowMoments"), momentsUnit);
+        glUseProgram(0);
+
+        ShadowCascadesProgramIds ids;
+        ids.momentsUnit = momentsUnit;
+        ids.SHADOWMV_id = glGetUniformLocation(program_id, "SHADOWMV");
+        ids.cascadeArea_id = glGetUniformLocation(program_id, "cascadeArea");
+        ids.cascadeOffset_id = glGetUniformLocation(program_id, "cascadeOffset");
+        ids.shadowDepthRange_id = glGetUniformLocation(program_id, "shadowDepthRange");
+        ids.prefilteredShadows_id = glGetUniformLocation(program_id, "prefilteredShadows");
+        programToIds[program_id] = ids;
+    }
+
+    /** uploads the cascades to the program in use, MODEL places the drawn object in the scene */
+    void updateProgram(GLuint program_id, const glm::mat4 &MODEL = IDENTITY_MATRIX) {
+        ShadowCascadesProgramIds ids = programToIds[program_id];
+        glm::mat4 SHADOWMV = shadowMV * MODEL;
+        glUniformMatrix4fv(ids.SHADOWMV_id, ONE, DONT_TRANSPOSE, glm::value_ptr(SHADOWMV));
+        glUniform4fv(ids.cascadeArea_id, NUM_CASCADES, glm::value_ptr(cascadeArea[0]));
+        glUniform2fv(ids.cascadeOffset_id, NUM_CASCADES, glm::value_ptr(cascadeOffset[0]));
+        glUniform1f(ids.shadowDepthRange_id, float(2.0 * depthHalfRange));
+        glUniform1i(ids.prefilteredShadows_id, prefiltered);
+
+        glActiveTexture(GL_TEXTURE0 + ids.momentsUnit);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, filter.getTexture());
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void Cleanup() {
+        depthArray.Cleanup();
+        filter.Cleanup();
+    }
+
+private:
+    /** queues the rectangle to redraw, and the areas of the moments its blur reaches, split where the map wraps around */
+    void addRegion(int cascade, const TexelRect &rect, const glm::dvec3 &origin, const glm::mat4 &frame) {
+        if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1) {
+            return;
+        }
+        double ts = texelSize[cascade];
+        for (auto& piece : splitAtWrap(rect)) {
+            Region region = toRegion(cascade, piece);
+            glm::mat4 projection = glm::ortho(float(piece.x0 * ts - origin.x), float(piece.x1 * ts - origin.x),
+                                              float(piece.y0 * ts - origin.y), float(piece.y1 * ts - origin.y),
+                                              float(-depthHalfRange), float(depthHalfRange));
+            region.SHADOWMVP = projection * frame;
+            dirtyRegions.push_back(region);
+            redrawnTexels += double(region.width) * region.height;
+        }
+
+        if (prefiltered) {
+            // the second pass reads the first one up to RADIUS texels away along y
+            for (auto& piece : splitAtWrap(expand(rect, EVSMFilter::RADIUS, 2 * EVSMFilter::RADIUS))) {
+                firstPassRegions.push_back(toRegion(cascade, piece));
+            }
+            for (auto& piece : splitAtWrap(expand(rect, EVSMFilter::RADIUS, EVSMFilter::RADIUS))) {
+                secondPassRegions.push_back(toRegion(cascade, piece));
+            }
+        }
+    }
+
+    /** the rectangle grown by the given texels on each side, at most one map wide */
+    TexelRect expand(const TexelRect &rect, int dx, int dy) const {
+        TexelRect grown{rect.x0 - dx, rect.y0 - dy, rect.x1 + dx, rect.y1 + dy};
+        grown.x1 = std::min(grown.x1, grown.x0 + size);
+        grown.y1 = std::min(grown.y1, grown.y0 + size);
+        return grown;
+    }
+
+    /** the pieces of a rectangle at most one map wide that do not wrap around */
+    std::vector<TexelRect> splitAtWrap(const TexelRect &rect) const {
+        std::vector<TexelRect> pieces;
+        long long xWrap = (floorDiv(rect.x0, size) + 1) * size;
+        long long yWrap = (floorDiv(rect.y0, size) + 1) * size;
+        for (auto& xs : {std::make_pair(rect.x0, std::min(rect.x1, xWrap)), std::make_pair(xWrap, rect.x1)}) {
+            for (auto& ys : {std::make_pair(rect.y0, std::min(rect.y1, yWrap)), std::make_pair(yWrap, rect.y1)}) {
+                if (xs.first < xs.second && ys.first < ys.second) {
+                    pieces.push_back(TexelRect{xs.first, ys.first, xs.second, ys.second});
+                }
+            }
+        }
+        return pieces;
+    }
+
+    /** the texels of the map holding a rectangle that does not wrap around */
+    Region toRegion(int cascade, const TexelRect &rect) const {
+        Region region;
+        region.cascade = cascade;
+        region.x = int(rect.x0 - floorDiv(rect.x0, size) * size);
+        region.y = int(rect.y0 - floorDiv(rect.y0, size) * size);
+        region.width = int(rect.x1 - rect.x0);
+        region.height = int(rect.y1 - rect.y0);
+        return region;
+    }
+
+    /** the texels of the cascade covering a world space box, with a one texel margin */
+    TexelRect texelBounds(int cascade, const glm::dvec3 &worldMin, const glm::dvec3 &worldMax) const {
+        glm::dvec2 bmin(DBL_MAX), bmax(-DBL_MAX);
+        for (int k = 0; k < 8; ++k) {
+            glm::dvec3 corner((k & 1) ? worldMax.x : worldMin.x,
+                              (k & 2) ? worldMax.y : worldMin.y,
+                              (k & 4) ? worldMax.z : worldMin.z);
+            glm::dvec2 p = glm::dvec2(lightRotation * corner) / texelSize[cascade];
+            bmin = glm::min(bmin, p);
+            bmax = glm::max(bmax, p);
+        }
+        return TexelRect{(long long)std::floor(bmin.x) - 1, (long long)std::floor(bmin.y) - 1,
+                         (long long)std::ceil(bmax.x) + 1, (long long)std::ceil(bmax.y) + 1};
+    }
+
+    static TexelRect intersect(const TexelRect &a, const TexelRect &b) {
+        return TexelRect{std::max(a.x0, b.x0), std::max(a.y0, b.y0), std::min(a.x1, b.x1), std::min(a.y1, b.y1)};
+    }
+
+    static long long floorDiv(long long a, long long b) {
+        return (a >= 0) ? a / b : -((-a + b - 1) / b);
+    }
+
+    static double fract(double x) {
+        return x - std::floor(x);
+    }
+};
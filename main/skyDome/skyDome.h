@@ -1,18 +1,46 @@
 #pragma once
+#include <map>
 #include "icg_helper.h"
 #include <glm/gtc/type_ptr.hpp>
-#include "skyPlane.h"
 #include "../gridmesh.h"
 #include "../light/light.h"
 #include "../light/lightable.h"
 #include "../material/material.h"
 #include "../camera/fractionalview.h"
 #include "../utils.h"
+#include "../framebuffer.h"
+#include "../screenquad/fullscreenquad.h"
 
 using namespace glm;
 
+struct SkyProgramIds{
+    GLuint sunPos_id, topSkyColor_id, bottomSkyColor_id, sunColor_id;
+    GLuint domeGradBottom_id, domeGradTop_id, skyRadius_id;
+    int cubeUnit;
+};
+
+/**
+ * @brief The SkyLayer class is what the SkyDome draws over the dome into its cube map, e.g. clouds.
+ * The layer writes premultiplied colors and its transmittance in alpha.
+ */
+class SkyLayer {
+public:
+    virtual ~SkyLayer() {}
+    /** faceVP: projection times the rotation of the view of the face, the dome is around the viewer */
+    virtual void DrawInSky(const glm::mat4 &faceVP) = 0;
+};
+
+/**
+ * @brief The SkyDome class renders the dome and its sky layer into a low resolution cube map,
+ * one face per frame, and draws the sky of the main and the mirrored views with one cube map fetch per pixel.
+ * The sun is left out of the cube map: it is shaded by the sky pass, dimmed by the transmittance of the layer
+ * the cube map keeps in its alpha. The main view can skip the layer when it draws it at its own resolution.
+ */
 class SkyDome: public ILightable{
 
+public:
+    /** side of the faces of the sky cube map */
+    static constexpr int CUBE_SIZE = 128;
 
 private:
     GLuint vertex_array_id_;        // vertex array object
@@ -20,12 +48,22 @@ private:
     GLuint vertex_buffer_object_position_;  // memory buffer for positions
     GLuint vertex_buffer_object_index_;     // memory buffer for indices
     GLuint MVPId;
-    GLuint sunPosId, bottomSkyColorId, topSkyColorId, domeGradBottomId, domeGradTopId, sunColorId;
+    GLuint bottomSkyColorId, topSkyColorId, domeGradBottomId, domeGradTopId;
     Light* light;
-    SkyPlane cloudPlane;
-    SkyPlane farCloudPlane;
+    SkyLayer* layer = nullptr;
+
+    ColorCubeFBO cube;
+    GLuint cubeTexture_id_;
+    mat4 faceViews[6];
+    mat4 faceProjection;
+    int nextFace = 0;
+    bool cubeValid = false;
+    int facesRendered = 0;
 
-    mat4 cloudPlaneModelMatrix, farCloudPlaneModelMatrix;
+    // the sky pass, a full-screen quad
+    FullScreenQuad quad;
+    GLuint skyProgram_id_;
+    GLuint inverseVP_id, withLayer_id;
 
     const float radius = 10.0f;
     const int rings = 24;
@@ -81,6 +119,10 @@ private:
     vec3 bottomSkyColor = mistColor;
     vec3 topSkyColor = blueSkyColor;
     vec3 sunColor = SUN_COLOR;
+    vec3 sunPos;
+
+    /** other programs shading the sky, e.g. where the water reflection leaves the screen */
+    std::map<GLuint, SkyProgramIds> programToIds;
 
     float PI = 3.14159265359f;
     float PIovr2 = PI * 0.5f;
@@ -92,6 +134,33 @@ private:
     std::vector<GLfloat> texcoords;
     std::vector<GLuint> indices;
 
+    /** the dome then the layer over it, the alpha keeps the transmittance of the layer */
+    void drawDome(const mat4 &VP) {
+        glUseProgram(program_id_);
+
+        glUniformMatrix4fv(MVPId, 1, GL_FALSE, value_ptr(VP));
+        glUniform3fv(topSkyColorId, 1, value_ptr(topSkyColor));
+        glUniform3fv(bottomSkyColorId, 1, value_ptr(bottomSkyColor));
+        glUniform1f(domeGradTopId, domeGradTop);
+        glUniform1f(domeGradBottomId, domeGradBottom);
+
+        // dome, opaque
+        glDisable(GL_BLEND);
+        glBindVertexArray(vertex_array_id_);
+        glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        glUseProgram(0);
+
+        if (layer != nullptr) {
+            glEnable(GL_BLEND);
+            glBlendFuncSeparate(GL_ONE, GL_SRC_ALPHA, GL_ZERO, GL_SRC_ALPHA);
+            layer->DrawInSky(VP);
+        }
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
 public:
 
     void Init() {
@@ -105,22 +174,6 @@ public:
 
         glUseProgram(program_id_);
 
-        cloudPlane.Init(0, vec2(4.0, 3.0));
-        farCloudPlane.Init(0, vec2(1.0, 1.0));
-        cloudPlaneModelMatrix =
-                translate(IDENTITY_MATRIX, vec3(0.0f, -4.0f, 0.0f))
-                *
-                rotate(IDENTITY_MATRIX, 0.0f, vec3(0.0f, 1.0f, 0.0f))
-                *
-                scale(IDENTITY_MATRIX, vec3(75.0f, 75.0f, 75.0f));
-
-        farCloudPlaneModelMatrix =
-                translate(IDENTITY_MATRIX, vec3(0.0f, 2.0f, 0.0f))
-                *
-                rotate(IDENTITY_MATRIX, 0.2f, vec3(0.0f, 1.0f, 0.0f))
-                *
-                scale(IDENTITY_MATRIX, vec3(75.0f, 75.0f, 75.0f));
-
         glGenVertexArrays(1, &vertex_array_id_);
         glBindVertexArray(vertex_array_id_);
 
@@ -189,30 +242,113 @@ public:
                               ZERO_STRIDE, ZERO_BUFFER_OFFSET);
 
         // other ids
-        sunPosId = glGetUniformLocation(program_id_, "sunPos");
         topSkyColorId = glGetUniformLocation(program_id_, "topSkyColor");
         bottomSkyColorId= glGetUniformLocation(program_id_, "bottomSkyColor");
         domeGradBottomId= glGetUniformLocation(program_id_, "domeGradBottom");
         domeGradTopId = glGetUniformLocation(program_id_, "domeGradTop");
-        sunColorId = glGetUniformLocation(program_id_, "sunColor");
         MVPId = glGetUniformLocation(program_id_, "MVP");
 
         // to avoid the current object being polluted
         glBindVertexArray(0);
         glUseProgram(0);
+
+        InitCube();
+        InitSkyPass();
+    }
+
+    /** the cube map and the views of its faces, from the center of the dome */
+    void InitCube() {
+        // alpha holds the transmittance of the layer
+        cubeTexture_id_ = cube.Init(CUBE_SIZE, GL_RGBA16F, GL_RGBA, GL_FLOAT);
+        glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+        const vec3 zero(0.0f);
+        faceViews[0] = lookAt(zero, vec3( 1.0f,  0.0f,  0.0f), vec3(0.0f, -1.0f,  0.0f));
+        faceViews[1] = lookAt(zero, vec3(-1.0f,  0.0f,  0.0f), vec3(0.0f, -1.0f,  0.0f));
+        faceViews[2] = lookAt(zero, vec3( 0.0f,  1.0f,  0.0f), vec3(0.0f,  0.0f,  1.0f));
+        faceViews[3] = lookAt(zero, vec3( 0.0f, -1.0f,  0.0f), vec3(0.0f,  0.0f, -1.0f));
+        faceViews[4] = lookAt(zero, vec3( 0.0f,  0.0f,  1.0f), vec3(0.0f, -1.0f,  0.0f));
+        faceViews[5] = lookAt(zero, vec3( 0.0f,  0.0f, -1.0f), vec3(0.0f, -1.0f,  0.0f));
+        faceProjection = perspective(radians(90.0f), 1.0f, 0.1f, 200.0f);
+    }
+
+    void InitSkyPass() {
+        skyProgram_id_ = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                 "sky_fshader.glsl");
+        if(!skyProgram_id_) {
+            exit(EXIT_FAILURE);
+        }
+
+        glUseProgram(skyProgram_id_);
+
+        quad.registerProgram(skyProgram_id_);
+
+        glUniform1i(glGetUniformLocation(skyProgram_id_, "skyCube"), 0 /*GL_TEXTURE0*/);
+        inverseVP_id = glGetUniformLocation(skyProgram_id_, "inverseVP");
+        withLayer_id = glGetUniformLocation(skyProgram_id_, "withLayer");
+
+        // the sky pass shades the sun with the dome colors
+        registerProgram(skyProgram_id_);
+
+        glUseProgram(0);
     }
 
     void useLight(Light* l){
         this->light = l;
         light->registerProgram(program_id_);
-        cloudPlane.useLight(l);
-        farCloudPlane.useLight(l);
+    }
+
+    /** the layer drawn over the dome into the cube map from now on */
+    void useSkyLayer(SkyLayer* layer) {
+        this->layer = layer;
+        cubeValid = false;
     }
 
     float getRadius(){
         return radius;
     }
 
+    /**
+     * lets another program shade the dome colors and the sun, see skyColor in water_fshader.glsl.
+     * cubeUnit: texture unit the program samples the sky cube map from, -1 if it does not
+     */
+    void registerProgram(GLuint program_id, int cubeUnit = -1) {
+        if (cubeUnit >= 0) {
+            glUseProgram(program_id);
+            glUniform1i(glGetUniformLocation(program_id, "skyCube"), cubeUnit);
+            glUseProgram(0);
+        }
+
+        SkyProgramIds ids;
+        ids.sunPos_id = glGetUniformLocation(program_id, "sunPos");
+        ids.topSkyColor_id = glGetUniformLocation(program_id, "topSkyColor");
+        ids.bottomSkyColor_id = glGetUniformLocation(program_id, "bottomSkyColor");
+        ids.sunColor_id = glGetUniformLocation(program_id, "sunColor");
+        ids.domeGradBottom_id = glGetUniformLocation(program_id, "domeGradBottom");
+        ids.domeGradTop_id = glGetUniformLocation(program_id, "domeGradTop");
+        ids.skyRadius_id = glGetUniformLocation(program_id, "skyRadius");
+        ids.cubeUnit = cubeUnit;
+        programToIds[program_id] = ids;
+    }
+
+    /** uploads the dome colors of the last update */
+    void updateProgram(GLuint program_id) {
+        SkyProgramIds ids = programToIds[program_id];
+        glUniform3fv(ids.sunPos_id, 1, value_ptr(sunPos));
+        glUniform3fv(ids.topSkyColor_id, 1, value_ptr(topSkyColor));
+        glUniform3fv(ids.bottomSkyColor_id, 1, value_ptr(bottomSkyColor));
+        glUniform3fv(ids.sunColor_id, 1, value_ptr(sunColor));
+        glUniform1f(ids.domeGradBottom_id, domeGradBottom);
+        glUniform1f(ids.domeGradTop_id, domeGradTop);
+        glUniform1f(ids.skyRadius_id, radius);
+
+        if (ids.cubeUnit >= 0) {
+            glActiveTexture(GL_TEXTURE0 + ids.cubeUnit);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture_id_);
+            glActiveTexture(GL_TEXTURE0);
+        }
+    }
+
     void Cleanup() {
         glBindVertexArray(0);
         glUseProgram(0);
@@ -220,49 +356,90 @@ public:
         glDeleteBuffers(1, &vertex_buffer_object_index_);
         glDeleteVertexArrays(1, &vertex_array_id_);
         glDeleteProgram(program_id_);
+        quad.Cleanup();
+        glDeleteProgram(skyProgram_id_);
+        cube.Cleanup();
     }
 
-    void Draw(const mat4 &MODEL,
-              const mat4 &VIEW,
-              const mat4 &PROJECTION,
-              const vec3 &viewPos) {
-        glUseProgram(program_id_);
-
-        mat4 skyboxMVP = PROJECTION * mat4(mat3(VIEW));
-        mat4 sceneMVP = PROJECTION * VIEW * MODEL;
-        mat4 cloudPlaneMVP = skyboxMVP * cloudPlaneModelMatrix;
-        mat4 farCloudPlaneMVP = skyboxMVP * farCloudPlaneModelMatrix;
-
+    /** moves the sun and updates the sky colors and the light, once per frame before anything is lit */
+    void update(const vec3 &viewPos) {
         float time = glfwGetTime();
 
         float theta = 0.01 * time - 0.0;
 
-        vec3 sunPos = sunOrbitCenter + radius * cos(theta) * sunOrbitXAxis + radius * sin(theta) * sunOrbitYAxis;
+        sunPos = sunOrbitCenter + radius * cos(theta) * sunOrbitXAxis + radius * sin(theta) * sunOrbitYAxis;
         computeSkyColors(sunPos, viewPos);
 
         light->setPos(sunPos);
+    }
 
-        glUniformMatrix4fv(MVPId, 1, GL_FALSE, value_ptr(skyboxMVP));
-        glUniform3fv(sunPosId, 1, value_ptr(sunPos));
-        glUniform3fv(topSkyColorId, 1, value_ptr(topSkyColor));
-        glUniform3fv(bottomSkyColorId, 1, value_ptr(bottomSkyColor));
-        glUniform3fv(sunColorId, 1, value_ptr(sunColor));
-        glUniform1f(domeGradTopId, domeGradTop);
-        glUniform1f(domeGradBottomId, domeGradBottom);
+    /**
+     * re-renders one face of the cube map, all of them the first time: the sky changes slowly
+     * and the sun, the only sharp feature, is not in it. Leaves the default framebuffer bound
+     */
+    void updateCubemap() {
+        int faces = cubeValid ? 1 : 6;
+        glDisable(GL_CULL_FACE);
+        glDisable(GL_DEPTH_TEST);
+        for (int i = 0; i < faces; ++i) {
+            cube.BindFace(nextFace);
+            glClear(GL_COLOR_BUFFER_BIT);
+            drawDome(faceProjection * faceViews[nextFace]);
+            nextFace = (nextFace + 1) % 6;
+        }
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_CULL_FACE);
+        cube.Unbind();
+        cubeValid = true;
+        facesRendered += faces;
+    }
 
-        // dome
-        glBindVertexArray(vertex_array_id_);
+    /**
+     * the sky seen with the rotation of VIEW, the dome is around the viewer. Writes no depth.
+     * withLayer: false shades the bare dome, for a view that draws the layer itself
+     */
+    void Draw(const mat4 &VIEW, const mat4 &PROJECTION, bool withLayer = true) {
+        glUseProgram(skyProgram_id_);
+        quad.Bind(skyProgram_id_);
+
+        mat4 inverseVP = inverse(PROJECTION * mat4(mat3(VIEW)));
+        glUniformMatrix4fv(inverseVP_id, ONE, DONT_TRANSPOSE, value_ptr(inverseVP));
+        glUniform1i(withLayer_id, withLayer);
+        updateProgram(skyProgram_id_);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubeTexture_id_);
+
+        glDisable(GL_DEPTH_TEST);
         glDepthMask(GL_FALSE);
-        glDrawElements(GL_TRIANGLES, numIndices, GL_UNSIGNED_INT, 0);
+        quad.Draw();
         glDepthMask(GL_TRUE);
+        glEnable(GL_DEPTH_TEST);
 
-        farCloudPlane.Draw(farCloudPlaneMVP, sunPos);
-        cloudPlane.Draw(cloudPlaneMVP, sunPos);
-
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
         glBindVertexArray(0);
         glUseProgram(0);
     }
 
+    /** the sky cube map, e.g. for ambient lighting */
+    GLuint getCubemap() const {
+        return cubeTexture_id_;
+    }
+
+    /** cube map faces rendered since the last resetStats */
+    int getFacesRendered() const {
+        return facesRendered;
+    }
+
+    void resetStats() {
+        facesRendered = 0;
+    }
+
+    /** bytes of video memory held by the cube map */
+    size_t memoryUsage() const {
+        return size_t(6) * CUBE_SIZE * CUBE_SIZE * 8;
+    }
+
     /** Easier to compute sky's color in CPU since it should have an affect on the light **/
     void computeSkyColors(const vec3& sunPos, const vec3& viewPos){
 
@@ -0,0 +1,44 @@
+#version 410 core
+// the sky of a view: one fetch of the sky cube map along the view ray, plus the sun.
+// The sun is too small for the cube map resolution, it is shaded here and dimmed by the
+// transmittance of the sky layer the cube map keeps in its alpha
+in vec2 uv;
+
+uniform samplerCube skyCube;
+// inverse of the projection times the rotation of the view
+uniform mat4 inverseVP;
+// false: the bare dome, the view draws the layer itself
+uniform bool withLayer;
+
+uniform vec3 sunPos;
+uniform vec3 topSkyColor;
+uniform vec3 bottomSkyColor;
+uniform vec3 sunColor;
+uniform float domeGradBottom;
+uniform float domeGradTop;
+uniform float skyRadius;
+
+layout (location = 0) out vec4 color;
+
+const float sunInnerRadius = 0.05f;
+const float sunOuterRadius = 0.30f;
+
+void main()
+{
+    vec4 farPoint = inverseVP * vec4(uv * 2.0f - 1.0f, 1.0f, 1.0f);
+    vec3 dir = normalize(farPoint.xyz / farPoint.w);
+    vec3 domePos = dir * skyRadius;
+    float domeGrad = smoothstep(domeGradBottom, domeGradTop, domePos.y);
+    vec3 domeColor = mix(bottomSkyColor, topSkyColor, smoothstep(0.0f, 1.0f, domeGrad));
+    // the dome is a smooth gradient, as cheap to shade as to fetch
+    vec4 sky = withLayer ? texture(skyCube, dir) : vec4(domeColor, 1.0f);
+
+    // same as the dome: full sun color inside the inner radius, a halo fading into the dome colors up to the outer one
+    float l = length(domePos - sunPos);
+    if (l < sunOuterRadius && domePos.y > -0.5f) {
+        float sun = 1.0f - smoothstep(sunInnerRadius, sunOuterRadius, l);
+        sky.rgb += sky.a * sun * (sunColor - domeColor);
+    }
+
+    color = vec4(sky.rgb, 1.0f);
+}
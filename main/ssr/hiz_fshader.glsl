@@ -0,0 +1,42 @@
+#version 410 core
+// builds the hierarchical depth one level at a time: the first level copies the depth buffer, each coarser
+// one keeps the closest depth of the texels it covers. The previous level is the only one the sampler sees
+
+uniform sampler2D depthTex;
+// depthTex is the depth buffer rather than the previous level
+uniform bool copyDepth;
+
+out vec4 color;
+
+float closestOf(in ivec2 texel, in ivec2 size)
+{
+    return texelFetch(depthTex, min(texel, size - 1), 0).r;
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if(copyDepth){
+        color = vec4(texelFetch(depthTex, texel, 0).r);
+        return;
+    }
+
+    ivec2 size = textureSize(depthTex, 0);
+    ivec2 base = 2 * texel;
+    float closest = min(min(closestOf(base, size), closestOf(base + ivec2(1, 0), size)),
+                        min(closestOf(base + ivec2(0, 1), size), closestOf(base + ivec2(1, 1), size)));
+
+    // odd sizes: the last texel also covers the extra column and row, or a ray could skip them
+    bool extraColumn = (size.x & 1) == 1 && base.x + 3 == size.x;
+    bool extraRow = (size.y & 1) == 1 && base.y + 3 == size.y;
+    if(extraColumn){
+        closest = min(closest, min(closestOf(base + ivec2(2, 0), size), closestOf(base + ivec2(2, 1), size)));
+    }
+    if(extraRow){
+        closest = min(closest, min(closestOf(base + ivec2(0, 2), size), closestOf(base + ivec2(1, 2), size)));
+    }
+    if(extraColumn && extraRow){
+        closest = min(closest, closestOf(base + ivec2(2, 2), size));
+    }
+
+    color = vec4(closest);
+}
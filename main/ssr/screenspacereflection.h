@@ -0,0 +1,177 @@
+#pragma once
+#include <map>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "../framebuffer.h"
+#include "../skyDome/skyDome.h"
+#include "../screenquad/fullscreenquad.h"
+
+struct ScreenSpaceReflectionProgramIds{
+    GLuint enabled_id, projection_id, hiZLevels_id;
+    int colorUnit, hiZUnit;
+};
+
+/**
+ * @brief The ScreenSpaceReflection class lets the water reflect the opaque scene of the current frame
+ * instead of a mirrored render of it: Capture copies the HDR color of the terrain and the models and builds
+ * a hierarchical depth (closest depth per cell) from their depth buffer, the water shader marches its
+ * reflected rays through it and falls back on the sky cube map where they leave the screen.
+ * What is not on screen cannot be reflected, which is the price of skipping the mirrored pass.
+ */
+class ScreenSpaceReflection {
+
+    private:
+        FullScreenQuad quad;
+        GLuint program_id_;             // GLSL shader program ID
+        GLuint copyDepth_id;
+
+        ColorFBO sceneColor;
+        ColorMipFBO hiZ;
+        GLuint sceneColorTexture_id_, hiZTexture_id_;
+        int width, height;
+
+        bool enabled = false;
+        glm::mat4 projection;
+        SkyDome* sky = nullptr;
+
+        std::map<GLuint, ScreenSpaceReflectionProgramIds> programToIds;
+
+    public:
+        /** width, height: resolution of the captured scene */
+        void Init(int width, int height, SkyDome* sky) {
+            this->width = width;
+            this->height = height;
+            this->sky = sky;
+
+            // same format as the HDR scene
+            sceneColorTexture_id_ = sceneColor.Init(width, height, GL_RGB16F, GL_RGB, GL_FLOAT, true);
+            hiZTexture_id_ = hiZ.Init(width, height, GL_R32F, GL_RED, GL_FLOAT);
+
+            // compile the shaders
+            program_id_ = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                  "hiz_fshader.glsl");
+            if(!program_id_) {
+                exit(EXIT_FAILURE);
+            }
+
+            glUseProgram(program_id_);
+
+            quad.registerProgram(program_id_);
+
+            glUniform1i(glGetUniformLocation(program_id_, "depthTex"), 0 /*GL_TEXTURE0*/);
+            copyDepth_id = glGetUniformLocation(program_id_, "copyDepth");
+
+            // to avoid the current object being polluted
+            glUseProgram(0);
+        }
+
+        void Resize(int width, int height) {
+            this->width = width;
+            this->height = height;
+            sceneColor.Resize(width, height);
+            hiZ.Resize(width, height);
+        }
+
+        /** the water reflects the mirror map again */
+        void setEnabled(bool enabled) {
+            this->enabled = enabled;
+        }
+
+        bool isEnabled() const {
+            return enabled;
+        }
+
+        /**
+         * copies the color and builds the hierarchical depth of the opaque scene drawn in hdrBuffer,
+         * with the given projection. Leaves the default framebuffer bound
+         */
+        void Capture(HDRColorAndDepthFBO& hdrBuffer, const glm::mat4 &projection) {
+            this->projection = projection;
+            hdrBuffer.BlitColorTo(sceneColor, 0, 0, width, height);
+
+            glUseProgram(program_id_);
+            quad.Bind(program_id_);
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_BLEND);
+            glActiveTexture(GL_TEXTURE0);
+
+            // finest level: a copy of the depth buffer
+            hiZ.BindLevel(0);
+            glUniform1i(copyDepth_id, true);
+            glBindTexture(GL_TEXTURE_2D, hdrBuffer.getDepthTexture());
+            quad.Draw();
+
+            // coarser levels: each one from the previous one only
+            glUniform1i(copyDepth_id, false);
+            for (int level = 1; level < hiZ.getLevels(); ++level) {
+                hiZ.RestrictToLevel(level - 1);
+                hiZ.BindLevel(level);
+                glBindTexture(GL_TEXTURE_2D, hiZTexture_id_);
+                quad.Draw();
+            }
+            glBindTexture(GL_TEXTURE_2D, 0);
+            hiZ.RestoreLevels();
+
+            glEnable(GL_DEPTH_TEST);
+            glBindVertexArray(0);
+            glUseProgram(0);
+            hiZ.Unbind();
+        }
+
+        /**
+         * colorUnit, hiZUnit: texture units the program samples the captured scene from,
+         * skyUnit: the one it samples the sky cube map from where the rays leave the screen
+         */
+        void registerProgram(GLuint program_id, int colorUnit, int hiZUnit, int skyUnit) {
+            glUseProgram(program_id);
+            glUniform1i(glGetUniformLocation(program_id, "sceneColor"), colorUnit);
+            glUniform1i(glGetUniformLocation(program_id, "hiZ"), hiZUnit);
+            glUseProgram(0);
+
+            ScreenSpaceReflectionProgramIds ids;
+            ids.enabled_id = glGetUniformLocation(program_id, "screenSpaceReflections");
+            ids.projection_id = glGetUniformLocation(program_id, "projection");
+            ids.hiZLevels_id = glGetUniformLocation(program_id, "hiZLevels");
+            ids.colorUnit = colorUnit;
+            ids.hiZUnit = hiZUnit;
+            programToIds[program_id] = ids;
+
+            if (sky != nullptr) {
+                sky->registerProgram(program_id, skyUnit);
+            }
+        }
+
+        void updateProgram(GLuint program_id) {
+            ScreenSpaceReflectionProgramIds ids = programToIds[program_id];
+            glUniform1i(ids.enabled_id, enabled);
+            if (!enabled) {
+                return;
+            }
+            glUniformMatrix4fv(ids.projection_id, ONE, DONT_TRANSPOSE, glm::value_ptr(projection));
+            glUniform1i(ids.hiZLevels_id, hiZ.getLevels());
+
+            glActiveTexture(GL_TEXTURE0 + ids.colorUnit);
+            glBindTexture(GL_TEXTURE_2D, sceneColorTexture_id_);
+            glActiveTexture(GL_TEXTURE0 + ids.hiZUnit);
+            glBindTexture(GL_TEXTURE_2D, hiZTexture_id_);
+            glActiveTexture(GL_TEXTURE0);
+
+            if (sky != nullptr) {
+                sky->updateProgram(program_id);
+            }
+        }
+
+        /** bytes of video memory held by the scene color and the hierarchical depth */
+        size_t memoryUsage() const {
+            size_t pixels = size_t(width) * height;
+            return pixels * 8 + pixels * 4 * 4 / 3;
+        }
+
+        void Cleanup() {
+            glUseProgram(0);
+            quad.Cleanup();
+            glDeleteProgram(program_id_);
+            sceneColor.Cleanup();
+            hiZ.Cleanup();
+        }
+};
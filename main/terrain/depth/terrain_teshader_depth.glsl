@@ -0,0 +1,43 @@
+#version 410 core
+
+// position-only copy of terrain_teshader.glsl for the depth pre-pass: it must stay in sync with it,
+// the main pass tests for depth equality against what is written here
+
+layout(quads, fractional_even_spacing, ccw) in;
+
+uniform mat4 MVP;
+
+uniform sampler2D heightMap;
+
+in vec3 vpoint_TE[];
+in vec2 uv_TE[];
+in vec2 vpoint_World_TE[];
+
+invariant gl_Position;
+
+vec2 interpolate2D(in vec2 v0, in vec2 v1, in vec2 v2, in vec2 v3)
+{
+    vec2 xlerp1 = mix(v0, v1, gl_TessCoord.x);
+    vec2 xlerp2 = mix(v3, v2, gl_TessCoord.x);
+
+    return mix(xlerp1, xlerp2, gl_TessCoord.y);
+}
+
+vec3 interpolate3D(in vec3 v0, in vec3 v1, in vec3 v2, in vec3 v3)
+{
+    vec3 xlerp1 = mix(v0, v1, gl_TessCoord.x);
+    vec3 xlerp2 = mix(v3, v2, gl_TessCoord.x);
+
+    return mix(xlerp1, xlerp2, gl_TessCoord.y);
+}
+
+void main()
+{
+    vec2 uv = interpolate2D(uv_TE[0], uv_TE[1], uv_TE[2], uv_TE[3]);
+    vec4 vpoint = vec4(interpolate3D(vpoint_TE[0], vpoint_TE[1], vpoint_TE[2], vpoint_TE[3]), 1.0f);
+
+    // Set height for generated (and original) vertices
+    vpoint.y = texture(heightMap, uv).r;
+
+    gl_Position = MVP * vpoint;
+}
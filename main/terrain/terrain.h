@@ -14,6 +14,20 @@ class Grid: public GridMesh{
     GLuint mirrorPassDebugId;
     GLuint grassTextureId, grassTextureBisId, rockTextureId, sandTextureId, snowTextureId;
     GLuint translationId, translationDebugId;
+    GLuint tessellationScaleId;
+    GLuint mirrorClipHeightId;
+
+    /** position-only program of the depth pre-pass, it shares the tessellation of the normal program */
+    ProgramIds depthProgramIds;
+
+    /** the depth buffer already holds this pass' depth, only the front-most fragments are shaded */
+    bool depthPrepassed = false;
+
+    /** scales the tessellation of the normal program down, for the passes rendered at a lower resolution */
+    float tessellationScale = 1.0f;
+
+    /** the mirror pass drops the patches below this height, the near plane of the reflection */
+    float mirrorClipHeight = 0.0f;
 
     public:
         Grid(int firstCorner = 0) : GridMesh(firstCorner)
@@ -26,18 +40,18 @@ class Grid: public GridMesh{
                                                   "terrain_tcshader.glsl",
                                                   "terrain_teshader.glsl");
 
-            shadowProgramIds.program_id = icg_helper::LoadShaders("terrain_vshader_shadow.glsl",
+            depthProgramIds.program_id = icg_helper::LoadShaders("terrain_vshader.glsl",
                                                   "terrain_fshader_shadow.glsl",
-                                                  "terrain_tcshader_shadow.glsl",
-                                                  "terrain_teshader_shadow.glsl");
-
+                                                  "terrain_tcshader.glsl",
+                                                  "terrain_teshader_depth.glsl");
 
             debugProgramIds.program_id = icg_helper::LoadShaders("terrain_vshader_debug.glsl",
                                                   "terrain_fshader_debug.glsl",
                                                   "terrain_tcshader_debug.glsl",
                                                   "terrain_teshader_debug.glsl",
                                                   "terrain_gshader_debug.glsl");
-            if(!normalProgramIds.program_id || !shadowProgramIds.program_id || !debugProgramIds.program_id) {
+            if(!normalProgramIds.program_id || !debugProgramIds.program_id
+                    || !depthProgramIds.program_id) {
                 exit(EXIT_FAILURE);
             }
 
@@ -48,6 +62,11 @@ class Grid: public GridMesh{
             // vertex coordinates and indices
             genGrid(4);
 
+            // the sampler units below need the locations: the pre-pass and the main pass must read the same heights
+            setupLocations(depthProgramIds);
+            glUniform1i(depthProgramIds.heightMap_id, 0);
+            setupLocations();
+
             // load texture
             loadHeightMap(heightMap);
             loadGrassMap(grassMap);
@@ -70,8 +89,9 @@ class Grid: public GridMesh{
             //Tesselation configuration
             glPatchParameteri(GL_PATCH_VERTICES, 4);
 
-            setupLocations();
             mirrorPassId = glGetUniformLocation(normalProgramIds.program_id, "mirrorPass");
+            tessellationScaleId = glGetUniformLocation(normalProgramIds.program_id, "tessellationScale");
+            mirrorClipHeightId = glGetUniformLocation(normalProgramIds.program_id, "mirrorClipHeight");
 
             glUseProgram(debugProgramIds.program_id);
             mirrorPassDebugId = glGetUniformLocation(debugProgramIds.program_id, "mirrorPass");
@@ -86,26 +106,74 @@ class Grid: public GridMesh{
             this->shadowTexture_id_ = id;
         }
 
+        /** when enabled, Draw tests for depth equality against a previous DrawDepth and does not write depth */
+        void useDepthPrepass(bool enabled){
+            depthPrepassed = enabled;
+        }
+
+        /** the next Draw calls tessellate the tiles scale times as finely, 1 is full tessellation */
+        void useTessellationScale(float scale){
+            tessellationScale = scale;
+        }
+
+        /** height of the oblique near plane the reflection is rendered with */
+        void useMirrorClipHeight(float height){
+            mirrorClipHeight = height;
+        }
+
+        /** writes the depth of the tile only, to be called with color writes disabled */
+        void DrawDepth(const glm::mat4 &MVP,
+                       const glm::mat4 &MV,
+                       const glm::vec2 &translation,
+                       const glm::vec2 &translationToSceneCenter) {
+            // the wireframe is drawn with plain depth testing
+            if(wireframeDebugEnabled){
+                return;
+            }
+
+            currentProgramIds = depthProgramIds;
+
+            glUseProgram(currentProgramIds.program_id);
+            glEnable(GL_DEPTH_TEST);
+            glEnable(GL_CULL_FACE);
+            glDepthFunc(GL_LESS);
+
+            bindHeightMapTexture();
+            glUniform2fv(currentProgramIds.translation_id, 1, glm::value_ptr(translation));
+            glUniform2fv(currentProgramIds.translationToSceneCenter_id, 1, glm::value_ptr(translationToSceneCenter));
+            setupMVP(MVP, MV, IDENTITY_MATRIX);
+
+            drawFrame();
+
+            glUseProgram(0);
+        }
+
         void Draw(const glm::mat4 &MVP = IDENTITY_MATRIX,
                   const glm::mat4 &MV = IDENTITY_MATRIX,
                   const glm::mat4 &NORMALM = IDENTITY_MATRIX,
-                  const glm::mat4 &SHADOWMVP = IDENTITY_MATRIX,
                   const FractionalView &FV = FractionalView(),
                   bool mirrorPass = false,
-                  bool shadowPass = false,
                   const glm::vec2 &translation = glm::vec2(0, 0),
                   const glm::vec2 &translationToSceneCenter = glm::vec2(0,0)) {
 
-            currentProgramIds = (shadowPass) ? shadowProgramIds : normalProgramIds;
+            currentProgramIds = normalProgramIds;
+            bool depthEqual = depthPrepassed && !mirrorPass && !wireframeDebugEnabled;
 
             glUseProgram(currentProgramIds.program_id);
             glEnable(GL_DEPTH_TEST);
             glEnable(GL_CULL_FACE);
-            glDepthFunc(GL_LESS);
+            glDepthFunc(depthEqual ? GL_EQUAL : GL_LESS);
+            glDepthMask(depthEqual ? GL_FALSE : GL_TRUE);
 
             bindHeightMapTexture();
             bindGrassMapTexture();
-            glUniformMatrix4fv(currentProgramIds.SHADOWMVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(SHADOWMVP));
+            // the cascade is selected per fragment
+            if(shadowCascades != nullptr){
+                shadowCascades->updateProgram(currentProgramIds.program_id);
+            }
+            if(horizonMaps != nullptr && light != nullptr){
+                horizonMaps->updateProgram(currentProgramIds.program_id, light->getPos());
+            }
             glUniform2fv(currentProgramIds.translation_id, 1, glm::value_ptr(translation));
             glUniform2fv(currentProgramIds.translationToSceneCenter_id, 1, glm::value_ptr(translationToSceneCenter));
             activateTextureUnits();
@@ -116,12 +184,18 @@ class Grid: public GridMesh{
 
             // if mirror pass is enabled then we cull underwater fragments
             glUniform1i(mirrorPassId, mirrorPass);
+            glUniform1i(currentProgramIds.deferredPass_id, deferredPass && !mirrorPass);
+            glUniform1f(tessellationScaleId, tessellationScale);
+            glUniform1f(mirrorClipHeightId, mirrorClipHeight);
 
             setupMVP(MVP, MV, NORMALM);
             setupOffset(FV);
 
             drawFrame();
 
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+
             if(debug){
                 //New rendering on top of the previous one
                 currentProgramIds = debugProgramIds;
@@ -144,6 +218,11 @@ class Grid: public GridMesh{
             glUseProgram(0);
         }
 
+        void Cleanup() {
+            glDeleteProgram(depthProgramIds.program_id);
+            GridMesh::Cleanup();
+        }
+
         void activateTextureUnits(){
             GridMesh::activateTextureUnits(false);
             glActiveTexture(GL_TEXTURE0 + 4);
@@ -3,7 +3,6 @@
 uniform mat4 MVP;
 uniform mat4 MV;
 uniform mat4 NORMALM;
-uniform sampler2DShadow shadowMap;
 uniform sampler2D heightMap;
 uniform sampler2D grassMap;
 uniform sampler2D grassTex;
@@ -14,9 +13,10 @@ uniform sampler2D rockTex;
 uniform vec3 light_dir;
 uniform vec3 La, Ld, Ls;
 uniform bool mirrorPass;
+// writes the G-buffer (albedo, normal and material) instead of the lit color
+uniform bool deferredPass;
 uniform float alpha;
 
-in vec4 shadowCoord_F;
 in vec4 vpoint_MV_F;
 in vec4 vpoint_F;
 in vec3 lightDir_F;
@@ -29,9 +29,8 @@ uniform float threshold_vpoint_World_F;
 
 
 layout (location = 0) out vec4 color;
-layout (location = 1) out vec4 brightColor;
-
-const vec3 brightnessTreshold = vec3(1.0, 1.0, 1.0);
+// the G-buffer normal and material, the forward passes write the HDR color only
+layout (location = 1) out vec4 gNormal;
 
 const float SLOPE_THRESHOLD = 0.5f;
 const float MIX_SLOPE_THRESHOLD = 0.1f;
@@ -45,6 +44,26 @@ const float WATER_HEIGHT = 0.01f,
 
 const float GRASS_TRANSITION = SAND_HEIGHT + (1.0f/1.5f) * (GRASS_HEIGHT - SAND_HEIGHT);
 
+const int NUM_CASCADES = 4;
+uniform sampler2DArrayShadow shadowMap;
+// to the light space of this frame, xy in world units and z the depth in the maps
+uniform mat4 SHADOWMV;
+// center and usable half side of each map in light space, 1 / its side
+uniform vec4 cascadeArea[NUM_CASCADES];
+// texture coordinates of the light space origin in each map, the maps wrap around
+uniform vec2 cascadeOffset[NUM_CASCADES];
+// light space depth covered by the maps, turns a world space bias into a depth offset
+uniform float shadowDepthRange;
+// blurred and mipmapped exponential variance moments of the maps, see evsm_fshader.glsl
+uniform sampler2DArray shadowMoments;
+// one filtered fetch of the moments, or the rotated PCF of the depth maps
+uniform bool prefilteredShadows;
+
+// sine of the horizon elevation in 4 azimuths, baked per tile, and the weights of the azimuths around the sun
+uniform sampler2D horizonMap;
+uniform vec4 horizonWeights;
+uniform float sunSine;
+
 const int numSamplingPositions = 9;
 uniform vec2 kernel[9] = vec2[]
 (
@@ -71,11 +90,54 @@ float randomAngle(in vec3 seed, in float freq)
    return random(seed, freq) * 6.283285f;
 }
 
-void main() {
-
-    if (mirrorPass && vpoint_F.y < -0.005f) {
-        discard;
+// the finest map holding the given light space position, NUM_CASCADES outside of all of them
+int selectCascade(in vec2 lightPos)
+{
+    for(int i = 0; i < NUM_CASCADES; i++){
+        if(all(lessThan(abs(lightPos - cascadeArea[i].xy), vec2(cascadeArea[i].z)))){
+            return i;
+        }
     }
+    return NUM_CASCADES;
+}
+
+// exponents of the warped depth, as in evsm_fshader.glsl
+const float positiveExponent = 5.54f;
+const float negativeExponent = 5.0f;
+
+// upper bound of the lit fraction from the mean and variance of the occluders warped depth
+float chebyshevUpperBound(in vec2 moments, in float mean, in float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    // cuts the tail of the bound to reduce light bleeding
+    float pMax = clamp((variance / (variance + d * d) - 0.2f) / 0.8f, 0.0f, 1.0f);
+    return (mean <= moments.x) ? 1.0f : pMax;
+}
+
+// one filtered fetch of the moments, the gradients come from the light space position so that they do not jump
+// where the cascade changes
+float evsmVisibility(in vec3 shadowCoord, in int cascade, in vec2 gradX, in vec2 gradY)
+{
+    vec4 moments = textureGrad(shadowMoments, vec3(shadowCoord.xy, cascade), gradX, gradY);
+    float depth = 2.0f * shadowCoord.z - 1.0f;
+    vec2 warped = vec2(exp(positiveExponent * depth), -exp(-negativeExponent * depth));
+    vec2 minVariance = 0.0001f * vec2(positiveExponent, negativeExponent) * warped;
+    minVariance *= minVariance;
+    return min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x),
+               chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+}
+
+// the terrain shadows itself where the sun is below its horizon, softened over a few degrees
+float horizonVisibility(in vec2 uv)
+{
+    float horizonSine = dot(texture(horizonMap, uv), horizonWeights);
+    return smoothstep(horizonSine - 0.05f, horizonSine + 0.05f, sunSine);
+}
+
+#include "gbuffer_normal.glsl"
+
+void main() {
 
     float grass_coef_noise = clamp(texture(grassMap, uv_F).g, 0.f, 1.f);
     vec2 normalDxDy = texture(heightMap, uv_F).yz;
@@ -150,26 +212,50 @@ void main() {
 //*/
 
     heightCol /= 255.0f;
+
+    // terrain material: no specular, the horizon visibility takes its place, the deferred lighting pass does the shadowing
+    if (deferredPass) {
+        color = vec4(heightCol, 1.0f);
+        gNormal = vec4(encodeNormal(normalize(normal_MV)), horizonVisibility(uv_F), 1.0f / 3.0f);
+        return;
+    }
     float cosNL = dot(normal_MV, lightDir);
-    float bias = max(0.05f * (1.0f - cosNL), 0.005f);
-
-    float visibility = 0;
-
-    // generate random rotation angle for each fragment
-    float angle = randomAngle(vpoint_F.xyz, 15.0f);
-    float s = sin(angle);
-    float c = cos(angle);
-    float PCFRadius = 1.0f/1000.0f;
-    for(int i=0; i < numSamplingPositions; i++)
-    {
-      // rotate offset
-      vec2 rotatedOffset = vec2(kernel[i].x * c + kernel[i].y * -s, kernel[i].x * s + kernel[i].y * c);
-      vec3 samplingPos = shadowCoord_F.xyz;
-      samplingPos += vec3(rotatedOffset * PCFRadius, -bias);
-      visibility += texture(shadowMap, samplingPos);
+    // in world units, the depth range of the maps turns it into a depth offset
+    float bias = max(0.1f * (1.0f - cosNL), 0.01f);
+
+    float visibility = 1.0f;
+
+    // outside of every map the terrain is lit
+    vec3 shadowPos = (SHADOWMV * vpoint_F).xyz;
+    // derivatives of the light space position, taken before branching
+    vec2 shadowGradX = dFdx(shadowPos.xy);
+    vec2 shadowGradY = dFdy(shadowPos.xy);
+    int cascade = selectCascade(shadowPos.xy);
+    // the reflection is blurred and seen through the waves, it skips the shadow lookups
+    if(!mirrorPass && cascade < NUM_CASCADES){
+        vec3 shadowCoord = vec3(shadowPos.xy * cascadeArea[cascade].w + cascadeOffset[cascade], shadowPos.z);
+        float depthBias = bias / shadowDepthRange;
+        if(prefilteredShadows){
+            visibility = evsmVisibility(vec3(shadowCoord.xy, shadowCoord.z - depthBias), cascade,
+                                        shadowGradX * cascadeArea[cascade].w, shadowGradY * cascadeArea[cascade].w);
+        } else {
+            visibility = 0.0f;
+
+            // generate random rotation angle for each fragment
+            float angle = randomAngle(vpoint_F.xyz, 15.0f);
+            float s = sin(angle);
+            float c = cos(angle);
+            float PCFRadius = 1.0f/1000.0f;
+            for(int i=0; i < numSamplingPositions; i++)
+            {
+              // rotate offset
+              vec2 rotatedOffset = vec2(kernel[i].x * c + kernel[i].y * -s, kernel[i].x * s + kernel[i].y * c);
+              visibility += texture(shadowMap, vec4(shadowCoord.xy + rotatedOffset * PCFRadius, cascade, shadowCoord.z - depthBias));
+            }
+            visibility /= numSamplingPositions;
+        }
     }
-
-    visibility /= numSamplingPositions;
+    visibility *= horizonVisibility(uv_F);
     visibility *= 1 - fadingValue;
 
 
@@ -185,10 +271,8 @@ void main() {
 
     color = vec4(clamp(lightingResult, vec3(0.0f), vec3(1.0f)), 1.0f);
 
-    color.a *= 1 - fadingValue;
-
-    float brightness = dot(color.rgb, brightnessTreshold);
-
-    brightColor = mix(vec4(0.0, 0.0, 0.0, 1.0), vec4(color), smoothstep(1.5, 6.0, brightness));
-    brightColor.a = color.a;
+    // the main pass is opaque and faded into the sky by the fog pass, the reflection has no depth to do so
+    if (mirrorPass) {
+        color.a *= 1 - fadingValue;
+    }
 }
@@ -5,6 +5,13 @@ layout (vertices = 4) out;
 
 uniform mat4 MVP;
 uniform mat4 MV;
+uniform sampler2D heightMap;
+// the reflection keeps what is above the water only
+uniform bool mirrorPass;
+// height of the near plane of the reflection
+uniform float mirrorClipHeight;
+// scales the tessellation down for the passes rendered at a lower resolution, e.g. the reflection
+uniform float tessellationScale = 1.0f;
 
 // attributes of the input CPs
 in vec3 vpoint_TC[];
@@ -20,6 +27,8 @@ const float CLOSEST_TESS_DISTANCE = 0.5f;
 const float FURTHEST_TESS_DISTANCE = 5.5f;
 const float MIN_TESSELATION = 8.0f;
 const float MAX_TESSELATION = 32.0f;
+// the heights inside a patch may rise a little above its corners and its center
+const float SUBMERGED_MARGIN = 0.05f;
 
 float GetTessLevel(in float Distance0, in float Distance1, in float height1, in float height2)
 {
@@ -42,7 +51,13 @@ float GetTessLevel(in float Distance0, in float Distance1, in float height1, in
         tessLvl /= 2.0;
     }
 
-    return tessLvl;
+    return max(tessLvl * tessellationScale, 1.0f);
+}
+
+bool submerged(){
+    float centerHeight = textureLod(heightMap, 0.25f * (uv_TC[0] + uv_TC[1] + uv_TC[2] + uv_TC[3]), 0.0f).r;
+    float maxHeight = max(max(max(vpoint_TC[0].y, vpoint_TC[1].y), max(vpoint_TC[2].y, vpoint_TC[3].y)), centerHeight);
+    return maxHeight < mirrorClipHeight - SUBMERGED_MARGIN;
 }
 
 bool offscreen(in vec3 v){
@@ -63,7 +78,8 @@ void main()
     vpoint_World_TE[gl_InvocationID] = vpoint_World_TC[gl_InvocationID];
 
 
-    if(all(bvec4(offscreen(vpoint_TC[0]), offscreen(vpoint_TC[1]), offscreen(vpoint_TC[2]), offscreen(vpoint_TC[3])))){
+    if((mirrorPass && submerged()) ||
+            all(bvec4(offscreen(vpoint_TC[0]), offscreen(vpoint_TC[1]), offscreen(vpoint_TC[2]), offscreen(vpoint_TC[3])))){
         // No tesselation means patch is dropped -> save computation time !
         gl_TessLevelOuter[0] = gl_TessLevelOuter[1] = gl_TessLevelOuter[2] = gl_TessLevelOuter[3] = 0;
         gl_TessLevelInner[0] = gl_TessLevelInner[1] = 0;
@@ -5,7 +5,6 @@ layout(quads, fractional_even_spacing, ccw) in;
 uniform mat4 MVP;
 uniform mat4 MV;
 uniform mat4 NORMALM;
-uniform mat4 SHADOWMVP;
 uniform vec3 lightPos;
 
 uniform sampler2D heightMap;
@@ -15,7 +14,6 @@ in vec2 uv_TE[];
 in vec2 vpoint_World_TE[];
 
 out vec4 vpoint_F;
-out vec4 shadowCoord_F;
 out vec2 uv_F;
 out vec4 vpoint_MV_F;
 out vec3 lightDir_F;
@@ -23,6 +21,9 @@ out vec3 viewDir_F;
 out float vheight_F;
 out vec2 vpoint_World_F;
 
+// the depth pre-pass (terrain_teshader_depth.glsl) must produce bit-identical depths
+invariant gl_Position;
+
 vec2 interpolate2D(in vec2 v0, in vec2 v1, in vec2 v2, in vec2 v3)
 {
     vec2 xlerp1 = mix(v0, v1, gl_TessCoord.x);
@@ -57,5 +58,4 @@ void main()
     viewDir_F = -normalize(vpoint_MV_F.xyz);
 
     gl_Position = MVP * vpoint_F;
-    shadowCoord_F = SHADOWMVP * vpoint_F;
 }
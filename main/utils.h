@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
 #include <glm/gtc/type_ptr.hpp>
 
 class Utils{
@@ -53,4 +56,93 @@ public:
         stbi_image_free(image);
         return texId;
     }
+
+    /**
+     * loads an RGBA image to be alpha tested against alphaThreshold: each mip level has its alpha scaled so that
+     * as many of its texels pass the test as in the full resolution image, instead of thinning out with distance
+     */
+    static GLuint loadImageCoveragePreserving(const char* filename, float alphaThreshold){
+        GLuint texId;
+
+        int width;
+        int height;
+        int nb_component;
+        unsigned char* image = stbi_load(filename, &width, &height, &nb_component, 4);
+
+        if(image == nullptr) {
+            throw std::runtime_error{"Utils::loadImageCoveragePreserving stbi_load failed"};
+        }
+
+        glGenTextures(1, &texId);
+        glBindTexture(GL_TEXTURE_2D, texId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        std::vector<float> level(image, image + 4 * width * height);
+        stbi_image_free(image);
+        float coverage = alphaCoverage(level, 1.0f, alphaThreshold);
+
+        for (int mip = 0; ; ++mip) {
+            std::vector<unsigned char> texels(level.size());
+            for (size_t i = 0; i < level.size(); ++i) {
+                texels[i] = (unsigned char) std::min(255.0f, std::round(level[i]));
+            }
+            glTexImage2D(GL_TEXTURE_2D, mip, GL_RGBA, width, height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, &texels[0]);
+            if (width == 1 && height == 1) {
+                break;
+            }
+
+            // 2x2 box filter, the last row or column is repeated for odd sizes
+            int nextWidth = std::max(1, width / 2), nextHeight = std::max(1, height / 2);
+            std::vector<float> next(4 * nextWidth * nextHeight);
+            for (int y = 0; y < nextHeight; ++y) {
+                for (int x = 0; x < nextWidth; ++x) {
+                    for (int c = 0; c < 4; ++c) {
+                        float sum = 0.0f;
+                        for (int dy = 0; dy < 2; ++dy) {
+                            for (int dx = 0; dx < 2; ++dx) {
+                                int sx = std::min(2 * x + dx, width - 1), sy = std::min(2 * y + dy, height - 1);
+                                sum += level[4 * (sy * width + sx) + c];
+                            }
+                        }
+                        next[4 * (y * nextWidth + x) + c] = 0.25f * sum;
+                    }
+                }
+            }
+
+            // the averaged alpha rarely passes the test as often, bisect the scale that restores the coverage
+            float low = 0.0f, high = 4.0f;
+            for (int iteration = 0; iteration < 16; ++iteration) {
+                float middle = 0.5f * (low + high);
+                if (alphaCoverage(next, middle, alphaThreshold) < coverage) {
+                    low = middle;
+                } else {
+                    high = middle;
+                }
+            }
+            for (size_t i = 3; i < next.size(); i += 4) {
+                next[i] = std::min(255.0f, next[i] * high);
+            }
+
+            level.swap(next);
+            width = nextWidth;
+            height = nextHeight;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texId;
+    }
+
+private:
+    /** fraction of the RGBA texels, in [0, 255], whose alpha scaled by scale passes the threshold in [0, 1] */
+    static float alphaCoverage(const std::vector<float>& rgba, float scale, float alphaThreshold){
+        size_t passing = 0;
+        for (size_t i = 3; i < rgba.size(); i += 4) {
+            passing += rgba[i] * scale > 255.0f * alphaThreshold;
+        }
+        return float(passing) / (rgba.size() / 4);
+    }
 };
@@ -8,6 +8,11 @@ uniform mat4 NORMALM;
 uniform sampler2D heightMap;
 uniform sampler2D normalMap;
 uniform float time;
+uniform vec2 offset;
+// as in water_teshader.glsl
+uniform sampler2D oceanDisplacement;
+uniform sampler2D oceanNormals;
+uniform float oceanScale;
 
 in vec3 vpoint_TE[];
 in vec2 uv_TE[];
@@ -18,17 +23,14 @@ out vec2 uv_G;
 out vec2 reflectOffset_G;
 out vec3 waveNormal_G;
 
-const float DEGTORAD = 3.14159265359f / 180.0f;
 const float rippleNormalWeight = 0.2f;
 
-float freqs[5] = float[5](1.0f, 3.0f, 11.0f, 21.0f, 23.0f);
-float amps[5] =  float[5](0.02f, 0.015f, 0.0085f, 0.006f, 0.004f);
-float phis[5] = float[5](0.8f, 1.0f, 1.2f, 1.4f, 2.1f);
-vec2 dirs[5] = vec2[5](vec2(0.0f,1.0f),vec2(0.5f, 1.0f),vec2(0.3f, 1.0f),vec2(0.4f, 1.0f),vec2(-0.2f, 1.0f));
-int exps[5] = int[5](1, 2, 2, 2, 3);
-float sinWave[5] = float[5](0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-float ddx[5] = float[5](0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-float ddy[5] = float[5](0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+// as in water_teshader.glsl
+float shoreAttenuation(in float terrainHeight)
+{
+    float depth = 5.0f * clamp(terrainHeight, -0.5f, 0.0f);
+    return 1.3f - exp(-depth * depth);
+}
 
 float interpolate2D(in float v0, in float v1, in float v2, in float v3)
 {
@@ -56,45 +58,16 @@ vec3 interpolate3D(in vec3 v0, in vec3 v1, in vec3 v2, in vec3 v3)
 
 void main()
 {
-
-    for(int i = 0; i < 5; i++){
-        dirs[i] = normalize(dirs[i]);
-        amps[i] *= 1.5f;
-    }
-
     // Interpolate the attributes of the output vertex using the barycentric coordinates
     uv_G = interpolate2D(uv_TE[0], uv_TE[1], uv_TE[2], uv_TE[3]);
     float tHeight = interpolate2D(terrainHeight_TE[0], terrainHeight_TE[1], terrainHeight_TE[2], terrainHeight_TE[3]);
-    vec2 tGradient = interpolate2D(terrainGradient_TE[0], terrainGradient_TE[1], terrainGradient_TE[2], terrainGradient_TE[3]);
     vec3 vpoint_G = interpolate3D(vpoint_TE[0], vpoint_TE[1], vpoint_TE[2], vpoint_TE[3]);
 
-    for(int i = 0; i < 5; i++){
-
-        amps[i] *=
-                1.3 - 1.0 *(
-                exp(-pow(5.0 * clamp(tHeight, -0.5, 0.0), 2.0)));
-
-        float waveParam = (dot(dirs[i], vec2(vpoint_G.xz)) * freqs[i]) + (phis[i] * time);
-
-        //Bring sin in [0,1] for later exponentiation
-        float sinTmp = (sin(waveParam) + 1.0f)/2.0f;
-
-        //First sin^k, then bring back to [-1, 1] and multiply by amplitude
-        sinWave[i] = amps[i] * pow(sinTmp, exps[i]);
-
-        //Compute derivate of the wave
-        float commonPartialDerivative = exps[i]  * freqs[i] * amps[i] * pow(sinTmp, exps[i] - 1.0f) * cos(waveParam);
-        ddx[i] = dirs[i].x * commonPartialDerivative;
-        ddy[i] = dirs[i].y * commonPartialDerivative;
-    }
-
-    vec3 waveNormal = vec3(0.0f);
-    for(int i = 0; i < 5; i++){
-        vpoint_G.y += sinWave[i];
-        waveNormal += vec3(-ddx[i], 1.0f, -ddy[i]);
-    }
-
-    waveNormal = normalize(waveNormal);
+    vec2 oceanUV = (uv_G + offset) * oceanScale;
+    float shore = shoreAttenuation(tHeight);
+    vpoint_G += shore * textureLod(oceanDisplacement, oceanUV, 0.0f).xyz;
+    vec3 oceanNormal = textureLod(oceanNormals, oceanUV, 0.0f).xyz;
+    vec3 waveNormal = normalize(vec3(shore * oceanNormal.x, oceanNormal.y, shore * oceanNormal.z));
 
     vec3 rippleNormal =
             texture(normalMap, (uv_G + vec2(0.0, 0.005 * time)) * 11.0).rgb * 2.0 - 1.0f
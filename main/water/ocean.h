@@ -0,0 +1,342 @@
+#pragma once
+#include <cmath>
+#include <map>
+#include <random>
+#include <vector>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "../framebuffer.h"
+#include "../screenquad/fullscreenquad.h"
+#include "wavesampler.h"
+
+struct OceanProgramIds{
+    GLuint scale_id;
+    int displacementUnit, normalUnit;
+};
+
+/**
+ * @brief The Ocean class animates a tileable patch of sea with a Tessendorf spectrum: once per frame the
+ * spectrum is advanced in time and brought back to the surface by an inverse FFT in fragment passes,
+ * then unpacked into a displacement texture and a normal and whitecaps texture. Every water tile samples
+ * the same two textures, repeated over the scene, instead of summing its waves per vertex.
+ * The displacement is also read back to the CPU a few frames late, for what floats on the water.
+ */
+class Ocean {
+
+public:
+    /** texels along each side of the patch, a power of two */
+    static constexpr int SIZE = 128;
+    /** in scene units, the textures repeat every patch */
+    static constexpr float PATCH_SIZE = 16.0f;
+
+private:
+    enum { SPECTRUM, FFT, FINALIZE, PROGRAMS };
+    /** reads in flight, the GPU has that many frames to copy the displacement before the CPU waits for it */
+    enum { READBACK_SLOTS = 3 };
+
+    FullScreenQuad quad;
+    GLuint program_id_[PROGRAMS];
+    GLuint time_id, horizontal_id, subtransformSize_id, normalPass_id;
+
+    GLuint initialSpectrumTexture_id_;
+    // ping-pong of the FFT passes, the spectrum pass writes the first one
+    ColorFBO transform[2];
+    GLuint transformTexture_id_[2];
+    ColorMipFBO displacement, normals;
+    GLuint displacementTexture_id_, normalTexture_id_;
+
+    // ring of pixel pack buffers, the fence of a slot is 0 once it has been read
+    GLuint readbackBuffer_[READBACK_SLOTS];
+    GLsync readbackFence_[READBACK_SLOTS];
+    int readbackWrite = 0, readbackRead = 0;
+    SampledField surface;
+
+    // the units of the scene have their own gravity, it keeps the pace of the former waves
+    const float gravity = 1.0f;
+    const float windSpeed = 2.0f;
+    const glm::vec2 windDirection = glm::normalize(glm::vec2(0.3f, 1.0f));
+    // of the height, the scene was built for waves of a few hundredths of a unit
+    const float rmsHeight = 0.012f;
+    const float choppiness = 1.5f;
+
+    /** scene units per unit of the tile coordinates of the water */
+    const float tileSize = 2.0f;
+
+    std::map<GLuint, OceanProgramIds> programToIds;
+
+    /**
+     * Phillips spectrum with random gaussian phases, scaled to the wanted height: the normalization the
+     * waves used to redo per vertex is done once here. Texels hold h0(k) and the conjugate of h0(-k)
+     */
+    GLuint createInitialSpectrum() {
+        const float PI = 3.14159265359f;
+        std::mt19937 generator(1337);
+        std::normal_distribution<float> gaussian(0.0f, 1.0f);
+
+        // largest wave the wind can raise, and the damping of the waves too short for the grid
+        float largest = windSpeed * windSpeed / gravity;
+        float smallest = 0.5f * PATCH_SIZE / SIZE;
+
+        std::vector<glm::vec2> h0(SIZE * SIZE);
+        double energy = 0.0;
+        for (int m = 0; m < SIZE; ++m) {
+            for (int n = 0; n < SIZE; ++n) {
+                glm::vec2 k = 2.0f * PI / PATCH_SIZE
+                        * glm::vec2(n < SIZE / 2 ? n : n - SIZE, m < SIZE / 2 ? m : m - SIZE);
+                float kLength = glm::length(k);
+                float phillips = 0.0f;
+                if (kLength > 0.0f) {
+                    float kWind = glm::dot(k / kLength, windDirection);
+                    phillips = std::exp(-1.0f / (kLength * largest * kLength * largest))
+                            / (kLength * kLength * kLength * kLength)
+                            * kWind * kWind
+                            * std::exp(-kLength * kLength * smallest * smallest);
+                    // little goes against the wind
+                    if (kWind < 0.0f) {
+                        phillips *= 0.07f;
+                    }
+                }
+                float amplitude = std::sqrt(phillips * 0.5f);
+                glm::vec2 h = amplitude * glm::vec2(gaussian(generator), gaussian(generator));
+                h0[m * SIZE + n] = h;
+                energy += glm::dot(h, h);
+            }
+        }
+
+        // mean square of the heights over time: both h0(k) and h0(-k) contribute to each wave vector
+        float scale = rmsHeight / float(std::sqrt(2.0 * energy));
+        std::vector<GLfloat> texels(SIZE * SIZE * 4);
+        for (int m = 0; m < SIZE; ++m) {
+            for (int n = 0; n < SIZE; ++n) {
+                glm::vec2 h = scale * h0[m * SIZE + n];
+                glm::vec2 hMinus = scale * h0[((SIZE - m) % SIZE) * SIZE + (SIZE - n) % SIZE];
+                GLfloat* t = &texels[4 * (m * SIZE + n)];
+                t[0] = h.x;
+                t[1] = h.y;
+                t[2] = hMinus.x;
+                t[3] = -hMinus.y;
+            }
+        }
+
+        GLuint texture_id;
+        glGenTextures(1, &texture_id);
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, SIZE, SIZE, 0, GL_RGBA, GL_FLOAT, &texels[0]);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture_id;
+    }
+
+    /** the RGBA texels of the displacement into the planes of the field */
+    static void unpackSurface(const GLfloat* texels, SampledField& field) {
+        if (field.empty()) {
+            field.resize(SIZE, SIZE, 3);
+        }
+        for (int c = 0; c < 3; ++c) {
+            float* plane = field.plane(c);
+            for (int t = 0; t < SIZE * SIZE; ++t) {
+                plane[t] = texels[4 * t + c];
+            }
+        }
+    }
+
+    /** takes the oldest read if the GPU is done with it, then starts this frame's if a buffer is free */
+    void readBackSurface() {
+        const GLsizeiptr bytes = SIZE * SIZE * 4 * sizeof(GLfloat);
+        GLsync& oldest = readbackFence_[readbackRead];
+        if (oldest != 0) {
+            GLenum status = glClientWaitSync(oldest, 0, 0 /*do not wait*/);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                glDeleteSync(oldest);
+                oldest = 0;
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer_[readbackRead]);
+                const GLfloat* texels = (const GLfloat*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+                if (texels != nullptr) {
+                    unpackSurface(texels, surface);
+                }
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                readbackRead = (readbackRead + 1) % READBACK_SLOTS;
+            }
+        }
+
+        if (readbackFence_[readbackWrite] == 0) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer_[readbackWrite]);
+            displacement.ReadColor(0, 0, SIZE, SIZE, GL_RGBA, GL_FLOAT, nullptr /*offset in the buffer*/);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            readbackFence_[readbackWrite] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            readbackWrite = (readbackWrite + 1) % READBACK_SLOTS;
+        }
+    }
+
+    void drawPass(int program, GLuint texture) {
+        quad.Bind(program_id_[program]);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        quad.Draw();
+    }
+
+public:
+    void Init() {
+        initialSpectrumTexture_id_ = createInitialSpectrum();
+        transformTexture_id_[0] = transform[0].Init(SIZE, SIZE, GL_RGBA32F, GL_RGBA, GL_FLOAT, false);
+        transformTexture_id_[1] = transform[1].Init(SIZE, SIZE, GL_RGBA32F, GL_RGBA, GL_FLOAT, false);
+        displacementTexture_id_ = displacement.Init(SIZE, SIZE, GL_RGBA16F, GL_RGBA, GL_FLOAT, true, true);
+        normalTexture_id_ = normals.Init(SIZE, SIZE, GL_RGBA16F, GL_RGBA, GL_FLOAT, true, true);
+
+        glGenBuffers(READBACK_SLOTS, readbackBuffer_);
+        for (int slot = 0; slot < READBACK_SLOTS; ++slot) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer_[slot]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, SIZE * SIZE * 4 * sizeof(GLfloat), NULL, GL_STREAM_READ);
+            readbackFence_[slot] = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // compile the shaders
+        program_id_[SPECTRUM] = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                        "ocean_spectrum_fshader.glsl");
+        program_id_[FFT] = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                   "ocean_fft_fshader.glsl");
+        program_id_[FINALIZE] = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                                        "ocean_finalize_fshader.glsl");
+        if(!program_id_[SPECTRUM] || !program_id_[FFT] || !program_id_[FINALIZE]) {
+            exit(EXIT_FAILURE);
+        }
+
+        for (int program = 0; program < PROGRAMS; ++program) {
+            quad.registerProgram(program_id_[program]);
+        }
+
+        glUseProgram(program_id_[SPECTRUM]);
+        glUniform1i(glGetUniformLocation(program_id_[SPECTRUM], "initialSpectrum"), 0 /*GL_TEXTURE0*/);
+        glUniform1f(glGetUniformLocation(program_id_[SPECTRUM], "patchSize"), PATCH_SIZE);
+        glUniform1f(glGetUniformLocation(program_id_[SPECTRUM], "gravity"), gravity);
+        time_id = glGetUniformLocation(program_id_[SPECTRUM], "time");
+
+        glUseProgram(program_id_[FFT]);
+        glUniform1i(glGetUniformLocation(program_id_[FFT], "spectrum"), 0 /*GL_TEXTURE0*/);
+        horizontal_id = glGetUniformLocation(program_id_[FFT], "horizontal");
+        subtransformSize_id = glGetUniformLocation(program_id_[FFT], "subtransformSize");
+
+        glUseProgram(program_id_[FINALIZE]);
+        glUniform1i(glGetUniformLocation(program_id_[FINALIZE], "surface"), 0 /*GL_TEXTURE0*/);
+        glUniform1f(glGetUniformLocation(program_id_[FINALIZE], "patchSize"), PATCH_SIZE);
+        glUniform1f(glGetUniformLocation(program_id_[FINALIZE], "choppiness"), choppiness);
+        normalPass_id = glGetUniformLocation(program_id_[FINALIZE], "normalPass");
+        glUseProgram(0);
+    }
+
+    /** the surface at the given time, in seconds. Leaves the default framebuffer bound */
+    void update(float time) {
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glActiveTexture(GL_TEXTURE0);
+
+        glUseProgram(program_id_[SPECTRUM]);
+        glUniform1f(time_id, time);
+        transform[0].Bind();
+        drawPass(SPECTRUM, initialSpectrumTexture_id_);
+
+        // rows then columns, each pass reads the target the previous one wrote
+        glUseProgram(program_id_[FFT]);
+        int source = 0;
+        for (int axis = 0; axis < 2; ++axis) {
+            glUniform1i(horizontal_id, axis == 0);
+            for (int subtransformSize = 2; subtransformSize <= SIZE; subtransformSize *= 2) {
+                glUniform1f(subtransformSize_id, float(subtransformSize));
+                transform[1 - source].Bind();
+                drawPass(FFT, transformTexture_id_[source]);
+                source = 1 - source;
+            }
+        }
+
+        glUseProgram(program_id_[FINALIZE]);
+        glUniform1i(normalPass_id, false);
+        displacement.Bind();
+        drawPass(FINALIZE, transformTexture_id_[source]);
+        glUniform1i(normalPass_id, true);
+        normals.Bind();
+        drawPass(FINALIZE, transformTexture_id_[source]);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        normals.Unbind();
+        displacement.GenerateMipmaps();
+        normals.GenerateMipmaps();
+        readBackSurface();
+
+        glEnable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    /**
+     * displacementUnit, normalUnit: texture units the program samples the ocean from, see water_teshader.glsl.
+     * oceanScale turns the tile coordinates of the water into coordinates of the patch
+     */
+    void registerProgram(GLuint program_id, int displacementUnit, int normalUnit) {
+        glUseProgram(program_id);
+        glUniform1i(glGetUniformLocation(program_id, "oceanDisplacement"), displacementUnit);
+        glUniform1i(glGetUniformLocation(program_id, "oceanNormals"), normalUnit);
+        glUseProgram(0);
+
+        OceanProgramIds ids;
+        ids.scale_id = glGetUniformLocation(program_id, "oceanScale");
+        ids.displacementUnit = displacementUnit;
+        ids.normalUnit = normalUnit;
+        programToIds[program_id] = ids;
+    }
+
+    /** the displacement of a few frames ago in scene axes, empty until the first read is done */
+    const SampledField& getSurface() const {
+        return surface;
+    }
+
+    /** the displacement of the last update, waits for the GPU: for checks, not for every frame */
+    void readSurfaceNow(SampledField& field) {
+        std::vector<GLfloat> texels(SIZE * SIZE * 4);
+        displacement.ReadColor(0, 0, SIZE, SIZE, GL_RGBA, GL_FLOAT, &texels[0]);
+        unpackSurface(&texels[0], field);
+    }
+
+    /** patch coordinates per unit of the tile coordinates, oceanScale of the shaders */
+    float getScale() const {
+        return tileSize / PATCH_SIZE;
+    }
+
+    void updateProgram(GLuint program_id) {
+        OceanProgramIds ids = programToIds[program_id];
+        glUniform1f(ids.scale_id, getScale());
+
+        glActiveTexture(GL_TEXTURE0 + ids.displacementUnit);
+        glBindTexture(GL_TEXTURE_2D, displacementTexture_id_);
+        glActiveTexture(GL_TEXTURE0 + ids.normalUnit);
+        glBindTexture(GL_TEXTURE_2D, normalTexture_id_);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /** bytes of video memory held by the spectrum, the transforms, the mipmapped surface textures and the reads */
+    size_t memoryUsage() const {
+        size_t texels = size_t(SIZE) * SIZE;
+        return 3 * texels * 16 + 2 * texels * 8 * 4 / 3 + READBACK_SLOTS * texels * 16;
+    }
+
+    void Cleanup() {
+        glUseProgram(0);
+        quad.Cleanup();
+        for (int program = 0; program < PROGRAMS; ++program) {
+            glDeleteProgram(program_id_[program]);
+        }
+        glDeleteTextures(1, &initialSpectrumTexture_id_);
+        glDeleteBuffers(READBACK_SLOTS, readbackBuffer_);
+        for (int slot = 0; slot < READBACK_SLOTS; ++slot) {
+            if (readbackFence_[slot] != 0) {
+                glDeleteSync(readbackFence_[slot]);
+            }
+        }
+        transform[0].Cleanup();
+        transform[1].Cleanup();
+        displacement.Cleanup();
+        normals.Cleanup();
+    }
+};
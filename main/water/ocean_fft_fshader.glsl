@@ -0,0 +1,39 @@
+#version 410 core
+// one radix-2 pass of an inverse Stockham FFT along the rows or the columns, two complex signals at once.
+// The auto-sort of Stockham needs no bit reversal: log2(size) passes per axis, ping-ponged
+in vec2 uv;
+
+uniform sampler2D spectrum;
+uniform bool horizontal;
+// 2, 4, ... up to the size of the transform
+uniform float subtransformSize;
+
+layout (location = 0) out vec4 color;
+
+const float PI = 3.14159265359f;
+
+vec2 multiplyComplex(in vec2 a, in vec2 b)
+{
+    return vec2(a.x * b.x - a.y * b.y, a.y * b.x + a.x * b.y);
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    int size = textureSize(spectrum, 0).x;
+    float index = float(horizontal ? texel.x : texel.y);
+
+    int evenIndex = int(floor(index / subtransformSize) * (subtransformSize * 0.5f)
+                        + mod(index, subtransformSize * 0.5f));
+    ivec2 even = horizontal ? ivec2(evenIndex, texel.y) : ivec2(texel.x, evenIndex);
+    ivec2 odd = horizontal ? ivec2(evenIndex + size / 2, texel.y) : ivec2(texel.x, evenIndex + size / 2);
+
+    vec4 evenValue = texelFetch(spectrum, even, 0);
+    vec4 oddValue = texelFetch(spectrum, odd, 0);
+
+    float twiddleArgument = 2.0f * PI * (index / subtransformSize);
+    vec2 twiddle = vec2(cos(twiddleArgument), sin(twiddleArgument));
+
+    color = vec4(evenValue.xy + multiplyComplex(twiddle, oddValue.xy),
+                 evenValue.zw + multiplyComplex(twiddle, oddValue.zw));
+}
@@ -0,0 +1,50 @@
+#version 410 core
+// unpacks the transformed surface into the textures the water samples: the displacement of the grid in scene
+// axes, or the normal of the displaced surface with the whitecaps where the choppy displacement folds it
+in vec2 uv;
+
+// h + i Dx in rg, Dy in ba, see ocean_spectrum_fshader.glsl. The rows of the ocean go along -z
+uniform sampler2D surface;
+uniform bool normalPass;
+uniform float patchSize;
+uniform float choppiness;
+
+layout (location = 0) out vec4 color;
+
+// below this Jacobian of the horizontal displacement the surface is about to fold, it foams
+const float FOAM_JACOBIAN = 0.9f;
+const float FOAM_RANGE = 0.3f;
+
+// x and y displacements and height, in the axes of the ocean
+vec3 displacement(in ivec2 texel)
+{
+    int size = textureSize(surface, 0).x;
+    vec4 s = texelFetch(surface, (texel + size) % size, 0);
+    return vec3(choppiness * s.y, s.x, choppiness * s.z);
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (!normalPass) {
+        vec3 d = displacement(texel);
+        color = vec4(d.x, d.y, -d.z, 0.0f);
+        return;
+    }
+
+    float texelSize = patchSize / float(textureSize(surface, 0).x);
+    vec3 left = displacement(texel - ivec2(1, 0));
+    vec3 right = displacement(texel + ivec2(1, 0));
+    vec3 down = displacement(texel - ivec2(0, 1));
+    vec3 up = displacement(texel + ivec2(0, 1));
+
+    // central differences of the displaced surface, (x, height, y)
+    vec3 tangentX = vec3(2.0f * texelSize + right.x - left.x, right.y - left.y, right.z - left.z);
+    vec3 tangentY = vec3(up.x - down.x, up.y - down.y, 2.0f * texelSize + up.z - down.z);
+    vec3 normal = normalize(cross(tangentY, tangentX));
+
+    float jacobian = (tangentX.x * tangentY.z - tangentY.x * tangentX.z) / (4.0f * texelSize * texelSize);
+    float foam = clamp((FOAM_JACOBIAN - jacobian) / FOAM_RANGE, 0.0f, 1.0f);
+
+    color = vec4(normal.x, normal.y, -normal.z, foam);
+}
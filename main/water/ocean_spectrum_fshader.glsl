@@ -0,0 +1,43 @@
+#version 410 core
+// the spectrum of the surface at the given time: each wave vector of the initial spectrum turns at the speed
+// of its deep water dispersion. The choppy horizontal displacements are derived from the heights
+in vec2 uv;
+
+// h0(k) in rg, the conjugate of h0(-k) in ba
+uniform sampler2D initialSpectrum;
+uniform float time;
+uniform float patchSize;
+uniform float gravity;
+
+// h + i Dx in rg, Dy in ba: the inverse transforms of Hermitian spectra are real, two of them share a complex
+layout (location = 0) out vec4 color;
+
+const float PI = 3.14159265359f;
+
+vec2 multiplyComplex(in vec2 a, in vec2 b)
+{
+    return vec2(a.x * b.x - a.y * b.y, a.y * b.x + a.x * b.y);
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    int size = textureSize(initialSpectrum, 0).x;
+    // the usual FFT order: the second half of the indices are the negative frequencies
+    vec2 n = vec2(texel.x < size / 2 ? texel.x : texel.x - size,
+                  texel.y < size / 2 ? texel.y : texel.y - size);
+    vec2 k = 2.0f * PI * n / patchSize;
+    float kLength = length(k);
+
+    vec4 h0 = texelFetch(initialSpectrum, texel, 0);
+    float omega = sqrt(gravity * kLength) * time;
+    vec2 phase = vec2(cos(omega), sin(omega));
+    vec2 h = multiplyComplex(h0.xy, phase) + multiplyComplex(h0.zw, vec2(phase.x, -phase.y));
+
+    // -i k / |k| h
+    vec2 kDir = kLength > 0.0f ? k / kLength : vec2(0.0f);
+    vec2 dx = vec2(h.y, -h.x) * kDir.x;
+    vec2 dy = vec2(h.y, -h.x) * kDir.y;
+
+    color = vec4(h.x - dx.y, h.y + dx.x, dy);
+}
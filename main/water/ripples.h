@@ -0,0 +1,212 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "../framebuffer.h"
+#include "../screenquad/fullscreenquad.h"
+
+struct RipplesProgramIds{
+    GLuint origin_id, extent_id;
+    int unit;
+};
+
+/**
+ * @brief The Ripples class simulates the waves the ship makes, a height field stepped with the wave equation in
+ * ping-pong textures. It covers a window of fixed size around the ship only, so its cost does not depend on the
+ * size of the scene: the window follows the ship in noise positions, which the band shifts of the scene leave
+ * in place, and scrolls its content by whole texels. The water adds its heights to the ocean displacement and
+ * its gradient to the ocean normals.
+ */
+class Ripples {
+
+public:
+    /** texels along each side of the window */
+    static constexpr int SIZE = 256;
+    /** in noise positions, a tile is one */
+    static constexpr float EXTENT = 2.0f;
+
+    /** where the hull pushes the water and by how much it moved since the previous update, see update */
+    struct Disturbance {
+        /** center and half size of the ellipse of the hull, in noise positions */
+        glm::vec2 center;
+        glm::vec2 halfSize;
+        /** height change at the center, and the change of the slope along the noise position axes */
+        float heightChange;
+        glm::vec2 slopeChange;
+    };
+
+private:
+    FullScreenQuad quad;
+    GLuint program_id_;             // GLSL shader program ID
+    GLuint shift_id, hullCenter_id, hullHalfSize_id, hullChange_id;
+
+    ColorFBO state[2];
+    GLuint stateTexture_id_[2];
+    int current = 0;
+
+    // the corner of the window, in texels from the noise position 0
+    glm::ivec2 originTexel {0, 0};
+    bool started = false;
+
+    // the steps have a fixed length, the frames run as many as they need
+    const float stepTime = 1.0f / 60.0f;
+    const int maxStepsPerUpdate = 4;
+    float pendingTime = 0.0f;
+    float lastTime = 0.0f;
+    int stepsLastUpdate = 0;
+    // what the hull did during the updates too short for a step
+    float pendingHeightChange = 0.0f;
+    glm::vec2 pendingSlopeChange {0.0f, 0.0f};
+
+    // scene units per noise position, and the waves per step
+    const float gridSize = 2.0f;
+    const float courant = 0.25f;
+    const float damping = 0.996f;
+    // the hull makes bigger waves than the volume it moves, so that they read in the normals
+    const float hullStrength = 4.0f;
+
+    std::map<GLuint, RipplesProgramIds> programToIds;
+
+    static float texelExtent() {
+        return EXTENT / SIZE;
+    }
+
+public:
+    void Init() {
+        for (int i = 0; i < 2; ++i) {
+            stateTexture_id_[i] = state[i].Init(SIZE, SIZE, GL_RGBA32F, GL_RGBA, GL_FLOAT, true);
+            // calm water, the clear color of the scene stays
+            const GLfloat calm[] = {0.0f, 0.0f, 0.0f, 0.0f};
+            state[i].Bind();
+            glClearBufferfv(GL_COLOR, 0, calm);
+            state[i].Unbind();
+        }
+
+        // compile the shaders
+        program_id_ = icg_helper::LoadShaders("screenquad_vshader.glsl",
+                                              "ripples_fshader.glsl");
+        if(!program_id_) {
+            exit(EXIT_FAILURE);
+        }
+
+        glUseProgram(program_id_);
+
+        quad.registerProgram(program_id_);
+
+        glUniform1i(glGetUniformLocation(program_id_, "state"), 0 /*GL_TEXTURE0*/);
+        glUniform1f(glGetUniformLocation(program_id_, "courant"), courant);
+        glUniform1f(glGetUniformLocation(program_id_, "damping"), damping);
+        glUniform1f(glGetUniformLocation(program_id_, "texelSize"), gridSize * texelExtent());
+        shift_id = glGetUniformLocation(program_id_, "shift");
+        hullCenter_id = glGetUniformLocation(program_id_, "hullCenter");
+        hullHalfSize_id = glGetUniformLocation(program_id_, "hullHalfSize");
+        hullChange_id = glGetUniformLocation(program_id_, "hullChange");
+
+        // to avoid the current object being polluted
+        glUseProgram(0);
+    }
+
+    /**
+     * recenters the window on the hull and runs the steps of the time elapsed, in seconds, since the previous
+     * update. The hull change is spread over the steps. Leaves the default framebuffer bound
+     */
+    void update(float time, const Disturbance &hull) {
+        glm::ivec2 newOriginTexel = glm::ivec2(glm::floor(hull.center / texelExtent())) - glm::ivec2(SIZE / 2);
+        if (!started) {
+            originTexel = newOriginTexel;
+            lastTime = time;
+            started = true;
+        }
+        glm::ivec2 shift = newOriginTexel - originTexel;
+        originTexel = newOriginTexel;
+
+        pendingTime = std::min(pendingTime + time - lastTime, maxStepsPerUpdate * stepTime);
+        lastTime = time;
+        stepsLastUpdate = int(pendingTime / stepTime);
+        pendingTime -= stepsLastUpdate * stepTime;
+        pendingHeightChange += hull.heightChange;
+        pendingSlopeChange += hull.slopeChange;
+        if (stepsLastUpdate == 0) {
+            // the scroll waits for the next step
+            originTexel -= shift;
+            return;
+        }
+
+        glm::vec2 hullCenter = hull.center / texelExtent() - glm::vec2(originTexel);
+        glm::vec2 hullHalfSize = glm::max(hull.halfSize / texelExtent(), glm::vec2(1.0f));
+        glm::vec3 hullChange = hullStrength / stepsLastUpdate
+                * glm::vec3(pendingHeightChange, pendingSlopeChange * texelExtent());
+        pendingHeightChange = 0.0f;
+        pendingSlopeChange = glm::vec2(0.0f);
+
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glUseProgram(program_id_);
+        quad.Bind(program_id_);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform2fv(hullCenter_id, 1, glm::value_ptr(hullCenter));
+        glUniform2fv(hullHalfSize_id, 1, glm::value_ptr(hullHalfSize));
+        glUniform3fv(hullChange_id, 1, glm::value_ptr(hullChange));
+
+        for (int step = 0; step < stepsLastUpdate; ++step) {
+            // the whole scroll in the first step
+            glm::ivec2 stepShift = step == 0 ? shift : glm::ivec2(0);
+            glUniform2i(shift_id, stepShift.x, stepShift.y);
+            state[1 - current].Bind();
+            glBindTexture(GL_TEXTURE_2D, stateTexture_id_[current]);
+            quad.Draw();
+            current = 1 - current;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        state[current].Unbind();
+        glEnable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    /** steps run by the last update, 0 when the frame was shorter than a step */
+    int getStepsLastUpdate() const {
+        return stepsLastUpdate;
+    }
+
+    /** unit: texture unit the program samples the ripples from, see the ripples function of water_fshader.glsl */
+    void registerProgram(GLuint program_id, int unit) {
+        glUseProgram(program_id);
+        glUniform1i(glGetUniformLocation(program_id, "rippleMap"), unit);
+        glUseProgram(0);
+
+        RipplesProgramIds ids;
+        ids.origin_id = glGetUniformLocation(program_id, "rippleOrigin");
+        ids.extent_id = glGetUniformLocation(program_id, "rippleExtent");
+        ids.unit = unit;
+        programToIds[program_id] = ids;
+    }
+
+    void updateProgram(GLuint program_id) {
+        RipplesProgramIds ids = programToIds[program_id];
+        glm::vec2 origin = glm::vec2(originTexel) * texelExtent();
+        glUniform2fv(ids.origin_id, 1, glm::value_ptr(origin));
+        glUniform1f(ids.extent_id, EXTENT);
+
+        glActiveTexture(GL_TEXTURE0 + ids.unit);
+        glBindTexture(GL_TEXTURE_2D, stateTexture_id_[current]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    /** bytes of video memory held by the two states */
+    size_t memoryUsage() const {
+        return 2 * size_t(SIZE) * SIZE * 16;
+    }
+
+    void Cleanup() {
+        glUseProgram(0);
+        quad.Cleanup();
+        glDeleteProgram(program_id_);
+        state[0].Cleanup();
+        state[1].Cleanup();
+    }
+};
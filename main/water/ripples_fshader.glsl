@@ -0,0 +1,60 @@
+#version 410 core
+// one step of the ripples around the ship: the wave equation on a height field, pushed by the hull where it
+// moves and absorbed before the edges of the window
+in vec2 uv;
+
+// height in r, height of the previous step in g, see ripples.h
+uniform sampler2D state;
+// texels the window moved by since the previous step, what leaves it is lost and what enters it is calm
+uniform ivec2 shift;
+// (wave speed * step / texel)^2, below 0.5 for the scheme to stay stable
+uniform float courant;
+uniform float damping;
+// ellipse of the hull and its center, in texels
+uniform vec2 hullCenter;
+uniform vec2 hullHalfSize;
+// height the hull moved by at its center, and the change of its slope per texel along x and y
+uniform vec3 hullChange;
+// in scene units
+uniform float texelSize;
+
+// height, previous height, and the gradient of the height along the scene x and z axes
+layout (location = 0) out vec4 color;
+
+// texels of the absorbing band along the edges
+const float SPONGE = 16.0f;
+
+vec2 fetch(in ivec2 texel)
+{
+    texel += shift;
+    if(any(lessThan(texel, ivec2(0))) || any(greaterThanEqual(texel, textureSize(state, 0)))){
+        return vec2(0.0f);
+    }
+    return texelFetch(state, texel, 0).rg;
+}
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    vec2 center = fetch(texel);
+    float left = fetch(texel - ivec2(1, 0)).r;
+    float right = fetch(texel + ivec2(1, 0)).r;
+    float down = fetch(texel - ivec2(0, 1)).r;
+    float up = fetch(texel + ivec2(0, 1)).r;
+
+    float height = 2.0f * center.r - center.g + courant * (left + right + down + up - 4.0f * center.r);
+    height *= damping;
+
+    // the water under the hull follows it, softened at the waterline
+    vec2 fromHull = gl_FragCoord.xy - hullCenter;
+    float footprint = 1.0f - smoothstep(0.6f, 1.0f, length(fromHull / hullHalfSize));
+    height += footprint * (hullChange.x + dot(hullChange.yz, fromHull));
+
+    vec2 size = vec2(textureSize(state, 0));
+    vec2 edge = min(gl_FragCoord.xy, size - gl_FragCoord.xy) / SPONGE;
+    height *= mix(0.85f, 1.0f, clamp(min(edge.x, edge.y), 0.0f, 1.0f));
+
+    // the rows of the window go along -z. The gradient is the one of the step before, one step late
+    vec2 gradient = vec2(right - left, down - up) / (2.0f * texelSize);
+    color = vec4(height, center.r, gradient);
+}
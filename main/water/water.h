@@ -6,6 +6,10 @@
 #include "../material/material.h"
 #include "../camera/fractionalview.h"
 #include "../utils.h"
+#include "../reflection/planarreflection.h"
+#include "../ssr/screenspacereflection.h"
+#include "ocean.h"
+#include "ripples.h"
 
 class Water: public GridMesh{
 
@@ -13,7 +17,24 @@ class Water: public GridMesh{
     GLuint offset_id;
     GLuint time_id;
     GLuint timeDebug_id;
+    GLuint offsetDebug_id;
     GLuint diffuseMap_id;
+    PlanarReflection* reflection = nullptr;
+    ScreenSpaceReflection* screenSpaceReflection = nullptr;
+    Ocean* ocean = nullptr;
+    Ripples* ripples = nullptr;
+
+    // the projected grid: one draw of a screen-space grid instead of the tiles
+    ProgramIds projectedProgramIds;
+    GLuint projected_vertex_array_id_;
+    GLuint projected_vertex_buffer_object_position_;
+    GLuint projected_vertex_buffer_object_index_;
+    GLuint projected_num_indices_;
+    GLuint inverseMVP_id, cameraPos_id, noiseOrigin_id, maxDistance_id, projectedTime_id;
+
+    /** vertices of the projected grid along each side of the screen */
+    static constexpr int projectedGridWidth = 256;
+    static constexpr int projectedGridHeight = 160;
 
     public:
         Water(){
@@ -30,8 +51,10 @@ class Water: public GridMesh{
                                                   "water_tcshader_debug.glsl",
                                                   "water_teshader_debug.glsl",
                                                   "water_gshader_debug.glsl");
+            projectedProgramIds.program_id = icg_helper::LoadShaders("water_projected_vshader.glsl",
+                                                  "water_fshader.glsl");
 
-            if(!normalProgramIds.program_id || !debugProgramIds.program_id) {
+            if(!normalProgramIds.program_id || !debugProgramIds.program_id || !projectedProgramIds.program_id) {
                 exit(EXIT_FAILURE);
             }
 
@@ -62,16 +85,75 @@ class Water: public GridMesh{
 
             glUseProgram(debugProgramIds.program_id);
             timeDebug_id = glGetUniformLocation(debugProgramIds.program_id, "time");
+            offsetDebug_id = glGetUniformLocation(debugProgramIds.program_id, "offset");
+
+            initProjectedGrid(fogStop, fogLength);
 
             // to avoid the current object being polluted
             glBindVertexArray(0);
             glUseProgram(0);
         }
 
+        /**
+         * atlasTiles: tiles along each side of the height and horizon atlases, atlasOrigin: the tile of the atlas
+         * holding the noise position 0, gridSize: the size of a tile in the coordinates the water is drawn in
+         */
+        void setProjectedGridAtlas(int atlasTiles, int atlasOrigin, float gridSize) {
+            glUseProgram(projectedProgramIds.program_id);
+            glUniform1f(glGetUniformLocation(projectedProgramIds.program_id, "atlasTiles"), atlasTiles);
+            glUniform1f(glGetUniformLocation(projectedProgramIds.program_id, "atlasOrigin"), atlasOrigin);
+            glUniform1f(glGetUniformLocation(projectedProgramIds.program_id, "gridSize"), gridSize);
+            glUseProgram(0);
+        }
+
+        void useLight(Light* l){
+            GridMesh::useLight(l);
+            l->registerProgram(projectedProgramIds.program_id);
+        }
+
+        void useShadowCascades(ShadowCascades* c){
+            GridMesh::useShadowCascades(c);
+            c->registerProgram(projectedProgramIds.program_id, 9);
+        }
+
+        void useHorizonMaps(HorizonMaps* h){
+            GridMesh::useHorizonMaps(h);
+            h->registerProgram(projectedProgramIds.program_id, 10);
+        }
+
+        /** the reflection tells where the mirror map was rendered from */
+        void useReflection(PlanarReflection* r){
+            this->reflection = r;
+            r->registerProgram(normalProgramIds.program_id);
+            r->registerProgram(projectedProgramIds.program_id);
+        }
+
+        /** when enabled, the water traces its reflection in the captured opaque scene instead of the mirror map */
+        void useScreenSpaceReflection(ScreenSpaceReflection* s){
+            this->screenSpaceReflection = s;
+            // the sky takes the first unit of the terrain materials, the water has none
+            s->registerProgram(normalProgramIds.program_id, 11, 12 /*after the moments and the horizon map*/, 5);
+            s->registerProgram(projectedProgramIds.program_id, 11, 12, 5);
+        }
+
+        /** the waves of every tile are sampled from the ocean surface */
+        void useOcean(Ocean* o){
+            this->ocean = o;
+            o->registerProgram(normalProgramIds.program_id, 13, 14 /*after the screen-space reflection*/);
+            o->registerProgram(debugProgramIds.program_id, 13, 14);
+            o->registerProgram(projectedProgramIds.program_id, 13, 14);
+        }
+
+        /** the ship's ripples add to the ocean where they are simulated */
+        void useRipples(Ripples* r){
+            this->ripples = r;
+            r->registerProgram(normalProgramIds.program_id, 15 /*after the ocean*/);
+            r->registerProgram(projectedProgramIds.program_id, 15);
+        }
+
         void Draw(const glm::mat4 &MVP = IDENTITY_MATRIX,
                   const glm::mat4 &MV = IDENTITY_MATRIX,
                   const glm::mat4 &NORMALM = IDENTITY_MATRIX,
-                  const glm::mat4 &SHADOWMVP = IDENTITY_MATRIX,
                   const FractionalView &FV = FractionalView(),
                   const glm::vec2 &offset = glm::vec2(0.0f, 0.0f),
                   const glm::vec2 translation = glm::vec2(0, 0),
@@ -81,14 +163,26 @@ class Water: public GridMesh{
             currentProgramIds = normalProgramIds;
 
             bindHeightMapTexture();
-            glUniformMatrix4fv(normalProgramIds.SHADOWMVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(SHADOWMVP));
             glUniform1f(time_id, glfwGetTime());
             glUniform2fv(offset_id, 1, glm::value_ptr(offset));
             glUniform2fv(currentProgramIds.translationToSceneCenter_id, 1, glm::value_ptr(translationToSceneCenter));
             glUniform2fv(currentProgramIds.translation_id, 1, glm::value_ptr(translation));
+            glUniform1i(currentProgramIds.deferredPass_id, deferredPass);
 
             if(light != nullptr)
                 light->updateProgram(currentProgramIds.program_id);
+            if(shadowCascades != nullptr)
+                shadowCascades->updateProgram(currentProgramIds.program_id);
+            if(horizonMaps != nullptr && light != nullptr)
+                horizonMaps->updateProgram(currentProgramIds.program_id, light->getPos());
+            if(reflection != nullptr)
+                reflection->updateProgram(currentProgramIds.program_id);
+            if(screenSpaceReflection != nullptr)
+                screenSpaceReflection->updateProgram(currentProgramIds.program_id);
+            if(ocean != nullptr)
+                ocean->updateProgram(currentProgramIds.program_id);
+            if(ripples != nullptr)
+                ripples->updateProgram(currentProgramIds.program_id);
 
             activateTextureUnits();
             setupMVP(MVP, MV, NORMALM);
@@ -101,6 +195,9 @@ class Water: public GridMesh{
                 glUseProgram(debugProgramIds.program_id);
                 currentProgramIds = debugProgramIds;
                 glUniform1f(timeDebug_id, glfwGetTime());
+                glUniform2fv(offsetDebug_id, 1, glm::value_ptr(offset));
+                if(ocean != nullptr)
+                    ocean->updateProgram(currentProgramIds.program_id);
                 glUniform2fv(currentProgramIds.translation_id, 1, glm::value_ptr(translation));
                 setupMVP(MVP, MV, NORMALM);
                 setupOffset(FV);
@@ -113,10 +210,131 @@ class Water: public GridMesh{
             glUseProgram(0);
         }
 
+        /**
+         * draws the water of the whole scene at once with the projected grid. The height map and the horizon map
+         * in use are the atlases of every tile, noiseOrigin: the noise position of the tile at the origin,
+         * maxDistance: how far from the camera the grid reaches
+         */
+        void DrawProjected(const glm::mat4 &MVP,
+                           const glm::mat4 &MV,
+                           const glm::mat4 &NORMALM,
+                           const glm::vec2 &noiseOrigin,
+                           const glm::vec2 &translationToSceneCenter,
+                           float maxDistance) {
+
+            glUseProgram(projectedProgramIds.program_id);
+            currentProgramIds = projectedProgramIds;
+
+            glm::mat4 inverseMV = glm::inverse(MV);
+            glUniformMatrix4fv(inverseMVP_id, ONE, DONT_TRANSPOSE, glm::value_ptr(glm::inverse(MVP)));
+            glUniform3fv(cameraPos_id, 1, glm::value_ptr(glm::vec3(inverseMV[3])));
+            glUniform2fv(noiseOrigin_id, 1, glm::value_ptr(noiseOrigin));
+            glUniform1f(maxDistance_id, maxDistance);
+            glUniform1f(projectedTime_id, glfwGetTime());
+            glUniform2fv(currentProgramIds.translationToSceneCenter_id, 1, glm::value_ptr(translationToSceneCenter));
+            glUniform1i(currentProgramIds.deferredPass_id, deferredPass);
+
+            if(light != nullptr)
+                light->updateProgram(currentProgramIds.program_id);
+            if(shadowCascades != nullptr)
+                shadowCascades->updateProgram(currentProgramIds.program_id);
+            if(horizonMaps != nullptr && light != nullptr)
+                horizonMaps->updateProgram(currentProgramIds.program_id, light->getPos());
+            if(reflection != nullptr)
+                reflection->updateProgram(currentProgramIds.program_id);
+            if(screenSpaceReflection != nullptr)
+                screenSpaceReflection->updateProgram(currentProgramIds.program_id);
+            if(ocean != nullptr)
+                ocean->updateProgram(currentProgramIds.program_id);
+            if(ripples != nullptr)
+                ripples->updateProgram(currentProgramIds.program_id);
+
+            activateTextureUnits();
+            setupMVP(MVP, MV, NORMALM);
+
+            glBindVertexArray(projected_vertex_array_id_);
+            glPolygonMode(GL_FRONT_AND_BACK, (wireframeDebugEnabled) ? GL_LINE : GL_FILL);
+            glDrawElements(GL_TRIANGLES, projected_num_indices_, GL_UNSIGNED_INT, 0);
+            glBindVertexArray(0);
+
+            glUseProgram(0);
+        }
+
+        void Cleanup() {
+            GridMesh::Cleanup();
+            glDeleteBuffers(1, &projected_vertex_buffer_object_position_);
+            glDeleteBuffers(1, &projected_vertex_buffer_object_index_);
+            glDeleteVertexArrays(1, &projected_vertex_array_id_);
+            glDeleteProgram(projectedProgramIds.program_id);
+        }
+
         void activateTextureUnits(){
             GridMesh::activateTextureUnits(true);
             glActiveTexture(GL_TEXTURE0 + 4);
             glBindTexture(GL_TEXTURE_2D, diffuseMap_id);
         }
 
+    private:
+        /** the grid in normalized device coordinates, the vertex shader moves it onto the water */
+        void initProjectedGrid(int fogStop, int fogLength) {
+            GLuint pid = projectedProgramIds.program_id;
+            setupLocations(projectedProgramIds);
+            inverseMVP_id = glGetUniformLocation(pid, "inverseMVP");
+            cameraPos_id = glGetUniformLocation(pid, "cameraPos");
+            noiseOrigin_id = glGetUniformLocation(pid, "noiseOrigin");
+            maxDistance_id = glGetUniformLocation(pid, "maxDistance");
+            projectedTime_id = glGetUniformLocation(pid, "time");
+
+            glUniform1f(glGetUniformLocation(pid, "threshold_vpoint_World_F"), fogStop - fogLength);
+            glUniform1f(glGetUniformLocation(pid, "max_vpoint_World_F"), fogStop);
+            glUniform1i(glGetUniformLocation(pid, "clipToTerrain"), true);
+            // the grid is in noise positions already
+            glUniform2f(glGetUniformLocation(pid, "offset"), 0.0f, 0.0f);
+            glUniform1i(projectedProgramIds.heightMap_id, 0);
+            glUniform1i(glGetUniformLocation(pid, "normalMap"), 1);
+            glUniform1i(glGetUniformLocation(pid, "shadowMap"), 2);
+            glUniform1i(glGetUniformLocation(pid, "mirrorMap"), 3);
+            glUniform1i(glGetUniformLocation(pid, "diffuseMap"), 4);
+
+            std::vector<GLfloat> vertices;
+            std::vector<GLuint> indices;
+            for(int j = 0; j < projectedGridHeight; j++){
+                for(int i = 0; i < projectedGridWidth; i++){
+                    vertices.push_back(-1.0f + 2.0f * i / (projectedGridWidth - 1));
+                    vertices.push_back(-1.0f + 2.0f * j / (projectedGridHeight - 1));
+                }
+            }
+            for(int j = 0; j < projectedGridHeight - 1; j++){
+                for(int i = 0; i < projectedGridWidth - 1; i++){
+                    GLuint corner = j * projectedGridWidth + i;
+                    indices.push_back(corner);
+                    indices.push_back(corner + 1);
+                    indices.push_back(corner + projectedGridWidth + 1);
+                    indices.push_back(corner);
+                    indices.push_back(corner + projectedGridWidth + 1);
+                    indices.push_back(corner + projectedGridWidth);
+                }
+            }
+            projected_num_indices_ = indices.size();
+
+            glGenVertexArrays(1, &projected_vertex_array_id_);
+            glBindVertexArray(projected_vertex_array_id_);
+
+            glGenBuffers(1, &projected_vertex_buffer_object_position_);
+            glBindBuffer(GL_ARRAY_BUFFER, projected_vertex_buffer_object_position_);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat),
+                         &vertices[0], GL_STATIC_DRAW);
+
+            glGenBuffers(1, &projected_vertex_buffer_object_index_);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, projected_vertex_buffer_object_index_);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                         &indices[0], GL_STATIC_DRAW);
+
+            GLuint loc_position = glGetAttribLocation(pid, "gridPos");
+            glEnableVertexAttribArray(loc_position);
+            glVertexAttribPointer(loc_position, 2, GL_FLOAT, DONT_NORMALIZE,
+                                  ZERO_STRIDE, ZERO_BUFFER_OFFSET);
+            glBindVertexArray(0);
+        }
+
 };
@@ -2,8 +2,30 @@
 uniform sampler2D diffuseMap;
 uniform sampler2D heightMap;
 uniform sampler2D mirrorMap;
+// mirrored view projection the mirror map was rendered with, it may be from a previous frame
+uniform mat4 mirrorVP;
+
+// screen-space reflections: the opaque scene of this frame and its hierarchical depth replace the mirror map
+uniform bool screenSpaceReflections;
+uniform sampler2D sceneColor;
+// closest window depth of each cell, the finest level at the resolution of the scene
+uniform sampler2D hiZ;
+uniform int hiZLevels;
+uniform mat4 projection;
+
+// the sky, for the reflected rays leaving the screen: the cube map of the dome and its layer, and the sun
+uniform samplerCube skyCube;
+uniform vec3 sunPos;
+uniform vec3 topSkyColor;
+uniform vec3 bottomSkyColor;
+uniform vec3 sunColor;
+uniform float domeGradBottom;
+uniform float domeGradTop;
+uniform float skyRadius;
 uniform sampler2D normalMap;
-uniform sampler2DShadow shadowMap;
+// normal of the ocean patch and its whitecaps in alpha, see ocean.h
+uniform sampler2D oceanNormals;
+uniform float oceanScale;
 uniform mat4 MV;
 uniform mat4 NORMALM;
 uniform vec3 viewPos;
@@ -15,24 +37,28 @@ uniform float threshold_vpoint_World_F;
 
 uniform float time;
 uniform vec2 offset;
+// writes the G-buffer (albedo, normal and material) instead of the lit color
+uniform bool deferredPass;
+// the projected grid covers the land and the water beyond the scene, they are cut here
+uniform bool clipToTerrain;
 
 in float tHeight_F;
 in vec2 uv_F;
-in vec3 normal_F;
-in vec3 normal_MV_F;
+// in the horizon map of the tile, or in the atlas of all of them
+in vec2 horizonUV_F;
 in vec3 vpoint_F;
 in vec3 vpoint_MV_F;
 in vec3 lightDir_F;
 in vec3 viewDir_MV_F;
 in vec4 gl_FragCoord;
-in vec4 shadowCoord_F;
 in vec2 vpoint_World_F;
+in vec4 clipPos_F;
 
 layout (location = 0) out vec4 color;
-layout (location = 1) out vec4 brightColor;
+// the G-buffer normal and material, the forward passes write the HDR color only
+layout (location = 1) out vec4 gNormal;
 
 const vec3 WATER_COLOR = vec3(75.0f,126.0f,157.0f) / 255.0f;
-const vec3 brightnessTreshold = vec3(1.0, 1.0, 1.0);
 const vec3 Y = vec3(0.0f, 1.0f, 0.0f);
 const float cosWaterReflectionAngleStart = 0.20f;
 const float cosWaterReflectionAngleEnd = 0.80f;
@@ -41,6 +67,26 @@ const float waterReflectionDistanceEnd = 10.0f;
 const float rippleNormalWeight = 0.15f;
 const float scumScale = 2.0f;
 
+const int NUM_CASCADES = 4;
+uniform sampler2DArrayShadow shadowMap;
+// to the light space of this frame, xy in world units and z the depth in the maps
+uniform mat4 SHADOWMV;
+// center and usable half side of each map in light space, 1 / its side
+uniform vec4 cascadeArea[NUM_CASCADES];
+// texture coordinates of the light space origin in each map, the maps wrap around
+uniform vec2 cascadeOffset[NUM_CASCADES];
+// light space depth covered by the maps, turns a world space bias into a depth offset
+uniform float shadowDepthRange;
+// blurred and mipmapped exponential variance moments of the maps, see evsm_fshader.glsl
+uniform sampler2DArray shadowMoments;
+// one filtered fetch of the moments, or the rotated PCF of the depth maps
+uniform bool prefilteredShadows;
+
+// sine of the horizon elevation in 4 azimuths, baked per tile, and the weights of the azimuths around the sun
+uniform sampler2D horizonMap;
+uniform vec4 horizonWeights;
+uniform float sunSine;
+
 const int numSamplingPositions = 9;
 uniform vec2 kernel[9] = vec2[9]
 (
@@ -67,6 +113,160 @@ float randomAngle(in vec3 seed, in float freq)
    return random(seed, freq) * 6.283285f;
 }
 
+// the finest map holding the given light space position, NUM_CASCADES outside of all of them
+int selectCascade(in vec2 lightPos)
+{
+    for(int i = 0; i < NUM_CASCADES; i++){
+        if(all(lessThan(abs(lightPos - cascadeArea[i].xy), vec2(cascadeArea[i].z)))){
+            return i;
+        }
+    }
+    return NUM_CASCADES;
+}
+
+// exponents of the warped depth, as in evsm_fshader.glsl
+const float positiveExponent = 5.54f;
+const float negativeExponent = 5.0f;
+
+// upper bound of the lit fraction from the mean and variance of the occluders warped depth
+float chebyshevUpperBound(in vec2 moments, in float mean, in float minVariance)
+{
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = mean - moments.x;
+    // cuts the tail of the bound to reduce light bleeding
+    float pMax = clamp((variance / (variance + d * d) - 0.2f) / 0.8f, 0.0f, 1.0f);
+    return (mean <= moments.x) ? 1.0f : pMax;
+}
+
+// one filtered fetch of the moments, the gradients come from the light space position so that they do not jump
+// where the cascade changes
+float evsmVisibility(in vec3 shadowCoord, in int cascade, in vec2 gradX, in vec2 gradY)
+{
+    vec4 moments = textureGrad(shadowMoments, vec3(shadowCoord.xy, cascade), gradX, gradY);
+    float depth = 2.0f * shadowCoord.z - 1.0f;
+    vec2 warped = vec2(exp(positiveExponent * depth), -exp(-negativeExponent * depth));
+    vec2 minVariance = 0.0001f * vec2(positiveExponent, negativeExponent) * warped;
+    minVariance *= minVariance;
+    return min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x),
+               chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+}
+
+const int SSR_MAX_STEPS = 64;
+// in world units along the reflected ray
+const float SSR_MAX_DISTANCE = 30.0f;
+// a ray behind a surface by more than this passed behind it rather than hitting it
+const float SSR_THICKNESS = 0.3f;
+
+// same as sky_fshader.glsl: the cube map along dir, the sun dimmed by the transmittance of the layer
+vec3 skyColor(in vec3 dir)
+{
+    vec4 sky = texture(skyCube, dir);
+
+    vec3 domePos = skyRadius * dir;
+    float l = length(domePos - sunPos);
+    if(l < 0.30f && domePos.y > -0.5){
+        float domeGrad = smoothstep(domeGradBottom, domeGradTop, domePos.y);
+        vec3 domeColor = mix(bottomSkyColor, topSkyColor, smoothstep(0.0, 1.0, domeGrad));
+        sky.rgb += sky.a * (1.0f - smoothstep(0.05f, 0.30f, l)) * (sunColor - domeColor);
+    }
+    return sky.rgb;
+}
+
+// window coordinates of a view space point
+vec3 toWindow(in vec3 p_MV)
+{
+    vec4 clip = projection * vec4(p_MV, 1.0f);
+    return (clip.xyz / clip.w) * 0.5f + 0.5f;
+}
+
+// distance to the eye plane of a window depth
+float viewDistance(in float depth)
+{
+    return projection[3][2] / ((2.0f * depth - 1.0f) + projection[2][2]);
+}
+
+// marches the ray through the hierarchical depth: the ray climbs to coarser cells while it passes in front of
+// everything they hold and goes down where it may hit. The window depth is linear along the projected ray.
+// Returns the window position of the hit in xy and 1 in z, or z = 0 on a miss
+vec3 traceScreenSpace(in vec3 origin_MV, in vec3 dir_MV)
+{
+    // the ray must stay in front of the eye to be projected
+    float nearDistance = viewDistance(0.0f);
+    float rayLength = SSR_MAX_DISTANCE;
+    if(origin_MV.z + dir_MV.z * rayLength > -nearDistance){
+        rayLength = 0.99f * (-nearDistance - origin_MV.z) / dir_MV.z;
+    }
+    vec3 start = toWindow(origin_MV);
+    vec3 delta = toWindow(origin_MV + dir_MV * rayLength) - start;
+
+    vec2 size = vec2(textureSize(hiZ, 0));
+    // parameter of one texel of the finest level along the ray
+    float texelT = 1.0f / max(max(abs(delta.x) * size.x, abs(delta.y) * size.y), 1.0f);
+    vec2 invDelta = vec2(delta.x != 0.0f ? 1.0f / delta.x : 1e10f, delta.y != 0.0f ? 1.0f / delta.y : 1e10f);
+    vec2 towards = step(0.0f, delta.xy);
+
+    float t = texelT;
+    int level = 0;
+    for(int i = 0; i < SSR_MAX_STEPS && t <= 1.0f; i++){
+        vec3 p = start + delta * t;
+        if(any(lessThan(p.xy, vec2(0.0f))) || any(greaterThan(p.xy, vec2(1.0f)))){
+            break;
+        }
+
+        vec2 cells = vec2(textureSize(hiZ, level));
+        vec2 cell = floor(p.xy * cells);
+        vec2 boundaryT = ((cell + towards) / cells - start.xy) * invDelta;
+        float exitT = min(min(boundaryT.x, boundaryT.y), 1.0f);
+        float closest = texelFetch(hiZ, ivec2(cell), level).r;
+
+        if(max(p.z, start.z + delta.z * exitT) < closest){
+            // in front of everything in the cell
+            t = exitT + 0.01f * texelT;
+            level = min(level + 1, hiZLevels - 1);
+        } else if(level > 0){
+            // it may hit in the cell, not before it reaches the closest depth
+            if(delta.z > 0.0f && p.z < closest){
+                t = max(t, (closest - start.z) / delta.z);
+            }
+            level--;
+        } else if(viewDistance(p.z) - viewDistance(closest) < SSR_THICKNESS){
+            return vec3(p.xy, 1.0f);
+        } else {
+            // behind a thin surface, the ray goes on
+            t = exitT + 0.01f * texelT;
+        }
+    }
+    return vec3(0.0f);
+}
+
+// the reflection of the scene on screen, the sky elsewhere
+vec3 screenSpaceReflection(in vec3 normal_MV)
+{
+    vec3 dir_MV = reflect(normalize(vpoint_MV_F), normal_MV);
+    vec3 sky = skyColor(normalize(transpose(mat3(MV)) * dir_MV));
+
+    vec3 hit = traceScreenSpace(vpoint_MV_F, dir_MV);
+    if(hit.z == 0.0f){
+        return sky;
+    }
+    // no hard cut where the rays leave the screen or turn towards the eye
+    vec2 edge = abs(hit.xy * 2.0f - 1.0f);
+    float confidence = (1.0f - smoothstep(0.85f, 1.0f, max(edge.x, edge.y)))
+                     * (1.0f - smoothstep(0.0f, 0.3f, dir_MV.z));
+    return mix(sky, textureLod(sceneColor, hit.xy, 0.0f).rgb, confidence);
+}
+
+// the water is in the shadow of the terrain where the sun is below the horizon of its tile
+float horizonVisibility(in vec2 uv)
+{
+    float horizonSine = dot(texture(horizonMap, uv), horizonWeights);
+    return smoothstep(horizonSine - 0.05f, horizonSine + 0.05f, sunSine);
+}
+
+#include "gbuffer_normal.glsl"
+
+#include "water_waves.glsl"
+
 //Assume dest is opaque
 vec4 blendColors(in vec4 src, in vec3 dst){
     vec4 v;
@@ -87,14 +287,25 @@ vec4 blendColors(in vec4 src, in vec4 dst){
 }
 
 void main() {
-    vec2 window_size = textureSize(mirrorMap, 0);
+    if(clipToTerrain && (tHeight_F > vpoint_F.y + 0.02f
+                         || max(abs(vpoint_World_F.x), abs(vpoint_World_F.y)) > max_vpoint_World_F)){
+        discard;
+    }
+
+    //The point of the mirror plane below the fragment is its own reflection: its projection in the reflection
+    //pass gives its texel in the mirror map, whatever its resolution and even if it was rendered in a previous frame
+    vec4 mirrorClip = mirrorVP * vec4(vpoint_F.x, 0.0f, vpoint_F.z, 1.0f);
+    vec2 mirrorUV = (mirrorClip.xy / mirrorClip.w) * 0.5f + 0.5f;
     vec3 lightDir = normalize((NORMALM * vec4(light_dir, 1.0)).xyz);
     vec3 viewDir = normalize(viewDir_MV_F);
-    vec3 normal = normalize(normal_F);
-    float _u = gl_FragCoord.x / window_size.x;
-    float _v = 1.0f - gl_FragCoord.y / window_size.y;
+    // flattened over the shallows like the displacement
+    vec4 ocean = texture(oceanNormals, (uv_F + offset) * oceanScale);
+    float shore = shoreAttenuation(tHeight_F);
+    // the ripples of the ship tilt it by their gradient
+    vec2 rippleGradient = ripples(uv_F + offset).ba;
+    vec3 normal = normalize(vec3(shore * ocean.x - rippleGradient.x, ocean.y, shore * ocean.z - rippleGradient.y));
     float valTimeShift = 0.01 * time;
-    float visibility = 0.0f;
+    float visibility = 1.0f;
 
     vec3 rippleNormal =
             texture(normalMap, (uv_F + vec2(0.0, valTimeShift)) * 3.0).rgb * 2.0 - 1.0f
@@ -106,26 +317,43 @@ void main() {
 
     vec3 normal_MV = normalize((NORMALM * vec4(completeNormal, 1.0f)).xyz);
     float cosNL = dot(normal_MV, lightDir);
-    float bias = max(0.05f * (1.0f - cosNL), 0.005f);
+    // in world units, the depth range of the maps turns it into a depth offset
+    float bias = max(0.1f * (1.0f - cosNL), 0.01f);
 
     float fadingValue = smoothstep(threshold_vpoint_World_F, max_vpoint_World_F,
                                   max(abs(vpoint_World_F.x), abs(vpoint_World_F.y))
                                   );
 
-    // generate random rotation angle for each fragment
-    float angle = randomAngle(gl_FragCoord.xyz, 15.0f);
-    float s = sin(angle);
-    float c = cos(angle);
-    float PCFRadius = 1/1000.0f;
-    for(int i=0; i < numSamplingPositions; i++)
-    {
-      // rotate offset
-      vec2 rotatedOffset = vec2(kernel[i].x * c + kernel[i].y * -s, kernel[i].x * s + kernel[i].y * c);
-      vec3 samplingPos = shadowCoord_F.xyz;
-      samplingPos += vec3(rotatedOffset * PCFRadius, -bias);
-      visibility += texture(shadowMap, samplingPos / shadowCoord_F.w);
+    // outside of every map the water is lit
+    vec3 shadowPos = (SHADOWMV * vec4(vpoint_F, 1.0f)).xyz;
+    // derivatives of the light space position, taken before branching
+    vec2 shadowGradX = dFdx(shadowPos.xy);
+    vec2 shadowGradY = dFdy(shadowPos.xy);
+    int cascade = selectCascade(shadowPos.xy);
+    if(!deferredPass && cascade < NUM_CASCADES){
+        vec3 shadowCoord = vec3(shadowPos.xy * cascadeArea[cascade].w + cascadeOffset[cascade], shadowPos.z);
+        float depthBias = bias / shadowDepthRange;
+        if(prefilteredShadows){
+            visibility = evsmVisibility(vec3(shadowCoord.xy, shadowCoord.z - depthBias), cascade,
+                                        shadowGradX * cascadeArea[cascade].w, shadowGradY * cascadeArea[cascade].w);
+        } else {
+            visibility = 0.0f;
+
+            // generate random rotation angle for each fragment
+            float angle = randomAngle(gl_FragCoord.xyz, 15.0f);
+            float s = sin(angle);
+            float c = cos(angle);
+            float PCFRadius = 1/1000.0f;
+            for(int i=0; i < numSamplingPositions; i++)
+            {
+              // rotate offset
+              vec2 rotatedOffset = vec2(kernel[i].x * c + kernel[i].y * -s, kernel[i].x * s + kernel[i].y * c);
+              visibility += texture(shadowMap, vec4(shadowCoord.xy + rotatedOffset * PCFRadius, cascade, shadowCoord.z - depthBias));
+            }
+            visibility /= numSamplingPositions;
+        }
     }
-    visibility /= numSamplingPositions;
+    visibility *= horizonVisibility(horizonUV_F);
     visibility *= 1 - fadingValue;
 
     //Flat normal is the projection of the wave normal onto the mirror surface
@@ -135,9 +363,13 @@ void main() {
     //Compute distortion
     vec2 reflectOffset = normalize(eyeNormal.xy) * length (flatNormal) * rippleNormalWeight;
 
-    vec3 reflection = texture(mirrorMap, vec2(_u, _v) + reflectOffset).rgb;
+    vec3 reflection = (screenSpaceReflections && !deferredPass)
+            ? screenSpaceReflection(normal_MV)
+            : texture(mirrorMap, mirrorUV + reflectOffset).rgb;
 
 
+    // scum on the crests near the shore, whitecaps where the waves fold
+    float scum = max(smoothstep(-0.15, 0.015, tHeight_F) * smoothstep(0.001, 0.006, vpoint_F.y), min(shore * ocean.a, 1.0f));
     vec4 scumColor = texture(diffuseMap, (uv_F + vec2(0.0f, valTimeShift)) * scumScale).rgba;
     vec3 lightingResult = reflection * La;
     vec3 lightingResultScum =  scumColor.rgb * 2.0 * La;
@@ -161,16 +393,18 @@ void main() {
                                 1.0 - smoothstep(waterReflectionDistanceStart, waterReflectionDistanceEnd, -vpoint_MV_F.z))
                                 );
 
+    // water material: the reflection is the albedo, its alpha blends it over the sea bed albedo
+    if (deferredPass) {
+        vec4 seaAlbedo = vec4(reflection, reflectionAlpha);
+        vec4 scumAlbedo = blendColors(vec4(2.0 * scumColor.rgb, scumColor.a), seaAlbedo);
+        color = mix(seaAlbedo, scumAlbedo, scum);
+        // the water specular is constant, the horizon visibility takes its place
+        gNormal = vec4(encodeNormal(normal_MV), horizonVisibility(horizonUV_F), 2.0f / 3.0f);
+        return;
+    }
+
     vec4 seaColor = vec4(lightingResult, reflectionAlpha);
     vec4 tmpColor = blendColors(vec4(lightingResultScum, scumColor.a), seaColor);
-    color = mix(seaColor, tmpColor, smoothstep(-0.15, 0.015, tHeight_F) * smoothstep(0.001, 0.006, vpoint_F.y));
-
-    // compute tranparency factor for a fog-effect
-    color.a *= 1 - fadingValue;
-
-    float brightness = dot(color.rgb, brightnessTreshold);
-
-    brightColor = mix(vec4(0.0, 0.0, 0.0, color.a), vec4(color), smoothstep(1.5, 6.0, brightness));
-    brightColor.a = color.a;
-
+    // alpha is the transmittance over the sea bed only, the fog pass fades the water into the sky
+    color = mix(seaColor, tmpColor, scum);
 }
@@ -0,0 +1,89 @@
+#version 410 core
+
+// the projected grid: a fixed grid of the screen whose vertices are moved along their camera ray to the water
+// plane, so that the vertices are spread evenly on screen instead of evenly in the world like the tiles
+
+uniform mat4 MVP;
+uniform mat4 MV;
+// from clip space back to the coordinates the water is drawn in
+uniform mat4 inverseMVP;
+uniform vec3 cameraPos;
+// the rays that do not reach the plane, and the hits beyond the scene, stop at this horizontal distance
+uniform float maxDistance;
+
+uniform vec3 lightPos;
+// the heights of every tile side by side in one texture, in the storage order of the tiles, see large_scene.h
+uniform sampler2D heightMap;
+// noise position of the tile at the origin of the coordinates the water is drawn in
+uniform vec2 noiseOrigin;
+uniform float gridSize;
+// tiles of the atlas along each side, and the one holding the noise position 0
+uniform float atlasTiles;
+uniform float atlasOrigin;
+uniform vec2 translationToSceneCenter;
+
+// the surface of the ocean patch, repeated over the tiles, see ocean.h
+uniform sampler2D oceanDisplacement;
+uniform float oceanScale;
+
+in vec2 gridPos;
+
+out float tHeight_F;
+out vec2 uv_F;
+out vec2 horizonUV_F;
+out vec3 vpoint_F;
+out vec3 vpoint_MV_F;
+out vec3 lightDir_F;
+out vec3 viewDir_MV_F;
+out vec2 vpoint_World_F;
+out vec4 clipPos_F;
+
+const float waterHeight = 0.0f;
+// the grid overlaps the screen edges, the displaced vertices must not uncover them
+const float screenMargin = 1.05f;
+
+#include "water_waves.glsl"
+
+vec3 unproject(in vec2 ndc, in float depth)
+{
+    vec4 p = inverseMVP * vec4(ndc, depth, 1.0f);
+    return p.xyz / p.w;
+}
+
+void main() {
+    vec2 ndc = gridPos * screenMargin;
+    vec3 dir = unproject(ndc, 1.0f) - unproject(ndc, -1.0f);
+
+    // the ray hits the plane if it goes towards it, from above or from below
+    vec3 p;
+    float toPlane = waterHeight - cameraPos.y;
+    if(dir.y * toPlane > 0.0f){
+        p = cameraPos + dir * (toPlane / dir.y);
+    } else {
+        p = cameraPos + normalize(vec3(dir.x + 1e-6f, 0.0f, dir.z)) * maxDistance;
+    }
+    vec2 horizontal = p.xz - cameraPos.xz;
+    float reach = length(horizontal);
+    if(reach > maxDistance){
+        p.xz = cameraPos.xz + horizontal * (maxDistance / reach);
+    }
+    vpoint_F = vec3(p.x, waterHeight, p.z);
+
+    // the noise position of the point, the same coordinates as uv + offset on a tile
+    uv_F = vec2(vpoint_F.x, -vpoint_F.z) / gridSize + 0.5f + noiseOrigin;
+    horizonUV_F = (uv_F + atlasOrigin) / atlasTiles;
+    tHeight_F = textureLod(heightMap, horizonUV_F, 0.0f).r;
+    vpoint_World_F = vec2(vpoint_F.x, -vpoint_F.z) + translationToSceneCenter;
+
+    vec3 displacement = textureLod(oceanDisplacement, uv_F * oceanScale, 0.0f).xyz;
+    vpoint_F += shoreAttenuation(tHeight_F) * displacement;
+    vpoint_F.y += ripples(uv_F).r;
+
+    vec4 vpoint_MV = MV * vec4(vpoint_F, 1.0f);
+    lightDir_F = normalize((MV * vec4(lightPos, 1.0f)).xyz - vpoint_MV.xyz);
+    viewDir_MV_F = -normalize(vpoint_MV.xyz);
+    vpoint_MV_F = vpoint_MV.xyz;
+
+    gl_Position = MVP * vec4(vpoint_F, 1.0f);
+    clipPos_F = gl_Position;
+}
@@ -5,7 +5,6 @@ layout(quads, fractional_even_spacing, ccw) in;
 uniform mat4 MVP;
 uniform mat4 MV;
 uniform mat4 NORMALM;
-uniform mat4 SHADOWMVP;
 
 uniform vec2 translation;
 uniform vec2 offset;
@@ -13,8 +12,9 @@ uniform vec3 lightPos;
 uniform sampler2D normalMap;
 uniform sampler2D heightMap;
 uniform sampler2D mirrorTexture;
-
-uniform float time;
+// the surface of the ocean patch, repeated over the tiles, see ocean.h
+uniform sampler2D oceanDisplacement;
+uniform float oceanScale;
 
 in vec3 vpoint_TE[];
 in vec2 uv_TE[];
@@ -24,27 +24,17 @@ in vec2 vpoint_World_TE[];
 
 out float tHeight_F;
 out vec2 uv_F;
+// the horizon map is the tile's own
+out vec2 horizonUV_F;
 out vec2 reflectOffset_F;
 out vec3 vpoint_F;
 out vec3 vpoint_MV_F;
-out vec3 normal_F;
-out vec3 normal_MV_F;
 out vec3 lightDir_F;
 out vec3 viewDir_MV_F;
-out vec4 shadowCoord_F;
 out vec2 vpoint_World_F;
+out vec4 clipPos_F;
 
-const float DEGTORAD = 3.14159265359f / 180.0f;
-const vec3 Y = vec3(0.0, 1.0f, 0.0f);
-
-float freqs[5] = float[5](1.0f, 3.0f, 11.0f, 21.0f, 23.0f);
-float amps[5] =  float[5](0.02f, 0.015f, 0.0085f, 0.006f, 0.004f);
-float phis[5] = float[5](0.8f, 1.0f, 1.2f, 1.4f, 2.1f);
-vec2 dirs[5] = vec2[5](vec2(0.0f,1.0f),vec2(0.5f, 1.0f),vec2(0.3f, 1.0f),vec2(0.4f, 1.0f),vec2(-0.2f, 1.0f));
-int exps[5] = int[5](1, 2, 2, 2, 3);
-float sinWave[5] = float[5](0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-float ddx[5] = float[5](0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-float ddy[5] = float[5](0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+#include "water_waves.glsl"
 
 float interpolate2D(in float v0, in float v1, in float v2, in float v3)
 {
@@ -72,57 +62,24 @@ vec3 interpolate3D(in vec3 v0, in vec3 v1, in vec3 v2, in vec3 v3)
 
 void main()
 {
-
-    for(int i = 0; i < 5; i++){
-        dirs[i] = normalize(dirs[i]);
-        amps[i] *= 1.5f;
-    }
-
     // Interpolate the attributes of the output vertex using the barycentric coordinates
     uv_F = interpolate2D(uv_TE[0], uv_TE[1], uv_TE[2], uv_TE[3]);
+    horizonUV_F = uv_F;
     tHeight_F = interpolate2D(terrainHeight_TE[0], terrainHeight_TE[1], terrainHeight_TE[2], terrainHeight_TE[3]);
-    vec2 tGradient = interpolate2D(terrainGradient_TE[0], terrainGradient_TE[1], terrainGradient_TE[2], terrainGradient_TE[3]);
     vpoint_F = interpolate3D(vpoint_TE[0], vpoint_TE[1], vpoint_TE[2], vpoint_TE[3]);
     vpoint_World_F = interpolate2D(vpoint_World_TE[0], vpoint_World_TE[1], vpoint_World_TE[2], vpoint_World_TE[3]);
 
-    vec2 uvWithOffset = uv_F + offset;
-
-    for(int i = 0; i < 5; i++){
-
-        amps[i] *=
-                1.3 - 1.0 *(
-                exp(-pow(5.0 * clamp(tHeight_F, -0.5, 0.0), 2.0)));
-
-        float waveParam = (dot(dirs[i], uvWithOffset) * freqs[i]) + (phis[i] * time);
-
-        //Bring sin in [0,1] for later exponentiation
-        float sinTmp = (sin(waveParam) + 1.0f)/2.0f;
-
-        //First sin^k, then bring back to [-1, 1] and multiply by amplitude
-        sinWave[i] = amps[i] * pow(sinTmp, exps[i]);
-
-        //Compute derivate of the wave
-        float commonPartialDerivative = exps[i]  * freqs[i] * amps[i] * pow(sinTmp, exps[i] - 1.0f) * cos(waveParam);
-        ddx[i] = dirs[i].x * commonPartialDerivative;
-        ddy[i] = dirs[i].y * commonPartialDerivative;
-    }
-
-    vec3 waveNormal = vec3(0.0f);
-    for(int i = 0; i < 5; i++){
-        vpoint_F.y += sinWave[i];
-        waveNormal += vec3(-ddx[i], 1.0f, -ddy[i]);
-    }
-
-    waveNormal = normalize(waveNormal);
-    normal_F = waveNormal;
+    // one fetch of the displacement, the normal is sampled per fragment
+    vec3 displacement = textureLod(oceanDisplacement, (uv_F + offset) * oceanScale, 0.0f).xyz;
+    vpoint_F += shoreAttenuation(tHeight_F) * displacement;
+    vpoint_F.y += ripples(uv_F + offset).r;
 
     vec4 vpoint_MV = MV * vec4(vpoint_F, 1.0f);
     // Lighting
-    normal_MV_F = normalize((NORMALM * vec4(waveNormal, 1.0f)).xyz);
     lightDir_F = normalize((MV * vec4(lightPos, 1.0f)).xyz - vpoint_MV.xyz);
     viewDir_MV_F = -normalize(vpoint_MV.xyz);
     vpoint_MV_F = vpoint_MV.xyz;
 
     gl_Position = MVP * vec4(vpoint_F, 1.0f);
-    shadowCoord_F = SHADOWMVP * vec4(vpoint_F, 1.0f);
+    clipPos_F = gl_Position;
 }
@@ -0,0 +1,23 @@
+// included by the water shaders and the wave probe, the waves they displace and shade must agree
+
+// the height of the ship's ripples in r, their gradient in ba, over a window of noise positions
+uniform sampler2D rippleMap;
+uniform vec2 rippleOrigin;
+uniform float rippleExtent;
+
+// the waves calm down over the shallows
+float shoreAttenuation(in float terrainHeight)
+{
+    float depth = 5.0f * clamp(terrainHeight, -0.5f, 0.0f);
+    return 1.3f - exp(-depth * depth);
+}
+
+// the ripples of the window around the ship, calm water outside of it, see ripples.h
+vec4 ripples(in vec2 noisePosition)
+{
+    vec2 rippleUV = (noisePosition - rippleOrigin) / rippleExtent;
+    if(rippleExtent <= 0.0f || any(lessThan(rippleUV, vec2(0.0f))) || any(greaterThan(rippleUV, vec2(1.0f)))){
+        return vec4(0.0f);
+    }
+    return textureLod(rippleMap, rippleUV, 0.0f);
+}
@@ -0,0 +1,8 @@
+#version 410 core
+in vec3 displacement_F;
+
+layout (location = 0) out vec4 color;
+
+void main() {
+    color = vec4(displacement_F, 1.0f);
+}
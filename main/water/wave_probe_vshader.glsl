@@ -0,0 +1,27 @@
+#version 410 core
+// the displacement of the water at the given points, as water_projected_vshader.glsl computes it, each point
+// drawn into its own pixel of a one row target so that the CPU evaluation can be compared with it
+
+// x and z in scene coordinates
+in vec2 position;
+
+uniform int count;
+uniform sampler2D heightMap;
+uniform vec2 noiseOrigin;
+uniform float gridSize;
+uniform float atlasTiles;
+uniform float atlasOrigin;
+uniform sampler2D oceanDisplacement;
+uniform float oceanScale;
+
+out vec3 displacement_F;
+
+#include "water_waves.glsl"
+
+void main() {
+    vec2 uv = vec2(position.x, -position.y) / gridSize + 0.5f + noiseOrigin;
+    float terrainHeight = textureLod(heightMap, (uv + atlasOrigin) / atlasTiles, 0.0f).r;
+    displacement_F = shoreAttenuation(terrainHeight) * textureLod(oceanDisplacement, uv * oceanScale, 0.0f).xyz;
+
+    gl_Position = vec4(2.0f * (float(gl_VertexID) + 0.5f) / float(count) - 1.0f, 0.0f, 0.0f, 1.0f);
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <vector>
+#include "icg_helper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include "../framebuffer.h"
+#include "ocean.h"
+
+/**
+ * @brief The WaveProbe class evaluates the water displacement at given points on the GPU, with the sampling of
+ * the water shaders, and reads it back: the reference the CPU evaluation of the WaveSampler is checked against.
+ * It waits for the GPU, it is a check and not a per frame query.
+ */
+class WaveProbe {
+
+    private:
+        GLuint vertex_array_id_;        // vertex array object
+        GLuint program_id_;             // GLSL shader program ID
+        GLuint vertex_buffer_object_;   // memory buffer
+        GLuint count_id, noiseOrigin_id;
+
+        ColorFBO target;
+        int capacity;
+        Ocean* ocean = nullptr;
+
+    public:
+        /** capacity: points evaluated at most per call, the arguments of WaveSampler::Init for the rest */
+        void Init(int capacity, Ocean* ocean, float gridSize, int atlasTiles, int atlasOrigin) {
+            this->capacity = capacity;
+            this->ocean = ocean;
+            target.Init(capacity, 1, GL_RGBA32F, GL_RGBA, GL_FLOAT, false);
+
+            // compile the shaders
+            program_id_ = icg_helper::LoadShaders("wave_probe_vshader.glsl",
+                                                  "wave_probe_fshader.glsl");
+            if(!program_id_) {
+                exit(EXIT_FAILURE);
+            }
+
+            glUseProgram(program_id_);
+
+            glGenVertexArrays(1, &vertex_array_id_);
+            glBindVertexArray(vertex_array_id_);
+
+            // the points, filled by each call
+            {
+                glGenBuffers(1, &vertex_buffer_object_);
+                glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+                glBufferData(GL_ARRAY_BUFFER, capacity * 2 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+
+                GLuint position_id = glGetAttribLocation(program_id_, "position");
+                glEnableVertexAttribArray(position_id);
+                glVertexAttribPointer(position_id, 2, GL_FLOAT, DONT_NORMALIZE,
+                                      ZERO_STRIDE, ZERO_BUFFER_OFFSET);
+            }
+
+            glUniform1i(glGetUniformLocation(program_id_, "heightMap"), 0 /*GL_TEXTURE0*/);
+            glUniform1f(glGetUniformLocation(program_id_, "gridSize"), gridSize);
+            glUniform1f(glGetUniformLocation(program_id_, "atlasTiles"), atlasTiles);
+            glUniform1f(glGetUniformLocation(program_id_, "atlasOrigin"), atlasOrigin);
+            count_id = glGetUniformLocation(program_id_, "count");
+            noiseOrigin_id = glGetUniformLocation(program_id_, "noiseOrigin");
+            ocean->registerProgram(program_id_, 1, 2 /*after the height atlas*/);
+
+            // to avoid the current object being polluted
+            glBindVertexArray(0);
+            glUseProgram(0);
+        }
+
+        /**
+         * the displacement at the scene positions (x[i], 0, z[i]) for i in [0, count[, count at most the capacity.
+         * heightAtlas: the terrain heights the water is attenuated by. Leaves the default framebuffer bound
+         */
+        void Evaluate(GLuint heightAtlas, const glm::vec2 &noiseOrigin, int count,
+                      const float* x, const float* z, float* dx, float* dy, float* dz) {
+            std::vector<GLfloat> points(2 * count);
+            for (int i = 0; i < count; ++i) {
+                points[2 * i] = x[i];
+                points[2 * i + 1] = z[i];
+            }
+            glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_object_);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, points.size() * sizeof(GLfloat), &points[0]);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            target.Bind();
+            glDisable(GL_DEPTH_TEST);
+            glDisable(GL_BLEND);
+            glUseProgram(program_id_);
+            glBindVertexArray(vertex_array_id_);
+            glUniform1i(count_id, capacity);
+            glUniform2fv(noiseOrigin_id, 1, glm::value_ptr(noiseOrigin));
+            ocean->updateProgram(program_id_);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, heightAtlas);
+            glDrawArrays(GL_POINTS, 0, count);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glBindVertexArray(0);
+            glUseProgram(0);
+            glEnable(GL_BLEND);
+            glEnable(GL_DEPTH_TEST);
+
+            std::vector<GLfloat> texels(4 * count);
+            target.ReadColor(0, 0, count, 1, GL_RGBA, GL_FLOAT, &texels[0]);
+            for (int i = 0; i < count; ++i) {
+                dx[i] = texels[4 * i];
+                dy[i] = texels[4 * i + 1];
+                dz[i] = texels[4 * i + 2];
+            }
+        }
+
+        void Cleanup() {
+            glBindVertexArray(0);
+            glUseProgram(0);
+            glDeleteBuffers(1, &vertex_buffer_object_);
+            glDeleteProgram(program_id_);
+            glDeleteVertexArrays(1, &vertex_array_id_);
+            target.Cleanup();
+        }
+};
@@ -0,0 +1,333 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <glm/glm.hpp>
+
+// four lanes: SSE2 is part of every x86-64 target, NEON of every 64-bit ARM one
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WAVE_SAMPLER_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define WAVE_SAMPLER_NEON
+#endif
+
+/**
+ * @brief A SampledField is a texture read back to the CPU: channels planes of width x height floats,
+ * the rows from the bottom of the texture like glReadPixels returns them. It repeats like GL_REPEAT.
+ */
+struct SampledField {
+    int width = 0, height = 0, channels = 0;
+    std::vector<float> values;
+
+    void resize(int width, int height, int channels) {
+        this->width = width;
+        this->height = height;
+        this->channels = channels;
+        values.assign(size_t(width) * height * channels, 0.0f);
+    }
+
+    /** the plane of the given channel */
+    float* plane(int channel) {
+        return &values[size_t(channel) * width * height];
+    }
+
+    const float* plane(int channel) const {
+        return &values[size_t(channel) * width * height];
+    }
+
+    bool empty() const {
+        return values.empty();
+    }
+};
+
+namespace wavesimd {
+
+#if defined(WAVE_SAMPLER_SSE2)
+    struct Float4 { __m128 v; };
+    inline Float4 splat(float a) { return {_mm_set1_ps(a)}; }
+    inline Float4 load(const float* p) { return {_mm_loadu_ps(p)}; }
+    inline void store(float* p, Float4 a) { _mm_storeu_ps(p, a.v); }
+    inline Float4 operator+(Float4 a, Float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+    inline Float4 operator-(Float4 a, Float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+    inline Float4 operator*(Float4 a, Float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+    inline Float4 min(Float4 a, Float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+    inline Float4 max(Float4 a, Float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+    /** b where a < limit, 0 elsewhere */
+    inline Float4 selectLess(Float4 a, Float4 limit, Float4 b) { return {_mm_and_ps(_mm_cmplt_ps(a.v, limit.v), b.v)}; }
+    inline Float4 floor(Float4 a) {
+        Float4 truncated = {_mm_cvtepi32_ps(_mm_cvttps_epi32(a.v))};
+        // truncation rounds the negative values up
+        return truncated - Float4{_mm_and_ps(_mm_cmpgt_ps(truncated.v, a.v), _mm_set1_ps(1.0f))};
+    }
+    /** 2^n for the integers n in [-126, 127] */
+    inline Float4 exp2Integer(Float4 n) {
+        __m128i biased = _mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127));
+        return {_mm_castsi128_ps(_mm_slli_epi32(biased, 23))};
+    }
+    inline void toIndices(Float4 a, int* indices) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(indices), _mm_cvttps_epi32(a.v));
+    }
+#elif defined(WAVE_SAMPLER_NEON)
+    struct Float4 { float32x4_t v; };
+    inline Float4 splat(float a) { return {vdupq_n_f32(a)}; }
+    inline Float4 load(const float* p) { return {vld1q_f32(p)}; }
+    inline void store(float* p, Float4 a) { vst1q_f32(p, a.v); }
+    inline Float4 operator+(Float4 a, Float4 b) { return {vaddq_f32(a.v, b.v)}; }
+    inline Float4 operator-(Float4 a, Float4 b) { return {vsubq_f32(a.v, b.v)}; }
+    inline Float4 operator*(Float4 a, Float4 b) { return {vmulq_f32(a.v, b.v)}; }
+    inline Float4 min(Float4 a, Float4 b) { return {vminq_f32(a.v, b.v)}; }
+    inline Float4 max(Float4 a, Float4 b) { return {vmaxq_f32(a.v, b.v)}; }
+    inline Float4 selectLess(Float4 a, Float4 limit, Float4 b) {
+        return {vreinterpretq_f32_u32(vandq_u32(vcltq_f32(a.v, limit.v), vreinterpretq_u32_f32(b.v)))};
+    }
+    inline Float4 floor(Float4 a) {
+        Float4 truncated = {vcvtq_f32_s32(vcvtq_s32_f32(a.v))};
+        return truncated - Float4{vreinterpretq_f32_u32(vandq_u32(vcgtq_f32(truncated.v, a.v),
+                                                                  vreinterpretq_u32_f32(vdupq_n_f32(1.0f))))};
+    }
+    inline Float4 exp2Integer(Float4 n) {
+        int32x4_t biased = vaddq_s32(vcvtq_s32_f32(n.v), vdupq_n_s32(127));
+        return {vreinterpretq_f32_s32(vshlq_n_s32(biased, 23))};
+    }
+    inline void toIndices(Float4 a, int* indices) {
+        vst1q_s32(indices, vcvtq_s32_f32(a.v));
+    }
+#else
+    struct Float4 { float v[4]; };
+    inline Float4 splat(float a) { return {{a, a, a, a}}; }
+    inline Float4 load(const float* p) { return {{p[0], p[1], p[2], p[3]}}; }
+    inline void store(float* p, Float4 a) { for (int l = 0; l < 4; ++l) p[l] = a.v[l]; }
+    inline Float4 operator+(Float4 a, Float4 b) { for (int l = 0; l < 4; ++l) a.v[l] += b.v[l]; return a; }
+    inline Float4 operator-(Float4 a, Float4 b) { for (int l = 0; l < 4; ++l) a.v[l] -= b.v[l]; return a; }
+    inline Float4 operator*(Float4 a, Float4 b) { for (int l = 0; l < 4; ++l) a.v[l] *= b.v[l]; return a; }
+    inline Float4 min(Float4 a, Float4 b) { for (int l = 0; l < 4; ++l) a.v[l] = std::min(a.v[l], b.v[l]); return a; }
+    inline Float4 max(Float4 a, Float4 b) { for (int l = 0; l < 4; ++l) a.v[l] = std::max(a.v[l], b.v[l]); return a; }
+    inline Float4 selectLess(Float4 a, Float4 limit, Float4 b) {
+        for (int l = 0; l < 4; ++l) a.v[l] = a.v[l] < limit.v[l] ? b.v[l] : 0.0f;
+        return a;
+    }
+    inline Float4 floor(Float4 a) { for (int l = 0; l < 4; ++l) a.v[l] = std::floor(a.v[l]); return a; }
+    inline Float4 exp2Integer(Float4 n) { for (int l = 0; l < 4; ++l) n.v[l] = std::ldexp(1.0f, int(n.v[l])); return n; }
+    inline void toIndices(Float4 a, int* indices) { for (int l = 0; l < 4; ++l) indices[l] = int(a.v[l]); }
+#endif
+
+    /** e^-x for x in [0, 87], within 2e-6 relative */
+    inline Float4 expNegative(Float4 x) {
+        Float4 y = splat(0.0f) - x * splat(1.44269504f);
+        Float4 n = floor(y);
+        Float4 f = y - n;
+        // Taylor series of 2^f on [0, 1[
+        Float4 p = splat(1.52527e-5f);
+        p = p * f + splat(1.54035e-4f);
+        p = p * f + splat(1.33336e-3f);
+        p = p * f + splat(9.61813e-3f);
+        p = p * f + splat(5.55041e-2f);
+        p = p * f + splat(2.40227e-1f);
+        p = p * f + splat(6.93147e-1f);
+        p = p * f + splat(1.0f);
+        return p * exp2Integer(n);
+    }
+
+    /**
+     * bilinear filtering of the channels [0, channels[ of the field at the texture coordinates (u, v), like
+     * the GL_LINEAR and GL_REPEAT sampling of the texture it was read back from
+     */
+    inline void bilinear(const SampledField& field, int channels, Float4 u, Float4 v, Float4* result) {
+        Float4 width = splat(float(field.width)), height = splat(float(field.height));
+        Float4 s = (u - floor(u)) * width - splat(0.5f);
+        Float4 t = (v - floor(v)) * height - splat(0.5f);
+        Float4 s0 = floor(s), t0 = floor(t);
+        Float4 fs = s - s0, ft = t - t0;
+
+        // the texels on both sides, wrapped around
+        s0 = s0 + selectLess(s0, splat(0.0f), width);
+        t0 = t0 + selectLess(t0, splat(0.0f), height);
+        Float4 s1 = s0 + splat(1.0f);
+        Float4 t1 = t0 + splat(1.0f);
+        s1 = s1 - (width - selectLess(s1, width, width));
+        t1 = t1 - (height - selectLess(t1, height, height));
+
+        int i00[4], i10[4], i01[4], i11[4];
+        toIndices(t0 * width + s0, i00);
+        toIndices(t0 * width + s1, i10);
+        toIndices(t1 * width + s0, i01);
+        toIndices(t1 * width + s1, i11);
+
+        for (int c = 0; c < channels; ++c) {
+            const float* p = field.plane(c);
+            // no gather below AVX2, the taps are loaded one by one
+            float v00[4], v10[4], v01[4], v11[4];
+            for (int l = 0; l < 4; ++l) {
+                v00[l] = p[i00[l]];
+                v10[l] = p[i10[l]];
+                v01[l] = p[i01[l]];
+                v11[l] = p[i11[l]];
+            }
+            Float4 bottom = load(v00) + fs * (load(v10) - load(v00));
+            Float4 top = load(v01) + fs * (load(v11) - load(v01));
+            result[c] = bottom + ft * (top - bottom);
+        }
+    }
+}
+
+/**
+ * @brief The WaveSampler class evaluates the displacement of the water surface on the CPU, the same way the
+ * water shaders do: the ocean displacement read back from the GPU, calmed down over the shallows by the height
+ * of the terrain below. It takes batches of points, four at a time, so that the ship and whatever floats can
+ * ask for thousands of them per frame. The ship's ripples (ripples in water_waves.glsl) are not part of it,
+ * the ship is what makes them.
+ */
+class WaveSampler {
+
+    /** the ocean displacement in scene axes, see ocean.h */
+    const SampledField* surface = nullptr;
+    /** the heights of every tile side by side, see the atlases of large_scene.h */
+    const SampledField* terrain = nullptr;
+
+    float gridSize = 2.0f;
+    float surfaceScale = 1.0f;
+    float atlasTiles = 1.0f;
+    float atlasOrigin = 0.0f;
+    glm::vec2 noiseOrigin {0.0f, 0.0f};
+
+public:
+    /** as the uniforms of water_projected_vshader.glsl, surfaceScale is oceanScale */
+    void Init(float gridSize, float surfaceScale, int atlasTiles, int atlasOrigin) {
+        this->gridSize = gridSize;
+        this->surfaceScale = surfaceScale;
+        this->atlasTiles = float(atlasTiles);
+        this->atlasOrigin = float(atlasOrigin);
+    }
+
+    void useFields(const SampledField* surface, const SampledField* terrain) {
+        this->surface = surface;
+        this->terrain = terrain;
+    }
+
+    /** the noise position of the tile at the origin of the scene coordinates, it moves with each band shift */
+    void setNoiseOrigin(const glm::vec2 &noiseOrigin) {
+        this->noiseOrigin = noiseOrigin;
+    }
+
+    /** false until the first surface reached the CPU */
+    bool isReady() const {
+        return surface != nullptr && terrain != nullptr && !surface->empty() && !terrain->empty();
+    }
+
+    /**
+     * the displacement of the water at the scene positions (x[i], 0, z[i]), for i in [0, count[.
+     * Every array holds count floats. Four points at a time, the remainder one by one
+     */
+    void evaluate(int count, const float* x, const float* z, float* dx, float* dy, float* dz) const {
+        using namespace wavesimd;
+        if (!isReady()) {
+            for (int i = 0; i < count; ++i) {
+                dx[i] = dy[i] = dz[i] = 0.0f;
+            }
+            return;
+        }
+
+        const Float4 invGridSize = splat(1.0f / gridSize);
+        const Float4 originU = splat(0.5f + noiseOrigin.x), originV = splat(0.5f + noiseOrigin.y);
+        const Float4 atlasOffset = splat(atlasOrigin), invAtlasTiles = splat(1.0f / atlasTiles);
+        const Float4 scale = splat(surfaceScale);
+
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            // noise position of the points, uv_F of the shaders
+            Float4 u = load(x + i) * invGridSize + originU;
+            Float4 v = originV - load(z + i) * invGridSize;
+
+            Float4 terrainHeight;
+            bilinear(*terrain, 1, (u + atlasOffset) * invAtlasTiles, (v + atlasOffset) * invAtlasTiles, &terrainHeight);
+            Float4 depth = splat(5.0f) * min(max(terrainHeight, splat(-0.5f)), splat(0.0f));
+            Float4 attenuation = splat(1.3f) - expNegative(depth * depth);
+
+            Float4 displacement[3];
+            bilinear(*surface, 3, u * scale, v * scale, displacement);
+            store(dx + i, attenuation * displacement[0]);
+            store(dy + i, attenuation * displacement[1]);
+            store(dz + i, attenuation * displacement[2]);
+        }
+        for (; i < count; ++i) {
+            evaluateReference(1, x + i, z + i, dx + i, dy + i, dz + i);
+        }
+    }
+
+    /** the height of the terrain under the scene positions (x[i], 0, z[i]), what floats keeps off the shore */
+    void evaluateTerrain(int count, const float* x, const float* z, float* height) const {
+        using namespace wavesimd;
+        if (!isReady()) {
+            for (int i = 0; i < count; ++i) {
+                height[i] = 0.0f;
+            }
+            return;
+        }
+
+        const Float4 invGridSize = splat(1.0f / gridSize);
+        // straight to the atlas cell of the points
+        const Float4 originU = splat(0.5f + noiseOrigin.x + atlasOrigin);
+        const Float4 originV = splat(0.5f + noiseOrigin.y + atlasOrigin);
+        const Float4 invAtlasTiles = splat(1.0f / atlasTiles);
+
+        int i = 0;
+        for (; i + 4 <= count; i += 4) {
+            Float4 u = load(x + i) * invGridSize + originU;
+            Float4 v = originV - load(z + i) * invGridSize;
+            Float4 terrainHeight;
+            bilinear(*terrain, 1, u * invAtlasTiles, v * invAtlasTiles, &terrainHeight);
+            store(height + i, terrainHeight);
+        }
+        for (; i < count; ++i) {
+            float u = x[i] / gridSize + 0.5f + noiseOrigin.x;
+            float v = -z[i] / gridSize + 0.5f + noiseOrigin.y;
+            sampleReference(*terrain, 1, (u + atlasOrigin) / atlasTiles, (v + atlasOrigin) / atlasTiles, height + i);
+        }
+    }
+
+    /** the same, one point at a time in plain arithmetic: what evaluate must match */
+    void evaluateReference(int count, const float* x, const float* z, float* dx, float* dy, float* dz) const {
+        for (int i = 0; i < count; ++i) {
+            if (!isReady()) {
+                dx[i] = dy[i] = dz[i] = 0.0f;
+                continue;
+            }
+            float u = x[i] / gridSize + 0.5f + noiseOrigin.x;
+            float v = -z[i] / gridSize + 0.5f + noiseOrigin.y;
+
+            float terrainHeight;
+            sampleReference(*terrain, 1, (u + atlasOrigin) / atlasTiles, (v + atlasOrigin) / atlasTiles, &terrainHeight);
+            float depth = 5.0f * std::min(std::max(terrainHeight, -0.5f), 0.0f);
+            float attenuation = 1.3f - std::exp(-depth * depth);
+
+            float displacement[3];
+            sampleReference(*surface, 3, u * surfaceScale, v * surfaceScale, displacement);
+            dx[i] = attenuation * displacement[0];
+            dy[i] = attenuation * displacement[1];
+            dz[i] = attenuation * displacement[2];
+        }
+    }
+
+private:
+    static int wrap(int i, int period) {
+        return ((i % period) + period) % period;
+    }
+
+    static void sampleReference(const SampledField& field, int channels, float u, float v, float* result) {
+        float s = (u - std::floor(u)) * field.width - 0.5f;
+        float t = (v - std::floor(v)) * field.height - 0.5f;
+        int s0 = int(std::floor(s)), t0 = int(std::floor(t));
+        float fs = s - s0, ft = t - t0;
+        int s1 = wrap(s0 + 1, field.width), t1 = wrap(t0 + 1, field.height);
+        s0 = wrap(s0, field.width);
+        t0 = wrap(t0, field.height);
+        for (int c = 0; c < channels; ++c) {
+            const float* p = field.plane(c);
+            float bottom = p[t0 * field.width + s0] + fs * (p[t0 * field.width + s1] - p[t0 * field.width + s0]);
+            float top = p[t1 * field.width + s0] + fs * (p[t1 * field.width + s1] - p[t1 * field.width + s0]);
+            result[c] = bottom + ft * (top - bottom);
+        }
+    }
+};